@@ -0,0 +1,428 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include "CLI11.hpp"
+#include "nfimm.h"
+
+/** @brief Microbenchmarks of the header hot paths
+ *
+ * Images are built in memory for each size, so no input files are needed:
+ * PNG with IDAT in 8 KiB chunks, as most encoders write them, and 24-bit
+ * BMP.  Each stage of PNG planning is timed on its own; everything the
+ * stage depends on is done, untimed, before each repetition.  Results are
+ * printed as one JSON object.
+ */
+struct BenchOptions
+{
+  unsigned warmup{10};         ///< unmeasured runs of each benchmark
+  unsigned repetitions{200};   ///< measured runs of each benchmark
+  std::vector<unsigned> sizes{ 256, 1024, 4096 };  ///< image width == height
+  std::string filter{""};      ///< run benchmarks whose name holds this
+  std::string outPath{""};     ///< JSON output, stdout if empty
+};
+
+/** @brief Timings of one benchmark on one input */
+struct BenchResult
+{
+  std::string name{};
+  uint32_t width{0};           ///< of the image, zero if no image
+  uint32_t height{0};
+  size_t bytes{0};             ///< of the input
+  std::vector<double> ns{};    ///< of each repetition, sorted
+};
+
+/** @brief Defeats elimination of results that are otherwise unused */
+static volatile uint32_t s_sink{0};
+
+/**
+ * @param sorted durations, ascending
+ * @param pct percentile, 0-100
+ * @return duration at the percentile, nearest rank
+ */
+static double percentile( const std::vector<double> &sorted, const double pct )
+{
+  if( sorted.empty() ) return 0.0;
+  const size_t rank{ static_cast<size_t>( pct / 100.0 * ( sorted.size() - 1 ) + 0.5 ) };
+  return sorted[std::min( rank, sorted.size() - 1 )];
+}
+
+/**
+ * SETUP runs before each run of BODY and is not timed.
+ *
+ * @param opts warmup and repetitions
+ * @param res IN/OUT : name and input; durations are set
+ * @param setup prepares one run, may be empty
+ * @param body the code measured
+ */
+static void measure( const BenchOptions &opts, BenchResult &res,
+                     const std::function<void()> &setup,
+                     const std::function<void()> &body )
+{
+  res.ns.clear();
+  res.ns.reserve( opts.repetitions );
+  for( unsigned i=0; i<opts.warmup + opts.repetitions; i++ )
+  {
+    if( setup ) setup();
+    const auto start{ std::chrono::steady_clock::now() };
+    body();
+    const auto stop{ std::chrono::steady_clock::now() };
+    if( i >= opts.warmup )
+      res.ns.push_back( std::chrono::duration<double, std::nano>( stop - start ).count() );
+  }
+  std::sort( res.ns.begin(), res.ns.end() );
+}
+
+/** @brief Append VAL big-endian */
+static void putBE32( std::vector<uint8_t> &buf, const uint32_t val )
+{
+  for( int shift=24; shift>=0; shift-=8 ) { buf.push_back( static_cast<uint8_t>( val >> shift ) ); }
+}
+
+/** @brief Append VAL little-endian, LEN bytes */
+static void putLE( std::vector<uint8_t> &buf, const uint32_t val, const int len )
+{
+  for( int i=0; i<len; i++ ) { buf.push_back( static_cast<uint8_t>( val >> ( 8 * i ) ) ); }
+}
+
+/** @brief Deterministic filler for image data; never decoded */
+static uint8_t nextByte( uint32_t &state )
+{
+  state = state * 1664525u + 1013904223u;
+  return static_cast<uint8_t>( state >> 24 );
+}
+
+/**
+ * @param width in pixels
+ * @param height in pixels
+ * @param phys true to include a pHYs chunk, else NFIMM inserts one
+ * @return 8-bit grayscale PNG with a Software tEXt and IDAT in 8 KiB chunks
+ */
+static std::vector<uint8_t> makePng( const uint32_t width, const uint32_t height,
+                                     const bool phys )
+{
+  std::vector<uint8_t> img( NFIMM::Signature::s_definedHex );
+  auto chunk = [&img]( const char *type, const uint8_t *data, const uint32_t len ) {
+    putBE32( img, len );
+    const size_t at{ img.size() };
+    img.insert( img.end(), type, type + 4 );
+    img.insert( img.end(), data, data + len );
+    putBE32( img, CRCforPNG::calc( &img[at], static_cast<int>( len + 4 ) ) );
+  };
+
+  std::vector<uint8_t> data;
+  putBE32( data, width );
+  putBE32( data, height );
+  data.insert( data.end(), { 8, 0, 0, 0, 0 } );
+  chunk( "IHDR", data.data(), static_cast<uint32_t>( data.size() ) );
+  if( phys )
+  {
+    data.clear();
+    putBE32( data, 2835 );
+    putBE32( data, 2835 );
+    data.push_back( 1 );
+    chunk( "pHYs", data.data(), static_cast<uint32_t>( data.size() ) );
+  }
+  static const char software[]{ "Software\0encoder" };
+  chunk( "tEXt", reinterpret_cast<const uint8_t *>( software ), sizeof( software ) - 1 );
+
+  // One filter byte per row.
+  data.resize( size_t{height} * ( width + 1 ) );
+  uint32_t state{1};
+  for( uint8_t &b : data ) { b = nextByte( state ); }
+  const size_t idatLength{ 8192 };
+  for( size_t at=0; at<data.size(); at+=idatLength ) {
+    chunk( "IDAT", data.data() + at,
+           static_cast<uint32_t>( std::min( idatLength, data.size() - at ) ) );
+  }
+  chunk( "IEND", nullptr, 0 );
+  return img;
+}
+
+/**
+ * @param width in pixels
+ * @param height in pixels
+ * @return 24-bit BMP with a BITMAPINFOHEADER, 2835 pixels per meter
+ */
+static std::vector<uint8_t> makeBmp( const uint32_t width, const uint32_t height )
+{
+  const uint32_t rowSize{ ( width * 3 + 3 ) & ~3u };
+  const uint32_t headers{ NFIMM::BMP::NUM_BYTES_BITMAPFILEHEADER +
+                          NFIMM::BMP::NUM_BYTES_DIB_BITMAPINFOHEADER };
+  std::vector<uint8_t> img{ 'B', 'M' };
+  putLE( img, headers + rowSize * height, 4 );
+  putLE( img, 0, 4 );
+  putLE( img, headers, 4 );
+  putLE( img, NFIMM::BMP::NUM_BYTES_DIB_BITMAPINFOHEADER, 4 );
+  putLE( img, width, 4 );
+  putLE( img, height, 4 );
+  putLE( img, 1, 2 );       // planes
+  putLE( img, 24, 2 );      // bits per pixel
+  putLE( img, 0, 4 );       // BI_RGB
+  putLE( img, rowSize * height, 4 );
+  putLE( img, 2835, 4 );
+  putLE( img, 2835, 4 );
+  putLE( img, 0, 4 );
+  putLE( img, 0, 4 );
+  uint32_t state{1};
+  for( size_t i=0; i<size_t{rowSize} * height; i++ ) { img.push_back( nextByte( state ) ); }
+  return img;
+}
+
+/** @brief Config of every benchmark: 500 PPI, three tEXt chunks */
+static std::shared_ptr<const NFIMM::ModificationConfig> makeConfig( const std::string &format )
+{
+  NFIMM::MetadataParameters mp( format );
+  mp.srcImg.resolution.horiz = mp.srcImg.resolution.vert = 72;
+  mp.set_srcImgSampleRateUnits( "inch" );
+  mp.destImg.resolution.horiz = mp.destImg.resolution.vert = 500;
+  mp.set_destImgSampleRateUnits( "inch" );
+  mp.destImg.textChunk = { "Author:NIST-ITL", "Description:NFIMM_bench",
+                           "Comment:header modified" };
+  return std::make_shared<const NFIMM::ModificationConfig>( mp );
+}
+
+/** @brief Stages of PNG planning, in order, see PNG::planImage() */
+enum class Stage { Signature, Parse, Process, InsertPhys, InsertText, Order };
+
+/**
+ * A new handler for each repetition starts from empty chunk containers.
+ *
+ * @param png OUT : handler with the stages before UPTO done
+ * @param cfg modification config
+ * @param img source image
+ * @param upTo first stage not done
+ */
+static void preparePng( std::unique_ptr<NFIMM::PNG> &png,
+                        const std::shared_ptr<const NFIMM::ModificationConfig> &cfg,
+                        const std::vector<uint8_t> &img, const Stage upTo )
+{
+  png.reset( new NFIMM::PNG( cfg ) );
+  png->readImageFileIntoBuffer( img.data(), img.size() );
+  NFIMM::PNG::_insertChunkIndex = 0;
+  NFIMM::NFIMM::s_r_cursor = 8;
+  if( upTo > Stage::Parse ) png->parseAllChunks();
+  if( upTo > Stage::Process ) png->processExistingChunks();
+  if( upTo > Stage::InsertPhys ) png->insertChunkPhys();
+  if( upTo > Stage::InsertText ) png->insertCustomText();
+}
+
+/**
+ * @param opts command-line options
+ * @return every result, in run order
+ * @throw Miscue A benchmark failed to modify its image
+ */
+static std::vector<BenchResult> runAll( const BenchOptions &opts )
+{
+  std::vector<BenchResult> results;
+  auto wanted = [&opts]( const std::string &name ) {
+    return opts.filter.empty() || name.find( opts.filter ) != std::string::npos;
+  };
+  auto run = [&]( const std::string &name, const uint32_t width, const size_t bytes,
+                  const std::function<void()> &setup, const std::function<void()> &body ) {
+    if( !wanted( name ) )
+      return;
+    BenchResult res;
+    res.name = name;
+    res.width = res.height = width;
+    res.bytes = bytes;
+    measure( opts, res, setup, body );
+    results.push_back( std::move( res ) );
+  };
+
+  for( const size_t len : { 16u, 64u, 256u, 4096u, 65536u, 1u << 20 } )
+  {
+    std::vector<uint8_t> buf( len );
+    uint32_t state{1};
+    for( uint8_t &b : buf ) { b = nextByte( state ); }
+    run( "crc_calc", 0, len, nullptr, [&buf] {
+      s_sink = s_sink + CRCforPNG::calc( buf.data(), static_cast<int>( buf.size() ) ); } );
+  }
+
+  const std::shared_ptr<const NFIMM::ModificationConfig> pngCfg{ makeConfig( "png" ) };
+  const std::shared_ptr<const NFIMM::ModificationConfig> bmpCfg{ makeConfig( "bmp" ) };
+  std::unique_ptr<NFIMM::PNG> png;
+  std::unique_ptr<NFIMM::BMP> bmp;
+  std::vector<uint8_t> out;
+  NFIMM::ModificationPlan plan;
+
+  for( const unsigned size : opts.sizes )
+  {
+    const std::vector<uint8_t> img{ makePng( size, size, true ) };
+    const std::vector<uint8_t> noPhys{ makePng( size, size, false ) };
+    const size_t bytes{ img.size() };
+
+    run( "png_signature", size, bytes, nullptr, [&img] {
+      NFIMM::ModificationResult res;
+      NFIMM::Signature sig( res, img.data(), img.size() );
+      s_sink = s_sink + sig.dataBytes[0]; } );
+    run( "png_parse_all_chunks", size, bytes,
+         [&] { preparePng( png, pngCfg, img, Stage::Parse ); },
+         [&] { png->parseAllChunks(); } );
+    run( "png_process_existing_chunks", size, bytes,
+         [&] { preparePng( png, pngCfg, img, Stage::Process ); },
+         [&] { png->processExistingChunks(); } );
+
+    // The pHYs of the source is updated, or a new one inserted.
+    std::shared_ptr<NFIMM::PNG::ChunkLayout> physChunk;
+    run( "png_phys_update", size, bytes,
+         [&] {
+           preparePng( png, pngCfg, img, Stage::Process );
+           for( auto &c : png->_srcChunkPointers ) {
+             if( c->type() == "pHYs" ) physChunk = c;
+           } },
+         [&] {
+           NFIMM::Phys ph( *pngCfg, png->_result, physChunk );
+           ph.parseChunk();
+           ph.updateChunk(); } );
+    run( "png_phys_insert", size, noPhys.size(),
+         [&] { preparePng( png, pngCfg, noPhys, Stage::InsertPhys ); },
+         [&] {
+           NFIMM::Phys ph( *pngCfg, png->_result, png->_srcChunkPointers[0] );
+           ph.insertChunk(); } );
+    run( "png_text_insert_chunks", size, bytes,
+         [&] { preparePng( png, pngCfg, img, Stage::InsertText ); },
+         [&] {
+           NFIMM::Text tx( *pngCfg, png->_result, png->_srcPath );
+           tx.insertChunks(); } );
+    run( "png_order_chunks", size, bytes,
+         [&] {
+           preparePng( png, pngCfg, img, Stage::Order );
+           plan = NFIMM::ModificationPlan{};
+           plan.segments.reset( img.data(), img.size() ); },
+         [&] { png->orderChunks( plan ); } );
+    run( "png_modify", size, bytes,
+         [&] {
+           png.reset( new NFIMM::PNG( pngCfg ) );
+           png->readImageFileIntoBuffer( img.data(), img.size() );
+           out.clear();
+           out.reserve( img.size() + 4096 ); },
+         [&] {
+           NFIMM::MemorySink sink( out );
+           png->modify( sink ); } );
+
+    const std::vector<uint8_t> bmpImg{ makeBmp( size, size ) };
+    run( "bmp_modify", size, bmpImg.size(),
+         [&] {
+           bmp.reset( new NFIMM::BMP( bmpCfg ) );
+           bmp->readImageFileIntoBuffer( bmpImg.data(), bmpImg.size() );
+           out.clear();
+           out.reserve( bmpImg.size() ); },
+         [&] {
+           NFIMM::MemorySink sink( out );
+           bmp->modify( sink ); } );
+  }
+  png.reset();
+  bmp.reset();
+  NFIMM::NFIMM::s_readData = nullptr;
+  NFIMM::NFIMM::s_readSize = 0;
+  return results;
+}
+
+/**
+ * @param opts warmup and repetitions
+ * @param overhead median of an empty benchmark, not subtracted
+ * @param results of every benchmark
+ * @return one JSON object; durations in nanoseconds
+ */
+static std::string toJson( const BenchOptions &opts, const double overhead,
+                           const std::vector<BenchResult> &results )
+{
+  std::ostringstream ss;
+  ss.setf( std::ios::fixed );
+  ss.precision( 1 );
+  ss << "{\"tool\":\"NFIMM_bench\",\"version\":\"" << NFIMM_VERSION << "\""
+     << ",\"warmup\":" << opts.warmup << ",\"repetitions\":" << opts.repetitions
+     << ",\"clock_overhead_ns\":" << overhead << ",\"results\":[";
+  for( size_t i=0; i<results.size(); i++ )
+  {
+    const BenchResult &r{ results[i] };
+    double sum{0.0};
+    for( const double ns : r.ns ) { sum += ns; }
+    ss << ( i ? "," : "" ) << "\n  {\"name\":\"" << r.name << "\",\"width\":" << r.width
+       << ",\"height\":" << r.height << ",\"bytes\":" << r.bytes
+       << ",\"min_ns\":" << ( r.ns.empty() ? 0.0 : r.ns.front() )
+       << ",\"mean_ns\":" << ( r.ns.empty() ? 0.0 : sum / r.ns.size() )
+       << ",\"p50_ns\":" << percentile( r.ns, 50 ) << ",\"p90_ns\":" << percentile( r.ns, 90 )
+       << ",\"p99_ns\":" << percentile( r.ns, 99 )
+       << ",\"max_ns\":" << ( r.ns.empty() ? 0.0 : r.ns.back() ) << "}";
+  }
+  ss << "\n]}\n";
+  return ss.str();
+}
+
+
+int main( int argc, char **argv )
+{
+  CLI::App app{"Time the header hot paths of NFIMM on images built in memory; JSON results."};
+  BenchOptions opts;
+
+  app.add_option( "-w, --warmup", opts.warmup, "Unmeasured runs of each benchmark, default 10" );
+  app.add_option( "-n, --repetitions", opts.repetitions, "Measured runs of each benchmark, default 200" );
+  app.add_option( "-s, --sizes", opts.sizes, "Image widths (and heights) in pixels, default 256 1024 4096" );
+  app.add_option( "-f, --filter", opts.filter, "Run only the benchmarks whose name holds this text" );
+  app.add_option( "-o, --output", opts.outPath, "Write the JSON results to PATH, default stdout" );
+  CLI11_PARSE( app, argc, argv );
+  opts.repetitions = std::max( opts.repetitions, 1u );
+
+  std::vector<BenchResult> results;
+  BenchResult empty;
+  try
+  {
+    measure( opts, empty, nullptr, [] {} );
+    results = runAll( opts );
+  }
+  catch( const NFIMM::Miscue &e )
+  {
+    std::cerr << "NFIMM_bench failed: " << e.what() << std::endl;
+    return -1;
+  }
+  const std::string json{ toJson( opts, percentile( empty.ns, 50 ), results ) };
+
+  if( opts.outPath.empty() )
+  {
+    std::cout << json;
+    return 0;
+  }
+  std::ofstream strm( opts.outPath, std::ios::out|std::ios::binary|std::ios::trunc );
+  strm << json;
+  if( !strm )
+  {
+    std::cerr << "CANNOT write results: '" << opts.outPath << "'" << std::endl;
+    return -1;
+  }
+  return 0;
+}
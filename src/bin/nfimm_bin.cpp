@@ -25,7 +25,16 @@ identification imply recommendation or endorsement by the National Institute
 of Standards and Technology, nor does it imply that the products and equipment
 identified are necessarily the best available for the purpose.
 *******************************************************************************/
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <utility>
+#ifdef _WIN32
+  #include <fcntl.h>
+  #include <io.h>
+#endif
 
 #include "CLI11.hpp"
 #include "nfimm.h"
@@ -33,6 +42,12 @@ identified are necessarily the best available for the purpose.
 
 
 void procArgs( CLI::App &, CmdLineOptions & );
+#ifndef _WIN32
+int serve( std::ostream & );
+int batch( std::ostream & );
+int probe( std::ostream & );
+int index( std::ostream & );
+#endif
 
 
 int main(int argc, char** argv) 
@@ -70,16 +85,69 @@ int main(int argc, char** argv)
     return(0);
   }
 
+  // With `-` the source image is read from stdin and the destination image
+  // is written to stdout as it is produced; messages then go to stderr.
+  const bool streamIn{ opts.srcImgPath == "-" };
+  const bool streamOut{ opts.tgtImgPath == "-" || !opts.probeFormat.empty() ||
+                       !opts.indexPath.empty() };
+  std::ostream &con{ streamOut ? std::cerr : std::cout };
+#ifdef _WIN32
+  if( streamIn ) _setmode( _fileno( stdin ), _O_BINARY );
+  if( streamOut ) _setmode( _fileno( stdout ), _O_BINARY );
+#else
+  // A reader that exits early is reported as a write error.
+  std::signal( SIGPIPE, SIG_IGN );
+#endif
+
   if( opts.flagVerbose )
-    opts.printOptions();  
+    opts.printOptions( con );  
+
+#ifndef _WIN32
+  if( !opts.servePath.empty() )
+    return serve( con );
+  if( !opts.indexPath.empty() )
+    return index( con );
+  if( !opts.probeFormat.empty() )
+    return probe( con );
+  if( !opts.batchPath.empty() )
+    return batch( con );
+#endif
 
 
   // Declare the pointers to metadata params and metadata modifier objects.
   // NFIMM is the base class for supported compression type's derived class.
   std::shared_ptr<NFIMM::MetadataParameters> mp;
   std::unique_ptr<NFIMM::NFIMM> nfimm_mp;
+  // First bytes of stdin, read to detect the format.
+  std::vector<uint8_t> head;
   try
   {
+    if( streamIn && opts.flagInPlace )
+    {
+      con << "\nIn-place modification requires a source image file!" << std::endl;
+      exit(0);
+    }
+    if( streamIn )
+    {
+      head.resize( NFIMM::HandlerRegistry::PREFIX_SIZE );
+      head.resize( NFIMM::NFIMM::readDescriptor( 0, head.data(), head.size() ) );
+    }
+
+    // The format of the source image is detected from its signature.
+    if( opts.imageFormat == "auto" )
+    {
+      const NFIMM::HandlerRegistry &reg{ NFIMM::HandlerRegistry::instance() };
+      opts.imageFormat = streamIn ? reg.detect( head.data(), head.size() )
+                                  : reg.detect( opts.srcImgPath );
+      if( opts.imageFormat.empty() )
+      {
+        con << "\nImage format not recognized, specify img-fmt!" << std::endl;
+        exit(0);
+      }
+      if( opts.flagVerbose )
+        con << "Detected image format: " << opts.imageFormat << std::endl;
+    }
+
     // Create the metadata
     mp.reset( new NFIMM::MetadataParameters( opts.imageFormat ) );
     mp->srcImg.resolution.horiz = opts.srcSampleRate;
@@ -91,62 +159,401 @@ int main(int argc, char** argv)
   }
   catch( const NFIMM::Miscue &e )
   {
-    std::cout << "NFIMM user caught exception: " << e.what() << std::endl;
+    con << "NFIMM user caught exception: " << e.what() << std::endl;
     exit(0);
   }
 
   try
   {
-    if( opts.imageFormat == "bmp" )
-    {
-      nfimm_mp.reset( new NFIMM::BMP( mp ) );
-    }
-    else  // must be png
+    if( mp->srcImg.compression == "png" )
     {
-      if( opts.vecPngTextChunk[0] == "" )
+      if( opts.vecPngTextChunk.empty() || opts.vecPngTextChunk[0] == "" )
       {
-        std::cout << "\nImage format is PNG and png-text-chunk cannot be empty!"
+        con << "\nImage format is PNG and png-text-chunk cannot be empty!"
                   << std::endl;
         exit(0);
       }
-      mp->destImg.textChunk = opts.vecPngTextChunk;
-      nfimm_mp.reset( new NFIMM::PNG( mp ) );
     }
+    // Also for the PNG images of a transaction.
+    mp->destImg.textChunk = opts.vecPngTextChunk;
+    // The handler is selected by the (normalized) compression.
+    nfimm_mp = NFIMM::HandlerRegistry::instance().create(
+                 NFIMM::ModificationConfig::fromParameters( *mp ) );
 
-    std::vector<uint8_t> vecSourceImage, vecDestImage;
-
+    if( opts.flagInPlace )
     {
-      std::fstream strm;
-      strm.open( opts.srcImgPath, std::ios::in|std::ios::binary );
-
-      vecSourceImage.clear();
-      std::vector<uint8_t> tmp(
-        (std::istreambuf_iterator<char>(strm)), std::istreambuf_iterator<char>() );
-      strm.close();
-      vecSourceImage = tmp;
+      nfimm_mp->modifyInPlace( opts.srcImgPath );
     }
+    else if( streamIn )
+    {
+      // Only the headers are held in memory for formats that stream.
+      std::FILE *out{ streamOut ? stdout : std::fopen( opts.tgtImgPath.c_str(), "wb" ) };
+      if( !out )
+      {
+        con << "\nCANNOT open target image: " << opts.tgtImgPath << std::endl;
+        exit(0);
+      }
+      nfimm_mp->modifyStream( 0, fileno( out ), std::move( head ) );
+      if( !streamOut )
+        std::fclose( out );
+    }
+    else
+    {
+      std::vector<uint8_t> vecSourceImage, vecDestImage;
+
+      {
+        std::fstream strm;
+        strm.open( opts.srcImgPath, std::ios::in|std::ios::binary );
 
-    nfimm_mp->readImageFileIntoBuffer( vecSourceImage );
-    nfimm_mp->modify();
-    nfimm_mp->writeImageBufferToFile( opts.tgtImgPath );
+        vecSourceImage.clear();
+        std::vector<uint8_t> tmp(
+          (std::istreambuf_iterator<char>(strm)), std::istreambuf_iterator<char>() );
+        strm.close();
+        vecSourceImage = std::move( tmp );
+      }
+
+      nfimm_mp->setSourcePath( opts.srcImgPath );
+      nfimm_mp->readImageFileIntoBuffer( std::move( vecSourceImage ) );
+      if( streamOut )
+      {
+        NFIMM::FdSink sink( 1 );
+        nfimm_mp->modify( sink );
+      }
+      else
+      {
+        NFIMM::FileSink sink( opts.tgtImgPath );
+        nfimm_mp->modify( sink );
+      }
+    }
 
     if( opts.flagVerbose )
     {
-      std::cout << "START RUNTIME Metadata LOG:" << std::endl;
-      for( std::string s : mp->log ) { std::cout << s << std::endl; }
-      std::cout << "START USER-SPECIFIED Metadata Paramaters:" << std::endl;
-      std::cout << mp->to_s() << std::endl;
-      std::cout << "GENERATED IMAGE: " << opts.tgtImgPath << std::endl;
+      con << "START RUNTIME Metadata LOG:" << std::endl;
+      for( const std::string &s : nfimm_mp->result().log ) { con << s << std::endl; }
+      con << "START USER-SPECIFIED Metadata Paramaters:" << std::endl;
+      con << mp->to_s() << std::endl;
+      con << "GENERATED IMAGE: " << opts.tgtImgPath << std::endl;
     }
   }
   catch( const NFIMM::Miscue &e )
   {
-    std::cout << "NFIMM user caught exception: " << e.what() << std::endl;
+    con << "NFIMM user caught exception: " << e.what() << std::endl;
     exit(0);
   }
 
 }
 
+#ifndef _WIN32
+/** @brief Server stopped by SIGINT and SIGTERM */
+static std::atomic<NFIMM::Server *> s_server{nullptr};
+/** @brief Batch stopped by SIGINT and SIGTERM */
+static std::atomic<NFIMM::Batch *> s_batch{nullptr};
+
+/** @brief Signal handler, stop the server or batch */
+extern "C" void onStopSignal( int )
+{
+  NFIMM::Server *server{ s_server.load() };
+  if( server )
+    server->stop();
+  NFIMM::Batch *bat{ s_batch.load() };
+  if( bat )
+    bat->stop();
+}
+
+/** @brief Config of the command line; png if the format is detected
+ *
+ * @param detect true if img-fmt is auto
+ * @return validated config
+ * @throw Miscue Invalid parameters
+ */
+static std::shared_ptr<const NFIMM::ModificationConfig> baseConfig( const bool detect )
+{
+  NFIMM::MetadataParameters mp( detect ? "png" : opts.imageFormat );
+  mp.srcImg.resolution.horiz = opts.srcSampleRate;
+  mp.srcImg.resolution.vert = opts.srcSampleRate;
+  mp.set_srcImgSampleRateUnits( opts.sampleRateUnits );
+  mp.destImg.resolution.horiz = opts.tgtSampleRate;
+  mp.destImg.resolution.vert = opts.tgtSampleRate;
+  mp.set_destImgSampleRateUnits( opts.sampleRateUnits );
+  mp.destImg.textChunk = opts.vecPngTextChunk;
+  return std::make_shared<const NFIMM::ModificationConfig>( mp );
+}
+
+/** @brief Serve requests until SIGINT or SIGTERM
+ *
+ * Every image is modified with the sample rate and custom text of the
+ * command line; its format is detected unless img-fmt is given.  See
+ * NFIMM::Server and NFIMM_client.
+ *
+ * @param con console for messages
+ * @return exit status
+ */
+int serve( std::ostream &con )
+{
+  try
+  {
+    const bool detect{ opts.imageFormat == "auto" };
+    NFIMM::Server server( baseConfig( detect ), opts.servePath, opts.workers,
+                          detect );
+    s_server.store( &server );
+    std::signal( SIGINT, onStopSignal );
+    std::signal( SIGTERM, onStopSignal );
+    con << "Serving on socket: " << opts.servePath << std::endl;
+    server.run();
+    s_server.store( nullptr );
+  }
+  catch( const NFIMM::Miscue &e )
+  {
+    con << "NFIMM user caught exception: " << e.what() << std::endl;
+    return -1;
+  }
+  con << "Server stopped" << std::endl;
+  return 0;
+}
+
+/** @brief Modify every image of the batch list until done or SIGINT/SIGTERM
+ *
+ * Each line of the list is a source image PATH and its target image PATH,
+ * separated by a tab, or a source image PATH alone to patch it in place;
+ * `-` reads the list from stdin.  With a journal, a
+ * stopped or crashed run is resumed by running it again: the images
+ * recorded as finished are skipped.  With dedup, identical sources are
+ * modified once.  With skip-current, images that already have the sample
+ * rate are not written.  Failures are printed as they happen.
+ *
+ * @param con console for messages
+ * @return exit status, nonzero if any image failed
+ */
+int batch( std::ostream &con )
+{
+  NFIMM::Batch::Summary sum;
+  try
+  {
+    std::ifstream file;
+    if( opts.batchPath != "-" )
+    {
+      file.open( opts.batchPath );
+      if( !file )
+        throw NFIMM::Miscue( NFIMM::MiscueCode::Io,
+                             "CANNOT open batch list: '" + opts.batchPath + "'" );
+    }
+    std::istream &list{ opts.batchPath == "-" ? std::cin : file };
+
+    const bool detect{ opts.imageFormat == "auto" };
+    NFIMM::Batch bat( baseConfig( detect ), opts.workers, detect );
+    if( !opts.journalPath.empty() )
+      bat.journal( opts.journalPath );
+    if( opts.dedup == "link" )
+      bat.dedup( NFIMM::Batch::Dedup::Link );
+    else if( opts.dedup == "copy" )
+      bat.dedup( NFIMM::Batch::Dedup::Copy );
+    bat.skipCurrent( opts.flagSkipCurrent );
+
+    std::string line;
+    auto source = [&list, &line]( NFIMM::Batch::Job &job ) {
+      while( std::getline( list, line ) )
+      {
+        if( line.empty() )
+          continue;
+        const size_t tab{ line.find( '\t' ) };
+        job.src.assign( line, 0, tab );
+        if( tab == std::string::npos )
+          job.dest.clear();
+        else
+          job.dest.assign( line, tab + 1, std::string::npos );
+        return true;
+      }
+      return false;
+    };
+    auto report = [&con]( const NFIMM::Batch::Job &job,
+                          const NFIMM::Batch::Outcome &out ) {
+      if( !out.status )
+        con << "FAILED: " << job.src << ": " << out.status.what() << " at byte "
+            << out.status.offset << std::endl;
+      else if( opts.flagVerbose )
+        con << ( out.skipped ? "Skipped: " : out.deduplicated ? "Deduplicated: "
+                 : out.current ? "Current: " : "Modified: " )
+            << ( job.dest.empty() ? job.src : job.dest ) << std::endl;
+    };
+
+    s_batch.store( &bat );
+    std::signal( SIGINT, onStopSignal );
+    std::signal( SIGTERM, onStopSignal );
+    sum = bat.run( source, report );
+    s_batch.store( nullptr );
+  }
+  catch( const NFIMM::Miscue &e )
+  {
+    s_batch.store( nullptr );
+    con << "NFIMM user caught exception: " << e.what() << std::endl;
+    return -1;
+  }
+  con << "Batch: " << sum.done << " modified (" << sum.deduplicated
+      << " deduplicated, " << sum.current << " current), " << sum.skipped
+      << " skipped, " << sum.failed << " failed" << std::endl;
+  return sum.failed ? 1 : 0;
+}
+
+/** @brief Print the header metadata of the source image, or of every source
+ * of the batch list, to stdout
+ *
+ * Only the headers are read and nothing is written; target PATHs of the
+ * list are ignored.  Records are printed as each source is probed, in the
+ * order the workers finish them.  Failures are records with their status.
+ *
+ * @param con console for messages
+ * @return exit status, nonzero if any image failed
+ */
+int probe( std::ostream &con )
+{
+  NFIMM::Batch::Summary sum;
+  try
+  {
+    std::ifstream file;
+    const bool single{ opts.batchPath.empty() };
+    const std::string &listPath{ single ? opts.srcImgPath : opts.batchPath };
+    if( listPath.empty() || ( single && listPath == "-" ) )
+      throw NFIMM::Miscue( NFIMM::MiscueCode::InvalidParameter,
+                           "Probe requires a source image file or batch list" );
+    if( !single && listPath != "-" )
+    {
+      file.open( listPath );
+      if( !file )
+        throw NFIMM::Miscue( NFIMM::MiscueCode::Io,
+                             "CANNOT open batch list: '" + listPath + "'" );
+    }
+    std::istream &list{ listPath == "-" ? std::cin : file };
+
+    const bool detect{ opts.imageFormat == "auto" };
+    NFIMM::Batch bat( baseConfig( detect ), single ? 1 : opts.workers, detect );
+
+    std::string line;
+    bool taken{false};
+    auto source = [&]( NFIMM::Batch::Job &job ) {
+      if( single )
+      {
+        job.src = listPath;
+        return !std::exchange( taken, true );
+      }
+      while( std::getline( list, line ) )
+      {
+        if( line.empty() )
+          continue;
+        job.src.assign( line, 0, line.find( '\t' ) );
+        return true;
+      }
+      return false;
+    };
+    const bool csv{ opts.probeFormat == "csv" };
+    if( csv )
+      std::cout << NFIMM::ImageProbe::csvHeader() << '\n';
+    auto report = [csv]( const NFIMM::ImageProbe &p ) {
+      std::cout << ( csv ? p.to_csv() : p.to_json() ) << '\n';
+    };
+
+    s_batch.store( &bat );
+    std::signal( SIGINT, onStopSignal );
+    std::signal( SIGTERM, onStopSignal );
+    sum = bat.probe( source, report );
+    s_batch.store( nullptr );
+    std::cout.flush();
+  }
+  catch( const NFIMM::Miscue &e )
+  {
+    s_batch.store( nullptr );
+    con << "NFIMM user caught exception: " << e.what() << std::endl;
+    return -1;
+  }
+  if( opts.flagVerbose )
+    con << "Probe: " << sum.done << " read, " << sum.failed << " failed" << std::endl;
+  return sum.failed ? 1 : 0;
+}
+
+/** @brief Refresh the corpus index from the batch list, then print the
+ * entries that match the query to stdout
+ *
+ * Only the images of the list that changed since the index was last
+ * refreshed are probed.  Entries are printed as PATHs, one per line, which
+ * is a batch list, or as probe records with --probe.  Without a query,
+ * nothing is printed.
+ *
+ * @param con console for messages
+ * @return exit status, nonzero if any image failed to probe
+ */
+int index( std::ostream &con )
+{
+  NFIMM::CorpusIndex::Totals totals;
+  try
+  {
+    const NFIMM::CorpusIndex::Query query( opts.query );
+    if( !opts.batchPath.empty() )
+    {
+      std::ifstream file;
+      if( opts.batchPath != "-" )
+      {
+        file.open( opts.batchPath );
+        if( !file )
+          throw NFIMM::Miscue( NFIMM::MiscueCode::Io,
+                               "CANNOT open batch list: '" + opts.batchPath + "'" );
+      }
+      std::istream &list{ opts.batchPath == "-" ? std::cin : file };
+
+      const bool detect{ opts.imageFormat == "auto" };
+      NFIMM::Batch bat( baseConfig( detect ), opts.workers, detect );
+      std::string line;
+      auto source = [&list, &line]( NFIMM::Batch::Job &job ) {
+        while( std::getline( list, line ) )
+        {
+          if( line.empty() )
+            continue;
+          job.src.assign( line, 0, line.find( '\t' ) );
+          return true;
+        }
+        return false;
+      };
+
+      s_batch.store( &bat );
+      std::signal( SIGINT, onStopSignal );
+      std::signal( SIGTERM, onStopSignal );
+      totals = NFIMM::CorpusIndex::refresh( opts.indexPath, bat, source );
+      s_batch.store( nullptr );
+      con << "Index: " << totals.unchanged << " unchanged, " << totals.probed
+          << " probed, " << totals.failed << " failed" << std::endl;
+    }
+
+    if( !opts.query.empty() )
+    {
+      const NFIMM::CorpusIndex idx( opts.indexPath );
+      const bool csv{ opts.probeFormat == "csv" };
+      if( csv )
+        std::cout << NFIMM::ImageProbe::csvHeader() << '\n';
+      size_t matched{0};
+      for( const NFIMM::CorpusIndex::Entry &e : idx )
+      {
+        if( !query.matches( e ) )
+          continue;
+        matched++;
+        if( opts.probeFormat.empty() )
+          std::cout << idx.pathOf( e ) << '\n';
+        else
+          std::cout << ( csv ? idx.probeOf( e ).to_csv() : idx.probeOf( e ).to_json() )
+                    << '\n';
+      }
+      std::cout.flush();
+      if( opts.flagVerbose )
+        con << "Query: " << matched << " of " << idx.size() << " entries" << std::endl;
+    }
+  }
+  catch( const NFIMM::Miscue &e )
+  {
+    s_batch.store( nullptr );
+    con << "NFIMM user caught exception: " << e.what() << std::endl;
+    return -1;
+  }
+  return totals.failed ? 1 : 0;
+}
+#endif
+
 /** @brief Process the command-line options
  *
  * @param app CLI-application object reference
@@ -163,11 +570,34 @@ procArgs( CLI::App &app, CmdLineOptions &opts )
 
   app.add_option( "-e, --png-text-chunk", opts.vecPngTextChunk, "list of 'tEXt' chunks in format 'keyword:text'" );
 
-  app.add_option( "-m, --img-fmt", opts.imageFormat, "Image compression format [ bmp | png ], default is 'png'" );
+  app.add_option( "-m, --img-fmt", opts.imageFormat, "Image compression format [ auto | an2k | bmp | jp2 | jpeg | png | tiff | wsq ], default is 'auto', detected from the source image" );
+
+  app.add_option( "-s, --src-img-path", opts.srcImgPath, "Source image PATH (absolute or relative), '-' for stdin" )
+    ->check( []( const std::string &path ) {
+      return path == "-" ? std::string{} : CLI::ExistingFile( path ); } );
+  app.add_option( "-t, --tgt-img-path", opts.tgtImgPath, "Target image PATH (absolute or relative), '-' for stdout" );
+
+  app.add_option( "--serve", opts.servePath, "Serve requests on UNIX socket PATH until SIGINT/SIGTERM, see NFIMM_client" );
+  app.add_option( "--workers", opts.workers, "Number of server or batch workers, default is one per CPU" );
+  app.add_option( "--batch", opts.batchPath, "Modify every 'source<TAB>target' line, or 'source' in place, of the list at PATH, '-' for stdin" );
+  app.add_option( "--journal", opts.journalPath, "Record finished batch images in the journal at PATH; a rerun skips them" );
+  app.add_option( "--dedup", opts.dedup, "Modify identical batch sources once, [ link | copy ] the target to the others" )
+    ->check( []( const std::string &mode ) {
+      return ( mode == "link" || mode == "copy" ) ? std::string{}
+                                                  : "Dedup must be link or copy"; } );
+  app.add_option( "--probe", opts.probeFormat, "Print the header metadata of the source image, or of every source of the --batch list, as [ csv | jsonl ]; nothing is written" )
+    ->check( []( const std::string &fmt ) {
+      return ( fmt == "csv" || fmt == "jsonl" ) ? std::string{}
+                                                : "Probe must be csv or jsonl"; } );
+  app.add_option( "--index", opts.indexPath, "Corpus index PATH: refreshed from the --batch list, probing only changed images, then queried" );
+  app.add_option( "--query", opts.query, "Print the PATHs, or --probe records, of the --index entries matching e.g. 'format=png,ppi=600,width>1600'" );
+
+  app.add_flag( "-i,--in-place", opts.flagInPlace, "Patch the source image file in place, no target image" )
+    ->multi_option_policy()
+    ->ignore_case();
 
-  app.add_option( "-s, --src-img-path", opts.srcImgPath, "Source image PATH (absolute or relative)" )
-    ->check(CLI::ExistingFile);
-  app.add_option( "-t, --tgt-img-path", opts.tgtImgPath, "Target image PATH (absolute or relative)" );
+  app.add_flag( "--skip-current", opts.flagSkipCurrent, "Batch: leave images that already have the sample rate untouched, link them to the target" )
+    ->multi_option_policy();
 
   app.add_flag( "-v,--version", opts.prVer, "Print versions and exit" )
     ->multi_option_policy()
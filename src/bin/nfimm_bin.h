@@ -32,7 +32,7 @@ identified are necessarily the best available for the purpose.
 
 /** @brief Container for command-line switches and parameters
   *
-  * Set the source image compression default: `png`.
+  * Set the source image compression default: `auto`.
   * Set the output-statuses to default: false.
   */
 struct
@@ -46,13 +46,13 @@ CmdLineOptions
   /** @brief Resolution units [inch | meter] */
   std::string sampleRateUnits {""};
 
-  /** @brief Source image PATH */
+  /** @brief Source image PATH, `-` for stdin */
   std::string srcImgPath {""};
-  /** @brief Target image PATH */
+  /** @brief Target image PATH, `-` for stdout */
   std::string tgtImgPath {""};
 
   /** @brief Image compression type */
-  std::string imageFormat {"png"};
+  std::string imageFormat {"auto"};
 
   /** @brief List of tEXt chunks for PNG image */
   std::vector<std::string> vecPngTextChunk{};
@@ -63,21 +63,58 @@ CmdLineOptions
   /** @brief When set, print runtime status to console */
   bool flagVerbose {false};
 
+  /** @brief When set, patch the source image, no target image */
+  bool flagInPlace {false};
+
+  /** @brief When set, batch images that are current are not written */
+  bool flagSkipCurrent {false};
+
+  /** @brief When set, serve requests on this UNIX socket PATH */
+  std::string servePath {""};
+  /** @brief Number of server or batch workers, zero for one per CPU */
+  unsigned workers {0};
+
+  /** @brief When set, modify every image of the list at this PATH */
+  std::string batchPath {""};
+  /** @brief Batch journal PATH, optional */
+  std::string journalPath {""};
+  /** @brief Batch deduplication [ link | copy ], empty for none */
+  std::string dedup {""};
+
+  /** @brief When set, probe the source image or batch list, print records
+   * in this format [ csv | jsonl ] */
+  std::string probeFormat {""};
+
+  /** @brief When set, refresh the corpus index at this PATH from the batch
+   * list, and query it */
+  std::string indexPath {""};
+  /** @brief Corpus index query, see NFIMM::CorpusIndex::Query */
+  std::string query {""};
+
   /** @brief Print cmd-line options to console */
   void
-  printOptions()
+  printOptions( std::ostream &os = std::cout )
   {
-    std::cout << "Source sample rate: " << srcSampleRate << "\n";
-    std::cout << "Target sample rate: " << tgtSampleRate << "\n";
-    std::cout << "Sample rate units: " << sampleRateUnits << "\n";
-    std::cout << "Source image filename: " << srcImgPath << "\n";
-    std::cout << "Target image filename: " << tgtImgPath << "\n";
-    std::cout << "Image compression type: " << imageFormat << "\n";
+    os << "Source sample rate: " << srcSampleRate << "\n";
+    os << "Target sample rate: " << tgtSampleRate << "\n";
+    os << "Sample rate units: " << sampleRateUnits << "\n";
+    os << "Source image filename: " << srcImgPath << "\n";
+    os << "Target image filename: " << tgtImgPath << "\n";
+    os << "Image compression type: " << imageFormat << "\n";
     if( !vecPngTextChunk.empty() )
     {
       for( auto s:vecPngTextChunk )
-        std::cout << "png text chunk: " << s << "\n";
+        os << "png text chunk: " << s << "\n";
     }
+    if( !servePath.empty() )
+      os << "Serve on socket: " << servePath << ", workers: " << workers << "\n";
+    if( !batchPath.empty() )
+      os << "Batch list: " << batchPath << ", journal: " << journalPath
+         << ", dedup: " << dedup << ", workers: " << workers << "\n";
+    if( !probeFormat.empty() )
+      os << "Probe format: " << probeFormat << "\n";
+    if( !indexPath.empty() )
+      os << "Index: " << indexPath << ", query: " << query << "\n";
   }
 
 } opts;
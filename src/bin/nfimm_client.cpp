@@ -0,0 +1,206 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "CLI11.hpp"
+#include "nfimm.h"
+
+/** @brief Load client of `NFIMM_bin --serve`
+ *
+ * Each connection has its own thread, and its own source and destination
+ * memfd; the source image is copied into the source memfd once.  Every
+ * request passes the two memfds, so no image bytes cross the socket.  The
+ * throughput and the latency percentiles of all requests are printed.
+ */
+struct ClientOptions
+{
+  std::string socketPath{""};   ///< server's socket
+  std::string srcImgPath{""};   ///< source image
+  std::string tgtImgPath{""};   ///< destination of the first request, optional
+  unsigned requests{10000};     ///< per connection
+  unsigned connections{1};      ///< concurrent clients
+  unsigned warmup{100};         ///< per connection, not measured
+};
+
+/** @brief Result of one connection */
+struct ConnectionResult
+{
+  std::vector<double> latencyUs{};   ///< of each measured request
+  unsigned errors{0};                ///< replies with a failure code
+  NFIMM::Server::Reply firstError{}; ///< reply of the first failure
+  std::string miscue{};              ///< connection failure, empty if none
+};
+
+/**
+ * @param name of the memfd, for /proc
+ * @param bytes initial content
+ * @return descriptor, open for read and write
+ * @throw Miscue memfd cannot be created or written
+ */
+static int makeMemfd( const char *name, const std::vector<uint8_t> &bytes )
+{
+  const int fd{ ::memfd_create( name, MFD_CLOEXEC ) };
+  if( fd < 0 )
+    throw NFIMM::Miscue( NFIMM::MiscueCode::Io, "CANNOT create memfd" );
+  NFIMM::FdSink( fd ).write( bytes.data(), bytes.size() );
+  return fd;
+}
+
+/**
+ * @param opts command-line options
+ * @param image source image bytes
+ * @param keep true to copy the destination image to the target path
+ * @param res OUT latencies and errors
+ */
+static void runConnection( const ClientOptions &opts,
+                           const std::vector<uint8_t> &image, const bool keep,
+                           ConnectionResult &res )
+{
+  int src{-1}, dst{-1};
+  try
+  {
+    src = makeMemfd( "nfimm-src", image );
+    dst = makeMemfd( "nfimm-dst", {} );
+    NFIMM::ServeClient client( opts.socketPath );
+    res.latencyUs.reserve( opts.requests );
+
+    for( unsigned i=0; i<opts.warmup + opts.requests; i++ )
+    {
+      const auto start{ std::chrono::steady_clock::now() };
+      const NFIMM::Server::Reply rep{ client.modify( src, dst ) };
+      const auto stop{ std::chrono::steady_clock::now() };
+      if( rep.code != 0 && res.errors++ == 0 )
+        res.firstError = rep;
+      if( i >= opts.warmup )
+        res.latencyUs.push_back(
+          std::chrono::duration<double, std::micro>( stop - start ).count() );
+
+      if( keep && i == 0 && rep.code == 0 )
+      {
+        std::vector<uint8_t> out( rep.size );
+        if( ::pread( dst, out.data(), out.size(), 0 ) != static_cast<ssize_t>( out.size() ) )
+          throw NFIMM::Miscue( NFIMM::MiscueCode::Io, "CANNOT read destination memfd" );
+        NFIMM::FileSink sink( opts.tgtImgPath );
+        sink.write( out.data(), out.size() );
+        sink.finish();
+      }
+    }
+  }
+  catch( const NFIMM::Miscue &e )
+  {
+    res.miscue = e.what();
+  }
+  if( src >= 0 ) ::close( src );
+  if( dst >= 0 ) ::close( dst );
+}
+
+/**
+ * @param sorted latencies, ascending
+ * @param pct percentile, 0-100
+ * @return latency at the percentile, nearest rank
+ */
+static double percentile( const std::vector<double> &sorted, const double pct )
+{
+  if( sorted.empty() ) return 0.0;
+  const size_t rank{ static_cast<size_t>( pct / 100.0 * ( sorted.size() - 1 ) + 0.5 ) };
+  return sorted[std::min( rank, sorted.size() - 1 )];
+}
+
+
+int main( int argc, char **argv )
+{
+  CLI::App app{"Measure requests per second and latency of NFIMM_bin --serve."};
+  ClientOptions opts;
+
+  app.add_option( "-S, --socket", opts.socketPath, "Server socket PATH" )->required();
+  app.add_option( "-s, --src-img-path", opts.srcImgPath, "Source image PATH, sent in every request" )
+    ->required()
+    ->check(CLI::ExistingFile);
+  app.add_option( "-t, --tgt-img-path", opts.tgtImgPath, "Write the destination image of the first request to PATH" );
+  app.add_option( "-n, --requests", opts.requests, "Measured requests per connection, default 10000" );
+  app.add_option( "-j, --connections", opts.connections, "Concurrent connections, default 1" );
+  app.add_option( "-w, --warmup", opts.warmup, "Unmeasured requests per connection, default 100" );
+  CLI11_PARSE( app, argc, argv );
+  opts.connections = std::max( opts.connections, 1u );
+
+  std::vector<uint8_t> image;
+  {
+    std::ifstream strm( opts.srcImgPath, std::ios::in|std::ios::binary );
+    image.assign( std::istreambuf_iterator<char>( strm ), std::istreambuf_iterator<char>() );
+  }
+
+  std::vector<ConnectionResult> results( opts.connections );
+  std::vector<std::thread> threads;
+  const auto start{ std::chrono::steady_clock::now() };
+  for( unsigned i=0; i<opts.connections; i++ )
+  {
+    threads.emplace_back( runConnection, std::cref( opts ), std::cref( image ),
+                          i == 0 && !opts.tgtImgPath.empty(), std::ref( results[i] ) );
+  }
+  for( std::thread &t : threads ) { t.join(); }
+  const double elapsed{
+    std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() };
+
+  std::vector<double> all;
+  unsigned errors{0};
+  for( const ConnectionResult &res : results )
+  {
+    if( !res.miscue.empty() )
+    {
+      std::cout << "Connection failed: " << res.miscue << std::endl;
+      return -1;
+    }
+    all.insert( all.end(), res.latencyUs.begin(), res.latencyUs.end() );
+    if( res.errors && errors == 0 )
+      std::cout << "First failure: "
+                << NFIMM::describe( static_cast<NFIMM::MiscueCode>( res.firstError.code ) )
+                << " at byte " << res.firstError.offset << std::endl;
+    errors += res.errors;
+  }
+  std::sort( all.begin(), all.end() );
+
+  const size_t total{ static_cast<size_t>( opts.connections ) * ( opts.warmup + opts.requests ) };
+  std::cout << "Image: " << opts.srcImgPath << ", " << image.size() << " bytes\n";
+  std::cout << "Requests: " << total << " (" << opts.connections << " connections, "
+            << opts.warmup << " warm-up each), failures: " << errors << "\n";
+  std::cout << "Elapsed: " << elapsed << " s, throughput: "
+            << static_cast<uint64_t>( total / elapsed ) << " requests/s\n";
+  std::cout << "Latency (us): p50 " << percentile( all, 50 )
+            << "  p90 " << percentile( all, 90 )
+            << "  p99 " << percentile( all, 99 )
+            << "  p99.9 " << percentile( all, 99.9 )
+            << "  max " << ( all.empty() ? 0.0 : all.back() ) << std::endl;
+  return errors ? 1 : 0;
+}
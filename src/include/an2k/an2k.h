@@ -0,0 +1,182 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+#include "nfimm_lib.h"
+#include "registry.h"
+
+#include <map>
+#include <memory>
+
+namespace NFIMM {
+
+
+/** @brief Support for ANSI/NIST-ITL transaction files (.an2, .eft)
+ *
+ * A transaction is a series of logical records; the Type-1 record is first
+ * and its CNT field (1.003) lists the type of every other record in order.
+ *
+ * Tagged records (Type-1, 2, 9 and up) are ASCII fields `T.NNN:value`
+ * separated by GS (`1D`) and ended by FS (`1C`).  The first field, T.001
+ * LEN, is the number of bytes of the record.  The image of a Type-13, 14,
+ * or 15 record is the last field, T.999, and is binary.
+ *
+ * Binary records (Type-3 to 8) begin with a 4-byte big-endian LEN.  The
+ * Type-4 record is an 18-byte header followed by the image.
+ *
+ * The sample rate of the images is in the fields:
+ *   * Type-1: 1.011 NSR native scanning resolution and 1.012 NTR nominal
+ *     transmitting resolution, pixels per mm as `19.69`
+ *   * Type-4: ISR, 0 minimum scanning resolution, 1 the NSR
+ *   * Type-13, 14, 15: T.008 SLC (0 none, 1 per inch, 2 per cm), T.009
+ *     THPS and T.010 TVPS
+ *
+ * ## Modifier Implementation Notes
+ * Every record is processed in one pass over the transaction:
+ *
+ * - Type-1: NSR and NTR are rewritten.
+ * - Type-4: ISR is set to 1, the image is patched, and LEN is updated.
+ * - Type-13, 14, 15: SLC, THPS and TVPS are rewritten, or inserted when
+ *   missing, the image is patched, and LEN is updated.
+ * - all other records are passed through unchanged.
+ *
+ * Each image is patched by the handler of its compression algorithm (GCA
+ * or CGA): WSQ, JPEG, JPEG 2000, or PNG; uncompressed images are unchanged.
+ * The image data of an embedded image is never copied, it is a range of
+ * the transaction.
+ *
+ * The scan rates T.016 SHPS and T.017 SVPS record the capture and are not
+ * changed.  "inch" rates are per inch, "meter" rates are rounded to pixels
+ * per cm (SLC) or mm (NSR), and anything else is SLC 0.
+ */
+class AN2K : public NFIMM {
+
+  public:
+  static const uint8_t FS{0x1C};   ///< record separator
+  static const uint8_t GS{0x1D};   ///< field separator
+  static const uint8_t RS{0x1E};   ///< subfield separator
+  static const uint8_t US{0x1F};   ///< information item separator
+
+  static const int NUM_BYTES_BINARY_LENGTH{4};
+  static const int NUM_BYTES_TYPE4_HEADER{18};
+  static const int OFFSET_TYPE4_ISR{12};
+  static const int OFFSET_TYPE4_GCA{17};
+
+  static constexpr uint32_t FIELD_LEN{1};
+  static constexpr uint32_t FIELD_CNT{3};
+  static constexpr uint32_t FIELD_NSR{11};
+  static constexpr uint32_t FIELD_NTR{12};
+  static constexpr uint32_t FIELD_HLL{6};
+  static constexpr uint32_t FIELD_VLL{7};
+  static constexpr uint32_t FIELD_SLC{8};
+  static constexpr uint32_t FIELD_THPS{9};
+  static constexpr uint32_t FIELD_TVPS{10};
+  static constexpr uint32_t FIELD_CGA{11};
+  static constexpr uint32_t FIELD_BPX{12};
+  static constexpr uint32_t FIELD_DATA{999};
+
+  /** @brief One logical record */
+  struct Record {
+    uint32_t type{0};     ///< record type from CNT
+    size_t offset{0};     ///< of the first byte
+    size_t length{0};     ///< LEN
+    size_t dataAt{0};     ///< offset of the image, 0 if none
+    /** @brief Offset past the record */
+    size_t end() const { return offset + length; }
+    /** @brief Tagged (ASCII) or binary record */
+    bool tagged() const { return type < 3 || type > 8; }
+  };
+
+  /** @brief One field of a tagged record */
+  struct Field {
+    uint32_t number{0};   ///< NNN of `T.NNN:`
+    size_t offset{0};     ///< of the tag
+    size_t valueAt{0};    ///< offset of the value
+    size_t valueEnd{0};   ///< offset of the GS or FS after the value
+  };
+
+  /** @brief Default constructor not used */
+  AN2K() = delete;
+  /** @brief Overloaded constructor with caller's metadata parameters */
+  AN2K( std::shared_ptr<MetadataParameters> & );
+  /** @brief Overloaded constructor with validated, shared parameters */
+  AN2K( std::shared_ptr<const ModificationConfig> );
+  /** @brief Does nothing */
+  ~AN2K() {}
+
+  /** @brief Read the LEN of the record at an offset */
+  static Status readRecord( const uint8_t *, const size_t, const size_t,
+                            Record & ) noexcept;
+  /** @brief Read the field at an offset of a tagged record */
+  static Status readField( const uint8_t *, const Record &, const size_t,
+                           Field & ) noexcept;
+  /** @brief Walk the fields of a tagged record, find one of them */
+  static Status scanFields( const uint8_t *, Record &, const uint32_t,
+                            Field & ) noexcept;
+  /** @brief Next record type of the CNT field */
+  static bool nextCntType( const uint8_t *, size_t &, const size_t,
+                           uint32_t & ) noexcept;
+  /** @brief Compression of an embedded image: wsq, jpeg, jp2, png, or "" */
+  static std::string embeddedFormat( const std::string & );
+
+  /** @brief Patch every record of the transaction */
+  void planImage( ModificationPlan & ) override;
+  /** @brief Walk the records and fields, check bounds */
+  Status validateImage() const noexcept override;
+  /** @brief Sample rate and dimensions of the first image record, the
+   * embedded images are not read */
+  Status probeImage( ImageProbe & ) override;
+  /** @brief Retrieve current Metadata Parameters */
+  std::string to_s();
+
+  private:
+  /** @brief Configs of the embedded images, by compression */
+  FormatConfigs _embedded{ _config };
+
+  /** @brief All records of the transaction */
+  std::vector<Record> readRecords();
+  /** @brief Type-4 source sample rate from the Type-1 NSR */
+  void readNativeRate( const std::map<uint32_t, std::string> & );
+  /** @brief Source sample rate and dimensions of a Type-4 record */
+  void readType4Info( const Record & );
+  /** @brief Source sample rate and dimensions of the first image record */
+  void readImageInfo( const Record &, const std::map<uint32_t, std::string> & );
+  /** @brief All fields of a tagged record, the values as strings */
+  std::map<uint32_t, std::string> fieldValues( const Record & );
+  /** @brief The tagged record up to its image with fields replaced */
+  std::vector<uint8_t> rewriteFields( const Record &,
+                                      const std::map<uint32_t, std::string> &,
+                                      const size_t );
+  /** @brief Plan of the embedded image with its own handler */
+  ModificationPlan planEmbedded( const std::string &, const size_t,
+                                 const size_t, const std::string & );
+  /** @brief NSR and NTR value, pixels per mm */
+  std::string ppmm() const;
+};   // END class AN2K
+
+}   // END namespace
@@ -0,0 +1,241 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+#include "nfimm_lib.h"
+#include "probe.h"
+#include "registry.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+
+namespace NFIMM {
+
+
+/** @brief Append-only record of the finished jobs of a Batch
+ *
+ * The file is a 16-byte header followed by fixed-size Key records.  A run
+ * that is interrupted, even by a reboot, leaves at most a torn last record,
+ * which is dropped when the journal is opened again.
+ *
+ * Records written before the journal was opened are loaded once into a
+ * sorted array for contains(); records added by this run are only written.
+ */
+class Journal
+{
+public:
+  /** @brief Job identity: source and destination paths, and the state of
+   * the source plus the parameters it was modified with */
+  struct Key {
+    uint64_t path{0};    ///< hash of source and destination paths
+    uint64_t state{0};   ///< hash of source size, mtime, and parameters
+
+    /** @brief Order of the replayed array */
+    bool operator<( const Key &k ) const {
+      return path < k.path || ( path == k.path && state < k.state );
+    }
+    /** @brief Same job, same source state */
+    bool operator==( const Key &k ) const {
+      return path == k.path && state == k.state;
+    }
+  };
+
+  /** @brief First 8 bytes of the file, 'NFIMMJNL' */
+  static constexpr char MAGIC[8]{ 'N', 'F', 'I', 'M', 'M', 'J', 'N', 'L' };
+  /** @brief Format version of the header and records */
+  static constexpr uint32_t VERSION{1};
+
+  /** @brief Default constructor not used */
+  Journal() = delete;
+  /** @brief Open or create the journal at PATH and load its records */
+  explicit Journal( const std::string & );
+  /** @brief Close the file; records not written are lost */
+  ~Journal();
+  Journal( const Journal & ) = delete;
+  Journal &operator=( const Journal & ) = delete;
+
+  /** @brief True if the job was finished by an earlier run */
+  bool contains( const Key & ) const;
+  /** @brief Number of records loaded from the file */
+  size_t replayed() const { return _done.size(); }
+  /** @brief Append the records and flush them to the device */
+  void write( const std::vector<Key> & );
+
+private:
+  std::string _path;             ///< for error messages
+  int _fd{-1};                   ///< open for append
+  std::vector<Key> _done{};      ///< sorted, loaded by the constructor
+};   // END class Journal
+
+
+/** @brief Modify a list of source images into destination files on worker
+ * threads
+ *
+ * Each worker keeps its configs and one handler per format for every job,
+ * as the Server does.  A source is memory-mapped and read in place.
+ *
+ * With a journal, every finished job is recorded, and a job already in the
+ * journal is skipped after a stat() of its source, which is neither opened
+ * nor read.  Records are written in groups: on a group, the file systems of
+ * the destinations written since the previous group are synced first, then
+ * the records, so a recorded destination is never lost.
+ *
+ * With deduplication, byte-identical sources are modified once: the first
+ * job of each content is modified, and every other job with the same
+ * content gets a hard link or copy of its destination.  Content is keyed by
+ * a 128-bit hash of the source bytes; a job whose content is being modified
+ * by another worker waits for it.
+ *
+ * A job without destination patches its source in place, see
+ * NFIMM::modifyInPlace().  With skipCurrent(), a source that already has the
+ * parameters, see NFIMM::isCurrent(), is not written: it is left untouched,
+ * or hard linked to its destination.
+ *
+ * probe() reads the headers of the sources of a list and writes nothing;
+ * with hashContent(), it reads the whole of each source to hash it.
+ */
+class Batch
+{
+public:
+  /** @brief One source image and its destination */
+  struct Job {
+    std::string src{};    ///< source image PATH
+    std::string dest{};   ///< destination image PATH, empty to patch src in place
+  };
+
+  /** @brief How the destination of a duplicate source is made */
+  enum class Dedup {
+    Off,    ///< every source is modified
+    Link,   ///< hard link, a copy if on another file system
+    Copy    ///< reflink where supported, else a copy
+  };
+
+  /** @brief Outcome of one job */
+  struct Outcome {
+    Status status{};            ///< Ok, or the failure
+    bool skipped{false};        ///< found in the journal, not modified
+    bool deduplicated{false};   ///< linked or copied from a duplicate
+    bool current{false};        ///< already had the parameters, not modified
+  };
+
+  /** @brief Totals of run() */
+  struct Summary {
+    size_t done{0};           ///< modified, linked, or copied
+    size_t skipped{0};        ///< found in the journal
+    size_t failed{0};         ///< status not Ok
+    size_t deduplicated{0};   ///< of done, linked or copied
+    size_t current{0};        ///< of done, untouched or linked as current
+  };
+
+  /** @brief Fill the job and return true, false at end of list; called by
+   * one worker at a time */
+  using Source = std::function<bool( Job & )>;
+  /** @brief Called for every job, by one worker at a time */
+  using Report = std::function<void( const Job &, const Outcome & )>;
+  /** @brief Called for every source probed, by one worker at a time */
+  using ProbeReport = std::function<void( const ImageProbe & )>;
+
+  /** @brief Default constructor not used */
+  Batch() = delete;
+  /** @brief Workers for the config; format detected per image if true */
+  Batch( std::shared_ptr<const ModificationConfig>, const unsigned, const bool );
+  /** @brief Record finished jobs in the journal at PATH, skip those found */
+  void journal( const std::string &, const size_t groupSize = 4096,
+                const std::chrono::milliseconds groupTime = std::chrono::seconds{1} );
+
+  /** @brief Modify each content once, link or copy the duplicates */
+  void dedup( const Dedup mode ) { _dedup = mode; }
+  /** @brief Leave current sources untouched, link them to their destination */
+  void skipCurrent( const bool skip ) { _skipCurrent = skip; }
+  /** @brief Set the content hash of every source probed */
+  void hashContent( const bool hash ) { _hashContent = hash; }
+
+  /** @brief Run every job of the source; returns after the last is recorded */
+  Summary run( const Source &, const Report & = nullptr );
+  /** @brief Probe the source of every job; destinations are ignored */
+  Summary probe( const Source &, const ProbeReport & );
+  /** @brief Take no more jobs; async-signal-safe */
+  void stop() noexcept { _stopping.store( true ); }
+
+private:
+  /** @brief Configs and handlers of one worker, reused for every job */
+  struct Worker;
+
+  /** @brief Run BODY on every worker, the calling thread being one */
+  void parallel( const std::function<void( Worker & )> & );
+  /** @brief Take and run jobs until the source ends or stop() */
+  void work( Worker &, const Source &, const Report &, Summary & );
+  /** @brief Read the header metadata of the source image at PATH */
+  void probe( Worker &, const std::string &, ImageProbe & );
+  /** @brief Modify one source image into its destination, or make it from
+   * the destination of a duplicate */
+  Status modify( Worker &, const Job &, Outcome & );
+  /** @brief Modify the mapped source image into its destination */
+  Status modify( Worker &, const Job &, const uint8_t *, const size_t, bool & );
+  /** @brief Identity of the job, false if its source cannot be stat()ed */
+  bool keyOf( const Job &, Journal::Key & ) const;
+  /** @brief Sync the destinations, then write the pending records */
+  void commit();
+
+  std::shared_ptr<const ModificationConfig> _config;  ///< base config
+  unsigned _workers;
+  bool _detect;                ///< format from signature, else config's
+  uint64_t _paramsHash{0};     ///< part of every journal key
+  std::atomic<bool> _stopping{false};
+
+  std::mutex _mtx;             ///< source, report, summary, and pending
+  std::unique_ptr<Journal> _journal{};
+  size_t _groupSize{4096};
+  std::chrono::milliseconds _groupTime{1000};
+  std::chrono::steady_clock::time_point _lastCommit{};
+  std::vector<Journal::Key> _pending{};
+  /** @brief Directory on each file system written since the last commit */
+  std::map<uint64_t, std::string> _devices{};
+  std::mutex _commitMtx;       ///< one commit at a time, in order
+
+  /** @brief First job of one source content */
+  struct Content {
+    bool finished{false};   ///< status and dest are set
+    Status status{};        ///< of the first job
+    std::string dest{};     ///< destination of the first job
+  };
+  Dedup _dedup{Dedup::Off};
+  bool _skipCurrent{false};             ///< see skipCurrent()
+  bool _hashContent{false};             ///< see hashContent()
+  bool _contentHasTime{false};          ///< source mtime is part of content
+  std::mutex _dedupMtx;                 ///< contents
+  std::condition_variable _dedupDone;   ///< a content is finished
+  /** @brief By the two halves of the content hash */
+  std::map<std::pair<uint64_t, uint64_t>, Content> _contents{};
+};   // END class Batch
+
+}   // END namespace
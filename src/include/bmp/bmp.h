@@ -38,9 +38,9 @@ namespace NFIMM {
  * six bytes of the file contain '42 4D EE A5 03 00', then the file size in
  * bytes 2-5 = '00 03 A5 EE' == 239,086.
  *
- * There are three INFOHEADER elements that are updated:
- *   * horiz and vert resolution (always)
- *   * image size (if and only if source image size was == 0)
+ * There are two INFOHEADER elements that are updated, the horiz and vert
+ * resolution.  Every other header byte, the color table, and the pixel data
+ * are passed to the destination image unchanged.
  *
  * BMP metadata is contained between the first byte of the file and the first
  * byte of the pixel-data-array.  This metadata is comprised of File Header
@@ -50,8 +50,16 @@ namespace NFIMM {
  *
  * **NFIMM** supports only the following DIB Headers:
  *
- *   * BITMAPCOREHEADER - 12-bytes
+ *   * BITMAPCOREHEADER - 12-bytes, has no resolution and is not changed
  *   * BITMAPINFOHEADER - 40-bytes
+ *   * BITMAPV2INFOHEADER - 52-bytes
+ *   * BITMAPV3INFOHEADER - 56-bytes
+ *   * OS22XBITMAPHEADER - 64-bytes
+ *   * BITMAPV4HEADER - 108-bytes
+ *   * BITMAPV5HEADER - 124-bytes
+ *
+ * All but the core header begin with the 40 bytes of the BITMAPINFOHEADER,
+ * which is where the resolution is located.
  *
  * Since there is no version field in the headers, the only way to determine
  * the type of image structure is by checking the DIB header's `size` field
@@ -63,33 +71,42 @@ class BMP : public NFIMM {
   static const int NUM_BYTES_BITMAPFILEHEADER{14};
   static const int NUM_BYTES_DIB_BITMAPCOREHEADER{12};
   static const int NUM_BYTES_DIB_BITMAPINFOHEADER{40};
+  static const int NUM_BYTES_DIB_BITMAPV2INFOHEADER{52};
+  static const int NUM_BYTES_DIB_BITMAPV3INFOHEADER{56};
+  static const int NUM_BYTES_DIB_OS22XBITMAPHEADER{64};
+  static const int NUM_BYTES_DIB_BITMAPV4HEADER{108};
+  static const int NUM_BYTES_DIB_BITMAPV5HEADER{124};
   static const int NUM_BYTES_BM_IDENTIFIER{2};
 
   /** @brief Default constructor not used */
   BMP() = delete;
-  /** @brief Overloaded constructor always used */
+  /** @brief Overloaded constructor with caller's metadata parameters */
   BMP( std::shared_ptr<MetadataParameters> & );
+  /** @brief Overloaded constructor with validated, shared parameters */
+  BMP( std::shared_ptr<const ModificationConfig> );
   /** @brief Does nothing */
   ~BMP() {}
 
-  /** @brief Modify the headers according to source image format */
-  void modify() override;
+  /** @brief Check DIB header size is one of the supported headers */
+  static bool isSupportedHeaderSize( const uint32_t );
+
+  /** @brief Parse the headers and patch the resolution, size is unchanged */
+  void planImage( ModificationPlan & ) override;
+  /** @brief Check identifier, header sizes, and pixel data bounds */
+  Status validateImage() const noexcept override;
+  /** @brief Bytes of the file and DIB headers of a streamed image */
+  size_t streamHeadLength( const uint8_t *, const size_t ) const noexcept override;
+  /** @brief Read the file and DIB header fields in place */
+  Status probeImage( ImageProbe & ) override;
   /** @brief Retrieve current Metadata Parameters */
   std::string to_s();
-
-  /** @brief Transfer all bytes from source to destination buffer */
-  void xferBytesBetweenBuffers( std::vector<uint8_t>&,
-                                const std::vector<uint8_t>& );
-
-  /** @brief Read source image pixel data (after the headers) */
-  void readImagePixels( const uint32_t, std::vector<uint8_t> & );
 };   // END class BMP
 
 
 /** @brief BMP File header contains 14-bytes
  *
- * The file header is read and saved in memory (buffer) for write to
- * destination image; there are no mods to this header.
+ * The file header is parsed for validation and logging only; there are no
+ * mods to this header and its bytes are referenced in the source image.
  *
  * The first two bytes are checked to be == 'BM' and error is thrown if not.
  *
@@ -102,17 +119,14 @@ public:
   /** @brief Default constructor not used */
   FileHeader() = delete;
   /** @brief Always use this overloaded ctor */
-  FileHeader( std::shared_ptr<MetadataParameters> & );
+  FileHeader( ModificationResult & );
 
-  /** @brief Image header info passed-by and runtime log returned-to caller */
-  std::shared_ptr<MetadataParameters> _params;
+  /** @brief Runtime log returned-to caller */
+  ModificationResult &_result;
 
   /** @brief Read the first 14 bytes of the file into the File header container */
   void read();
 
-  /** @brief Container for entire header */
-  std::vector<uint8_t> _vecEntireHeader;
-
   /** @brief Comparator for first two bytes of BMP header, usually 'BM' */
   const uint8_t _fileType[BMP::NUM_BYTES_BM_IDENTIFIER] = { 0x42, 0x4D };  // 'BM'
   /** @brief bytes 0-1 == 'BM' */
@@ -138,9 +152,6 @@ public:
     uint32_t calculated_size_image{0};
   } _actual;
 
-  /** @brief Loads the FILEHEADER in vector container */
-  void headerAsVector();
-
   /** @brief Convert the FileHeader to single string; useful for debug */
   std::string to_s( const std::string & );
   /** @brief Convert the FileHeader to string of hex; useful for debug */
@@ -148,23 +159,35 @@ public:
 };   // END class FileHeader
 
 
-/** @brief BMP Info header contains 40-bytes
+/** @brief BMP Info (DIB) header contains 12, or 40 or more bytes
  *
- * There are three fields to be updated: _biSize, biXPelsPerMeter,
- * and biYPelsPerMeter.
+ * There are two fields to be updated: biXPelsPerMeter and biYPelsPerMeter.
+ * Only the first 40 bytes are parsed; the rest of a larger header is passed
+ * through unchanged.
  */
 class InfoHeader {
 public:
   /** @brief Default constructor not used */
   InfoHeader() = delete;
   /** @brief Always use this overloaded ctor */
-  InfoHeader( std::shared_ptr<MetadataParameters> & );
+  InfoHeader( const ModificationConfig &, ModificationResult & );
+
+  /** @brief Validated modification parameters */
+  const ModificationConfig &_config;
+  /** @brief Source image metadata and runtime log returned-to caller */
+  ModificationResult &_result;
 
-  /** @brief Image header info passed-by and runtime log returned-to caller  */
-  std::shared_ptr<MetadataParameters> _params;
+  /** @brief Offset of biXPelsPerMeter from the start of the header */
+  static const int OFFSET_X_PELS_PER_METER{24};
 
-  /** @brief Read the 40 bytes of the Info header */
+  /** @brief Read the Info header */
   void read();
+  /** @brief Read the remaining bytes of the BITMAPCOREHEADER */
+  void readCore();
+  /** @brief BITMAPCOREHEADER has no sample rate */
+  bool hasResolution() const {
+    return _actual.headerCountBytes != BMP::NUM_BYTES_DIB_BITMAPCOREHEADER;
+  }
   /** @brief Update the Info header with user-specified metadata values */
   void update();
   /** @brief Write the individual header elements into one entire buffer */
@@ -175,10 +198,7 @@ public:
   /** @brief Convert the InfoHeader to string of hex; useful for debug */
   std::string to_s_hex();
 
-  /** @brief Container for entire Info header */
-  std::vector<uint8_t> _vecEntireHeader;
-
-  /** @brief bytes 0-3 header size, value must be == 40 */
+  /** @brief bytes 0-3 header size, see BMP for supported values */
   uint8_t _biSize[4]{0};
   /** @brief bytes 4-7 image width */
   uint8_t _biWidth[4]{0};
@@ -226,9 +246,6 @@ public:
     uint32_t colors_important{0};
   } _actual;
 
-  /** @brief Loads the INFOHEADER in vector container */
-  void headerAsVector();
-
 };   // END class InfoHeader
 
 }   // END namespace
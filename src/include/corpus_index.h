@@ -0,0 +1,167 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+#include "batch.h"
+#include "probe.h"
+
+#include <string>
+#include <vector>
+
+namespace NFIMM {
+
+
+/** @brief Memory-mapped index of the header metadata of a corpus of images
+ *
+ * The file is a 32-byte header, the entries sorted by the hash of their
+ * path, then the paths.  Queries read the mapped entries; no image is
+ * opened.
+ *
+ * refresh() rebuilds the index from a list of images.  An image whose
+ * inode, size, and mtime are those of its entry keeps the entry, after a
+ * stat(); every other image is probed and its whole content hashed.  The
+ * new index is written beside the old one and renamed over it, so a reader
+ * maps either the old or the new index, never a partial one.
+ */
+class CorpusIndex
+{
+public:
+  /** @brief Header metadata of one image, and the state of its file */
+  struct Entry {
+    uint64_t pathHash{0};       ///< hash64() of the path
+    uint64_t pathOffset{0};     ///< of the path, from the start of the paths
+    uint64_t size{0};           ///< bytes of the file
+    uint64_t inode{0};
+    int64_t mtimeSec{0};
+    uint32_t mtimeNsec{0};
+    uint32_t pathLength{0};     ///< bytes of the path, no NUL
+    uint64_t contentHash[2]{};  ///< 128-bit hash of the file's bytes
+    uint64_t headerEnd{0};      ///< see ImageProbe
+    uint64_t resolutionOffset{0};  ///< see ImageProbe
+    uint64_t statusOffset{0};   ///< source image offset of the failure
+    int32_t code{0};            ///< MiscueCode of the probe, Ok == 0
+    uint32_t width{0};
+    uint32_t height{0};
+    uint32_t horiz{0};          ///< horizontal sample rate, header units
+    uint32_t vert{0};           ///< vertical sample rate, header units
+    uint32_t dibHeaderSize{0};
+    uint32_t compression{0};    ///< BMP biCompression
+    uint16_t bitDepth{0};
+    uint8_t colorType{0};
+    uint8_t units{0};           ///< header spec for horiz and vert units
+    uint8_t flags{0};           ///< RESOLUTION_EXISTS, NFIMM_SOFTWARE
+    char format[7]{};           ///< compression, NUL-padded
+  };
+  static_assert( sizeof( Entry ) == 128, "CorpusIndex::Entry layout" );
+
+  /** @brief Entry::flags bit, header holds a sample rate */
+  static const uint8_t RESOLUTION_EXISTS{0x01};
+  /** @brief Entry::flags bit, PNG Software tEXt written by NFIMM */
+  static const uint8_t NFIMM_SOFTWARE{0x02};
+
+  /** @brief First 8 bytes of the file, 'NFIMMIDX' */
+  static constexpr char MAGIC[8]{ 'N', 'F', 'I', 'M', 'M', 'I', 'D', 'X' };
+  /** @brief Format version of the header and entries */
+  static constexpr uint32_t VERSION{1};
+
+  /** @brief Entries selected by all of a list of conditions
+   *
+   * A condition is `field OP value`, OP one of `= < > <= >=`, and a list
+   * joins them with commas, e.g. "format=png,ppi=600,width>1600".  Fields:
+   * format (= only), width, height, depth, horiz, vert, units, ppi, size,
+   * and code.  ppi is the horizontal and vertical sample rate in pixels per
+   * inch; an entry whose units are not known never matches it.
+   */
+  class Query
+  {
+  public:
+    /** @brief Match every entry */
+    Query() = default;
+    /** @brief Parse the list of conditions */
+    explicit Query( const std::string & );
+    /** @brief True if the entry meets every condition */
+    bool matches( const Entry & ) const;
+
+  private:
+    /** @brief One numeric condition */
+    struct Condition {
+      std::string field{};
+      std::string op{};
+      uint64_t value{0};
+    };
+    std::string _format{};               ///< empty for any
+    std::vector<Condition> _conditions{};
+  };
+
+  /** @brief Totals of refresh() */
+  struct Totals {
+    size_t unchanged{0};   ///< entry kept after a stat()
+    size_t probed{0};      ///< probed Ok
+    size_t failed{0};      ///< probed, status not Ok
+  };
+
+  /** @brief Default constructor not used */
+  CorpusIndex() = delete;
+  /** @brief Map the index at PATH; a missing file is an empty index */
+  explicit CorpusIndex( const std::string & );
+  /** @brief Unmap the file */
+  ~CorpusIndex();
+  CorpusIndex( const CorpusIndex & ) = delete;
+  CorpusIndex &operator=( const CorpusIndex & ) = delete;
+
+  /** @brief Number of entries */
+  size_t size() const { return _count; }
+  /** @brief First entry, in path-hash order */
+  const Entry *begin() const { return _entries; }
+  /** @brief Past the last entry */
+  const Entry *end() const { return _entries + _count; }
+  /** @brief Entry of the image at PATH, nullptr if none */
+  const Entry *find( const std::string & ) const;
+  /** @brief Path of the entry */
+  std::string pathOf( const Entry & ) const;
+  /** @brief Entry as an ImageProbe; tEXt is not indexed */
+  ImageProbe probeOf( const Entry & ) const;
+
+  /** @brief Sample rate of the entry in pixels per inch, false if its
+   * units are not known */
+  static bool ppi( const Entry &, uint32_t &, uint32_t & );
+
+  /** @brief Rebuild the index at PATH from the images of the list */
+  static Totals refresh( const std::string &, Batch &, const Batch::Source & );
+
+private:
+  std::string _path;            ///< for error messages
+  void *_map{nullptr};          ///< whole file, nullptr if empty
+  size_t _mapSize{0};
+  const Entry *_entries{nullptr};
+  size_t _count{0};
+  const char *_paths{nullptr};  ///< path of entry at its pathOffset
+  size_t _pathsSize{0};
+};   // END class CorpusIndex
+
+}   // END namespace
@@ -0,0 +1,49 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace NFIMM {
+
+/** @brief Fast non-cryptographic 64-bit hash (XXH64) of a byte range
+ *
+ * The value depends only on the bytes and the seed, never on the platform
+ * or the build, so it may be stored, e.g. in a batch Journal.
+ */
+uint64_t hash64( const void *, const size_t, const uint64_t seed = 0 );
+
+/** @brief hash64() of the characters of a string */
+inline uint64_t hash64( const std::string &s, const uint64_t seed = 0 )
+{
+  return hash64( s.data(), s.size(), seed );
+}
+
+}   // END namespace
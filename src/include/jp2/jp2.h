@@ -0,0 +1,149 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+#include "nfimm_lib.h"
+
+namespace NFIMM {
+
+
+/** @brief Support for operations on images in JPEG 2000 (JP2) format
+ *
+ * Multi-byte values in JP2 boxes are big-endian.
+ *
+ * A JP2 file is a series of boxes.  Each box begins with a 4-byte length
+ * LBox that counts the whole box, and a 4-byte type TBox, e.g. `jp2h`.
+ * LBox 1 means the length is the 8-byte XLBox that follows the type; LBox 0
+ * means the box extends to the end of the file.  A superbox, e.g. `jp2h`,
+ * contains only boxes.
+ *
+ * The file begins with the 12-byte signature box `jP  `, then `ftyp`.  The
+ * `jp2h` header superbox begins with `ihdr` (height, width, components, bit
+ * depth) and may contain the resolution superbox `res `:
+ *   * `resc` - capture resolution, the sample rate of the scan
+ *   * `resd` - default display resolution
+ *
+ * Both are 10 bytes: VR_N, VR_D, HR_N, HR_D (2 bytes each), VR_E, HR_E
+ * (signed byte each); the resolution is N / D * 10^E grid points per meter.
+ *
+ * The contiguous codestream box `jp2c` holds the compressed image.
+ *
+ * ## Modifier Implementation Notes
+ * The top-level boxes and the children of `jp2h` and `res ` are walked; the
+ * codestream is never parsed or changed and is passed to the destination
+ * image as one range of the source image.
+ *
+ * - `resc` and `resd` both present with their standard length: the 10
+ *   bytes of each are patched in place, the size is unchanged.
+ * - otherwise: the `res ` box is replaced, or added at the end of `jp2h`,
+ *   with both `resc` and `resd`, and the `jp2h` length is updated.
+ *
+ * JP2 resolution is always per meter.  For "inch" the sample rate is
+ * converted exactly, e.g. 500 PPI is 25000 / 127 * 10^2; any other units
+ * are taken as pixels per meter.
+ */
+class JP2 : public NFIMM {
+
+  public:
+  static const int NUM_BYTES_BOX_HEADER{8};
+  static const int NUM_BYTES_XL_BOX_HEADER{16};
+  static const int NUM_BYTES_SIGNATURE_BOX{12};
+  /** @brief Data of the image header box `ihdr` */
+  static const int NUM_BYTES_IHDR_DATA{14};
+  /** @brief Data of the `resc` and `resd` boxes */
+  static const int NUM_BYTES_RES_DATA{10};
+
+  static const uint32_t BOX_SIGNATURE{0x6A502020};  ///< `jP  `
+  static const uint32_t BOX_HEADER{0x6A703268};     ///< `jp2h`
+  static const uint32_t BOX_IMAGE_HEADER{0x69686472};  ///< `ihdr`
+  static const uint32_t BOX_RESOLUTION{0x72657320}; ///< `res `
+  static const uint32_t BOX_CAPTURE{0x72657363};    ///< `resc`
+  static const uint32_t BOX_DISPLAY{0x72657364};    ///< `resd`
+  static const uint32_t BOX_CODESTREAM{0x6A703263}; ///< `jp2c`
+
+  /** @brief One box, length 0 if absent */
+  struct Box {
+    size_t offset{0};     ///< of LBox
+    size_t headerSize{0}; ///< 8, or 16 with XLBox
+    size_t length{0};     ///< of the whole box
+    uint32_t type{0};     ///< TBox
+    /** @brief Offset of the box data */
+    size_t data() const { return offset + headerSize; }
+    /** @brief Offset past the box */
+    size_t end() const { return offset + length; }
+  };
+
+  /** @brief Boxes of interest, the first of each type */
+  struct Layout {
+    Box header;      ///< `jp2h`
+    Box imageHeader; ///< `ihdr`
+    Box resolution;  ///< `res `
+    Box capture;     ///< `resc`
+    Box display;     ///< `resd`
+    Box codestream;  ///< `jp2c`
+  };
+
+  /** @brief Default constructor not used */
+  JP2() = delete;
+  /** @brief Overloaded constructor with caller's metadata parameters */
+  JP2( std::shared_ptr<MetadataParameters> & );
+  /** @brief Overloaded constructor with validated, shared parameters */
+  JP2( std::shared_ptr<const ModificationConfig> );
+  /** @brief Does nothing */
+  ~JP2() {}
+
+  /** @brief Read the box header at an offset */
+  static Status readBox( const uint8_t *, const size_t, const size_t,
+                         Box & ) noexcept;
+  /** @brief Walk the top-level boxes and the children of `jp2h` */
+  static Status scanBoxes( const uint8_t *, const size_t, Layout & ) noexcept;
+  /** @brief Printable box type, trailing spaces removed */
+  static std::string boxName( const uint32_t );
+  /** @brief Encode pixels per meter NUM / DEN as JP2 resolution fields */
+  static void encodeResolution( uint64_t, uint64_t, uint16_t &, uint16_t &,
+                                int8_t & );
+
+  /** @brief Patch or add the resolution boxes, the codestream is unchanged */
+  void planImage( ModificationPlan & ) override;
+  /** @brief Walk the boxes, check bounds and the header superbox */
+  Status validateImage() const noexcept override;
+  /** @brief Bytes up to the end of `jp2h` of a streamed image */
+  size_t streamHeadLength( const uint8_t *, const size_t ) const noexcept override;
+  /** @brief Retrieve current Metadata Parameters */
+  std::string to_s();
+
+  private:
+  /** @brief Plan one keep per box from cursor up to offset */
+  void keepBoxes( ModificationPlan &, size_t &, const size_t );
+  /** @brief The 10 data bytes of `resc` and `resd` */
+  void resolutionData( uint8_t * );
+  /** @brief Read the source sample rate, if any */
+  void readResolution( const Layout & );
+};   // END class JP2
+
+}   // END namespace
@@ -0,0 +1,198 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+#include "nfimm_lib.h"
+
+namespace NFIMM {
+
+
+/** @brief Support for operations on images in JPEG (JFIF and EXIF) format
+ *
+ * Multi-byte values in JPEG marker segments are big-endian.
+ *
+ * A JPEG file is a series of marker segments that begins with SOI (`FF D8`).
+ * Each marker is `FF` followed by a marker code; all markers but SOI, EOI,
+ * TEM and RSTn are followed by a 2-byte length that counts itself and the
+ * segment data.  The image data follows the first SOS (start of scan)
+ * marker segment and is entropy-coded.
+ *
+ * The sample rate is found in the following segments:
+ *
+ *   * APP0 `JFIF` - units, Xdensity and Ydensity (2 bytes each)
+ *   * APP1 `Exif` - TIFF IFD0 XResolution, YResolution and ResolutionUnit
+ *
+ * ## Modifier Implementation Notes
+ * The marker segments are walked from SOI to the first SOS; nothing from
+ * the SOS onward, i.e. the entropy-coded data and any following scans, is
+ * parsed or changed.  It is passed to the destination image as one range
+ * of the source image.
+ *
+ * - APP0 `JFIF`: units and densities are patched in place (5 bytes).
+ * - APP1 `Exif`: the resolution values are patched in place when all three
+ *   tags are present with their standard type and count; otherwise only
+ *   this segment is rewritten, see Exif.
+ * - neither: a JFIF APP0 segment is inserted after SOI.
+ *
+ * Destination units follow the sample-rate units: "inch" is dots per inch,
+ * "meter" is dots per cm (JFIF) or centimeter (EXIF), anything else is an
+ * aspect ratio (JFIF) or no absolute unit (EXIF).
+ */
+class JPEG : public NFIMM {
+
+  public:
+  static const int NUM_BYTES_MARKER{2};
+  static const int NUM_BYTES_SEGMENT_LENGTH{2};
+  /** @brief Entire JFIF APP0 segment without thumbnail */
+  static const int NUM_BYTES_JFIF_APP0{18};
+  /** @brief Offset of the units byte from the APP0 marker */
+  static const int OFFSET_JFIF_UNITS{11};
+  /** @brief Offset of the TIFF header from the APP1 marker */
+  static const int OFFSET_EXIF_TIFF{10};
+
+  /** @brief Offsets of the marker segments of interest, 0 if absent */
+  struct Markers {
+    size_t jfif{0};      ///< APP0 JFIF marker
+    size_t exif{0};      ///< APP1 Exif marker
+    size_t exifLength{0};///< APP1 segment length, excludes the marker
+    size_t sof{0};       ///< SOFn marker
+    size_t sos{0};       ///< first SOS marker
+  };
+
+  /** @brief Default constructor not used */
+  JPEG() = delete;
+  /** @brief Overloaded constructor with caller's metadata parameters */
+  JPEG( std::shared_ptr<MetadataParameters> & );
+  /** @brief Overloaded constructor with validated, shared parameters */
+  JPEG( std::shared_ptr<const ModificationConfig> );
+  /** @brief Does nothing */
+  ~JPEG() {}
+
+  /** @brief Walk the marker segments from SOI to the first SOS */
+  static Status scanMarkers( const uint8_t *, const size_t,
+                             Markers & ) noexcept;
+  /** @brief Human readable name of a marker code */
+  static std::string markerName( const uint8_t );
+  /** @brief Destination JFIF units and densities */
+  static uint8_t jfifDensity( const ModificationConfig &,
+                              uint32_t &, uint32_t & );
+  /** @brief Check the JFIF density fits in its 2 bytes */
+  static bool isSupportedDensity( const ModificationConfig & );
+
+  /** @brief Patch the sample rate segments, the scan data is unchanged */
+  void planImage( ModificationPlan & ) override;
+  /** @brief Walk the marker segments, check bounds and EXIF structure */
+  Status validateImage() const noexcept override;
+  /** @brief Bytes up to the end of the SOS header of a streamed image */
+  size_t streamHeadLength( const uint8_t *, const size_t ) const noexcept override;
+  /** @brief Retrieve current Metadata Parameters */
+  std::string to_s();
+
+  private:
+  /** @brief Plan the JFIF APP0 segment with units and densities patched */
+  void planJfif( ModificationPlan &, const size_t );
+  /** @brief Plan every segment up to offset that is not patched */
+  void keepSegments( ModificationPlan &, size_t &, const size_t );
+};   // END class JPEG
+
+
+/** @brief EXIF resolution tags in the TIFF structure of the APP1 segment
+ *
+ * The APP1 data is `Exif\0\0` followed by a TIFF header and IFDs; all
+ * offsets are from the first byte of the TIFF header, and the byte order is
+ * that of the TIFF header (`II` little-endian or `MM` big-endian).
+ *
+ * IFD0 contains the tags:
+ *   * XResolution 0x011A, RATIONAL, count 1
+ *   * YResolution 0x011B, RATIONAL, count 1
+ *   * ResolutionUnit 0x0128, SHORT, count 1: 1 none, 2 inch, 3 centimeter
+ *
+ * When the three tags are present as above their values are patched in
+ * place.  Otherwise the IFD0 is rewritten, with the tags, after the last
+ * byte of the TIFF structure and the IFD0 offset in the TIFF header points
+ * to it.  No other byte is moved, therefore every other offset, e.g. of the
+ * Exif sub-IFD and the thumbnail, is still correct; the old IFD0 is unused.
+ */
+class Exif {
+public:
+  static const uint16_t TAG_X_RESOLUTION{0x011A};
+  static const uint16_t TAG_Y_RESOLUTION{0x011B};
+  static const uint16_t TAG_RESOLUTION_UNIT{0x0128};
+  static const uint16_t TYPE_SHORT{3};
+  static const uint16_t TYPE_RATIONAL{5};
+  static const int NUM_BYTES_TIFF_HEADER{8};
+  static const int NUM_BYTES_IFD_ENTRY{12};
+
+  /** @brief One IFD0 entry of a resolution tag */
+  struct Entry {
+    bool found{false};    ///< tag is in IFD0
+    size_t offset{0};     ///< of the entry
+    uint16_t type{0};     ///< TIFF field type
+    uint32_t count{0};    ///< number of values
+    uint32_t value{0};    ///< value, or offset of value
+  };
+
+  /** @brief Location of IFD0 and its resolution tags */
+  struct Layout {
+    bool bigEndian{false};   ///< TIFF byte order is `MM`
+    size_t ifd0{0};          ///< offset of IFD0
+    uint16_t countEntries{0};///< number of IFD0 entries
+    Entry xRes;              ///< XResolution
+    Entry yRes;              ///< YResolution
+    Entry unit;              ///< ResolutionUnit
+  };
+
+  /** @brief Default constructor not used */
+  Exif() = delete;
+  /** @brief Always use this overloaded ctor */
+  Exif( const ModificationConfig &, ModificationResult & );
+
+  /** @brief Validated modification parameters */
+  const ModificationConfig &_config;
+  /** @brief Source image metadata and runtime log returned-to caller */
+  ModificationResult &_result;
+
+  /** @brief Locate IFD0 and the resolution tags */
+  static Status parse( const uint8_t *, const size_t, Layout & ) noexcept;
+  /** @brief True when the tag values are patched in place */
+  static bool patchInPlace( const Layout & );
+
+  /** @brief Plan the APP1 segment with the resolution tags updated */
+  void plan( ModificationPlan &, const size_t, const size_t );
+
+private:
+  /** @brief Read the source sample rate, if any */
+  void readResolution( const uint8_t *, const Layout & );
+  /** @brief Rewrite the segment with a new IFD0 */
+  void planRewrite( ModificationPlan &, const uint8_t *, const size_t,
+                    const Layout & );
+  /** @brief Destination ResolutionUnit and rational denominator */
+  uint16_t unitTag( uint32_t & ) const;
+};   // END class Exif
+
+}   // END namespace
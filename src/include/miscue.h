@@ -32,11 +32,71 @@ identified are necessarily the best available for the purpose.
   #pragma warning( disable: 4514 )
 #endif
 
+#include <cstddef>
 #include <exception>
 #include <string>
 
 namespace NFIMM {
 
+/** @brief Reason for a failed modification
+ *
+ * Reported by the no-throw API in Status, and by Miscue::code().
+ */
+enum class MiscueCode : int {
+  Ok = 0,            ///< no error
+  InvalidParameter,  ///< metadata parameters or API arguments
+  Truncated,         ///< source image ends inside a header, chunk or pixels
+  InvalidSignature,  ///< not the declared image format
+  InvalidHeader,     ///< header present but malformed
+  InvalidChunk,      ///< PNG chunk unknown or malformed
+  SizeMismatch,      ///< header sizes disagree
+  Unsupported,       ///< valid image, variant not supported by NFIMM
+  Io,                ///< read or write of a file, descriptor or command
+  Other              ///< none of the above
+};
+
+/**
+ * The descriptions are string literals, so reporting an error never
+ * allocates.
+ *
+ * @param code reason for failure
+ * @return fixed description of CODE
+ */
+inline const char *describe( const MiscueCode code ) noexcept
+{
+  switch( code )
+  {
+    case MiscueCode::Ok:               return "OK";
+    case MiscueCode::InvalidParameter: return "Invalid parameter";
+    case MiscueCode::Truncated:        return "Source image truncated";
+    case MiscueCode::InvalidSignature: return "Invalid image signature";
+    case MiscueCode::InvalidHeader:    return "Invalid image header";
+    case MiscueCode::InvalidChunk:     return "Invalid PNG chunk";
+    case MiscueCode::SizeMismatch:     return "Image header size mismatch";
+    case MiscueCode::Unsupported:      return "Unsupported image variant";
+    case MiscueCode::Io:               return "Input/output error";
+    case MiscueCode::Other:            break;
+  }
+  return "Modification failed";
+}
+
+/** @brief Outcome of a no-throw call
+ *
+ * Holds no strings; see describe().
+ */
+struct Status
+{
+  MiscueCode code{MiscueCode::Ok};  ///< reason for failure
+  size_t offset{0};   ///< byte of source image where failure was found
+
+  /** @return true if no error */
+  bool ok() const noexcept { return code == MiscueCode::Ok; }
+  /** @return true if no error */
+  explicit operator bool() const noexcept { return ok(); }
+  /** @return fixed description of the code */
+  const char *what() const noexcept { return describe( code ); }
+};
+
 /**
  * @brief Handle exceptions thrown during metadata modification.
  */
@@ -44,12 +104,29 @@ class Miscue: public std::exception {
 
   /** @brief message that describes the error */
   std::string _msg{};
+  /** @brief reason for failure */
+  MiscueCode _code{MiscueCode::Other};
 public:
   /**
   @param msg error message
   */
   Miscue( const std::string &msg ) : _msg{"NFIMM Exception: " + msg} {}
 
+  /**
+  @param code reason for failure
+  @param msg error message
+  */
+  Miscue( const MiscueCode code, const std::string &msg )
+    : _msg{"NFIMM Exception: " + msg}, _code{code} {}
+
+  /**
+  @param st failed status
+  */
+  explicit Miscue( const Status &st )
+    : _msg{std::string{"NFIMM Exception: "} + st.what() + " at byte " +
+           std::to_string( st.offset )},
+      _code{st.code} {}
+
   /**
   @return text of the error message
   */
@@ -57,6 +134,14 @@ public:
   {
     return _msg.c_str();
   }
+
+  /**
+  @return reason for failure
+  */
+  MiscueCode code() const noexcept
+  {
+    return _code;
+  }
 };
 
 }   // End namespace
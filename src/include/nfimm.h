@@ -1,2 +1,16 @@
+#include "hash.h"
+#include "output_sink.h"
+#include "probe.h"
+#include "registry.h"
+#ifndef _WIN32
+  #include "batch.h"
+  #include "corpus_index.h"
+  #include "server.h"
+#endif
+#include "an2k/an2k.h"
 #include "bmp/bmp.h"
+#include "jp2/jp2.h"
+#include "jpeg/jpeg.h"
 #include "png/png.h"
+#include "tiff/tiff.h"
+#include "wsq/wsq.h"
@@ -0,0 +1,108 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+/*
+ * C interface of NFIMM.
+ *
+ * Source and destination images are caller memory; NFIMM neither allocates
+ * nor frees them.  A batch is processed on an internal thread pool and its
+ * results are written to a caller array, one per job, in job order.  Every
+ * struct is plain data and every function is safe to call from any thread.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Reason for a failed job, same values as NFIMM::MiscueCode */
+enum nfimm_code {
+  NFIMM_OK = 0,                 /**< no error */
+  NFIMM_INVALID_PARAMETER = 1,  /**< parameters, arguments, or destination too small */
+  NFIMM_TRUNCATED = 2,          /**< source image ends inside a header */
+  NFIMM_INVALID_SIGNATURE = 3,  /**< not the declared or any known format */
+  NFIMM_INVALID_HEADER = 4,     /**< header present but malformed */
+  NFIMM_INVALID_CHUNK = 5,      /**< PNG chunk unknown or malformed */
+  NFIMM_SIZE_MISMATCH = 6,      /**< header sizes disagree */
+  NFIMM_UNSUPPORTED = 7,        /**< valid image, variant not supported */
+  NFIMM_IO = 8,                 /**< read or write failed */
+  NFIMM_OTHER = 9               /**< none of the above */
+};
+
+/** @brief Validated, immutable modification parameters; see nfimm_config_create() */
+typedef struct nfimm_config nfimm_config;
+
+/** @brief Modification parameters, copied by nfimm_config_create() */
+typedef struct nfimm_params {
+  const char *compression;   /**< "auto" to detect per image, or png, bmp, jp2, jpeg, tiff, wsq, an2k */
+  uint32_t src_horiz;        /**< source sample rate, 0 if unknown */
+  uint32_t src_vert;         /**< source sample rate, 0 if unknown */
+  const char *src_units;     /**< "inch" or "meter", NULL if unknown */
+  uint32_t dest_horiz;       /**< destination sample rate */
+  uint32_t dest_vert;        /**< destination sample rate */
+  const char *dest_units;    /**< "inch" or "meter" */
+  const char *const *text;   /**< PNG custom text 'keyword:text', may be NULL */
+  size_t text_count;         /**< number of entries in text */
+} nfimm_params;
+
+/** @brief One image: caller-owned source and destination memory */
+typedef struct nfimm_job {
+  const nfimm_config *config;  /**< parameters of this image */
+  const uint8_t *src;          /**< source image, unchanged */
+  size_t src_size;             /**< bytes of the source image */
+  uint8_t *dest;               /**< destination image memory */
+  size_t dest_capacity;        /**< bytes available at dest */
+} nfimm_job;
+
+/** @brief Outcome of one job */
+typedef struct nfimm_result {
+  int32_t code;        /**< nfimm_code */
+  uint32_t reserved;   /**< zero */
+  size_t dest_size;    /**< bytes written; the size needed if dest_capacity was too small */
+  size_t offset;       /**< source byte where a validation failure was found */
+} nfimm_result;
+
+/** @brief Validate and compile the parameters; NFIMM_OK and *out set on success */
+int nfimm_config_create( const nfimm_params *params, nfimm_config **out );
+/** @brief Release a config; no job may still use it */
+void nfimm_config_destroy( nfimm_config *config );
+
+/** @brief Modify one image on the calling thread; returns result->code */
+int nfimm_process( const nfimm_job *job, nfimm_result *result );
+/** @brief Modify N images on the thread pool; returns the number of failed jobs */
+size_t nfimm_process_batch( const nfimm_job *jobs, size_t n, nfimm_result *results );
+
+/** @brief Fixed description of a code, never NULL */
+const char *nfimm_describe( int code );
+
+#ifdef __cplusplus
+}
+#endif
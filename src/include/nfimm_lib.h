@@ -47,12 +47,17 @@ namespace NFIMM {
  * ## Overview
  * This class is used to set the image header metadata in the destination
  * image.  The constructor signature with string param verfies the user-input
- * compression type against those that are supported by NFIMM: bmp and png.
+ * compression type against those that are supported by NFIMM: an2k, bmp, jp2,
+ * jpeg, png, tiff, and wsq.
  *
  * It also contains a "log" container that is updated with runtime info that
  * could be helpful in the event of metadata update failures.  The log is kept
  * here because the metadata parameters are available to the caller.
  *
+ * The parameters are validated and copied into an immutable
+ * ModificationConfig; the log, chunk counts, and source `pHYs` resolution
+ * are copied here from the ModificationResult after each image.
+ *
  * ## Source image sample-rate for PNG
  * The source image resolution/sample-rate metadata is optional unless the image
  * resolution is NOT included in the source image header, and, the text field
@@ -69,7 +74,8 @@ namespace NFIMM {
  */
 class MetadataParameters
 {
-  /** @brief Source image format (hence the destination format): png or bmp */
+  /** @brief Source image format (hence the destination format): png, bmp,
+   * jp2, jpeg, tiff, wsq, or an2k */
   std::string compression{};
 
   public:
@@ -116,8 +122,8 @@ class MetadataParameters
   struct {
     /** @brief Count of chunks in source image header */
     uint32_t countSourceChunks{0};
-    /** @brief Count is incremented when pHYS is missing in source image
-        and for each custom text specified by user */
+    /** @brief Count of `pHYs` and `tEXt` chunks inserted into the most
+        recent destination image */
     uint32_t countInsertChunks{0};
     /** @brief Total of source image chunks plus any chunks to be inserted */
     uint32_t sumChunks()
@@ -147,6 +153,224 @@ class MetadataParameters
 
 std::string printVersion();
 
+class ChunkTemplate;
+
+
+/** @brief Immutable, validated image header metadata modification parameters
+ *
+ * Built once from the caller's MetadataParameters; all members are const.
+ * A single object may be shared by any number of concurrent modifications,
+ * one per thread, and reused for every image of a batch without reset.
+ *
+ * The constructor verifies the parameters and, for PNG, compiles the
+ * pre-encoded metadata chunks (see ChunkTemplate).  Therefore there is no
+ * per-image copy or verification of the parameters.
+ *
+ * Everything that is produced per image (chunk counts, metadata extracted
+ * from the source image, and the runtime log) is returned in the
+ * ModificationResult.
+ */
+class ModificationConfig
+{
+  public:
+
+  /** @brief Image sample rate */
+  struct Resolution {
+    uint32_t horiz{0};       ///< horizontal sample-rate
+    uint32_t vert{0};        ///< vertical sample-rate
+    uint8_t  units{0};       ///< header spec for horiz and vert units
+    std::string unitsStr{};  ///< [ inch | meter | other ]
+  };
+
+  /** @brief Default constructor not used */
+  ModificationConfig() = delete;
+  /** @brief Validate and copy the caller's metadata parameters */
+  explicit ModificationConfig( const MetadataParameters & );
+
+  /** @brief New shared config for the caller's metadata parameters */
+  static std::shared_ptr<const ModificationConfig>
+    fromParameters( const MetadataParameters & );
+  /** @brief Build the cache key for the metadata parameters */
+  static std::string keyFor( const MetadataParameters & );
+  /** @brief Same parameters for an image of another format */
+  std::shared_ptr<const ModificationConfig>
+    withCompression( const std::string & ) const;
+  /** @brief Every parameter as one string, see keyFor() */
+  std::string key() const;
+
+  /** @brief Source image format (hence the destination format) */
+  const std::string compression;
+  /** @brief Source image sample rate, optional */
+  const Resolution srcResolution;
+  /** @brief Destination image sample rate */
+  const Resolution destResolution;
+  /** @brief List of custom comments 'keyword:text' */
+  const std::vector<std::string> textChunk;
+
+  /** @brief Pre-encoded PNG chunks, nullptr for all other formats */
+  std::shared_ptr<const ChunkTemplate> chunkTemplate() const;
+
+  /** @brief Get image sample rate units */
+  std::string get_imgSampleRateUnits( const std::string & ) const;
+
+  /** @brief Get the metadata parameters */
+  std::string to_s() const;
+
+  private:
+  /** @brief The parameters with another compression */
+  MetadataParameters toParameters( const std::string & ) const;
+  /** @brief Compiled by the constructor for PNG */
+  std::shared_ptr<const ChunkTemplate> _chunkTemplate{};
+};   // END class ModificationConfig
+
+
+/** @brief Per-image result of image header metadata modification
+ *
+ * A new result is started for each call of NFIMM::modify().
+ */
+struct ModificationResult
+{
+  /** @brief Runtime log updated by NFIMM, init empty */
+  std::vector<std::string> log{};
+  /** @brief Set false to keep no log; callers then build no log strings */
+  bool logging{true};
+  /** @brief Function to push to log */
+  void loggit( const std::string & );
+  /** @brief Function to push a literal to log, copied only when logging */
+  void loggit( const char * );
+  /** @brief Start the result of a new image, logging is kept */
+  void restart();
+
+  /** @brief Metadata extracted from the source image header */
+  struct {
+    uint32_t width{0};    ///< in pixels
+    uint32_t height{0};   ///< in pixels
+    uint16_t bitDepth{0}; ///< PNG, JPEG, TIFF bits per sample, BMP bits per pixel
+    /** @brief Set when the source image header contains a sample rate */
+    bool resolutionExists{false};
+    /** @brief Source image sample rate as found in its header */
+    struct {
+      uint32_t horiz{0};  ///< horizontal sample-rate
+      uint32_t vert{0};   ///< vertical sample-rate
+      uint8_t  units{0};  ///< header spec for horiz and vert units
+    } resolution;
+    uint32_t existingPhysResolution{0};  ///< for PNG pHYs chunk in src image
+  } srcImg;
+
+  struct {
+    /** @brief Count of chunks in source image header */
+    uint32_t countSourceChunks{0};
+    /** @brief Count of `pHYs` and `tEXt` chunks inserted */
+    uint32_t countInsertChunks{0};
+    /** @brief Total of source image chunks plus any chunks to be inserted */
+    uint32_t sumChunks() const
+    {
+      return countSourceChunks + countInsertChunks;
+    }
+  } pngWriteImageInfo;
+};   // END struct ModificationResult
+
+class OutputSink;
+class FdSink;
+struct ImageProbe;
+
+/** @brief Destination image as an ordered list of byte ranges
+ *
+ * Each segment is either a range of the source image or a set of new bytes
+ * owned by the list.  Adjacent source ranges, and adjacent new bytes, are
+ * merged so the list is as short as the layout of the destination allows.
+ * The destination image is never assembled unless copyTo() is called.
+ *
+ * The source image must remain valid and unchanged for as long as the
+ * segments are used.
+ */
+class SegmentList
+{
+public:
+  /** @brief One contiguous range of the destination image */
+  struct Segment
+  {
+    size_t srcOffset{0};           ///< offset in source image, if fromSource()
+    size_t length{0};              ///< number of bytes
+    std::vector<uint8_t> bytes{};  ///< new bytes, empty if fromSource()
+
+    /** @brief True if the bytes are read from the source image */
+    bool fromSource() const { return bytes.empty(); }
+  };
+
+  /** @brief Empty list, see reset() */
+  SegmentList() = default;
+
+  /** @brief Clear all segments and set the source image */
+  void reset( const uint8_t *, const size_t );
+  /** @brief Append a range of the source image */
+  void addSource( const size_t, const size_t );
+  /** @brief Append new bytes */
+  void addBytes( const uint8_t *, const size_t );
+
+  /** @brief All segments in destination order */
+  const std::vector<Segment> &segments() const { return _segments; }
+  /** @brief First byte of segment, in the source image or in the list */
+  const uint8_t *data( const Segment & ) const;
+  /** @brief Number of bytes of the destination image */
+  size_t size() const { return _size; }
+
+  /** @brief Assemble the destination image in caller's memory */
+  size_t copyTo( uint8_t * ) const;
+  /** @brief Write each segment in order to the sink */
+  size_t writeTo( OutputSink & ) const;
+  /** @brief Each segment on its own line, useful for debug */
+  std::string to_s() const;
+
+private:
+  const uint8_t *_source{nullptr};   ///< source image
+  size_t _sourceSize{0};             ///< bytes in source image
+  std::vector<Segment> _segments{};
+  size_t _size{0};
+};   // END class SegmentList
+
+/** @brief Destination image size, header edits, and segments, known before
+ * any destination bytes are produced
+ *
+ * Returned by NFIMM::plan() and consumed by NFIMM::execute().
+ */
+struct ModificationPlan
+{
+  /** @brief What happens to one element of the source image */
+  enum class Action { Keep, Update, Insert };
+
+  /** @brief One element of the destination image, in write order */
+  struct Edit
+  {
+    Action action{Action::Keep};  ///< copied, rewritten, or new
+    std::string element{};        ///< header, chunk type, or image data
+    size_t size{0};               ///< number of bytes in destination image
+  };
+
+  /** @brief Exact number of bytes of the destination image */
+  size_t outputSize{0};
+  /** @brief All elements of the destination image in write order; repeated
+   * elements that are kept, e.g. PNG `IDAT`, are one edit */
+  std::vector<Edit> edits{};
+  /** @brief The destination image as source ranges and new bytes */
+  SegmentList segments{};
+
+  /** @brief Append an element copied unchanged from the source image */
+  void keep( const std::string &, const size_t, const size_t );
+  /** @brief Append an element rewritten from the source image */
+  void update( const std::string &, const uint8_t *, const size_t );
+  /** @brief Append an element that is not in the source image */
+  void insert( const std::string &, const uint8_t *, const size_t );
+  /** @brief Append the plan of an image embedded at a source offset */
+  void append( const ModificationPlan &, const size_t, const std::string & );
+  /** @brief Each edit on its own line, useful for debug */
+  std::string to_s() const;
+
+private:
+  /** @brief Append an edit, merge with previous if same kept element */
+  void addEdit( const Action, const std::string &, const size_t );
+};   // END struct ModificationPlan
+
 /** @brief The NIST Fingerprint Image Metadata Modification (NFIMM) library API
  * 
  * PURPOSE:
@@ -154,7 +378,7 @@ std::string printVersion();
  *   image metadata while maintaining image-data integrity.
  * 
  * The following metadata are supported:
- * - image resolution (BMP and PNG)
+ * - image resolution (BMP, JP2, JPEG, PNG, TIFF, WSQ, and ANSI/NIST-ITL)
  * - custom text (automated or specified by user, PNG only)
  * 
  * TERMINOLOGY:
@@ -165,14 +389,18 @@ std::string printVersion();
  * 
  * HOW TO USE:
  * - The caller instantiates this class using the constructor that takes the
- *   API struct (object) that contains all metadata required to be changed.
+ *   API struct (object) that contains all metadata required to be changed,
+ *   or, for batches and concurrent use, the ModificationConfig built once
+ *   from that struct.  HandlerRegistry creates the handler of an image from
+ *   its signature bytes.
  * - Metadata that is capable of being extracted from the source image is passed
  *   unchanged during the update process (to the destination file).
  * - Metadata specific by the caller (e.g. sample-rate and comments) are added
  *   to the appropriate image header location.
  * 
  * API struct (object):
- * - compression image formats supported: PNG, BMP
+ * - compression image formats supported: PNG, BMP, JP2, JPEG, TIFF, WSQ;
+ *   and ANSI/NIST-ITL transactions of these
  * - metadata parameters:
  *   - source image resolution (horizontal and vertical, optional)
  *   - dest image resolution (horizontal and vertical)
@@ -181,18 +409,41 @@ std::string printVersion();
 class NFIMM
 {
 public:
-  /** @brief Container for entire source input image */
-  static inline std::vector<uint8_t> s_readBuffer;
+  // The image buffers are per thread; each thread may run its own
+  // modification concurrently.
+
+  /** @brief Owned storage for the source image, when read from file or moved
+   * in; empty when the caller's bytes are borrowed */
+  static inline thread_local std::vector<uint8_t> s_readBuffer;
+  /** @brief First byte of the source image, owned or borrowed */
+  static inline thread_local const uint8_t *s_readData{nullptr};
+  /** @brief Number of bytes of the source image */
+  static inline thread_local size_t s_readSize{0};
   /** @brief Current offset/index into source image buffer for READ */
-  static inline int s_r_cursor;
+  static inline thread_local int s_r_cursor;
+  /** @brief The read-buffer holds only the headers of a streamed source
+   * image, see streamHeadLength(); the rest of the image follows unread */
+  static inline thread_local bool s_readPartial{false};
+
+  /** @brief streamHeadLength() of a format that reads the whole image */
+  static constexpr size_t STREAM_WHOLE_IMAGE{ static_cast<size_t>( -1 ) };
 
   /** @brief Container for entire destination output image */
-  static inline std::vector<uint8_t> s_writeBuffer;
+  static inline thread_local std::vector<uint8_t> s_writeBuffer;
   /** @brief Current offset/index into source image buffer for WRITE */
-  static inline int s_w_cursor;
+  static inline thread_local int s_w_cursor;
 
-  /** @brief Image header info passed-by and runtime log returned-to caller */
+  /** @brief Image header info passed-by and runtime log returned-to caller,
+   * nullptr when constructed with ModificationConfig */
   std::shared_ptr<MetadataParameters> _params;
+  /** @brief Validated modification parameters, shared and never modified */
+  std::shared_ptr<const ModificationConfig> _config;
+  /** @brief Counts, source image metadata, and runtime log of modify() */
+  ModificationResult _result;
+  /** @brief Source image PATH for PNG Creation Time from file timestamp */
+  std::string _srcPath{};
+  /** @brief The caller set _srcPath for the next image read */
+  bool _srcPathSet{false};
 
 public:
   /** @brief Helper function express a series of four bytes to a uint32 value */
@@ -206,23 +457,74 @@ public:
 
   /** @brief Full constructor with all accessible metadata members defined */
   NFIMM( std::shared_ptr<MetadataParameters> & );
+  /** @brief Constructor with validated parameters shared by all images */
+  NFIMM( std::shared_ptr<const ModificationConfig> );
 
   /** @brief Opens and reads the entire source image file into memory */
   void readImageFileIntoBuffer( const std::string & );
-  /** @brief Loads the entire source image bytes into vector */
-  void readImageFileIntoBuffer( const std::vector<uint8_t> );
-  /** @brief Loads the destination image buffer into vector */
+  /** @brief Copies the entire source image bytes into the read-buffer */
+  void readImageFileIntoBuffer( const std::vector<uint8_t> & );
+  /** @brief Moves the entire source image bytes into the read-buffer */
+  void readImageFileIntoBuffer( std::vector<uint8_t> && );
+  /** @brief Reads the source image in place from the caller's memory */
+  void readImageFileIntoBuffer( const uint8_t *, const size_t );
+  /** @brief Source image PATH of the next image, e.g. for PNG Creation Time */
+  void setSourcePath( const std::string &path ) {
+    _srcPath = path;
+    _srcPathSet = true;
+  }
+  /** @brief Keep the runtime log of every image, on by default */
+  void setLogging( const bool on ) { _result.logging = on; }
+  /** @brief Moves the destination image buffer into vector */
   void retrieveWriteImageBuffer( std::vector<uint8_t> & );
+  /** @brief Copies the destination image into caller's memory */
+  size_t retrieveWriteImageBuffer( uint8_t *, const size_t );
+  /** @brief Moves out the destination image buffer */
+  std::vector<uint8_t> releaseWriteImageBuffer();
+  /** @brief Number of bytes of the destination image */
+  static size_t writeImageSize() { return s_writeBuffer.size(); }
   /** @brief Write destination image buffer to file */
   void writeImageBufferToFile( const std::string & );
 
-  /** @brief Modify the headers according to source image format
-   * Empty implementation required for linking. */
-  virtual void modify() {};
+  /** @brief Modify the headers according to source image format */
+  void modify();
+  /** @brief Modify the headers, the destination image as segments */
+  void modify( SegmentList & );
+  /** @brief Modify the headers, stream the destination image to sink */
+  size_t modify( OutputSink & );
+  /** @brief Modify the headers, write only the changed bytes into the file */
+  size_t modifyInPlace( const std::string & );
+  /** @brief Modify the image read from a descriptor, write it to a descriptor */
+  size_t modifyStream( const int, const int, std::vector<uint8_t> && = {} );
+  /** @brief Parse the source headers and compute the destination image */
+  const ModificationPlan &plan();
+  /** @brief Write the planned destination image into caller's memory */
+  size_t execute( const ModificationPlan &, uint8_t *, const size_t );
+
+  // No-throw API: malformed source images are reported without exceptions.
+  /** @brief Check the structure of the source image */
+  Status validate() const noexcept;
+  /** @brief True if the source image already has the parameters; no-throw */
+  bool isCurrent() noexcept;
+  /** @brief Read the header metadata of the source image; no-throw */
+  Status probe( ImageProbe & ) noexcept;
+  /** @brief No-throw modify() into the write-buffer */
+  Status tryModify() noexcept;
+  /** @brief No-throw modify() returning the segments */
+  Status tryModify( SegmentList & ) noexcept;
+  /** @brief No-throw modify() streaming to the sink */
+  Status tryModify( OutputSink & ) noexcept;
+  /** @brief Plan and write into caller's memory; no-throw, see execute() */
+  Status tryModify( uint8_t *, const size_t, size_t & ) noexcept;
+  /** @brief Result of the most recent modify() */
+  const ModificationResult &result() const { return _result; }
 
   /** @brief Helper function express a uint32 value as a series of four bytes */
   static void expressUINT32AsFourBytes( const size_t, uint8_t[], const bool );
 
+  /** @brief Helper function read from a descriptor, short only at end */
+  static size_t readDescriptor( const int, uint8_t *, const size_t );
+
   /** @brief Helper function get next 4 bytes in buffer */
   static void next4bytes( uint8_t [] );
   /** @brief Helper function get next number of bytes in buffer */
@@ -238,6 +540,42 @@ public:
   static void convertPPMMtoPPI( const uint32_t, uint32_t & );
   /** @brief Helper function convert pixels per inch to pixels per millimeter */
   static void convertPPItoPPMM( const uint32_t, uint32_t & );
+
+protected:
+  /** @brief Format-specific structure check of the source image, called by
+   * validate().  Must not throw or allocate. */
+  virtual Status validateImage() const noexcept { return Status{}; }
+  /** @brief Format-specific isCurrent() of a source image; the default
+   * plans the image and compares the plan with the source */
+  virtual bool isCurrentImage() noexcept;
+  /** @brief Format-specific probe() of a source image; the default plans
+   * the image and reports what its handler extracted */
+  virtual Status probeImage( ImageProbe & );
+  /** @brief Format-specific parse and update of the source headers, and
+   * the layout of the destination image, called by plan().
+   * Empty implementation required for linking. */
+  virtual void planImage( ModificationPlan & ) {};
+  /** @brief Format-specific streaming, called by modifyStream().  The
+   * default reads the headers, see streamHeadLength(), writes their plan,
+   * and passes the rest of the source image through. */
+  virtual size_t streamImage( const int, FdSink &, std::vector<uint8_t> & );
+  /** @brief Bytes of a streamed source image that plan() needs, 0 if more
+   * bytes are needed to tell; the default is STREAM_WHOLE_IMAGE */
+  virtual size_t streamHeadLength( const uint8_t *, const size_t ) const noexcept
+    { return STREAM_WHOLE_IMAGE; }
+
+private:
+  /** @brief Plan of the most recent plan() */
+  ModificationPlan _plan{};
+  /** @brief Number of result log entries already copied to the caller */
+  size_t _publishedLogCount{0};
+
+  /** @brief plan() of a source image that passed validate() */
+  const ModificationPlan &planValidated();
+  /** @brief Validate, then run the planned action; no-throw */
+  template<typename Action> Status guard( Action && ) noexcept;
+  /** @brief Copy the result to the caller's MetadataParameters, if any */
+  void publishResult();
 };   // END class NFIMM
 
 }   // END namespace
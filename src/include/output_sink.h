@@ -0,0 +1,171 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+#include "nfimm_lib.h"
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+
+namespace NFIMM {
+
+/** @brief Destination for the bytes of the destination image
+ *
+ * The destination image is written in order, one segment at a time, as it
+ * is produced; see NFIMM::modify( OutputSink & ).  Bytes of the source image
+ * are passed by pointer into the source and are never buffered by NFIMM.
+ * The largest new-bytes segment is the set of inserted chunks.
+ */
+class OutputSink
+{
+public:
+  /** @brief Does nothing */
+  virtual ~OutputSink() {}
+
+  /** @brief Write the next LEN bytes of the destination image */
+  virtual void write( const uint8_t *, const size_t ) = 0;
+  /** @brief Called once after the last write; flush and close as needed */
+  virtual void finish() {}
+};   // END class OutputSink
+
+
+/** @brief Write to an open file descriptor: file, pipe, or socket
+ *
+ * Partial writes and interrupted writes are retried.  The descriptor is not
+ * closed.  When writing to a pipe or socket, the caller should ignore
+ * SIGPIPE so that a reader that exits early is reported as a Miscue.
+ */
+class FdSink : public OutputSink
+{
+public:
+  /** @brief Default constructor not used */
+  FdSink() = delete;
+  /** @brief Write to open descriptor */
+  explicit FdSink( const int fd ) : _fd(fd) {}
+
+  /** @brief Write all bytes to the descriptor */
+  void write( const uint8_t *, const size_t ) override;
+  /** @brief Write the rest of an input descriptor, in the kernel if possible */
+  size_t copyFrom( const int );
+
+private:
+  int _fd;  ///< open for write by caller
+};   // END class FdSink
+
+
+/** @brief Write to a file by PATH
+ *
+ * The file is created or truncated by the first write, so a modification
+ * that fails before any output leaves an existing file untouched.
+ */
+class FileSink : public OutputSink
+{
+public:
+  /** @brief Default constructor not used */
+  FileSink() = delete;
+  /** @brief File is opened by first write */
+  explicit FileSink( const std::string &path ) : _path(path) {}
+
+  /** @brief Append bytes to the file */
+  void write( const uint8_t *, const size_t ) override;
+  /** @brief Close the file */
+  void finish() override;
+
+private:
+  std::string _path;     ///< destination image
+  std::ofstream _strm;   ///< binary output
+};   // END class FileSink
+
+
+/** @brief Write to the standard input of a command, see popen(3)
+ *
+ * As for FdSink, the caller should ignore SIGPIPE.
+ */
+class PipeSink : public OutputSink
+{
+public:
+  /** @brief Default constructor not used */
+  PipeSink() = delete;
+  /** @brief Start the command */
+  explicit PipeSink( const std::string & );
+  /** @brief Close the pipe if finish() was not called */
+  ~PipeSink();
+
+  /** @brief Write bytes to the command */
+  void write( const uint8_t *, const size_t ) override;
+  /** @brief Close the pipe and wait for the command */
+  void finish() override;
+
+private:
+  std::string _command;   ///< for error messages
+  FILE *_pipe{nullptr};   ///< open for write
+};   // END class PipeSink
+
+
+/** @brief Append to a vector in memory */
+class MemorySink : public OutputSink
+{
+public:
+  /** @brief Append to the caller's vector */
+  explicit MemorySink( std::vector<uint8_t> &vec ) : _vec(vec) {}
+
+  /** @brief Append bytes to the vector */
+  void write( const uint8_t *data, const size_t len ) override
+  {
+    _vec.insert( _vec.end(), data, data + len );
+  }
+
+private:
+  std::vector<uint8_t> &_vec;  ///< owned by caller
+};   // END class MemorySink
+
+
+/** @brief Pass each segment to the caller's function */
+class CallbackSink : public OutputSink
+{
+public:
+  /** @brief Called with each segment of the destination image, in order */
+  using Callback = std::function<void( const uint8_t *, size_t )>;
+
+  /** @brief Default constructor not used */
+  CallbackSink() = delete;
+  /** @brief Call FN for every write */
+  explicit CallbackSink( Callback fn ) : _fn(std::move(fn)) {}
+
+  /** @brief Pass bytes to the callback */
+  void write( const uint8_t *data, const size_t len ) override
+  {
+    _fn( data, len );
+  }
+
+private:
+  Callback _fn;  ///< caller's function
+};   // END class CallbackSink
+
+}   // END namespace
@@ -27,17 +27,55 @@ identified are necessarily the best available for the purpose.
 *******************************************************************************/
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
 
 namespace CRCforPNG {
 
-/** @brief Build the table for a fast CRC computation */
+/** @brief Table of Cyclic Redundancy Checksums for all 8-bit bytes,
+ * generated at compile time */
+constexpr std::array<uint32_t, 256> makeCRCtable()
+{
+  std::array<uint32_t, 256> table{};
+  for( uint32_t n=0; n<256; n++ )
+  {
+    uint32_t c{n};
+    for( int k=0; k<8; k++ ) {
+      if( c & 1 ) {
+        c = 0xedb88320L ^ ( c >> 1 );
+      }
+      else {
+        c = c >> 1;
+      }
+    }
+    table[n] = c;
+  }
+  return table;
+}
+
+/** @brief Table used by all CRC calculations, compile-time and runtime */
+inline constexpr std::array<uint32_t, 256> s_crcTable{ makeCRCtable() };
+
+/** @brief Calculates the CRC of bytes [first, first+len) at compile time */
+template<size_t N>
+constexpr uint32_t calcConstexpr( const std::array<uint8_t, N> &buf,
+                                  const size_t first, const size_t len )
+{
+  uint32_t c{0xffffffffL};
+  for( size_t n=first; n<first+len; n++ ) {
+    c = s_crcTable[ ( c ^ buf[n] ) & 0xff ] ^ ( c >> 8 );
+  }
+  return c ^ 0xffffffffL;
+}
+
+/** @brief Does nothing, the table is built at compile time */
 void buildCRCtable();
 /** @brief Calculates the CRC with a new string of bytes */
-uint32_t calc( uint8_t *buf, int len );
-/** @brief Check that CRC table exists and build it if needed */
+uint32_t calc( const uint8_t *buf, int len );
+/** @brief Dump the CRC table */
 std::string to_s_CRCtable();
 /** @brief Updates a running CRC with a new string of bytes */
-uint32_t updateCRC( const uint32_t, uint8_t *, int );
+uint32_t updateCRC( const uint32_t, const uint8_t *, int );
 
 }   // END namespace
@@ -30,6 +30,7 @@ identified are necessarily the best available for the purpose.
 #include "nfimm_lib.h"
 #include "png/crc_public_code.h"
 
+#include <array>
 #include <vector>
 
 namespace NFIMM {
@@ -49,7 +50,7 @@ public:
   /** @brief Default constructor not used */
   Signature() = delete;
   /** @brief Constructor used to parse the PNG signature */
-  Signature( std::shared_ptr<MetadataParameters> &, std::vector<uint8_t> & );
+  Signature( ModificationResult &, const uint8_t *, const size_t );
   /** @brief Does nothing */
   ~Signature() {};
 
@@ -63,8 +64,6 @@ public:
         { 0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A };
   /** @brief Receives source-image bytes */
   std::vector<uint8_t> dataBytes;
-
-  /** @brief Image header info passed-by and runtime log returned-to caller */
 };
 
 
@@ -198,12 +197,14 @@ class PNG : public NFIMM {
   static const int NUM_BYTES_CHUNK_TYPE{4};
   static const int NUM_BYTES_CHUNK_CRC{4};
 
-  static size_t _insertChunkIndex;   ///< Maintain index of inserted chunks
+  static thread_local size_t _insertChunkIndex;   ///< Maintain index of inserted chunks
 
   /** @brief Default constructor not used */
   PNG() = delete;
-  /** @brief Overloaded constructor always used */
+  /** @brief Overloaded constructor with caller's metadata parameters */
   PNG( std::shared_ptr<MetadataParameters> & );
+  /** @brief Overloaded constructor with validated, shared parameters */
+  PNG( std::shared_ptr<const ModificationConfig> );
   /** @brief Does nothing */
   ~PNG() {}
 
@@ -217,9 +218,17 @@ class PNG : public NFIMM {
    *    their own chunk-object
    * 2. identify and process the pHYs modification-eligible chunk
    * 3. Determine tEXt custom text insertion
-   * 4. transfer chunks in proper order to the destimation image write-buffer
+   * 4. lay out the chunks of the destination image and calculate its size
    */
-  void modify() override;
+  void planImage( ModificationPlan & ) override;
+  /** @brief Walk signature and chunks, check bounds and chunk types */
+  Status validateImage() const noexcept override;
+  /** @brief pHYs as planned and NFIMM Software present, ahead of first IDAT */
+  bool isCurrentImage() noexcept override;
+  /** @brief Read IHDR, pHYs, and tEXt ahead of the first IDAT in place */
+  Status probeImage( ImageProbe & ) override;
+  /** @brief Read and plan the chunks ahead of the first IDAT, pass the rest */
+  size_t streamImage( const int, FdSink &, std::vector<uint8_t> & ) override;
 
   /** @brief Parse all chunks in source image including the image bytes */
   void parseAllChunks( int = 8 );
@@ -235,8 +244,8 @@ class PNG : public NFIMM {
   void insertCustomText();
 
   // Functions to build and write PNG image.
-  /** @brief Transfer chunks from source to destination buffer */
-  void xferChunks();
+  /** @brief Lay out chunks of destination image and calculate its size */
+  void orderChunks( ModificationPlan & );
   // unsigned long crc( unsigned char *, int );
   /** @brief Transfer all bytes from source to destination buffer */
   void xferBytesBetweenBuffers( std::vector<uint8_t>&,
@@ -249,9 +258,18 @@ class PNG : public NFIMM {
   /** @brief Container for PNG chunk and the 4-parts:
    *  length, type, data, and CRC. */
   struct ChunkLayout {
+    ChunkLayout() = default;
+    /** @brief Chunk owns its buffers, not copyable */
+    ChunkLayout( const ChunkLayout & ) = delete;
+    ChunkLayout &operator=( const ChunkLayout & ) = delete;
+    /** @brief Deletes the whole chunk and data buffers */
+    ~ChunkLayout() { delete [] wholeChunkBuffer; delete [] dataBuffer; }
+
     /** @brief Pointer to the whole chunk (all 4-parts)
-     *  Deleted after xfer to write-buffer, see PNG::xferChunks(). */
-    uint8_t *wholeChunkBuffer;
+     *  nullptr for IDAT, which is only referenced in the source image */
+    uint8_t *wholeChunkBuffer{nullptr};
+    /** @brief Offset of the chunk in the source image, if sourced */
+    size_t srcOffset{0};
 
     /** @brief Convert the entire chunk's buffer bytes to single vector */
     std::vector<uint8_t> wholeChunk();
@@ -268,7 +286,7 @@ class PNG : public NFIMM {
     /** @brief Convert the type-bytes to single string */
     std::string type();
 
-    uint8_t *dataBuffer;  ///< Pointer to the chunk data
+    uint8_t *dataBuffer{nullptr};  ///< Pointer to the chunk data, see above
     /** @brief Convert the data buffer bytes to single string; useful for debug */
     std::string data();
 
@@ -283,13 +301,13 @@ class PNG : public NFIMM {
   /** @brief Container for pointers to chunks parsed from source image. */
   std::vector<std::shared_ptr<ChunkLayout>> _srcChunkPointers;
   /** @brief Container for pointers to chunks inserted into destination image. */
-  static std::vector<std::shared_ptr<ChunkLayout>> s_insertChunkPointers;
+  static thread_local std::vector<std::shared_ptr<ChunkLayout>> s_insertChunkPointers;
 
   /** @brief Set to true if `pHYs` chunk exists in source image header */
-  static inline bool s_pHYsChunkExists{false};
+  static inline thread_local bool s_pHYsChunkExists{false};
  
   /** @brief Supports parsing of each byte in the buffer */
-  static inline uint8_t s_oneByte{0};
+  static inline thread_local uint8_t s_oneByte{0};
   /** @brief Current offset/index into destination image buffer for WRITE */
   int _w_cursor{0};
 
@@ -367,16 +385,13 @@ class IhdrX {
   /** @brief Default constructor not used */
   IhdrX() = delete;
   /** @brief Constructor used to parse chunk */
-  IhdrX( std::shared_ptr<MetadataParameters> &, std::shared_ptr<PNG::ChunkLayout> & );
+  IhdrX( ModificationResult &, std::shared_ptr<PNG::ChunkLayout> & );
   /** @brief Does nothing */
   ~IhdrX() {}
 
   /* @brief Index into the `_srcChunkPointers` vector */
   // uint32_t _idx{0};
 
-  /* @brief Image header info passed-by and runtime log returned-to caller  */
-  // std::shared_ptr<MetadataParameters> _params;
-
   protected:
 
   /** @brief Container for image width and height */
@@ -460,6 +475,10 @@ class IhdrX {
  *
  * Build the DATA based on the image resolution value specified by the user.
  * The horizontal and vertical resolutions are identical.
+ *
+ * Whole chunks for the standard fingerprint sample rates, 500, 1000, and
+ * 2000 PPI (19685, 39370, and 78740 pixels per meter), are generated at
+ * compile time, CRC included.  All other sample rates are built at runtime.
  */ 
 class Phys {
 
@@ -472,11 +491,17 @@ class Phys {
   /** @brief Default constructor not used */
   Phys() = delete;
   /** @brief Support to insert-new or update-existing chunk */
-  Phys( std::shared_ptr<MetadataParameters> &,
+  Phys( const ModificationConfig &, ModificationResult &,
         std::shared_ptr<PNG::ChunkLayout> & );
   /** @brief Does nothing */
   ~Phys() {}
 
+  /** @brief Whole `pHYs` chunk from LEN to CRC inclusive */
+  using WholeChunk = std::array<uint8_t, NUM_BYTES_CHUNK_PHYS_TOTAL>;
+
+  /** @brief Whole chunk for the destination sample rate and units */
+  static WholeChunk buildChunk( const uint32_t, const std::string & );
+
   /** @brief Insert `pHYs` chunk since does not exist in source image header */
   void insertChunk();
   /** @brief Parse `pHYs` chunk if exists in source image header */
@@ -485,8 +510,10 @@ class Phys {
    * to destination image header */
   void updateChunk();
 
-  /** @brief Image header info passed-by and runtime log returned-to caller */
-  std::shared_ptr<MetadataParameters> _params;
+  /** @brief Validated modification parameters */
+  const ModificationConfig &_config;
+  /** @brief Counts, source image metadata, and runtime log */
+  ModificationResult &_result;
 
   /** @brief Index into the `_srcChunkPointers` vector */
   uint32_t _idx{0};
@@ -558,7 +585,7 @@ private:
  * invalid comment-keyword is ignored.  Ignored keywords are dumped to log file.
  *
  * The Comment chunk describes resampling from/to rates, e.g., "1000 to 500 PPI".
- * The sample rates are taken from the MetadataParameters to build the string
+ * The sample rates are taken from the ModificationConfig to build the string
  * (of bytes) for the chunk.
  *
  * Example chunk that is built:
@@ -578,7 +605,7 @@ class Text {
   /** @brief Default constructor not used */
   Text() = delete;
   /** @brief Overloaded constructor always used */
-  Text( std::shared_ptr<MetadataParameters> & );
+  Text( const ModificationConfig &, ModificationResult &, const std::string & );
   /** @brief Does nothing */
   ~Text() {}
 
@@ -612,12 +639,17 @@ class Text {
   /** @brief Insert `tEXt` key:value pairs into destination image metadata */
   void insertChunks();
 
-  /** @brief Image header info passed-by and runtime log returned-to caller  */
-  std::shared_ptr<MetadataParameters> _params;
+  /** @brief Validated modification parameters */
+  const ModificationConfig &_config;
+  /** @brief Counts, source image metadata, and runtime log */
+  ModificationResult &_result;
+  /** @brief Source image PATH for Creation Time "file" */
+  const std::string &_srcPath;
+
   /** @brief Get date/time for file last modified */
-  void getFiletime( const std::string &, UTCtime * );
+  static void getFiletime( const std::string &, UTCtime * );
   /** @brief Get date/time from computer clock */
-  void getUTCtime( UTCtime * );
+  static void getUTCtime( UTCtime * );
 
   /** @brief Predefined keywords for chunk `tEXt`
    *
@@ -627,7 +659,7 @@ class Text {
    * number of text chunks can appear, and more than one with the same keyword
    * is permissible.
    */
-  std::vector<std::string> _textKeywords {
+  static inline const std::vector<std::string> _textKeywords {
     "Title",
     "Author",
     "Description",
@@ -643,4 +675,91 @@ class Text {
 };   // END class Text
 
 
+/** @brief Pre-encoded metadata chunks for one set of modification parameters
+ *
+ * Within a batch the destination sample rate, units, and custom text are
+ * the same for every image.  Rather than tokenize each `keyword:text` string,
+ * verify its keyword, and calculate the CRC for every image, the complete
+ * chunks (LEN, type, data, and CRC) are built once per parameter set and
+ * copied into each destination image.
+ *
+ * Only the per-image fields are patched:
+ * - Comment "NFIMM updated pHYs resolution from X": X is the source image
+ *   `pHYs` resolution
+ * - Creation Time "file": the source image file timestamp
+ *
+ * For both, the running CRC of the fixed chunk prefix is saved so that only
+ * the per-image bytes are run through the CRC calculation.
+ *
+ * Creation Time "now" is read from the computer clock when the template is
+ * compiled and is therefore the same for every image in the batch.
+ *
+ * The template is compiled by the ModificationConfig constructor and is
+ * shared, read-only, by every image modified with that config.
+ */
+class ChunkTemplate {
+
+  public:
+  /** @brief Default constructor not used */
+  ChunkTemplate() = delete;
+  /** @brief Compile all chunks for the modification parameters */
+  explicit ChunkTemplate( const ModificationConfig & );
+  /** @brief Does nothing */
+  ~ChunkTemplate() {}
+
+  /** @brief New chunk-layout object loaded from whole chunk bytes */
+  static std::shared_ptr<PNG::ChunkLayout>
+    toChunkLayout( const std::vector<uint8_t> & );
+
+  /** @brief Build the `tEXt` chunks for insertion into destination image */
+  void buildTextChunks( ModificationResult &, const std::string &,
+                        std::vector<std::shared_ptr<PNG::ChunkLayout>> & ) const;
+  /** @brief True if a Creation Time chunk holds the source file's time */
+  bool usesFileTime() const;
+
+  /** @brief Whole `pHYs` chunk from LEN to CRC inclusive */
+  std::vector<uint8_t> _physChunk{};
+
+  /** @brief One caller-specified `tEXt` chunk */
+  struct TextEntry {
+    /** @brief Whole chunk; for FILE_TIME the last 11 bytes are patched */
+    std::vector<uint8_t> wholeChunk{};
+    /** @brief Set when the chunk holds the source file timestamp */
+    bool isFileTime{false};
+    /** @brief Running CRC of type, keyword, and null-separator */
+    uint32_t prefixCRC{0};
+  };
+  /** @brief Caller-specified `tEXt` chunks in order of the parameters */
+  std::vector<TextEntry> _textEntries{};
+
+  /** @brief Whole Comment chunk when `pHYs` does not exist in source image */
+  std::vector<uint8_t> _commentInserted{};
+  /** @brief Comment text before the source image resolution */
+  std::string _commentUpdatedPrefix{};
+  /** @brief Comment text after the source image resolution */
+  std::string _commentUpdatedSuffix{};
+  /** @brief Running CRC of type, keyword, separator, and text prefix */
+  uint32_t _commentUpdatedPrefixCRC{0};
+
+  /** @brief Whole Software chunk with the NFIMM version */
+  std::vector<uint8_t> _softwareChunk{};
+
+  /** @brief Caller-specified keywords that are not valid, logged per image */
+  std::vector<std::string> _ignoredKeywords{};
+
+private:
+  /** @brief Encode keyword, null-separator, and text into whole chunk */
+  static std::vector<uint8_t> encodeText( const std::string &,
+                                          const std::string & );
+  /** @brief Encode keyword, null-separator, and text without the CRC */
+  static std::vector<uint8_t> encodeBytes( const std::string &,
+                                           const std::string & );
+  /** @brief Encode keyword, null-separator, and UTC time into whole chunk */
+  static std::vector<uint8_t> encodeTime( const std::string &,
+                                          const Text::UTCtime & );
+  /** @brief Calculate and store the CRC of the whole chunk bytes */
+  static void setCRC( std::vector<uint8_t> & );
+};   // END class ChunkTemplate
+
+
 }   // END namespace
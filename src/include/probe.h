@@ -0,0 +1,87 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+#include "miscue.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace NFIMM {
+
+
+/** @brief Header metadata of one source image, see NFIMM::probe()
+ *
+ * Values are as found in the header, in the units of the format: PNG, BMP,
+ * and JP2 sample rates are per meter, the others as given by `units`.
+ * Fields a format does not have are zero or empty.
+ */
+struct ImageProbe
+{
+  std::string path{};        ///< source image PATH, set by the caller
+  std::string format{};      ///< compression, e.g. png
+  Status status{};           ///< Ok, or why the header could not be read
+
+  uint32_t width{0};         ///< in pixels
+  uint32_t height{0};        ///< in pixels
+  uint16_t bitDepth{0};      ///< PNG bits per sample, BMP bits per pixel
+  uint8_t colorType{0};      ///< PNG IHDR color type
+
+  bool resolutionExists{false};  ///< header holds a sample rate
+  uint32_t horiz{0};         ///< horizontal sample rate
+  uint32_t vert{0};          ///< vertical sample rate
+  uint8_t units{0};          ///< header spec for horiz and vert units
+
+  /** @brief Bytes of headers ahead of the image data: PNG first IDAT, BMP
+   * file and DIB headers; zero if not known */
+  uint64_t headerEnd{0};
+  /** @brief Offset of the PNG pHYs chunk or the BMP biXPelsPerMeter, zero
+   * if none */
+  uint64_t resolutionOffset{0};
+  uint32_t dibHeaderSize{0};   ///< BMP DIB header bytes
+  uint32_t compression{0};     ///< BMP biCompression
+
+  uint64_t size{0};             ///< bytes of the source image
+  /** @brief 128-bit hash of the source bytes, if requested; zero if not */
+  std::pair<uint64_t, uint64_t> contentHash{};
+
+  bool nfimmSoftware{false};   ///< PNG Software tEXt written by NFIMM
+  /** @brief PNG tEXt keyword and text, in order; text is Latin-1 */
+  std::vector<std::pair<std::string, std::string>> text{};
+
+  /** @brief Names of the fields of to_csv() */
+  static std::string csvHeader();
+  /** @brief One CSV line, no line end; text as 'keyword=text' joined by ';' */
+  std::string to_csv() const;
+  /** @brief One JSON object on one line, no line end */
+  std::string to_json() const;
+};   // END struct ImageProbe
+
+}   // END namespace
@@ -0,0 +1,184 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+#include "nfimm_lib.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+
+namespace NFIMM {
+
+
+/** @brief Configs of every image format for one set of parameters
+ *
+ * The config of a format is derived from the base config on first use and
+ * then reused, see ModificationConfig::withCompression().  Not thread-safe;
+ * use one per thread or per batch.
+ */
+class FormatConfigs
+{
+public:
+  /** @brief Default constructor not used */
+  FormatConfigs() = delete;
+  /** @brief Derive every config from the base config */
+  explicit FormatConfigs( std::shared_ptr<const ModificationConfig> );
+
+  /** @brief Config of the format, the base config for its own format */
+  std::shared_ptr<const ModificationConfig> get( const std::string & );
+
+private:
+  /** @brief Caller's config */
+  std::shared_ptr<const ModificationConfig> _base;
+  /** @brief Derived configs, by compression */
+  std::map<std::string, std::shared_ptr<const ModificationConfig>> _configs{};
+};   // END class FormatConfigs
+
+
+/** @brief Handlers of a worker, one per format, created on first use
+ *
+ * Every handler is created without logging and reused for every image of
+ * its format.  Not thread-safe; use one per thread.
+ */
+class HandlerCache
+{
+public:
+  /** @brief Handler of the format, created with its config of CONFIGS */
+  NFIMM &get( const std::string &, FormatConfigs & );
+  /** @brief Handler of the format, created with the config */
+  NFIMM &get( const std::string &, std::shared_ptr<const ModificationConfig> );
+
+private:
+  /** @brief Handlers by compression */
+  std::map<std::string, std::unique_ptr<NFIMM>> _handlers{};
+};   // END class HandlerCache
+
+
+/** @brief Source image file mapped read-only, and read in place
+ *
+ * The read-buffer of the calling thread borrows the mapping, see
+ * NFIMM::readImageFileIntoBuffer(); both are released on destruction, the
+ * read-buffer cleared even if nothing was mapped, e.g. when the source is
+ * the caller's memory or was read from a pipe.  Not available on Windows.
+ */
+class MappedSource
+{
+public:
+  /** @brief Nothing mapped */
+  MappedSource() = default;
+  /** @brief Not copyable, owns the mapping */
+  MappedSource( const MappedSource & ) = delete;
+  /** @brief Not copyable, owns the mapping */
+  MappedSource &operator=( const MappedSource & ) = delete;
+  /** @brief Unmap the file, and clear the read-buffer */
+  ~MappedSource();
+
+  /** @brief Map SIZE bytes of the file open on the descriptor */
+  bool map( const int, const size_t ) noexcept;
+
+  /** @brief First byte of the mapped file, nullptr if none */
+  const uint8_t *data() const noexcept { return _data; }
+  /** @brief Number of bytes mapped */
+  size_t size() const noexcept { return _size; }
+
+private:
+  /** @brief Mapped file */
+  const uint8_t *_data{nullptr};
+  /** @brief Bytes of the mapped file */
+  size_t _size{0};
+};   // END class MappedSource
+
+
+/** @brief Image format handlers, selected by the signature of the image
+ *
+ * Every handler is registered with its compression name and the leading
+ * bytes that every image of that format begins with.  A prefix of
+ * PREFIX_SIZE bytes is enough to detect every built-in format, so a batch
+ * of mixed formats is processed in one pass without a format per image:
+ *
+ *   | format | signature                           |
+ *   |--------|-------------------------------------|
+ *   | an2k   | `1.001:` or `1.01:`                 |
+ *   | bmp    | `BM`                                |
+ *   | jp2    | `00 00 00 0C 6A 50 20 20 0D 0A 87 0A` |
+ *   | jpeg   | `FF D8 FF`                          |
+ *   | png    | `89 50 4E 47 0D 0A 1A 0A`           |
+ *   | tiff   | `II*\0`, `MM\0*`, BigTIFF `II+\0`, `MM\0+` |
+ *   | wsq    | `FF A0 FF`                          |
+ *
+ * The longest matching signature wins.  Formats are added with add() before
+ * concurrent use; detect() and create() may then be called from any thread.
+ */
+class HandlerRegistry
+{
+public:
+  /** @brief Builds the handler of a format from a config of that format */
+  using Factory =
+    std::function<std::unique_ptr<NFIMM>( std::shared_ptr<const ModificationConfig> )>;
+
+  /** @brief Number of leading bytes read to detect the format */
+  static constexpr size_t PREFIX_SIZE{16};
+
+  /** @brief Registry of the built-in handlers */
+  static HandlerRegistry &instance();
+
+  /** @brief Register a signature of a format, and its handler */
+  void add( const std::string &, const std::vector<uint8_t> &, Factory );
+
+  /** @brief Format of the image by its leading bytes, "" if unknown */
+  const std::string &detect( const uint8_t *, const size_t ) const noexcept;
+  /** @brief Format of the image file by its leading bytes, "" if unknown */
+  std::string detect( const std::string & ) const;
+  /** @brief True if there is a handler for the format */
+  bool supports( const std::string & ) const;
+  /** @brief Every format with a handler, sorted */
+  std::vector<std::string> formats() const;
+
+  /** @brief Handler for the format of the config */
+  std::unique_ptr<NFIMM> create( std::shared_ptr<const ModificationConfig> ) const;
+  /** @brief Handler for the image, with the config of its detected format */
+  std::unique_ptr<NFIMM> create( const uint8_t *, const size_t, FormatConfigs & ) const;
+
+private:
+  /** @brief Leading bytes of the images of a format */
+  struct Signature {
+    std::string format;            ///< compression
+    std::vector<uint8_t> bytes;    ///< at offset zero
+  };
+
+  /** @brief Built-in handlers only */
+  HandlerRegistry();
+
+  /** @brief Longest first */
+  std::vector<Signature> _signatures{};
+  /** @brief Handlers by compression */
+  std::map<std::string, Factory> _factories{};
+};   // END class HandlerRegistry
+
+}   // END namespace
@@ -0,0 +1,143 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+#include "nfimm_lib.h"
+#include "registry.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace NFIMM {
+
+
+/** @brief Resident modification service on a UNIX domain socket
+ *
+ * Starting a process per image costs far more than the header edit; the
+ * server is started once and its workers keep their configs, handlers,
+ * and buffers for every request.
+ *
+ * Image bytes never cross the socket.  A request is a Request message with
+ * two descriptors attached (SCM_RIGHTS): the source image, then the
+ * destination.  Either may be a file or a memfd; the source may also be a
+ * pipe.  A regular source is memory-mapped and read in place.  A regular
+ * destination is written from offset zero and truncated to the destination
+ * size; any other descriptor is written in order.  The descriptors are
+ * closed by the server after the Reply is sent.
+ *
+ * A connection may send any number of requests, one at a time.  Each worker
+ * serves one connection at a time; further clients wait in the listen
+ * backlog.
+ *
+ * The sample rate and custom text are those of the server's config; the
+ * format of each image is detected from its signature, see HandlerRegistry,
+ * unless the server is started for one format.
+ */
+class Server
+{
+public:
+  /** @brief First field of every request, 'NFIM' */
+  static constexpr uint32_t MAGIC{0x4E46494D};
+  /** @brief Protocol version of Request */
+  static constexpr uint32_t VERSION{1};
+
+  /** @brief Fixed-size request, sent with the two descriptors */
+  struct Request {
+    uint32_t magic{MAGIC};      ///< always MAGIC
+    uint32_t version{VERSION};  ///< always VERSION
+  };
+
+  /** @brief Fixed-size reply to every request */
+  struct Reply {
+    int32_t code{0};       ///< MiscueCode, 0 for Ok
+    uint32_t reserved{0};  ///< zero
+    uint64_t size{0};      ///< bytes of the destination image written
+    uint64_t offset{0};    ///< source byte where a validation failure was found
+  };
+
+  /** @brief Default constructor not used */
+  Server() = delete;
+  /** @brief Bind and listen on the socket PATH */
+  Server( std::shared_ptr<const ModificationConfig>, const std::string &,
+          const unsigned, const bool );
+  /** @brief Stop, wait for the workers, and remove the socket */
+  ~Server();
+
+  /** @brief Serve until stop(); called once */
+  void run();
+  /** @brief Wake every worker and make run() return; async-signal-safe */
+  void stop() noexcept;
+
+private:
+  /** @brief Configs and handlers of one worker, reused for every request */
+  struct Worker;
+
+  /** @brief Accept and serve connections until stopped */
+  void work( const unsigned );
+  /** @brief Serve the requests of one connection until it is closed */
+  void serve( Worker &, const int );
+  /** @brief Modify the source descriptor into the destination */
+  Reply modify( Worker &, const int, const int );
+
+  std::shared_ptr<const ModificationConfig> _config;  ///< base config
+  std::string _path;          ///< socket file, removed by destructor
+  bool _detect;               ///< format from signature, else config's
+  int _listenFd{-1};          ///< bound and listening
+  std::atomic<bool> _stopping{false};
+  /** @brief Connection of each worker, -1 if none; shut down by stop() */
+  std::unique_ptr<std::atomic<int>[]> _connections;
+  std::vector<std::thread> _threads{};
+  unsigned _workers;
+};   // END class Server
+
+
+/** @brief Client of the Server, one connection
+ *
+ * Not thread-safe; use one client per thread.
+ */
+class ServeClient
+{
+public:
+  /** @brief Default constructor not used */
+  ServeClient() = delete;
+  /** @brief Connect to the server's socket PATH */
+  explicit ServeClient( const std::string & );
+  /** @brief Close the connection */
+  ~ServeClient();
+  ServeClient( const ServeClient & ) = delete;
+  ServeClient &operator=( const ServeClient & ) = delete;
+
+  /** @brief Modify the source descriptor into the destination descriptor */
+  Server::Reply modify( const int, const int );
+
+private:
+  int _fd{-1};  ///< connected socket
+};   // END class ServeClient
+
+}   // END namespace
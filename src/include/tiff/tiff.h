@@ -0,0 +1,179 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+#include "nfimm_lib.h"
+
+namespace NFIMM {
+
+
+/** @brief Support for operations on images in TIFF and BigTIFF format
+ *
+ * A TIFF file begins with an 8-byte header (16 bytes for BigTIFF): the byte
+ * order `II` little-endian or `MM` big-endian, the version 42 (43 for
+ * BigTIFF), and the offset of the first IFD (image file directory).  Each
+ * IFD is one page; it holds a count of entries, the entries sorted by tag,
+ * and the offset of the next IFD, 0 for the last page.
+ *
+ * Field            | TIFF     | BigTIFF
+ * -----------------|----------|---------
+ * entry count      | 2 bytes  | 8 bytes
+ * entry            | 12 bytes | 20 bytes
+ * value or offset  | 4 bytes  | 8 bytes
+ * next IFD offset  | 4 bytes  | 8 bytes
+ *
+ * Each entry is tag, type, count of values, and the value itself when it
+ * fits in the value field, otherwise the offset of the value.
+ *
+ * The sample rate of each page is in the tags:
+ *   * XResolution 0x011A, RATIONAL, count 1
+ *   * YResolution 0x011B, RATIONAL, count 1
+ *   * ResolutionUnit 0x0128, SHORT, count 1: 1 none, 2 inch, 3 centimeter
+ *
+ * ## Modifier Implementation Notes
+ * The IFD chain is walked and the tags of every page are updated; strip and
+ * tile data are never read or moved.
+ *
+ * - When the three tags of a page are present as above, their values are
+ *   patched in place.  A BigTIFF RATIONAL fits in its value field.
+ * - Otherwise the IFD of the page is rewritten, with the tags, after the
+ *   end of the source image; the offset that pointed to the old IFD (in
+ *   the header or in the previous IFD) points to the new one.  Every other
+ *   offset is unchanged because no source byte is moved.
+ *
+ * The work is proportional to the number of pages, not the size of the
+ * file; see NFIMM::modifyInPlace() to patch a file without copying it.
+ *
+ * Destination units follow the sample-rate units: "inch" is per inch,
+ * "meter" is the exact rational N/100 per centimeter, anything else is no
+ * absolute unit.
+ */
+class TIFF : public NFIMM {
+
+  public:
+  static const uint16_t TAG_IMAGE_WIDTH{0x0100};
+  static const uint16_t TAG_IMAGE_LENGTH{0x0101};
+  static const uint16_t TAG_BITS_PER_SAMPLE{0x0102};
+  static const uint16_t TAG_X_RESOLUTION{0x011A};
+  static const uint16_t TAG_Y_RESOLUTION{0x011B};
+  static const uint16_t TAG_RESOLUTION_UNIT{0x0128};
+  static const uint16_t TYPE_SHORT{3};
+  static const uint16_t TYPE_LONG{4};
+  static const uint16_t TYPE_RATIONAL{5};
+  static const uint16_t TYPE_LONG8{16};
+
+  /** @brief Byte order and field sizes of the file */
+  struct Format {
+    bool bigEndian{false};   ///< `MM`
+    bool bigTiff{false};     ///< version 43
+    /** @brief Bytes of the header */
+    size_t headerSize() const { return bigTiff ? 16u : 8u; }
+    /** @brief Bytes of the IFD entry count */
+    size_t countSize() const { return bigTiff ? 8u : 2u; }
+    /** @brief Bytes of an IFD entry */
+    size_t entrySize() const { return bigTiff ? 20u : 12u; }
+    /** @brief Bytes of an offset, and of the value field of an entry */
+    size_t offsetSize() const { return bigTiff ? 8u : 4u; }
+  };
+
+  /** @brief One IFD entry of a resolution tag */
+  struct Entry {
+    bool found{false};    ///< tag is in the IFD
+    uint16_t type{0};     ///< TIFF field type
+    uint64_t count{0};    ///< number of values
+    size_t valueAt{0};    ///< offset of the value field of the entry
+    uint64_t value{0};    ///< value field as an offset
+  };
+
+  /** @brief One page */
+  struct Ifd {
+    size_t offset{0};        ///< of the entry count
+    uint64_t countEntries{0};///< number of entries
+    uint64_t countResolutionEntries{0};  ///< entries of the three tags
+    size_t nextAt{0};        ///< offset of the next IFD offset field
+    uint64_t next{0};        ///< next IFD offset, 0 for the last page
+    Entry xRes;              ///< XResolution
+    Entry yRes;              ///< YResolution
+    Entry unit;              ///< ResolutionUnit
+    uint32_t width{0};       ///< ImageWidth, if a single value
+    uint32_t height{0};      ///< ImageLength, if a single value
+    uint16_t bitDepth{0};    ///< BitsPerSample, first value
+    /** @brief Offset past the next IFD offset field */
+    size_t end( const Format &fmt ) const { return nextAt + fmt.offsetSize(); }
+  };
+
+  /** @brief Default constructor not used */
+  TIFF() = delete;
+  /** @brief Overloaded constructor with caller's metadata parameters */
+  TIFF( std::shared_ptr<MetadataParameters> & );
+  /** @brief Overloaded constructor with validated, shared parameters */
+  TIFF( std::shared_ptr<const ModificationConfig> );
+  /** @brief Does nothing */
+  ~TIFF() {}
+
+  /** @brief Read the header: byte order, version, first IFD offset */
+  static Status readHeader( const uint8_t *, const size_t, Format &,
+                            uint64_t & ) noexcept;
+  /** @brief Read one IFD and its resolution tags */
+  static Status readIfd( const uint8_t *, const size_t, const Format &,
+                         const uint64_t, Ifd & ) noexcept;
+
+  /** @brief Read 2 bytes in file byte order */
+  static uint16_t get16( const uint8_t *, const bool );
+  /** @brief Read 4 bytes in file byte order */
+  static uint32_t get32( const uint8_t *, const bool );
+  /** @brief Read 8 bytes in file byte order */
+  static uint64_t get64( const uint8_t *, const bool );
+  /** @brief Write LEN bytes of value in file byte order */
+  static void putN( uint8_t *, const uint64_t, const size_t, const bool );
+
+  /** @brief Patch the resolution tags of every page */
+  void planImage( ModificationPlan & ) override;
+  /** @brief Walk the IFD chain, check bounds and cycles */
+  Status validateImage() const noexcept override;
+  /** @brief Retrieve current Metadata Parameters */
+  std::string to_s();
+
+  private:
+  /** @brief One destination byte range that replaces source bytes */
+  struct Patch {
+    size_t offset{0};             ///< in source image
+    std::vector<uint8_t> bytes{}; ///< new bytes
+    std::string element{};        ///< tag or offset that is patched
+  };
+
+  /** @brief Patches of the page's tags, empty if the IFD must move */
+  std::vector<Patch> inPlacePatches( const Format &, const Ifd & ) const;
+  /** @brief The IFD with the resolution tags, for the end of the file */
+  std::vector<uint8_t> rewriteIfd( const Format &, const Ifd &,
+                                   const size_t, const uint64_t ) const;
+  /** @brief Destination ResolutionUnit and rational denominator */
+  uint16_t unitTag( uint32_t & ) const;
+};   // END class TIFF
+
+}   // END namespace
@@ -0,0 +1,130 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#pragma once
+
+#include "nfimm_lib.h"
+
+namespace NFIMM {
+
+
+/** @brief Support for operations on images in WSQ format
+ *
+ * Multi-byte values in WSQ marker segments are big-endian.
+ *
+ * A WSQ file is a series of marker segments that begins with SOI (`FF A0`).
+ * Each marker is `FF` followed by a marker code; all markers but SOI and EOI
+ * are followed by a 2-byte length that counts itself and the segment data.
+ * The tables (DTT, DQT, DHT), comments (COM) and the frame header (SOF)
+ * precede the blocks; each block is a SOB header followed by the
+ * entropy-coded data.
+ *
+ * WSQ has no resolution field.  The sample rate is the `PPI` attribute of
+ * the NISTCOM comment, a COM segment whose text begins `NIST_COM` and is
+ * one `NAME value` attribute per line, e.g.
+ *
+ *     NIST_COM 8
+ *     PIX_WIDTH 500
+ *     PIX_HEIGHT 500
+ *     PIX_DEPTH 8
+ *     PPI 500
+ *     ...
+ *
+ * The `NIST_COM` value is the number of attributes, itself included.
+ *
+ * ## Modifier Implementation Notes
+ * The marker segments are walked from SOI to the SOF; nothing from the SOF
+ * onward, i.e. the frame header and the blocks, is parsed or changed.  It
+ * is passed to the destination image as one range of the source image.
+ *
+ * - NISTCOM present: only the value of its `PPI` attribute is rewritten, or
+ *   the attribute is appended and the count incremented; every other byte
+ *   of the comment is unchanged.
+ * - NISTCOM absent: a NISTCOM comment is inserted after SOI, where the NBIS
+ *   encoder writes it.
+ *
+ * The `PPI` is the horizontal sample rate in pixels per inch; "meter" is
+ * converted and rounded, anything else is taken as pixels per inch.
+ */
+class WSQ : public NFIMM {
+
+  public:
+  static const int NUM_BYTES_MARKER{2};
+  static const int NUM_BYTES_SEGMENT_LENGTH{2};
+  /** @brief Frame header data read: black, white, height, width */
+  static const int NUM_BYTES_SOF_READ{6};
+
+  static const uint8_t MARKER_SOI{0xA0};
+  static const uint8_t MARKER_EOI{0xA1};
+  static const uint8_t MARKER_SOF{0xA2};
+  static const uint8_t MARKER_SOB{0xA3};
+  static const uint8_t MARKER_DTT{0xA4};
+  static const uint8_t MARKER_DQT{0xA5};
+  static const uint8_t MARKER_DHT{0xA6};
+  static const uint8_t MARKER_DRT{0xA7};
+  static const uint8_t MARKER_COM{0xA8};
+
+  /** @brief Offsets of the marker segments of interest, 0 if absent */
+  struct Markers {
+    size_t nistcom{0};   ///< COM marker of the NISTCOM comment
+    size_t sof{0};       ///< SOF marker
+  };
+
+  /** @brief Default constructor not used */
+  WSQ() = delete;
+  /** @brief Overloaded constructor with caller's metadata parameters */
+  WSQ( std::shared_ptr<MetadataParameters> & );
+  /** @brief Overloaded constructor with validated, shared parameters */
+  WSQ( std::shared_ptr<const ModificationConfig> );
+  /** @brief Does nothing */
+  ~WSQ() {}
+
+  /** @brief Walk the marker segments from SOI to the SOF */
+  static Status scanMarkers( const uint8_t *, const size_t,
+                             Markers & ) noexcept;
+  /** @brief Human readable name of a marker code */
+  static std::string markerName( const uint8_t );
+  /** @brief Destination `PPI` attribute value */
+  static uint32_t ppi( const ModificationConfig & );
+
+  /** @brief Patch or insert the NISTCOM comment, the blocks are unchanged */
+  void planImage( ModificationPlan & ) override;
+  /** @brief Walk the marker segments, check bounds */
+  Status validateImage() const noexcept override;
+  /** @brief Bytes up to the end of the SOF segment of a streamed image */
+  size_t streamHeadLength( const uint8_t *, const size_t ) const noexcept override;
+  /** @brief Retrieve current Metadata Parameters */
+  std::string to_s();
+
+  private:
+  /** @brief Plan the NISTCOM comment with the PPI attribute rewritten */
+  void planNistcom( ModificationPlan &, const size_t );
+  /** @brief Plan every segment up to offset that is not patched */
+  void keepSegments( ModificationPlan &, size_t &, const size_t );
+};   // END class WSQ
+
+}   // END namespace
@@ -0,0 +1,713 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "an2k/an2k.h"
+#include "probe.h"
+#include "registry.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+
+namespace NFIMM {
+
+/** 
+ * Initialize the read-buffer cursor and clear the write-buffer.
+*/
+AN2K::AN2K( std::shared_ptr<MetadataParameters> &mps ) : NFIMM(mps)
+{
+  s_r_cursor = 0;
+  s_writeBuffer.clear();
+}
+
+/** 
+ * Initialize the read-buffer cursor and clear the write-buffer.
+*/
+AN2K::AN2K( std::shared_ptr<const ModificationConfig> cfg )
+    : NFIMM(std::move(cfg))
+{
+  s_r_cursor = 0;
+  s_writeBuffer.clear();
+}
+
+/**
+ * Read every record, then patch the sample rate records in one pass.  The
+ * destination transaction has the records in source order; see the class
+ * description for what is changed in each.
+ *
+ * @param pln OUT : destination image size and edits
+ * @throw Miscue Invalid record, invalid or unsupported embedded image
+ */
+void AN2K::planImage( ModificationPlan &pln )
+{
+  _result.loggit( "Initialize for ANSI/NIST-ITL modification" );
+  const uint8_t *buf{ s_readData };
+
+  const std::vector<Record> records{ readRecords() };
+  if( _result.logging )
+    _result.loggit( "Records: " + std::to_string( records.size() ) );
+
+  const std::string rate{ ppmm() };
+  bool infoRead{false};
+  for( size_t i=0; i<records.size(); i++ )
+  {
+    const Record &rec{ records[i] };
+    const std::string name{ "Type-" + std::to_string( rec.type ) };
+
+    if( rec.type == 1 )
+    {
+      const std::map<uint32_t, std::string> values{ fieldValues( rec ) };
+      readNativeRate( values );
+      const std::vector<uint8_t> bytes{
+        rewriteFields( rec, { { FIELD_NSR, rate }, { FIELD_NTR, rate } }, 0 ) };
+      pln.update( name, bytes.data(), bytes.size() );
+      if( _result.logging )
+        _result.loggit( "WRITE Type-1 NSR and NTR: " + rate );
+    }
+    else if( rec.type == 4 )
+    {
+      static const char *const gca[]{ "NONE", "WSQ20", "JPEGB", "JPEGL",
+                                      "JP2", "JP2L", "PNG" };
+      const uint8_t *hdr{ buf + rec.offset };
+      const uint8_t code{ hdr[OFFSET_TYPE4_GCA] };
+      const std::string prefix{ _result.logging
+        ? "Record " + std::to_string( i ) + " " + name + " " : std::string{} };
+      if( !infoRead )
+      {
+        readType4Info( rec );
+        infoRead = true;
+      }
+
+      const ModificationPlan sub{ planEmbedded(
+        code < sizeof( gca ) / sizeof( gca[0] ) ? embeddedFormat( gca[code] ) : "",
+        rec.dataAt, rec.end() - rec.dataAt, prefix ) };
+      const uint64_t length{ NUM_BYTES_TYPE4_HEADER + uint64_t{ sub.outputSize } };
+      if( length > 0xFFFFFFFF )
+        throw Miscue( MiscueCode::Unsupported,
+                      "Type-4 record exceeds 4 GB" );
+      uint8_t header[NUM_BYTES_TYPE4_HEADER];
+      std::copy( hdr, hdr + NUM_BYTES_TYPE4_HEADER, header );
+      expressUINT32AsFourBytes( length, header, true );
+      header[OFFSET_TYPE4_ISR] = 1;
+      pln.update( name + " header", header, sizeof( header ) );
+      pln.append( sub, rec.dataAt, name + " " );
+      if( _result.logging )
+        _result.loggit( prefix + "ISR: 1, LEN: " + std::to_string( length ) );
+    }
+    else if( ( rec.type == 13 || rec.type == 14 || rec.type == 15 ) && rec.dataAt )
+    {
+      const std::map<uint32_t, std::string> values{ fieldValues( rec ) };
+      const std::string prefix{ _result.logging
+        ? "Record " + std::to_string( i ) + " " + name + " " : std::string{} };
+      if( !infoRead )
+      {
+        readImageInfo( rec, values );
+        infoRead = true;
+      }
+
+      auto cga = values.find( FIELD_CGA );
+      const ModificationPlan sub{ planEmbedded(
+        cga == values.end() ? "" : embeddedFormat( cga->second ),
+        rec.dataAt, rec.end() - 1 - rec.dataAt, prefix ) };
+
+      std::string slc{"0"};
+      uint32_t horiz{ _config->destResolution.horiz };
+      uint32_t vert{ _config->destResolution.vert };
+      if( _config->destResolution.unitsStr == "inch" )
+      {
+        slc = "1";
+      }
+      else if( _config->destResolution.unitsStr == "meter" )
+      {
+        slc = "2";
+        horiz = ( horiz + 50 ) / 100;
+        vert  = ( vert + 50 ) / 100;
+      }
+      const std::vector<uint8_t> bytes{ rewriteFields( rec,
+        { { FIELD_SLC, slc }, { FIELD_THPS, std::to_string( horiz ) },
+          { FIELD_TVPS, std::to_string( vert ) } }, sub.outputSize + 1 ) };
+      pln.update( name + " fields", bytes.data(), bytes.size() );
+      pln.append( sub, rec.dataAt, name + " " );
+      pln.keep( name + " FS", rec.end() - 1, 1 );
+      if( _result.logging )
+        _result.loggit( prefix + "SLC: " + slc + ", THPS: " +
+                        std::to_string( horiz ) + ", TVPS: " + std::to_string( vert ) );
+    }
+    else
+    {
+      pln.keep( name, rec.offset, rec.length );
+    }
+  }
+
+  const size_t end{ records.back().end() };
+  if( end < s_readSize )
+    pln.keep( "Trailing bytes", end, s_readSize - end );
+}   // END planImage()
+
+/**
+ * The image is planned by the handler of its compression, with the image
+ * as its source image; the read-buffer is restored on return.  An image
+ * without a handler, e.g. uncompressed, is one range.
+ *
+ * @param format wsq, jpeg, jp2, png, or "" for none
+ * @param at offset of the image
+ * @param len number of bytes of the image
+ * @param prefix for the log entries of the handler
+ * @return plan of the image, source offsets are from AT
+ * @throw Miscue Invalid or unsupported embedded image
+ */
+ModificationPlan AN2K::planEmbedded( const std::string &format, const size_t at,
+                                     const size_t len, const std::string &prefix )
+{
+  ModificationPlan sub;
+  if( format.empty() )
+  {
+    sub.segments.reset( s_readData + at, len );
+    sub.keep( "image data", 0, len );
+    if( _result.logging )
+      _result.loggit( prefix + "image unchanged, " + std::to_string( len ) + " bytes" );
+    return sub;
+  }
+
+  std::unique_ptr<NFIMM> handler{
+    HandlerRegistry::instance().create( _embedded.get( format ) ) };
+  handler->setLogging( _result.logging );
+
+  // The handler reads the image in place; restore the transaction after.
+  struct View {
+    const uint8_t *data;
+    size_t size;
+    ~View() { s_readData = data; s_readSize = size; }
+  } view{ s_readData, s_readSize };
+  s_readData = view.data + at;
+  s_readSize = len;
+
+  if( _result.logging )
+    _result.loggit( prefix + format + " image, " + std::to_string( len ) + " bytes" );
+  try
+  {
+    sub = handler->plan();
+  }
+  catch( const Miscue & )
+  {
+    for( const std::string &s : handler->result().log ) { _result.loggit( prefix + s ); }
+    throw;
+  }
+  for( const std::string &s : handler->result().log ) { _result.loggit( prefix + s ); }
+  return sub;
+}
+
+/**
+ * The fields are written in source order with the tag and separators of the
+ * source.  A replaced field that is missing is inserted before the first
+ * field with a greater number.  LEN is computed last.
+ *
+ * @param rec tagged record
+ * @param values new values by field number
+ * @param tail number of bytes of the record after the returned bytes: the
+ *   image and FS, or 0 when the record has no image
+ * @return the record, up to and including the `T.999:` tag if any
+ */
+std::vector<uint8_t> AN2K::rewriteFields( const Record &rec,
+                                          const std::map<uint32_t, std::string> &values,
+                                          const size_t tail )
+{
+  const char *src{ reinterpret_cast<const char *>( s_readData ) };
+  struct Entry {
+    uint32_t number;
+    std::string tag;
+    std::string value;
+  };
+  std::vector<Entry> entries;
+  Field f;
+  for( size_t at{ rec.offset }; ; at = f.valueEnd + 1 )
+  {
+    const Status st{ readField( s_readData, rec, at, f ) };
+    if( !st )
+      throw Miscue( st );
+    auto v = values.find( f.number );
+    entries.push_back( Entry{ f.number,
+      std::string( src + f.offset, f.valueAt - f.offset ),
+      v != values.end() ? v->second :
+        f.number == FIELD_LEN || f.number == FIELD_DATA ? std::string{} :
+          std::string( src + f.valueAt, f.valueEnd - f.valueAt ) } );
+    if( f.number == FIELD_DATA || f.valueEnd == rec.end() - 1 )
+      break;
+  }
+
+  for( const auto &v : values )
+  {
+    auto it = entries.begin() + 1;
+    while( it != entries.end() && it->number < v.first ) { ++it; }
+    if( it != entries.end() && it->number == v.first )
+      continue;
+    std::string number{ std::to_string( v.first ) };
+    number.insert( 0, 3 - std::min<size_t>( 3, number.size() ), '0' );
+    entries.insert( it, Entry{ v.first,
+      std::to_string( rec.type ) + "." + number + ":", v.second } );
+  }
+
+  // Every byte but the LEN value.
+  std::string text;
+  for( const Entry &e : entries )
+  {
+    if( !text.empty() )
+      text.push_back( static_cast<char>( GS ) );
+    text.append( e.tag );
+    if( e.number != FIELD_DATA )
+      text.append( e.value );
+  }
+  if( entries.back().number != FIELD_DATA )
+    text.push_back( static_cast<char>( FS ) );
+
+  const size_t base{ text.size() + tail };
+  size_t length{ base + 1 };
+  while( base + std::to_string( length ).size() != length )
+    length = base + std::to_string( length ).size();
+  text.insert( entries.front().tag.size(), std::to_string( length ) );
+  return std::vector<uint8_t>( text.begin(), text.end() );
+}
+
+/**
+ * @param rec tagged record
+ * @return value of each field but the image
+ */
+std::map<uint32_t, std::string> AN2K::fieldValues( const Record &rec )
+{
+  std::map<uint32_t, std::string> values;
+  Field f;
+  for( size_t at{ rec.offset }; ; at = f.valueEnd + 1 )
+  {
+    const Status st{ readField( s_readData, rec, at, f ) };
+    if( !st )
+      throw Miscue( st );
+    if( f.number == FIELD_DATA )
+      break;
+    values.emplace( f.number, std::string(
+      reinterpret_cast<const char *>( s_readData ) + f.valueAt,
+      f.valueEnd - f.valueAt ) );
+    if( f.valueEnd == rec.end() - 1 )
+      break;
+  }
+  return values;
+}
+
+/**
+ * The NSR is the sample rate of the Type-4 images, it is converted to pixels
+ * per inch.
+ *
+ * @param values fields of the Type-1 record
+ */
+void AN2K::readNativeRate( const std::map<uint32_t, std::string> &values )
+{
+  auto nsr = values.find( FIELD_NSR );
+  if( _result.logging )
+    _result.loggit( "READ Type-1 NSR: " +
+                    ( nsr == values.end() ? std::string{"none"} : nsr->second ) );
+  if( nsr != values.end() )
+  {
+    const double v{ std::strtod( nsr->second.c_str(), nullptr ) };
+    _result.srcImg.resolution.horiz = static_cast<uint32_t>( v * 25.4 + 0.5 );
+    _result.srcImg.resolution.vert  = _result.srcImg.resolution.horiz;
+  }
+}
+
+/**
+ * ISR 0 is the minimum scanning resolution, 500 pixels per inch; otherwise
+ * the rate is the NSR read by readNativeRate().
+ *
+ * @param rec Type-4 record
+ */
+void AN2K::readType4Info( const Record &rec )
+{
+  const uint8_t *hdr{ s_readData + rec.offset };
+  _result.srcImg.width    = ( hdr[13] << 8 ) | hdr[14];
+  _result.srcImg.height   = ( hdr[15] << 8 ) | hdr[16];
+  _result.srcImg.bitDepth = 8;
+  if( hdr[OFFSET_TYPE4_ISR] == 0 )
+    _result.srcImg.resolution.horiz = _result.srcImg.resolution.vert = 500;
+  _result.srcImg.resolutionExists = _result.srcImg.resolution.horiz != 0;
+  _result.srcImg.resolution.units = 1;
+}
+
+/**
+ * @param rec Type-13, 14, or 15 record
+ * @param values fields of the record
+ */
+void AN2K::readImageInfo( const Record &rec,
+                          const std::map<uint32_t, std::string> &values )
+{
+  auto number = [&values]( const uint32_t field ) -> uint32_t {
+    auto v = values.find( field );
+    return v == values.end() ? 0 :
+      static_cast<uint32_t>( std::strtoul( v->second.c_str(), nullptr, 10 ) );
+  };
+  _result.srcImg.width    = number( FIELD_HLL );
+  _result.srcImg.height   = number( FIELD_VLL );
+  _result.srcImg.bitDepth = static_cast<uint16_t>( number( FIELD_BPX ) );
+  const uint32_t slc{ number( FIELD_SLC ) };
+  const uint32_t horiz{ number( FIELD_THPS ) }, vert{ number( FIELD_TVPS ) };
+  if( _result.logging )
+    _result.loggit( "READ Type-" + std::to_string( rec.type ) + " width: " +
+      std::to_string( _result.srcImg.width ) + ", height: " +
+      std::to_string( _result.srcImg.height ) + ", SLC: " + std::to_string( slc ) +
+      ", THPS: " + std::to_string( horiz ) + ", TVPS: " + std::to_string( vert ) );
+  _result.srcImg.resolution.horiz = horiz;
+  _result.srcImg.resolution.vert  = vert;
+  _result.srcImg.resolution.units = static_cast<uint8_t>( slc );
+  _result.srcImg.resolutionExists = slc != 0 && horiz != 0 && vert != 0;
+}
+
+/**
+ * @return every record of the transaction, checked by validateImage()
+ * @throw Miscue Invalid record
+ */
+std::vector<AN2K::Record> AN2K::readRecords()
+{
+  const uint8_t *buf{ s_readData };
+  std::vector<Record> records;
+  Record rec;
+  rec.type = 1;
+  Field cnt;
+  Status st{ readRecord( buf, s_readSize, 0, rec ) };
+  if( st )
+    st = scanFields( buf, rec, FIELD_CNT, cnt );
+  if( !st )
+    throw Miscue( st );
+  records.push_back( rec );
+
+  size_t cntAt{ cnt.valueAt };
+  while( cntAt < cnt.valueEnd && buf[cntAt] != RS ) { cntAt++; }
+  cntAt++;
+  uint32_t type{0};
+  while( nextCntType( buf, cntAt, cnt.valueEnd, type ) )
+  {
+    Record next;
+    next.type = type;
+    st = readRecord( buf, s_readSize, records.back().end(), next );
+    if( st && next.tagged() )
+    {
+      Field unused;
+      st = scanFields( buf, next, FIELD_DATA, unused );
+    }
+    if( !st )
+      throw Miscue( st );
+    records.push_back( next );
+  }
+  return records;
+}
+
+/**
+ * The record type of a binary record is not in the record; it is set by
+ * the caller from CNT.
+ *
+ * @param buf source image
+ * @param size number of bytes in source image
+ * @param pos offset of the record
+ * @param rec IN/OUT : type in, offset, length, and image offset out
+ * @return failure and its offset, or Ok
+ */
+Status AN2K::readRecord( const uint8_t *buf, const size_t size,
+                         const size_t pos, Record &rec ) noexcept
+{
+  rec.offset = pos;
+  rec.length = 0;
+  rec.dataAt = 0;
+  if( pos >= size )
+    return Status{ MiscueCode::Truncated, pos };
+
+  uint64_t length{0};
+  if( rec.tagged() )
+  {
+    // T.001:LEN
+    size_t p{ pos };
+    uint32_t type{0}, field{0};
+    while( p < size && p - pos < 3 && buf[p] >= '0' && buf[p] <= '9' )
+      type = type * 10 + ( buf[p++] - '0' );
+    if( p == pos || p >= size || buf[p] != '.' || type != rec.type )
+      return Status{ pos == 0 ? MiscueCode::InvalidSignature
+                              : MiscueCode::InvalidHeader, pos };
+    const size_t fieldAt{ ++p };
+    while( p < size && p - fieldAt < 3 && buf[p] >= '0' && buf[p] <= '9' )
+      field = field * 10 + ( buf[p++] - '0' );
+    if( p == fieldAt || p >= size || buf[p] != ':' || field != FIELD_LEN )
+      return Status{ MiscueCode::InvalidHeader, pos };
+    const size_t lenAt{ ++p };
+    while( p < size && p - lenAt < 19 && buf[p] >= '0' && buf[p] <= '9' )
+      length = length * 10 + ( buf[p++] - '0' );
+    if( p >= size )
+      return Status{ MiscueCode::Truncated, pos };
+    if( p == lenAt || ( buf[p] != GS && buf[p] != FS ) || length <= p - pos )
+      return Status{ MiscueCode::InvalidHeader, pos };
+    if( length > size - pos )
+      return Status{ MiscueCode::Truncated, pos };
+    if( buf[pos+length-1] != FS )
+      return Status{ MiscueCode::InvalidHeader, pos + length - 1 };
+  }
+  else
+  {
+    if( size - pos < static_cast<size_t>( NUM_BYTES_BINARY_LENGTH ) )
+      return Status{ MiscueCode::Truncated, pos };
+    length = ( uint32_t{ buf[pos] } << 24 ) | ( buf[pos+1] << 16 ) |
+             ( buf[pos+2] << 8 ) | buf[pos+3];
+    const size_t minimum( rec.type == 4 ? NUM_BYTES_TYPE4_HEADER
+                                         : NUM_BYTES_BINARY_LENGTH + 1 );
+    if( length < minimum )
+      return Status{ MiscueCode::InvalidHeader, pos };
+    if( length > size - pos )
+      return Status{ MiscueCode::Truncated, pos };
+    if( rec.type == 4 )
+      rec.dataAt = pos + NUM_BYTES_TYPE4_HEADER;
+  }
+  rec.length = static_cast<size_t>( length );
+  return Status{};
+}
+
+/**
+ * @param buf source image
+ * @param rec tagged record, checked by readRecord()
+ * @param at offset of the tag
+ * @param field OUT : the field; the value of T.999 is the rest of the
+ *   record but FS
+ * @return failure and its offset, or Ok
+ */
+Status AN2K::readField( const uint8_t *buf, const Record &rec, const size_t at,
+                        Field &field ) noexcept
+{
+  field = Field{};
+  const size_t end{ rec.end() - 1 };   // FS
+  size_t p{ at };
+  uint32_t type{0};
+  while( p < end && p - at < 3 && buf[p] >= '0' && buf[p] <= '9' )
+    type = type * 10 + ( buf[p++] - '0' );
+  if( p == at || p >= end || buf[p] != '.' || type != rec.type )
+    return Status{ MiscueCode::InvalidHeader, at };
+  const size_t numberAt{ ++p };
+  while( p < end && p - numberAt < 3 && buf[p] >= '0' && buf[p] <= '9' )
+    field.number = field.number * 10 + ( buf[p++] - '0' );
+  if( p == numberAt || p >= end || buf[p] != ':' )
+    return Status{ MiscueCode::InvalidHeader, at };
+
+  field.offset  = at;
+  field.valueAt = p + 1;
+  if( field.number == FIELD_DATA )
+  {
+    field.valueEnd = end;
+    return Status{};
+  }
+  for( p = field.valueAt; p < end && buf[p] != GS; p++ ) {}
+  field.valueEnd = p;
+  return Status{};
+}
+
+/**
+ * Walk every field of the record up to FS or T.999.
+ *
+ * @param buf source image
+ * @param rec IN/OUT : tagged record, image offset set if T.999 is found
+ * @param number of the field to find
+ * @param found OUT : the field, number 0 if absent
+ * @return failure and its offset, or Ok
+ */
+Status AN2K::scanFields( const uint8_t *buf, Record &rec, const uint32_t number,
+                         Field &found ) noexcept
+{
+  found = Field{};
+  Field f;
+  for( size_t at{ rec.offset }; ; at = f.valueEnd + 1 )
+  {
+    const Status st{ readField( buf, rec, at, f ) };
+    if( !st )
+      return st;
+    if( f.number == number )
+      found = f;
+    if( f.number == FIELD_DATA )
+    {
+      rec.dataAt = f.valueAt;
+      return Status{};
+    }
+    if( f.valueEnd == rec.end() - 1 )
+      return Status{};
+  }
+}
+
+/**
+ * The CNT subfields are `type US IDC`, separated by RS; the first subfield
+ * is the count and is skipped by the caller.
+ *
+ * @param buf source image
+ * @param pos IN/OUT : offset of the subfield, of the next one on return
+ * @param end offset past the CNT value
+ * @param type OUT : record type
+ * @return false when there is no further subfield
+ */
+bool AN2K::nextCntType( const uint8_t *buf, size_t &pos, const size_t end,
+                        uint32_t &type ) noexcept
+{
+  type = 0;
+  size_t p{ pos };
+  while( p < end && p - pos < 3 && buf[p] >= '0' && buf[p] <= '9' )
+    type = type * 10 + ( buf[p++] - '0' );
+  if( p == pos || p >= end || buf[p] != US )
+    return false;
+  while( p < end && buf[p] != RS ) { p++; }
+  pos = p + 1;
+  return true;
+}
+
+/**
+ * Checks the same conditions as planImage(), reading the records in place:
+ * - Type-1 record with CNT
+ * - each record listed by CNT within the source image, with its LEN
+ * - each field of a tagged record is `T.NNN:` with T the record type
+ *
+ * The embedded images are checked by their handlers during planImage().
+ *
+ * @return Ok, or the first failure and its offset
+ */
+Status AN2K::validateImage() const noexcept
+{
+  const uint8_t *buf{ s_readData };
+  Record rec;
+  rec.type = 1;
+  Field cnt;
+  Status st{ readRecord( buf, s_readSize, 0, rec ) };
+  if( st )
+    st = scanFields( buf, rec, FIELD_CNT, cnt );
+  if( !st )
+    return st;
+  if( cnt.number != FIELD_CNT )
+    return Status{ MiscueCode::InvalidHeader, 0 };
+
+  size_t cntAt{ cnt.valueAt };
+  while( cntAt < cnt.valueEnd && buf[cntAt] != RS ) { cntAt++; }
+  cntAt++;
+  uint32_t type{0};
+  while( nextCntType( buf, cntAt, cnt.valueEnd, type ) )
+  {
+    Record next;
+    next.type = type;
+    st = readRecord( buf, s_readSize, rec.end(), next );
+    if( st && next.tagged() )
+    {
+      Field unused;
+      st = scanFields( buf, next, FIELD_DATA, unused );
+    }
+    if( !st )
+      return st;
+    rec = next;
+  }
+  return Status{};
+}
+
+/**
+ * The source image is read as by planImage() up to the first image record;
+ * the embedded images and the destination parameters are not used, so any
+ * valid transaction is probed whatever its image compression.
+ *
+ * @param probe OUT : metadata of the first image record
+ * @return Ok, or the validation failure
+ * @throw Miscue Invalid record
+ */
+Status AN2K::probeImage( ImageProbe &probe )
+{
+  const Status st{ validateImage() };
+  if( !st )
+    return st;
+
+  _result.restart();
+  for( const Record &rec : readRecords() )
+  {
+    if( rec.type == 1 )
+    {
+      readNativeRate( fieldValues( rec ) );
+    }
+    else if( rec.type == 4 )
+    {
+      readType4Info( rec );
+      break;
+    }
+    else if( ( rec.type == 13 || rec.type == 14 || rec.type == 15 ) && rec.dataAt )
+    {
+      readImageInfo( rec, fieldValues( rec ) );
+      break;
+    }
+  }
+  probe.width = _result.srcImg.width;
+  probe.height = _result.srcImg.height;
+  probe.bitDepth = _result.srcImg.bitDepth;
+  probe.resolutionExists = _result.srcImg.resolutionExists;
+  probe.horiz = _result.srcImg.resolution.horiz;
+  probe.vert = _result.srcImg.resolution.vert;
+  probe.units = _result.srcImg.resolution.units;
+  return Status{};
+}
+
+/**
+ * @param cga compression algorithm name, e.g. `WSQ20`
+ * @return handler format, "" for none or not supported
+ */
+std::string AN2K::embeddedFormat( const std::string &cga )
+{
+  if( cga.compare( 0, 3, "WSQ" ) == 0 )
+    return "wsq";
+  if( cga == "JPEGB" || cga == "JPEGL" )
+    return "jpeg";
+  if( cga == "JP2" || cga == "JP2L" )
+    return "jp2";
+  if( cga == "PNG" )
+    return "png";
+  return "";
+}
+
+/**
+ * "meter" is pixels per meter; any other unit is pixels per inch.
+ *
+ * @return sample rate in pixels per mm with 2 decimals, e.g. `19.69`
+ */
+std::string AN2K::ppmm() const
+{
+  const uint64_t horiz{ _config->destResolution.horiz };
+  const uint64_t hundredths{ _config->destResolution.unitsStr == "meter"
+                               ? ( horiz + 5 ) / 10
+                               : ( horiz * 1000 + 127 ) / 254 };
+  std::string frac{ std::to_string( hundredths % 100 ) };
+  if( frac.size() < 2 )
+    frac.insert( 0, "0" );
+  return std::to_string( hundredths / 100 ) + "." + frac;
+}
+
+/** @return current Metadata Parameters */
+std::string AN2K::to_s()
+{
+  std::string s{"AN2K: "};
+  s.append( _config->to_s() );
+  return s;
+}
+
+}   // END namespace
@@ -0,0 +1,731 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "batch.h"
+#include "hash.h"
+#include "output_sink.h"
+#include "png/png.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+  #include <linux/fs.h>
+#endif
+
+namespace NFIMM {
+
+namespace {
+
+/** @brief Bytes before the first record: MAGIC, VERSION, record size */
+const size_t JOURNAL_HEADER_SIZE{16};
+
+/** @brief Write all bytes, retrying short writes and EINTR */
+bool writeAll( const int fd, const void *data, size_t len )
+{
+  const char *p{ static_cast<const char *>( data ) };
+  while( len > 0 )
+  {
+    const ssize_t n{ ::write( fd, p, len ) };
+    if( n < 0 && errno == EINTR )
+      continue;
+    if( n <= 0 )
+      return false;
+    p += n;
+    len -= static_cast<size_t>( n );
+  }
+  return true;
+}
+
+/** @brief Flush the file's data to the device */
+bool syncData( const int fd )
+{
+#ifdef __APPLE__
+  return ::fsync( fd ) == 0;
+#else
+  return ::fdatasync( fd ) == 0;
+#endif
+}
+
+/** @brief Copy the file FROM to TO, a reflink where the file system shares
+ * extents, else copy_file_range() or read() and write()
+ *
+ * @return false if not copied; TO may be partially written
+ */
+bool copyFile( const std::string &from, const std::string &to )
+{
+  const int in{ ::open( from.c_str(), O_RDONLY | O_CLOEXEC ) };
+  if( in < 0 )
+    return false;
+  const int out{ ::open( to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 ) };
+  if( out < 0 )
+  {
+    ::close( in );
+    return false;
+  }
+
+  bool copied{false};
+#ifdef __linux__
+  copied = ::ioctl( out, FICLONE, in ) == 0;
+  while( !copied )
+  {
+    const ssize_t n{ ::copy_file_range( in, nullptr, out, nullptr, 1u << 30, 0 ) };
+    if( n < 0 && errno == EINTR )
+      continue;
+    if( n == 0 )
+      copied = true;
+    else if( n < 0 )
+      break;
+  }
+#endif
+  if( !copied && ::lseek( in, 0, SEEK_SET ) == 0 && ::ftruncate( out, 0 ) == 0 &&
+      ::lseek( out, 0, SEEK_SET ) == 0 )
+  {
+    std::vector<char> buf( 1u << 16 );
+    for( ;; )
+    {
+      const ssize_t n{ ::read( in, buf.data(), buf.size() ) };
+      if( n < 0 && errno == EINTR )
+        continue;
+      if( n < 0 || ( n > 0 && !writeAll( out, buf.data(), static_cast<size_t>( n ) ) ) )
+        break;
+      if( n == 0 )
+      {
+        copied = true;
+        break;
+      }
+    }
+  }
+  ::close( in );
+  return ::close( out ) == 0 && copied;
+}
+
+/** @brief Make TO a hard link of FROM, or a copy if LINK is false or the
+ * link fails, e.g. across file systems; an existing TO is replaced
+ *
+ * @return false if neither could be made
+ */
+bool replicate( const std::string &from, const std::string &to, const bool link )
+{
+  if( link )
+  {
+    if( ::link( from.c_str(), to.c_str() ) == 0 )
+      return true;
+    if( errno == EEXIST && ::unlink( to.c_str() ) == 0 &&
+        ::link( from.c_str(), to.c_str() ) == 0 )
+      return true;
+  }
+  return copyFile( from, to );
+}
+
+/** @brief Directory of PATH, "." if none */
+std::string parentOf( const std::string &path )
+{
+  const size_t slash{ path.rfind( '/' ) };
+  if( slash == std::string::npos )
+    return ".";
+  return slash == 0 ? "/" : path.substr( 0, slash );
+}
+
+}   // END namespace
+
+
+/******************************************************************************/
+/* class Journal methods implementations */
+
+constexpr char Journal::MAGIC[8];
+
+/**
+ * A new or empty file gets the header.  In an existing file, a torn last
+ * record is cut off, and the records are loaded and sorted.  Records are in
+ * host byte order.
+ *
+ * @param path journal file
+ * @throw Miscue Cannot open, read, or write the file; not a journal
+ */
+Journal::Journal( const std::string &path ) : _path(path)
+{
+  _fd = ::open( path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+  struct stat st;
+  if( _fd < 0 || ::fstat( _fd, &st ) != 0 )
+  {
+    const std::string err{ std::strerror( errno ) };
+    if( _fd >= 0 ) ::close( _fd );
+    throw Miscue( MiscueCode::Io, "CANNOT open journal '" + path + "': " + err );
+  }
+  auto fail = [this]( const MiscueCode code, const std::string &msg ) {
+    ::close( _fd );
+    _fd = -1;
+    throw Miscue( code, msg + ": '" + _path + "'" );
+  };
+
+  uint8_t header[JOURNAL_HEADER_SIZE]{0};
+  std::memcpy( header, MAGIC, sizeof( MAGIC ) );
+  const uint32_t version{ VERSION };
+  const uint32_t recordSize{ sizeof( Key ) };
+  std::memcpy( header + 8, &version, sizeof( version ) );
+  std::memcpy( header + 12, &recordSize, sizeof( recordSize ) );
+
+  // A file shorter than the header is a journal only if it is a torn header.
+  const size_t size{ static_cast<size_t>( st.st_size ) };
+  const size_t have{ std::min( size, JOURNAL_HEADER_SIZE ) };
+  uint8_t found[JOURNAL_HEADER_SIZE];
+  if( ::pread( _fd, found, have, 0 ) != static_cast<ssize_t>( have ) )
+    fail( MiscueCode::Io, "CANNOT read journal" );
+  if( std::memcmp( found, header, have ) != 0 )
+    fail( MiscueCode::InvalidHeader, "Not a journal of this version" );
+  if( size < JOURNAL_HEADER_SIZE )
+  {
+    if( size > 0 && ::ftruncate( _fd, 0 ) != 0 )
+      fail( MiscueCode::Io, "CANNOT truncate journal" );
+    if( !writeAll( _fd, header, sizeof( header ) ) || !syncData( _fd ) )
+      fail( MiscueCode::Io, "CANNOT write journal" );
+    return;
+  }
+
+  const size_t count{ ( size - JOURNAL_HEADER_SIZE ) / sizeof( Key ) };
+  const size_t whole{ JOURNAL_HEADER_SIZE + count * sizeof( Key ) };
+  if( whole != size && ::ftruncate( _fd, static_cast<off_t>( whole ) ) != 0 )
+    fail( MiscueCode::Io, "CANNOT cut torn record of journal" );
+
+  _done.resize( count );
+  size_t got{0};
+  uint8_t *dst{ reinterpret_cast<uint8_t *>( _done.data() ) };
+  while( got < count * sizeof( Key ) )
+  {
+    const ssize_t n{ ::pread( _fd, dst + got, count * sizeof( Key ) - got,
+                              static_cast<off_t>( JOURNAL_HEADER_SIZE + got ) ) };
+    if( n < 0 && errno == EINTR )
+      continue;
+    if( n <= 0 )
+      fail( MiscueCode::Io, "CANNOT read journal" );
+    got += static_cast<size_t>( n );
+  }
+  std::sort( _done.begin(), _done.end() );
+}
+
+Journal::~Journal()
+{
+  if( _fd >= 0 )
+    ::close( _fd );
+}
+
+/**
+ * @param key job identity
+ * @return true if an earlier run recorded the job
+ */
+bool Journal::contains( const Key &key ) const
+{
+  return std::binary_search( _done.begin(), _done.end(), key );
+}
+
+/**
+ * @param keys records in order of completion
+ * @throw Miscue Cannot write or sync the file
+ */
+void Journal::write( const std::vector<Key> &keys )
+{
+  if( keys.empty() )
+    return;
+  if( !writeAll( _fd, keys.data(), keys.size() * sizeof( Key ) ) || !syncData( _fd ) )
+    throw Miscue( MiscueCode::Io, "CANNOT write journal '" + _path + "': " +
+                  std::strerror( errno ) );
+}
+
+
+/******************************************************************************/
+/* class Batch methods implementations */
+
+struct Batch::Worker
+{
+  /** @brief Configs derived from the batch's config, by format */
+  FormatConfigs configs;
+  /** @brief One handler per format, created on first use */
+  HandlerCache handlers{};
+
+  /** @brief Derive every config from the batch's config */
+  explicit Worker( std::shared_ptr<const ModificationConfig> cfg )
+    : configs(std::move(cfg)) {}
+};
+
+/**
+ * @param cfg sample rate and custom text of every image; its compression
+ *   is used unless DETECT
+ * @param workers number of threads, zero for one per CPU
+ * @param detect format of each image from its signature
+ */
+Batch::Batch( std::shared_ptr<const ModificationConfig> cfg,
+              const unsigned workers, const bool detect )
+  : _config(std::move(cfg)),
+    _workers(workers ? workers : std::max( 1u, std::thread::hardware_concurrency() )),
+    _detect(detect)
+{
+  _paramsHash = hash64( ( detect ? "auto\x1f" : "" ) + _config->key() );
+  const std::shared_ptr<const ChunkTemplate> tmpl{ _config->chunkTemplate() };
+  _contentHasTime = tmpl && tmpl->usesFileTime();
+}
+
+/**
+ * @param path journal file, created if missing
+ * @param groupSize records per group commit
+ * @param groupTime longest time between group commits
+ * @throw Miscue Cannot open the journal
+ */
+void Batch::journal( const std::string &path, const size_t groupSize,
+                     const std::chrono::milliseconds groupTime )
+{
+  _journal.reset( new Journal( path ) );
+  _groupSize = std::max( groupSize, size_t{1} );
+  _groupTime = groupTime;
+}
+
+/**
+ * The calling thread is one of the workers.  After the last job, or after
+ * stop(), the pending records are committed.
+ *
+ * @param source list of jobs
+ * @param report called for every job, may be empty
+ * @return totals
+ * @throw Miscue Cannot write the journal or sync a destination
+ */
+Batch::Summary Batch::run( const Source &source, const Report &report )
+{
+  Summary sum;
+  _lastCommit = std::chrono::steady_clock::now();
+  parallel( [&]( Worker &worker ) { work( worker, source, report, sum ); } );
+  if( _journal )
+    commit();
+  return sum;
+}
+
+/**
+ * Only the headers are read: a source is mapped, and the pages its
+ * handler's probe touches are all that is read from the device, unless
+ * hashContent().  The journal, deduplication, and skipCurrent() do not
+ * apply.
+ *
+ * @param source list of jobs
+ * @param report called for every source probed
+ * @return totals: done is the number of sources probed Ok
+ */
+Batch::Summary Batch::probe( const Source &source, const ProbeReport &report )
+{
+  Summary sum;
+  parallel( [&]( Worker &worker ) {
+    Job job;
+    for( ;; )
+    {
+      {
+        std::lock_guard<std::mutex> lk( _mtx );
+        if( _stopping.load() || !source( job ) )
+          return;
+      }
+      ImageProbe p;
+      p.path = job.src;
+      probe( worker, job.src, p );
+
+      std::lock_guard<std::mutex> lk( _mtx );
+      if( p.status ) sum.done++;
+      else sum.failed++;
+      report( p );
+    }
+  } );
+  return sum;
+}
+
+/**
+ * The first exception thrown by any worker stops the others, and is
+ * rethrown once they have all returned.
+ *
+ * @param body run once on each worker
+ */
+void Batch::parallel( const std::function<void( Worker & )> &body )
+{
+  std::exception_ptr error{};
+  auto guarded = [&]( Worker &worker ) {
+    try
+    {
+      body( worker );
+    }
+    catch( ... )
+    {
+      std::lock_guard<std::mutex> lk( _mtx );
+      if( !error )
+        error = std::current_exception();
+      stop();
+    }
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  for( unsigned i=0; i<_workers; i++ ) {
+    workers.emplace_back( new Worker( _config ) );
+  }
+  std::vector<std::thread> threads;
+  for( unsigned i=1; i<_workers; i++ ) {
+    threads.emplace_back( guarded, std::ref( *workers[i] ) );
+  }
+  guarded( *workers[0] );
+  for( std::thread &t : threads ) { t.join(); }
+
+  if( error )
+    std::rethrow_exception( error );
+}
+
+/**
+ * @param worker configs and handlers of this thread
+ * @param source list of jobs
+ * @param report called for every job, may be empty
+ * @param sum IN/OUT : totals
+ */
+void Batch::work( Worker &worker, const Source &source, const Report &report,
+                  Summary &sum )
+{
+  Job job;
+  for( ;; )
+  {
+    {
+      std::lock_guard<std::mutex> lk( _mtx );
+      if( _stopping.load() || !source( job ) )
+        return;
+    }
+
+    Outcome out;
+    Journal::Key key;
+    bool keyed{ _journal && keyOf( job, key ) };
+    if( keyed && _journal->contains( key ) )
+      out.skipped = true;
+    else
+      out.status = modify( worker, job, out );
+
+    // A source modified in place is recorded as it is now.
+    const bool inPlace{ job.dest.empty() };
+    if( keyed && inPlace && !out.skipped && out.status && !out.current )
+      keyed = keyOf( job, key );
+
+    // The file system of a recorded destination is synced by the commit.
+    const std::string &written{ inPlace ? job.src : job.dest };
+    struct stat st;
+    const bool record{ keyed && !out.skipped && out.status &&
+                       ::stat( written.c_str(), &st ) == 0 };
+
+    bool due{false};
+    {
+      std::lock_guard<std::mutex> lk( _mtx );
+      if( out.skipped ) sum.skipped++;
+      else if( out.status ) sum.done++;
+      else sum.failed++;
+      if( out.deduplicated ) sum.deduplicated++;
+      if( out.current ) sum.current++;
+      if( report )
+        report( job, out );
+      if( record )
+      {
+        _pending.push_back( key );
+        const uint64_t dev{ static_cast<uint64_t>( st.st_dev ) };
+        if( _devices.find( dev ) == _devices.end() )
+          _devices.emplace( dev, parentOf( written ) );
+      }
+      due = !_pending.empty() &&
+            ( _pending.size() >= _groupSize ||
+              std::chrono::steady_clock::now() - _lastCommit >= _groupTime );
+    }
+    if( due )
+      commit();
+  }
+}
+
+/**
+ * The source is mapped and read in place.  With deduplication, the first
+ * job of a content modifies it; a later job with the same content waits
+ * until the first is finished, then links or copies its destination.  If
+ * the first job failed, or the link or copy fails, the job modifies its
+ * own source.  Jobs modified in place are not deduplicated.  Failures are
+ * returned, never thrown.
+ *
+ * @param worker configs and handlers of this thread
+ * @param job source and destination
+ * @param out OUT : deduplicated or current
+ * @return Ok, or the failure
+ */
+Status Batch::modify( Worker &worker, const Job &job, Outcome &out )
+{
+  const int fd{ ::open( job.src.c_str(), O_RDONLY | O_CLOEXEC ) };
+  struct stat srcStat, dstStat;
+  if( fd < 0 || ::fstat( fd, &srcStat ) != 0 )
+  {
+    if( fd >= 0 ) ::close( fd );
+    return Status{ MiscueCode::Io, 0 };
+  }
+  // The mapped source must not be truncated by its own destination; a
+  // destination linked to the source, e.g. by an earlier run, is unlinked.
+  if( !job.dest.empty() && ::stat( job.dest.c_str(), &dstStat ) == 0 &&
+      dstStat.st_dev == srcStat.st_dev && dstStat.st_ino == srcStat.st_ino &&
+      ( job.dest == job.src || ::unlink( job.dest.c_str() ) != 0 ) )
+  {
+    ::close( fd );
+    return Status{ MiscueCode::InvalidParameter, 0 };
+  }
+  const size_t size{ static_cast<size_t>( srcStat.st_size ) };
+  MappedSource source;
+  const bool mapped{ source.map( fd, size ) };
+  ::close( fd );
+  if( size == 0 )
+    return Status{ MiscueCode::Truncated, 0 };
+  if( !mapped )
+    return Status{ MiscueCode::Io, 0 };
+  const uint8_t *data{ source.data() };
+
+  if( _dedup == Dedup::Off || job.dest.empty() )
+    return modify( worker, job, data, size, out.current );
+
+  // A PNG Creation Time "file" makes the source's time part of its content.
+  const uint64_t seed{ _paramsHash ^
+    ( _contentHasTime ? static_cast<uint64_t>( srcStat.st_mtime ) : 0 ) };
+  const std::pair<uint64_t, uint64_t> hash{
+    hash64( data, size, seed ), hash64( data, size, ~seed ) };
+  std::unique_lock<std::mutex> lk( _dedupMtx );
+  const auto found = _contents.emplace( hash, Content{} );
+  Content &content{ found.first->second };
+  if( !found.second )
+  {
+    _dedupDone.wait( lk, [&content] { return content.finished; } );
+    const bool ok{ content.status.ok() };
+    const std::string from{ content.dest };
+    lk.unlock();
+    if( ok && replicate( from, job.dest, _dedup == Dedup::Link ) )
+    {
+      out.deduplicated = true;
+      return Status{};
+    }
+    return modify( worker, job, data, size, out.current );
+  }
+  lk.unlock();
+
+  // The waiters are released however modify() returns; a throw is Other.
+  struct Finish {
+    std::unique_lock<std::mutex> &lk;
+    std::condition_variable &done;
+    Content &content;
+    const std::string &dest;
+    Status status{ MiscueCode::Other, 0 };
+    ~Finish() {
+      lk.lock();
+      content.status = status;
+      content.dest = dest;
+      content.finished = true;
+      done.notify_all();
+    }
+  } finish{ lk, _dedupDone, content, job.dest };
+  finish.status = modify( worker, job, data, size, out.current );
+  return finish.status;
+}
+
+/**
+ * The handler of the source's format is created on first use and reused.
+ * A job without destination patches its source in place.  With
+ * skipCurrent(), a current source is left untouched, and linked to its
+ * destination if it has one.
+ *
+ * @param worker configs and handlers of this thread
+ * @param job source and destination
+ * @param data mapped source image
+ * @param size bytes of the source image
+ * @param current OUT : true if the source needed no modification
+ * @return Ok, or the failure
+ */
+Status Batch::modify( Worker &worker, const Job &job, const uint8_t *data,
+                      const size_t size, bool &current )
+{
+  const std::string &format{ _detect ? HandlerRegistry::instance().detect( data, size )
+                                     : _config->compression };
+  if( format.empty() )
+    return Status{ MiscueCode::InvalidSignature, 0 };
+
+  NFIMM *handler{nullptr};
+  try
+  {
+    handler = &worker.handlers.get( format, worker.configs );
+  }
+  catch( const Miscue &e )
+  {
+    return Status{ e.code(), 0 };
+  }
+
+  handler->setSourcePath( job.src );
+  handler->readImageFileIntoBuffer( data, size );
+  if( _skipCurrent && handler->isCurrent() )
+  {
+    current = true;
+    if( job.dest.empty() || replicate( job.src, job.dest, true ) )
+      return Status{};
+    return Status{ MiscueCode::Io, 0 };
+  }
+  if( job.dest.empty() )
+  {
+    try
+    {
+      handler->modifyInPlace( job.src );
+    }
+    catch( const Miscue &e )
+    {
+      return Status{ e.code(), 0 };
+    }
+    catch( const std::exception & )
+    {
+      return Status{ MiscueCode::Other, 0 };
+    }
+    return Status{};
+  }
+  FileSink sink( job.dest );
+  return handler->tryModify( sink );
+}
+
+/**
+ * Failures are set in the probe's status, never thrown.
+ *
+ * @param worker configs and handlers of this thread
+ * @param path source image
+ * @param p OUT : format, status, and header metadata
+ */
+void Batch::probe( Worker &worker, const std::string &path, ImageProbe &p )
+{
+  const int fd{ ::open( path.c_str(), O_RDONLY | O_CLOEXEC ) };
+  struct stat st;
+  if( fd < 0 || ::fstat( fd, &st ) != 0 )
+  {
+    if( fd >= 0 ) ::close( fd );
+    p.status = Status{ MiscueCode::Io, 0 };
+    return;
+  }
+  const size_t size{ static_cast<size_t>( st.st_size ) };
+  MappedSource source;
+  const bool mapped{ source.map( fd, size ) };
+  ::close( fd );
+  if( !mapped )
+  {
+    p.status = Status{ size ? MiscueCode::Io : MiscueCode::Truncated, 0 };
+    return;
+  }
+  const uint8_t *data{ source.data() };
+  p.size = size;
+  if( _hashContent )
+    p.contentHash = { hash64( data, size ), hash64( data, size, ~uint64_t{0} ) };
+
+  const std::string &format{ _detect ? HandlerRegistry::instance().detect( data, size )
+                                     : _config->compression };
+  if( format.empty() )
+  {
+    p.status = Status{ MiscueCode::InvalidSignature, 0 };
+    return;
+  }
+  NFIMM *handler{nullptr};
+  try
+  {
+    handler = &worker.handlers.get( format, worker.configs );
+  }
+  catch( const Miscue &e )
+  {
+    p.format = format;
+    p.status = Status{ e.code(), 0 };
+    return;
+  }
+  handler->setSourcePath( path );
+  handler->readImageFileIntoBuffer( data, size );
+  handler->probe( p );
+}
+
+/**
+ * Neither file is opened: the source is only stat()ed.  A source replaced,
+ * rewritten, or touched since it was recorded has another key.
+ *
+ * @param job source and destination
+ * @param key OUT : identity of the job
+ * @return false if the source cannot be stat()ed
+ */
+bool Batch::keyOf( const Job &job, Journal::Key &key ) const
+{
+  struct stat st;
+  if( ::stat( job.src.c_str(), &st ) != 0 )
+    return false;
+#ifdef __APPLE__
+  const struct timespec &mtime{ st.st_mtimespec };
+#else
+  const struct timespec &mtime{ st.st_mtim };
+#endif
+  const uint64_t state[]{ static_cast<uint64_t>( st.st_size ),
+                          static_cast<uint64_t>( mtime.tv_sec ),
+                          static_cast<uint64_t>( mtime.tv_nsec ),
+                          static_cast<uint64_t>( st.st_ino ), _paramsHash };
+  key.path = hash64( job.dest, hash64( job.src ) );
+  key.state = hash64( state, sizeof( state ) );
+  return true;
+}
+
+/**
+ * Commits are serialized; jobs keep running meanwhile.  The destinations
+ * of the records are flushed before the records, by one syncfs() per file
+ * system on Linux, by sync() elsewhere.
+ *
+ * @throw Miscue Cannot sync a destination or write the journal
+ */
+void Batch::commit()
+{
+  std::lock_guard<std::mutex> commitLk( _commitMtx );
+  std::vector<Journal::Key> keys;
+  std::map<uint64_t, std::string> devices;
+  {
+    std::lock_guard<std::mutex> lk( _mtx );
+    keys.swap( _pending );
+    devices.swap( _devices );
+    _lastCommit = std::chrono::steady_clock::now();
+  }
+  if( keys.empty() )
+    return;
+
+#ifdef __linux__
+  for( const auto &dev : devices )
+  {
+    const int fd{ ::open( dev.second.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC ) };
+    const bool synced{ fd >= 0 && ::syncfs( fd ) == 0 };
+    if( fd >= 0 ) ::close( fd );
+    if( !synced )
+      throw Miscue( MiscueCode::Io, "CANNOT sync destinations in '" +
+                    dev.second + "': " + std::strerror( errno ) );
+  }
+#else
+  ::sync();
+#endif
+  _journal->write( keys );
+}
+
+}   // END namespace
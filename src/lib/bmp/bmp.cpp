@@ -27,7 +27,9 @@ identified are necessarily the best available for the purpose.
 *******************************************************************************/
 
 #include "bmp/bmp.h"
+#include "probe.h"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -39,120 +41,262 @@ namespace NFIMM {
 */
 BMP::BMP( std::shared_ptr<MetadataParameters> &mps ) : NFIMM(mps)
 {
-  _params->loggit( "Initialize for BMP modification" );
+  s_r_cursor = 0;
+  s_writeBuffer.clear();
+}
+
+/** 
+ * Initialize the read-buffer cursor and clear the write-buffer.
+*/
+BMP::BMP( std::shared_ptr<const ModificationConfig> cfg )
+    : NFIMM(std::move(cfg))
+{
   s_r_cursor = 0;
   s_writeBuffer.clear();
 }
 
 /**
- * Parse the image file's header and update with new parameters.
- * @throw Miscue Invalid image FILE or INFO header, calculated image-size
- *   mismatch
+ * Parse the image file's header and update with new parameters.  The
+ * destination image is the same size as the source image.
+ *
+ * @param pln OUT : destination image size and edits
+ * @throw Miscue Invalid image FILE or INFO header, source image shorter
+ *   than its file header size
  */
-void BMP::modify()
+void BMP::planImage( ModificationPlan &pln )
 {
-  std::unique_ptr<FileHeader> fileHeader(new FileHeader( _params ));
-  std::unique_ptr<InfoHeader> infoHeader(new InfoHeader( _params ));
+  _result.loggit( "Initialize for BMP modification" );
+  s_r_cursor = 0;
+  std::unique_ptr<FileHeader> fileHeader(new FileHeader( _result ));
+  std::unique_ptr<InfoHeader> infoHeader(new InfoHeader( *_config, _result ));
   try
   {
     fileHeader->read();
-    _params->loggit( fileHeader->to_s( "READ file header:" ) );
+    if( _result.logging )
+      _result.loggit( fileHeader->to_s( "READ file header:" ) );
     infoHeader->read();
-    _params->loggit( infoHeader->to_s( "READ info header:" ) );
+    if( _result.logging )
+      _result.loggit( infoHeader->to_s( "READ info header:" ) );
   }
-  catch( const Miscue &e )
+  catch( const Miscue & )
   {
-    throw e;
+    throw;
   }
   
-  // Check that File header calculated size image == Info header Size image
-  if( fileHeader->_actual.calculated_size_image == infoHeader->_actual.size_image )
+  // Check that File header calculated size image == Info header Size image.
+  // Neither is changed, so a mismatch is only logged.
+  if( !infoHeader->hasResolution() )
+  {
+    _result.loggit( "BITMAPCOREHEADER: no image-size or sample rate fields" );
+  }
+  else if( fileHeader->_actual.calculated_size_image == infoHeader->_actual.size_image )
   {
-    _params->loggit(
+    _result.loggit(
       "VALIDATION OK: FILEHEADER calculated size equals INFOHEADER file size." );
-    _params->loggit(
+    _result.loggit(
       "calc size:   " + std::to_string( fileHeader->_actual.calculated_size_image ) );
-    _params->loggit(
+    _result.loggit(
       "actual size: " + std::to_string( infoHeader->_actual.size_image ) );
   }
-  else if( infoHeader->_actual.size_image == 0 )
+  else
   {
     std::string err{"INFOHEADER image-size: "};
     err.append( "calculated size: " +
       std::to_string( fileHeader->_actual.calculated_size_image ) );
     err.append( ", src image header actual size: " +
       std::to_string( infoHeader->_actual.size_image ) );
-    err.append( "  where 0 is OK" );
-    _params->loggit( err );
-    infoHeader->_actual.size_image = fileHeader->_actual.fileSize
-                                   - fileHeader->_actual.offsetToPixelData;
+    if( infoHeader->_actual.size_image == 0 )
+      err.append( "  where 0 is OK" );
+    _result.loggit( err );
+  }
+  
+  // The color table, if any, and pixel data follow the headers; their size
+  // is full size of file minus size of headers.
+  const uint32_t headersEnd = NUM_BYTES_BITMAPFILEHEADER
+                            + infoHeader->_actual.headerCountBytes;
+  const uint32_t countPixelData = fileHeader->_actual.fileSize - headersEnd;
+
+  if( fileHeader->_actual.fileSize < headersEnd )
+  {
+    std::string err{"ERROR: BMP file size smaller than headers: "};
+    err.append( std::to_string( fileHeader->_actual.fileSize ) );
+    _result.loggit( err );
+    throw Miscue( MiscueCode::InvalidHeader, err );
+  }
+  if( s_readSize < fileHeader->_actual.fileSize && !s_readPartial )
+  {
+    std::string err{"BMP pixel data truncated: file size "};
+    err.append( std::to_string( fileHeader->_actual.fileSize ) + ", have " +
+      std::to_string( s_readSize ) );
+    _result.loggit( err );
+    throw Miscue( MiscueCode::Truncated, err );
+  }
+
+  // At this point, replace the sample rate.
+  infoHeader->update();
+  if( _result.logging )
+    _result.loggit( infoHeader->to_s( "WRITE info header:" ) );
+
+  // Only the sample rate is written; every other header byte, the color
+  // table, and the pixel data are referenced in the source image.
+  pln.keep( "File header", 0, NUM_BYTES_BITMAPFILEHEADER );
+  if( infoHeader->hasResolution() )
+  {
+    const uint32_t ppmOffset = NUM_BYTES_BITMAPFILEHEADER
+                             + InfoHeader::OFFSET_X_PELS_PER_METER;
+    uint8_t ppm[8];
+    std::copy( infoHeader->_biXPelsPerMeter, infoHeader->_biXPelsPerMeter + 4,
+               ppm );
+    std::copy( infoHeader->_biYPelsPerMeter, infoHeader->_biYPelsPerMeter + 4,
+               ppm + 4 );
+    pln.keep( "Info header", NUM_BYTES_BITMAPFILEHEADER,
+              InfoHeader::OFFSET_X_PELS_PER_METER );
+    pln.update( "Pels per meter", ppm, sizeof( ppm ) );
+    pln.keep( "Info header", ppmOffset + sizeof( ppm ),
+              headersEnd - ppmOffset - sizeof( ppm ) );
   }
   else
   {
-    std::string err{"File header calculated image-size ERROR: "};
-    err.append( "calc size: " +
-      std::to_string( fileHeader->_actual.calculated_size_image ) );
-    err.append( ", actual size: " +
-      std::to_string( infoHeader->_actual.size_image ) );
-    _params->loggit( err );
-    throw Miscue( err );
+    pln.keep( "Info header", NUM_BYTES_BITMAPFILEHEADER,
+              infoHeader->_actual.headerCountBytes );
   }
-  
-  // Read the pixel data; the s_r_cursor is the start point; the size of the
-  // image pixel data is full size of file minus size of headers.
-  uint32_t countPixelData = fileHeader->_actual.fileSize
-                          - NUM_BYTES_BITMAPFILEHEADER
-                          - infoHeader->_actual.headerCountBytes;
+  pln.keep( "Pixel data", headersEnd,
+            s_readPartial ? s_readSize - headersEnd : countPixelData );
+}   // END planImage()
 
-  std::vector<uint8_t> sourceImagePixels;
-  readImagePixels( countPixelData, sourceImagePixels );
+/**
+ * Checks the same conditions as planImage(), reading the header fields in
+ * place:
+ * - 'BM' identifier
+ * - DIB header size is supported
+ * - headers, color table and pixel data lie within the source image
+ *
+ * @return Ok, or the first failure found and its source image offset
+ */
+Status BMP::validateImage() const noexcept
+{
+  const uint8_t *buf{ s_readData };
+  const size_t size{ s_readSize };
+  auto le32 = [buf]( const size_t offset ) {
+    uint32_t val{0};
+    NFIMM::expressFourBytesAsUINT32( val, buf + offset, false );
+    return val;
+  };
 
-  // At this point, replace the file size, width, height, and sample rate.
-  fileHeader->headerAsVector();
-  infoHeader->update();
-  infoHeader->headerAsVector();
-  _params->loggit( fileHeader->to_s( "WRITE file header:" ) );
-  _params->loggit( infoHeader->to_s( "WRITE info header:" ) );
-
-  s_w_cursor = 0;
-  // File header
-  xferBytesBetweenBuffers( s_writeBuffer, fileHeader->_vecEntireHeader );
-  // Info header
-  xferBytesBetweenBuffers( s_writeBuffer, infoHeader->_vecEntireHeader );
-  // Pixel data
-  xferBytesBetweenBuffers( s_writeBuffer, sourceImagePixels );
-}   // END modify()
+  if( size < NUM_BYTES_BITMAPFILEHEADER + 4u )
+    return Status{ MiscueCode::Truncated, 0 };
+  if( buf[0] != 0x42 || buf[1] != 0x4D )   // 'BM'
+    return Status{ MiscueCode::InvalidSignature, 0 };
+
+  const uint32_t headerSize{ le32( NUM_BYTES_BITMAPFILEHEADER ) };
+  if( !isSupportedHeaderSize( headerSize ) )
+    return Status{ MiscueCode::Unsupported, NUM_BYTES_BITMAPFILEHEADER };
+  const size_t headersEnd{ NUM_BYTES_BITMAPFILEHEADER + headerSize };
+  if( size < headersEnd )
+    return Status{ MiscueCode::Truncated, NUM_BYTES_BITMAPFILEHEADER };
+
+  const uint32_t fileSize{ le32( 2 ) };
+  if( fileSize < headersEnd )
+    return Status{ MiscueCode::InvalidHeader, 2 };
+  if( size < fileSize && !s_readPartial )
+    return Status{ MiscueCode::Truncated, headersEnd };
+  return Status{};
+}
 
 /**
- * Read the remaining bytes from source image AFTER the two headers. Therefore,
- * the "starting point" for the read is the current read-cursor value.
- * 
- * @param len total num bytes to read
- * @param toVec receiving container for the bytes
+ * The plan needs the file and DIB headers only; the color table and the
+ * pixel data are passed through.
+ *
+ * @param buf first bytes of the source image
+ * @param size number of bytes read
+ * @return end of the DIB header, 0 if its size is not yet read, or SIZE
+ *   when the image is not a supported BMP
  */
-void BMP::readImagePixels( const uint32_t len, std::vector<uint8_t> &toVec )
+size_t BMP::streamHeadLength( const uint8_t *buf, const size_t size ) const noexcept
 {
-  for( uint32_t i=NFIMM::s_r_cursor; i<len+NFIMM::s_r_cursor; i++ ) {
-    toVec.push_back( NFIMM::s_readBuffer[i] );
-  }
+  if( size < NUM_BYTES_BITMAPFILEHEADER + 4u )
+    return 0;
+  uint32_t headerSize{0};
+  expressFourBytesAsUINT32( headerSize, buf + NUM_BYTES_BITMAPFILEHEADER, false );
+  if( buf[0] != 0x42 || buf[1] != 0x4D || !isSupportedHeaderSize( headerSize ) )
+    return size;
+  return NUM_BYTES_BITMAPFILEHEADER + headerSize;
 }
 
-/** @return current Metadata Parameters */
-std::string BMP::to_s()
+/**
+ * The headers are validated as by validateImage() and their fields read in
+ * place; the sample rate is pixels per meter, units == 1.
+ *
+ * @param probe OUT : DIB header fields
+ * @return Ok, or the validation failure
+ */
+Status BMP::probeImage( ImageProbe &probe )
 {
-  std::string s{"BMP: "};
-  s.append( _params->to_s() );
-  return s;
+  const Status st{ validateImage() };
+  if( !st )
+    return st;
+
+  const uint8_t *dib{ s_readData + NUM_BYTES_BITMAPFILEHEADER };
+  auto le16 = [dib]( const size_t offset ) {
+    return static_cast<uint16_t>( dib[offset] | dib[offset+1] << 8 );
+  };
+  auto le32 = [dib]( const size_t offset ) {
+    uint32_t val{0};
+    NFIMM::expressFourBytesAsUINT32( val, dib + offset, false );
+    return val;
+  };
+
+  probe.dibHeaderSize = le32( 0 );
+  probe.headerEnd = NUM_BYTES_BITMAPFILEHEADER + probe.dibHeaderSize;
+  if( probe.dibHeaderSize == NUM_BYTES_DIB_BITMAPCOREHEADER )
+  {
+    probe.width = le16( 4 );
+    probe.height = le16( 6 );
+    probe.bitDepth = le16( 10 );
+    return Status{};
+  }
+  // Height is negative for a top-down image.
+  const int32_t width{ static_cast<int32_t>( le32( 4 ) ) };
+  const int32_t height{ static_cast<int32_t>( le32( 8 ) ) };
+  probe.width = width < 0 ? 0u - static_cast<uint32_t>( width ) : width;
+  probe.height = height < 0 ? 0u - static_cast<uint32_t>( height ) : height;
+  probe.bitDepth = le16( 14 );
+  probe.compression = le32( 16 );
+  probe.resolutionExists = true;
+  probe.horiz = le32( InfoHeader::OFFSET_X_PELS_PER_METER );
+  probe.vert = le32( InfoHeader::OFFSET_X_PELS_PER_METER + 4 );
+  probe.units = 1;
+  probe.resolutionOffset =
+    NUM_BYTES_BITMAPFILEHEADER + InfoHeader::OFFSET_X_PELS_PER_METER;
+  return Status{};
 }
 
 /**
- * @param to buffer to receive bytes
- * @param from buffer to take bytes
+ * @param headerSize value of the first 4 bytes of the DIB header
+ * @return true if the header is one of those listed in BMP
  */
-void BMP::xferBytesBetweenBuffers( std::vector<uint8_t> &to,
-                                   const std::vector<uint8_t> &from )
+bool BMP::isSupportedHeaderSize( const uint32_t headerSize )
 {
-  for( uint8_t byte : from ) { to.push_back( byte ); }
+  switch( headerSize ) {
+    case NUM_BYTES_DIB_BITMAPCOREHEADER:
+    case NUM_BYTES_DIB_BITMAPINFOHEADER:
+    case NUM_BYTES_DIB_BITMAPV2INFOHEADER:
+    case NUM_BYTES_DIB_BITMAPV3INFOHEADER:
+    case NUM_BYTES_DIB_OS22XBITMAPHEADER:
+    case NUM_BYTES_DIB_BITMAPV4HEADER:
+    case NUM_BYTES_DIB_BITMAPV5HEADER:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/** @return current Metadata Parameters */
+std::string BMP::to_s()
+{
+  std::string s{"BMP: "};
+  s.append( _config->to_s() );
+  return s;
 }
 
 
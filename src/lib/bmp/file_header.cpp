@@ -32,21 +32,10 @@ namespace NFIMM {
 
 
 /**
- * @param mps needed to update the runtime log
+ * @param result needed to update the runtime log
  */
-FileHeader::FileHeader( std::shared_ptr<MetadataParameters> &mps )
-           : _params(mps) {}
-
-/** Load each data element into single container. */
-void FileHeader::headerAsVector() {
-
-  for( int i=0; i<BMP::NUM_BYTES_BM_IDENTIFIER; i++ )
-     { _vecEntireHeader.push_back(_bfType[i] ); }
-  for( int i=0; i<4; i++ ) { _vecEntireHeader.push_back( _bfSize[i] ); }
-  for( int i=0; i<2; i++ ) { _vecEntireHeader.push_back( _bfReserved1[i] ); }
-  for( int i=0; i<2; i++ ) { _vecEntireHeader.push_back( _bfReserved2[i] ); }
-  for( int i=0; i<4; i++ ) { _vecEntireHeader.push_back( _bfOffBits[i] ); }
-}
+FileHeader::FileHeader( ModificationResult &result )
+           : _result(result) {}
 
 /** Specified to contain the following values:\n
  *   bytes 0 and 1: 'BM' for Windows and is most common, most likely supported\n
@@ -63,8 +52,9 @@ void FileHeader::headerAsVector() {
  */
 void FileHeader::read()
 {
-  _params->loggit( "FileHeader _readBuffer size: " +
-                    std::to_string( NFIMM::s_readBuffer.size() ) );
+  if( _result.logging )
+    _result.loggit( "FileHeader _readBuffer size: " +
+                      std::to_string( NFIMM::s_readSize ) );
   NFIMM::nextLengthBytes( BMP::NUM_BYTES_BM_IDENTIFIER, _bfType );
   // Validate BMP identifier.
   for( int i=0; i<BMP::NUM_BYTES_BM_IDENTIFIER; i++ ) {
@@ -72,8 +62,8 @@ void FileHeader::read()
       continue;
     else {
       std::string err{"ERROR: First 2-bytes of file header not 'BM'"};
-      _params->loggit( err );
-      throw Miscue( err );
+      _result.loggit( err );
+      throw Miscue( MiscueCode::InvalidSignature, err );
     }
   }
 
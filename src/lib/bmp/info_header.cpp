@@ -31,34 +31,27 @@ identified are necessarily the best available for the purpose.
 namespace NFIMM {
 
 /**
- * @param mps needed to update the runtime log
+ * @param cfg destination sample rate
+ * @param result needed to update the runtime log and source image metadata
  */
-
-InfoHeader::InfoHeader( std::shared_ptr<MetadataParameters> &mps )
-           : _params(mps) {}
-
-/** Load each data element into single container. */
-void InfoHeader::headerAsVector() {
-
-  for( int i=0; i<4; i++ ) { _vecEntireHeader.push_back( _biSize[i] ); }
-  for( int i=0; i<4; i++ ) { _vecEntireHeader.push_back( _biWidth[i] ); }
-  for( int i=0; i<4; i++ ) { _vecEntireHeader.push_back( _biHeight[i] ); }
-  for( int i=0; i<2; i++ ) { _vecEntireHeader.push_back( _biPlanes[i] ); }
-  for( int i=0; i<2; i++ ) { _vecEntireHeader.push_back( _biBitCount[i] ); }
-  for( int i=0; i<4; i++ ) { _vecEntireHeader.push_back( _biCompression[i] ); }
-  for( int i=0; i<4; i++ ) { _vecEntireHeader.push_back( _biSizeImage[i] ); }
-  for( int i=0; i<4; i++ ) { _vecEntireHeader.push_back( _biXPelsPerMeter[i] ); }
-  for( int i=0; i<4; i++ ) { _vecEntireHeader.push_back( _biYPelsPerMeter[i] ); }
-  for( int i=0; i<4; i++ ) { _vecEntireHeader.push_back( _biClrUsed[i] ); }
-  for( int i=0; i<4; i++ ) { _vecEntireHeader.push_back( _biClrImportant[i] ); }
-}
+InfoHeader::InfoHeader( const ModificationConfig &cfg,
+                        ModificationResult &result )
+           : _config(cfg), _result(result) {}
 
 /**
- * Immediately follows the BMP File Header. NFIMM only supports header that
- * contains exactly 40 bytes.
+ * Immediately follows the BMP File Header.  See BMP for the supported header
+ * sizes.
+ *
+ * The BITMAPCOREHEADER (12 bytes) contains:\n
+ *   bytes 0-3:    size of this header - must == 12\n
+ *   bytes 4-5:    image width\n
+ *   bytes 6-7:    image height\n
+ *   bytes 8-9:    count of planes - must == 1\n
+ *   bytes 10-11:  bits/pixel 1,4,8 or 24
  *
- *  Specified to contain the following values:\n
- *   bytes 0-3:    size of this header - must == 40\n
+ * All other headers begin with the BITMAPINFOHEADER (40 bytes), which is
+ *  specified to contain the following values:\n
+ *   bytes 0-3:    size of this header\n
  *   bytes 4-7:    image width\n
  *   bytes 8-11:   image height\n
  *   bytes 12-13:  count of planes - must == 1\n
@@ -70,23 +63,28 @@ void InfoHeader::headerAsVector() {
  *   bytes 32-35:  num entries in color map that are used\n
  *   bytes 36-39:  num significant colors
  *
- * Reads the entire header and saves accordingly.
+ * Reads the BITMAPINFOHEADER part of the header and saves accordingly; the
+ * remaining bytes of the larger headers (color masks, color space, ICC
+ * profile) are skipped, they are passed to the destination image unchanged.
  *
- * If the size of the header is not equal to 40 bytes return immediately and
- * forgo reading the rest of the header.
+ * If the size of the header is not supported return immediately and forgo
+ * reading the rest of the header.
  */
 void InfoHeader::read()
 {
   NFIMM::next4bytes( _biSize );
-  // Validate that the header == 40 bytes
+  // Validate the header size
   NFIMM::expressFourBytesAsUINT32( _actual.headerCountBytes, _biSize, false );
-  if( _actual.headerCountBytes == BMP::NUM_BYTES_DIB_BITMAPINFOHEADER )
-  {}
-  else {
-    std::string err{"ERROR: INFOHEADER size not == 40 bytes, is "};
+  if( !BMP::isSupportedHeaderSize( _actual.headerCountBytes ) ) {
+    std::string err{"ERROR: DIB header size not supported: "};
     err += std::to_string( _actual.headerCountBytes );
-    _params->loggit( err );
-    throw Miscue( err );
+    _result.loggit( err );
+    throw Miscue( MiscueCode::Unsupported, err );
+  }
+
+  if( _actual.headerCountBytes == BMP::NUM_BYTES_DIB_BITMAPCOREHEADER ) {
+    readCore();
+    return;
   }
 
   NFIMM::next4bytes( _biWidth );
@@ -120,10 +118,42 @@ void InfoHeader::read()
   NFIMM::expressFourBytesAsUINT32( _actual.vertical_ppmm, _biYPelsPerMeter, false );
   NFIMM::convertPPMMtoPPI( _actual.vertical_ppmm, _actual.vertical_ppi );
 
+  _result.srcImg.width    = _actual.width;
+  _result.srcImg.height   = _actual.height;
+  _result.srcImg.bitDepth = _actual.bit_depth;
+  _result.srcImg.resolutionExists = true;
+  _result.srcImg.resolution.horiz = _actual.horizontal_ppmm;
+  _result.srcImg.resolution.vert  = _actual.vertical_ppmm;
+  _result.srcImg.resolution.units = 1;   // meter
+
   NFIMM::next4bytes( _biClrUsed );
   NFIMM::expressFourBytesAsUINT32( _actual.colors_used, _biClrUsed, false );
   NFIMM::next4bytes( _biClrImportant );
   NFIMM::expressFourBytesAsUINT32( _actual.colors_important, _biClrImportant, false );
+
+  NFIMM::s_r_cursor +=
+    _actual.headerCountBytes - BMP::NUM_BYTES_DIB_BITMAPINFOHEADER;
+}
+
+/**
+ * The 16-bit width and height are read into the low bytes of the 32-bit
+ * fields.  There is no sample rate in this header.
+ */
+void InfoHeader::readCore()
+{
+  NFIMM::nextLengthBytes( 2, _biWidth );
+  NFIMM::expressFourBytesAsUINT32( _actual.width, _biWidth, false );
+  NFIMM::nextLengthBytes( 2, _biHeight );
+  NFIMM::expressFourBytesAsUINT32( _actual.height, _biHeight, false );
+  NFIMM::nextLengthBytes( 2, _biPlanes );
+  NFIMM::expressTwoBytesAsUINT16( _actual.count_planes, _biPlanes, false );
+  NFIMM::nextLengthBytes( 2, _biBitCount );
+  NFIMM::expressTwoBytesAsUINT16( _actual.bit_depth, _biBitCount, false );
+
+  _result.srcImg.width    = _actual.width;
+  _result.srcImg.height   = _actual.height;
+  _result.srcImg.bitDepth = _actual.bit_depth;
+  _result.srcImg.resolutionExists = false;
 }
 
 
@@ -170,22 +200,21 @@ std::string InfoHeader::to_s_hex() {
 }
 
 /**
- * Convert PPI values to PPMM and load into the Info header container.
- * Load the image size value into the Info header container.
+ * Convert PPI values to PPMM and load into the Info header container.  No
+ * other field is changed.  The BITMAPCOREHEADER has no sample rate and is
+ * not changed.
  */
 void InfoHeader::update()
 {
-  _actual.horizontal_ppi = _params->destImg.resolution.horiz;
-  _actual.vertical_ppi   = _params->destImg.resolution.vert;
+  if( !hasResolution() ) return;
 
-  NFIMM::convertPPItoPPMM( _params->destImg.resolution.horiz, _actual.horizontal_ppmm );
+  _actual.horizontal_ppi = _config.destResolution.horiz;
+  _actual.vertical_ppi   = _config.destResolution.vert;
+
+  NFIMM::convertPPItoPPMM( _config.destResolution.horiz, _actual.horizontal_ppmm );
   NFIMM::expressUINT32AsFourBytes( _actual.horizontal_ppmm, _biXPelsPerMeter, false );
-  NFIMM::convertPPItoPPMM( _params->destImg.resolution.vert, _actual.vertical_ppmm );
+  NFIMM::convertPPItoPPMM( _config.destResolution.vert, _actual.vertical_ppmm );
   NFIMM::expressUINT32AsFourBytes( _actual.vertical_ppmm, _biYPelsPerMeter, false );
-
-  // In case where bitmap-size was == 0 in the source image, which is ok if
-  // image not compressed, go ahead and update with _actual value.
-  NFIMM::expressUINT32AsFourBytes( _actual.size_image, _biSizeImage, false );
 }
 
 
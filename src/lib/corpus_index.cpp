@@ -0,0 +1,478 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "corpus_index.h"
+#include "hash.h"
+#include "output_sink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace NFIMM {
+
+namespace {
+
+/** @brief Bytes before the first entry: MAGIC, VERSION, entry size, number
+ * of entries, bytes of the paths */
+const size_t INDEX_HEADER_SIZE{32};
+
+/** @brief Set the file state of the entry */
+void setState( CorpusIndex::Entry &e, const struct stat &st )
+{
+#ifdef __APPLE__
+  const struct timespec &mtime{ st.st_mtimespec };
+#else
+  const struct timespec &mtime{ st.st_mtim };
+#endif
+  e.size = static_cast<uint64_t>( st.st_size );
+  e.inode = static_cast<uint64_t>( st.st_ino );
+  e.mtimeSec = static_cast<int64_t>( mtime.tv_sec );
+  e.mtimeNsec = static_cast<uint32_t>( mtime.tv_nsec );
+}
+
+/** @brief Round the rate per meter or per centimeter to per inch */
+uint32_t perInch( const uint32_t rate, const uint64_t perUnit )
+{
+  return static_cast<uint32_t>( ( uint64_t{rate} * 254 + perUnit / 2 ) / perUnit );
+}
+
+}   // END namespace
+
+
+/******************************************************************************/
+/* class CorpusIndex::Query methods implementations */
+
+/**
+ * @param conditions comma-separated list, see Query
+ * @throw Miscue Unknown field, operator, or value
+ */
+CorpusIndex::Query::Query( const std::string &conditions )
+{
+  static const char *const fields[]{ "width", "height", "depth", "horiz", "vert",
+                                     "units", "ppi", "size", "code" };
+  size_t start{0};
+  while( start <= conditions.size() )
+  {
+    size_t end{ conditions.find( ',', start ) };
+    if( end == std::string::npos )
+      end = conditions.size();
+    const std::string term{ conditions.substr( start, end - start ) };
+    start = end + 1;
+    if( term.empty() )
+      continue;
+
+    const size_t at{ term.find_first_of( "<>=" ) };
+    if( at == std::string::npos || at == 0 )
+      throw Miscue( MiscueCode::InvalidParameter, "Invalid query condition: '" + term + "'" );
+    Condition cond;
+    cond.field = term.substr( 0, at );
+    const size_t opLength{ term.compare( at + 1, 1, "=" ) == 0 && term[at] != '=' ? 2u : 1u };
+    cond.op = term.substr( at, opLength );
+    const std::string value{ term.substr( at + opLength ) };
+
+    if( cond.field == "format" )
+    {
+      if( cond.op != "=" || value.empty() )
+        throw Miscue( MiscueCode::InvalidParameter, "Invalid query condition: '" + term + "'" );
+      _format = value;
+      continue;
+    }
+    if( std::find_if( std::begin( fields ), std::end( fields ),
+                      [&cond]( const char *f ) { return cond.field == f; } ) ==
+        std::end( fields ) )
+      throw Miscue( MiscueCode::InvalidParameter, "Unknown query field: '" + cond.field + "'" );
+    char *stop{nullptr};
+    cond.value = std::strtoull( value.c_str(), &stop, 10 );
+    if( value.empty() || *stop != '\0' )
+      throw Miscue( MiscueCode::InvalidParameter, "Invalid query value: '" + term + "'" );
+    _conditions.push_back( cond );
+  }
+}
+
+/**
+ * @param e indexed image
+ * @return true if the entry meets every condition
+ */
+bool CorpusIndex::Query::matches( const Entry &e ) const
+{
+  if( !_format.empty() &&
+      _format.compare( 0, std::string::npos, e.format,
+                       strnlen( e.format, sizeof( e.format ) ) ) != 0 )
+    return false;
+
+  auto holds = []( const uint64_t val, const Condition &cond ) {
+    if( cond.op == "=" ) return val == cond.value;
+    if( cond.op == "<" ) return val < cond.value;
+    if( cond.op == ">" ) return val > cond.value;
+    if( cond.op == "<=" ) return val <= cond.value;
+    return val >= cond.value;
+  };
+  for( const Condition &cond : _conditions )
+  {
+    if( cond.field == "ppi" )
+    {
+      uint32_t horiz{0}, vert{0};
+      if( !ppi( e, horiz, vert ) || !holds( horiz, cond ) || !holds( vert, cond ) )
+        return false;
+      continue;
+    }
+    const uint64_t val{
+      cond.field == "width"  ? e.width :
+      cond.field == "height" ? e.height :
+      cond.field == "depth"  ? e.bitDepth :
+      cond.field == "horiz"  ? e.horiz :
+      cond.field == "vert"   ? e.vert :
+      cond.field == "units"  ? e.units :
+      cond.field == "size"   ? e.size :
+                               static_cast<uint64_t>( e.code ) };
+    if( !holds( val, cond ) )
+      return false;
+  }
+  return true;
+}
+
+
+/******************************************************************************/
+/* class CorpusIndex methods implementations */
+
+/**
+ * @param path index file
+ * @throw Miscue Cannot read the file, or it is not an index of this version
+ */
+CorpusIndex::CorpusIndex( const std::string &path ) : _path(path)
+{
+  const int fd{ ::open( path.c_str(), O_RDONLY | O_CLOEXEC ) };
+  if( fd < 0 && errno == ENOENT )
+    return;
+  struct stat st;
+  if( fd < 0 || ::fstat( fd, &st ) != 0 )
+  {
+    const std::string err{ std::strerror( errno ) };
+    if( fd >= 0 ) ::close( fd );
+    throw Miscue( MiscueCode::Io, "CANNOT open index '" + path + "': " + err );
+  }
+  _mapSize = static_cast<size_t>( st.st_size );
+  _map = _mapSize ? ::mmap( nullptr, _mapSize, PROT_READ, MAP_SHARED, fd, 0 ) : nullptr;
+  ::close( fd );
+  if( _map == MAP_FAILED )
+  {
+    _map = nullptr;
+    throw Miscue( MiscueCode::Io, "CANNOT map index '" + path + "'" );
+  }
+
+  const uint8_t *buf{ static_cast<const uint8_t *>( _map ) };
+  uint32_t version{0}, entrySize{0};
+  uint64_t count{0}, pathsSize{0};
+  if( _mapSize >= INDEX_HEADER_SIZE )
+  {
+    std::memcpy( &version, buf + 8, sizeof( version ) );
+    std::memcpy( &entrySize, buf + 12, sizeof( entrySize ) );
+    std::memcpy( &count, buf + 16, sizeof( count ) );
+    std::memcpy( &pathsSize, buf + 24, sizeof( pathsSize ) );
+  }
+  if( _mapSize < INDEX_HEADER_SIZE || std::memcmp( buf, MAGIC, sizeof( MAGIC ) ) != 0 ||
+      version != VERSION || entrySize != sizeof( Entry ) ||
+      count > ( _mapSize - INDEX_HEADER_SIZE ) / sizeof( Entry ) ||
+      INDEX_HEADER_SIZE + count * sizeof( Entry ) + pathsSize != _mapSize )
+  {
+    if( _map ) ::munmap( _map, _mapSize );
+    _map = nullptr;
+    throw Miscue( MiscueCode::InvalidHeader, "Not an index of this version: '" + path + "'" );
+  }
+  _entries = reinterpret_cast<const Entry *>( buf + INDEX_HEADER_SIZE );
+  _count = static_cast<size_t>( count );
+  _paths = reinterpret_cast<const char *>( _entries + _count );
+  _pathsSize = static_cast<size_t>( pathsSize );
+}
+
+/** Readers of the entries must be done. */
+CorpusIndex::~CorpusIndex()
+{
+  if( _map )
+    ::munmap( _map, _mapSize );
+}
+
+/**
+ * @param path image PATH, as listed when the index was refreshed
+ * @return its entry, nullptr if none
+ */
+const CorpusIndex::Entry *CorpusIndex::find( const std::string &path ) const
+{
+  const uint64_t hash{ hash64( path ) };
+  const Entry *e{ std::lower_bound( begin(), end(), hash,
+    []( const Entry &entry, const uint64_t h ) { return entry.pathHash < h; } ) };
+  for( ; e != end() && e->pathHash == hash; ++e ) {
+    if( e->pathLength == path.size() && pathOf( *e ) == path )
+      return e;
+  }
+  return nullptr;
+}
+
+/**
+ * @param e entry of this index
+ * @return its path
+ * @throw Miscue Path outside the index
+ */
+std::string CorpusIndex::pathOf( const Entry &e ) const
+{
+  if( e.pathOffset > _pathsSize || e.pathLength > _pathsSize - e.pathOffset )
+    throw Miscue( MiscueCode::InvalidHeader, "Corrupt index: '" + _path + "'" );
+  return std::string( _paths + e.pathOffset, e.pathLength );
+}
+
+/**
+ * @param e entry of this index
+ * @return header metadata as probed when the entry was made
+ */
+ImageProbe CorpusIndex::probeOf( const Entry &e ) const
+{
+  ImageProbe p;
+  p.path = pathOf( e );
+  p.format.assign( e.format, strnlen( e.format, sizeof( e.format ) ) );
+  p.status = Status{ static_cast<MiscueCode>( e.code ), e.statusOffset };
+  p.width = e.width;
+  p.height = e.height;
+  p.bitDepth = e.bitDepth;
+  p.colorType = e.colorType;
+  p.resolutionExists = e.flags & RESOLUTION_EXISTS;
+  p.horiz = e.horiz;
+  p.vert = e.vert;
+  p.units = e.units;
+  p.headerEnd = e.headerEnd;
+  p.resolutionOffset = e.resolutionOffset;
+  p.dibHeaderSize = e.dibHeaderSize;
+  p.compression = e.compression;
+  p.size = e.size;
+  p.contentHash = { e.contentHash[0], e.contentHash[1] };
+  p.nfimmSoftware = e.flags & NFIMM_SOFTWARE;
+  return p;
+}
+
+/**
+ * Units are those of the format's header: PNG, BMP, and JP2 per meter;
+ * TIFF 2 inch, 3 centimeter; AN2K and WSQ 1 inch, AN2K 2 centimeter.  The
+ * JPEG unit 2 is per centimeter in JFIF but per inch in EXIF, so it is not
+ * known; 1 is per inch and 3 per centimeter.
+ *
+ * @param e indexed image
+ * @param horiz OUT : horizontal pixels per inch, rounded
+ * @param vert OUT : vertical pixels per inch, rounded
+ * @return false if the image has no sample rate or its units are not known
+ */
+bool CorpusIndex::ppi( const Entry &e, uint32_t &horiz, uint32_t &vert )
+{
+  if( !( e.flags & RESOLUTION_EXISTS ) )
+    return false;
+  const std::string format( e.format, strnlen( e.format, sizeof( e.format ) ) );
+  uint64_t perUnit{0};   // rate * 254 / perUnit is per inch
+  if( ( format == "png" || format == "bmp" || format == "jp2" ) && e.units == 1 )
+    perUnit = 10000;   // meter
+  else if( ( format == "tiff" && e.units == 3 ) || ( format == "jpeg" && e.units == 3 ) ||
+           ( format == "an2k" && e.units == 2 ) )
+    perUnit = 100;     // centimeter
+  else if( ( format == "tiff" && e.units == 2 ) || ( format == "jpeg" && e.units == 1 ) ||
+           ( ( format == "an2k" || format == "wsq" ) && e.units == 1 ) )
+  {
+    horiz = e.horiz;
+    vert = e.vert;
+    return true;
+  }
+  else
+    return false;
+  horiz = perInch( e.horiz, perUnit );
+  vert = perInch( e.vert, perUnit );
+  return true;
+}
+
+/**
+ * The index lists exactly the images of the list, in path-hash order; a
+ * path listed twice has one entry.  Each listed image is stat()ed as it is
+ * taken from the list: an image with the inode, size, and mtime of its
+ * entry keeps it; every other image is probed by the batch's workers, with
+ * hashContent(), and is indexed with the state found before it was read.
+ * An image that fails to probe is indexed with its status, so it is probed
+ * again only once it has changed.
+ *
+ * @param path index file, created if missing
+ * @param bat workers, config, and format detection of the probes
+ * @param source list of images; destinations are ignored
+ * @return totals
+ * @throw Miscue Cannot read the old index, or write the new one
+ */
+CorpusIndex::Totals CorpusIndex::refresh( const std::string &path, Batch &bat,
+                                          const Batch::Source &source )
+{
+  const CorpusIndex old( path );
+  Totals totals;
+  std::vector<std::pair<Entry, std::string>> built;
+  built.reserve( old.size() );
+  // State of each image being probed, as found before it was read.
+  std::map<std::string, struct stat> pending;
+
+  // The source and report are called by one worker at a time.
+  auto changed = [&]( Batch::Job &job ) {
+    while( source( job ) )
+    {
+      if( pending.count( job.src ) )
+        continue;
+      struct stat st;
+      const bool exists{ ::stat( job.src.c_str(), &st ) == 0 };
+      if( !exists )
+        st = {};
+      Entry state;
+      setState( state, st );
+      const Entry *e{ exists ? old.find( job.src ) : nullptr };
+      if( e && e->size == state.size && e->inode == state.inode &&
+          e->mtimeSec == state.mtimeSec && e->mtimeNsec == state.mtimeNsec )
+      {
+        built.emplace_back( *e, job.src );
+        totals.unchanged++;
+        continue;
+      }
+      pending[job.src] = st;
+      return true;
+    }
+    return false;
+  };
+  auto report = [&]( const ImageProbe &p ) {
+    Entry e;
+    const auto found = pending.find( p.path );
+    if( found != pending.end() )
+    {
+      setState( e, found->second );
+      pending.erase( found );
+    }
+    std::strncpy( e.format, p.format.c_str(), sizeof( e.format ) );
+    e.code = static_cast<int32_t>( p.status.code );
+    e.statusOffset = p.status.offset;
+    e.contentHash[0] = p.contentHash.first;
+    e.contentHash[1] = p.contentHash.second;
+    e.width = p.width;
+    e.height = p.height;
+    e.bitDepth = p.bitDepth;
+    e.colorType = p.colorType;
+    e.horiz = p.horiz;
+    e.vert = p.vert;
+    e.units = p.units;
+    e.headerEnd = p.headerEnd;
+    e.resolutionOffset = p.resolutionOffset;
+    e.dibHeaderSize = p.dibHeaderSize;
+    e.compression = p.compression;
+    e.flags = ( p.resolutionExists ? RESOLUTION_EXISTS : 0 ) |
+              ( p.nfimmSoftware ? NFIMM_SOFTWARE : 0 );
+    built.emplace_back( e, p.path );
+    if( p.status ) totals.probed++;
+    else totals.failed++;
+  };
+  bat.hashContent( true );
+  bat.probe( changed, report );
+
+  for( auto &b : built ) {
+    b.first.pathHash = hash64( b.second );
+    b.first.pathLength = static_cast<uint32_t>( b.second.size() );
+  }
+  std::sort( built.begin(), built.end(), []( const auto &a, const auto &b ) {
+    return a.first.pathHash < b.first.pathHash ||
+           ( a.first.pathHash == b.first.pathHash && a.second < b.second ); } );
+  built.erase( std::unique( built.begin(), built.end(), []( const auto &a, const auto &b ) {
+    return a.second == b.second; } ), built.end() );
+
+  std::string paths;
+  for( auto &b : built ) {
+    b.first.pathOffset = paths.size();
+    paths.append( b.second );
+  }
+
+  // Written beside the index, then renamed over it.
+  const std::string tmp{ path + ".tmp" };
+  const int fd{ ::open( tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 ) };
+  if( fd < 0 )
+    throw Miscue( MiscueCode::Io, "CANNOT create index '" + tmp + "': " + std::strerror( errno ) );
+  try
+  {
+    uint8_t header[INDEX_HEADER_SIZE]{0};
+    const uint32_t version{ VERSION };
+    const uint32_t entrySize{ sizeof( Entry ) };
+    const uint64_t count{ built.size() };
+    const uint64_t pathsSize{ paths.size() };
+    std::memcpy( header, MAGIC, sizeof( MAGIC ) );
+    std::memcpy( header + 8, &version, sizeof( version ) );
+    std::memcpy( header + 12, &entrySize, sizeof( entrySize ) );
+    std::memcpy( header + 16, &count, sizeof( count ) );
+    std::memcpy( header + 24, &pathsSize, sizeof( pathsSize ) );
+
+    FdSink sink( fd );
+    sink.write( header, sizeof( header ) );
+    std::vector<Entry> entries;
+    entries.reserve( std::min( built.size(), size_t{1} << 16 ) );
+    for( size_t i=0; i<built.size(); i++ ) {
+      entries.push_back( built[i].first );
+      if( entries.size() == entries.capacity() || i + 1 == built.size() ) {
+        sink.write( reinterpret_cast<const uint8_t *>( entries.data() ),
+                    entries.size() * sizeof( Entry ) );
+        entries.clear();
+      }
+    }
+    sink.write( reinterpret_cast<const uint8_t *>( paths.data() ), paths.size() );
+    if( ::fsync( fd ) != 0 )
+      throw Miscue( MiscueCode::Io, "CANNOT sync index '" + tmp + "'" );
+  }
+  catch( ... )
+  {
+    ::close( fd );
+    ::unlink( tmp.c_str() );
+    throw;
+  }
+  if( ::close( fd ) != 0 || ::rename( tmp.c_str(), path.c_str() ) != 0 )
+  {
+    const std::string err{ std::strerror( errno ) };
+    ::unlink( tmp.c_str() );
+    throw Miscue( MiscueCode::Io, "CANNOT replace index '" + path + "': " + err );
+  }
+
+  // The rename is durable once the directory is synced.
+  const size_t slash{ path.rfind( '/' ) };
+  const std::string dir{ slash == std::string::npos ? "." : slash == 0 ? "/"
+                                                    : path.substr( 0, slash ) };
+  const int dirFd{ ::open( dir.c_str(), O_RDONLY | O_CLOEXEC ) };
+  if( dirFd >= 0 )
+  {
+    ::fsync( dirFd );
+    ::close( dirFd );
+  }
+  return totals;
+}
+
+}   // END namespace
@@ -0,0 +1,136 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "hash.h"
+
+namespace NFIMM {
+
+namespace {
+
+const uint64_t PRIME1{0x9E3779B185EBCA87ULL};
+const uint64_t PRIME2{0xC2B2AE3D27D4EB4FULL};
+const uint64_t PRIME3{0x165667B19E3779F9ULL};
+const uint64_t PRIME4{0x85EBCA77C2B2AE63ULL};
+const uint64_t PRIME5{0x27D4EB2F165667C5ULL};
+
+inline uint64_t rotl( const uint64_t x, const int r )
+{
+  return ( x << r ) | ( x >> ( 64 - r ) );
+}
+
+/** @brief Little-endian load, whatever the host byte order */
+inline uint64_t read64( const uint8_t *p )
+{
+  uint64_t v{0};
+  for( int i=7; i>=0; i-- ) { v = ( v << 8 ) | p[i]; }
+  return v;
+}
+
+inline uint32_t read32( const uint8_t *p )
+{
+  return static_cast<uint32_t>( p[0] ) | ( static_cast<uint32_t>( p[1] ) << 8 ) |
+         ( static_cast<uint32_t>( p[2] ) << 16 ) | ( static_cast<uint32_t>( p[3] ) << 24 );
+}
+
+inline uint64_t mixLane( uint64_t acc, const uint64_t input )
+{
+  acc += input * PRIME2;
+  return rotl( acc, 31 ) * PRIME1;
+}
+
+inline uint64_t merge( uint64_t acc, const uint64_t val )
+{
+  acc ^= mixLane( 0, val );
+  return acc * PRIME1 + PRIME4;
+}
+
+}   // END namespace
+
+/**
+ * Four lanes of 8 bytes are mixed per 32-byte stripe, then the tail; see
+ * the xxHash specification.
+ *
+ * @param data first byte
+ * @param len number of bytes
+ * @param seed start value
+ * @return hash of the bytes
+ */
+uint64_t hash64( const void *data, const size_t len, const uint64_t seed )
+{
+  const uint8_t *p{ static_cast<const uint8_t *>( data ) };
+  const uint8_t *const end{ p + len };
+  uint64_t h{0};
+
+  if( len >= 32 )
+  {
+    uint64_t v1{ seed + PRIME1 + PRIME2 };
+    uint64_t v2{ seed + PRIME2 };
+    uint64_t v3{ seed };
+    uint64_t v4{ seed - PRIME1 };
+    const uint8_t *const limit{ end - 32 };
+    do
+    {
+      v1 = mixLane( v1, read64( p ) );
+      v2 = mixLane( v2, read64( p + 8 ) );
+      v3 = mixLane( v3, read64( p + 16 ) );
+      v4 = mixLane( v4, read64( p + 24 ) );
+      p += 32;
+    } while( p <= limit );
+    h = rotl( v1, 1 ) + rotl( v2, 7 ) + rotl( v3, 12 ) + rotl( v4, 18 );
+    h = merge( h, v1 );
+    h = merge( h, v2 );
+    h = merge( h, v3 );
+    h = merge( h, v4 );
+  }
+  else
+    h = seed + PRIME5;
+
+  h += static_cast<uint64_t>( len );
+  for( ; p + 8 <= end; p += 8 ) {
+    h ^= mixLane( 0, read64( p ) );
+    h = rotl( h, 27 ) * PRIME1 + PRIME4;
+  }
+  if( p + 4 <= end ) {
+    h ^= static_cast<uint64_t>( read32( p ) ) * PRIME1;
+    h = rotl( h, 23 ) * PRIME2 + PRIME3;
+    p += 4;
+  }
+  for( ; p < end; p++ ) {
+    h ^= *p * PRIME5;
+    h = rotl( h, 11 ) * PRIME1;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME2;
+  h ^= h >> 29;
+  h *= PRIME3;
+  h ^= h >> 32;
+  return h;
+}
+
+}   // END namespace
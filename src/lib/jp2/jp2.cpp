@@ -0,0 +1,468 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "jp2/jp2.h"
+#include "tiff/tiff.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+namespace NFIMM {
+
+/** 
+ * Initialize the read-buffer cursor and clear the write-buffer.
+*/
+JP2::JP2( std::shared_ptr<MetadataParameters> &mps ) : NFIMM(mps)
+{
+  s_r_cursor = 0;
+  s_writeBuffer.clear();
+}
+
+/** 
+ * Initialize the read-buffer cursor and clear the write-buffer.
+*/
+JP2::JP2( std::shared_ptr<const ModificationConfig> cfg )
+    : NFIMM(std::move(cfg))
+{
+  s_r_cursor = 0;
+  s_writeBuffer.clear();
+}
+
+/**
+ * Walk the boxes and patch the resolution.  The order of the destination
+ * image is:
+ *   1. all boxes before `jp2h`, unchanged
+ *   2. `jp2h` with `resc` and `resd` patched, or with its length updated
+ *      and the `res ` box replaced or appended
+ *   3. all remaining boxes, including `jp2c`, unchanged
+ *
+ * @param pln OUT : destination image size and edits
+ * @throw Miscue Invalid box structure, header box would exceed 4 GB
+ */
+void JP2::planImage( ModificationPlan &pln )
+{
+  _result.loggit( "Initialize for JP2 modification" );
+  const uint8_t *buf{ s_readData };
+
+  Layout lay;
+  const Status st{ scanBoxes( buf, s_readSize, lay ) };
+  if( !st )
+    throw Miscue( st );
+
+  // ihdr: HEIGHT, WIDTH, NC, BPC, ...
+  {
+    const uint8_t *ihdr{ buf + lay.imageHeader.data() };
+    _result.srcImg.height   = TIFF::get32( ihdr, true );
+    _result.srcImg.width    = TIFF::get32( ihdr + 4, true );
+    _result.srcImg.bitDepth = ihdr[10] == 0xFF ? 0 : ( ihdr[10] & 0x7F ) + 1;
+    if( _result.logging )
+      _result.loggit( "ihdr image width: " + std::to_string( _result.srcImg.width ) +
+        ", height: " + std::to_string( _result.srcImg.height ) +
+        ", components: " + std::to_string( TIFF::get16( ihdr + 8, true ) ) +
+        ", bit depth: " + std::to_string( _result.srcImg.bitDepth ) );
+  }
+  readResolution( lay );
+
+  uint8_t data[NUM_BYTES_RES_DATA];
+  resolutionData( data );
+
+  size_t cursor{0};
+  keepBoxes( pln, cursor, lay.header.offset );
+
+  const Box &capture{ lay.capture }, &display{ lay.display };
+  if( capture.length == NUM_BYTES_BOX_HEADER + NUM_BYTES_RES_DATA &&
+      display.length == NUM_BYTES_BOX_HEADER + NUM_BYTES_RES_DATA )
+  {
+    const Box &first{ capture.offset < display.offset ? capture : display };
+    const Box &second{ capture.offset < display.offset ? display : capture };
+    pln.keep( "jp2h", lay.header.offset, first.data() - lay.header.offset );
+    pln.update( boxName( first.type ), data, sizeof( data ) );
+    pln.keep( "jp2h", first.end(), second.data() - first.end() );
+    pln.update( boxName( second.type ), data, sizeof( data ) );
+    pln.keep( "jp2h", second.end(), lay.header.end() - second.end() );
+    _result.loggit( "Patch resc and resd in place" );
+  }
+  else
+  {
+    // res superbox with resc and resd
+    const size_t childSize{ NUM_BYTES_BOX_HEADER + NUM_BYTES_RES_DATA };
+    uint8_t res[NUM_BYTES_BOX_HEADER + 2 * childSize];
+    TIFF::putN( res, sizeof( res ), 4, true );
+    TIFF::putN( res + 4, BOX_RESOLUTION, 4, true );
+    uint8_t *child{ res + NUM_BYTES_BOX_HEADER };
+    for( const uint32_t type : { BOX_CAPTURE, BOX_DISPLAY } )
+    {
+      TIFF::putN( child, childSize, 4, true );
+      TIFF::putN( child + 4, type, 4, true );
+      std::copy( data, data + sizeof( data ), child + NUM_BYTES_BOX_HEADER );
+      child += childSize;
+    }
+
+    const Box &hdr{ lay.header };
+    const uint64_t length{ hdr.length - lay.resolution.length + sizeof( res ) };
+    uint8_t head[NUM_BYTES_XL_BOX_HEADER];
+    if( hdr.headerSize == NUM_BYTES_XL_BOX_HEADER )
+    {
+      TIFF::putN( head, 1, 4, true );
+      TIFF::putN( head + 8, length, 8, true );
+    }
+    else if( length <= 0xFFFFFFFF )
+    {
+      TIFF::putN( head, length, 4, true );
+    }
+    else
+    {
+      throw Miscue( MiscueCode::Unsupported,
+                    "JP2 header box would exceed 4 GB" );
+    }
+    TIFF::putN( head + 4, BOX_HEADER, 4, true );
+    pln.update( "jp2h", head, hdr.headerSize );
+
+    cursor = hdr.data();
+    if( lay.resolution.length )
+    {
+      keepBoxes( pln, cursor, lay.resolution.offset );
+      pln.insert( "res", res, sizeof( res ) );
+      cursor = lay.resolution.end();
+      keepBoxes( pln, cursor, hdr.end() );
+      if( _result.logging )
+        _result.loggit( "Replace res box, jp2h length: " + std::to_string( length ) );
+    }
+    else
+    {
+      keepBoxes( pln, cursor, hdr.end() );
+      pln.insert( "res", res, sizeof( res ) );
+      if( _result.logging )
+        _result.loggit( "Append res box, jp2h length: " + std::to_string( length ) );
+    }
+  }
+
+  cursor = lay.header.end();
+  keepBoxes( pln, cursor, s_readSize );
+}   // END planImage()
+
+/**
+ * Plan one keep per box, named by its type, from CURSOR up to END.  The
+ * boxes were checked by scanBoxes(); the codestream is one keep.
+ *
+ * @param pln OUT : destination image edits
+ * @param cursor IN/OUT : offset of next box, == END on return
+ * @param end offset of the next box that is not kept unchanged
+ */
+void JP2::keepBoxes( ModificationPlan &pln, size_t &cursor, const size_t end )
+{
+  while( cursor < end )
+  {
+    Box box;
+    if( !readBox( s_readData, end, cursor, box ) )
+    {
+      pln.keep( "Trailing bytes", cursor, end - cursor );
+      break;
+    }
+    pln.keep( box.type == BOX_CODESTREAM ? "jp2c codestream" : boxName( box.type ),
+              cursor, box.length );
+    cursor = box.end();
+  }
+  cursor = end;
+}
+
+/**
+ * The capture resolution is the sample rate of the scan; the display
+ * resolution is used when there is no capture resolution.  The source
+ * resolution is in pixels per meter, as PNG.
+ *
+ * @param lay boxes of the source image
+ */
+void JP2::readResolution( const Layout &lay )
+{
+  const Box &box{ lay.capture.length ? lay.capture : lay.display };
+  if( !box.length )
+  {
+    _result.loggit( "READ no resc or resd box" );
+    return;
+  }
+
+  const uint8_t *p{ s_readData + box.data() };
+  auto value = []( const uint8_t *n, const int8_t e ) -> uint32_t {
+    const uint16_t num{ TIFF::get16( n, true ) }, den{ TIFF::get16( n + 2, true ) };
+    if( den == 0 )
+      return 0;
+    const double v{ std::round( num * std::pow( 10.0, e ) / den ) };
+    return v > 0xFFFFFFFF ? 0 : static_cast<uint32_t>( v );
+  };
+  const uint32_t vert{ value( p, static_cast<int8_t>( p[8] ) ) };
+  const uint32_t horiz{ value( p + 4, static_cast<int8_t>( p[9] ) ) };
+  if( _result.logging )
+    _result.loggit( "READ " + boxName( box.type ) + " pixels per meter, horiz: " +
+                    std::to_string( horiz ) + ", vert: " + std::to_string( vert ) );
+  if( horiz != 0 && vert != 0 )
+  {
+    _result.srcImg.resolutionExists = true;
+    _result.srcImg.resolution.horiz = horiz;
+    _result.srcImg.resolution.vert  = vert;
+    _result.srcImg.resolution.units = 1;
+  }
+}
+
+/**
+ * @param data OUT : VR_N, VR_D, HR_N, HR_D, VR_E, HR_E
+ */
+void JP2::resolutionData( uint8_t *data )
+{
+  const bool inch{ _config->destResolution.unitsStr == "inch" };
+  uint16_t num[2], den[2];
+  int8_t exp[2];
+  const uint32_t rate[2]{ _config->destResolution.vert,
+                          _config->destResolution.horiz };
+  for( int i=0; i<2; i++ )
+  {
+    // 1 inch is 0.0254 meter: PPI * 5000 / 127 pixels per meter.
+    if( inch )
+      encodeResolution( uint64_t{ rate[i] } * 5000, 127, num[i], den[i], exp[i] );
+    else
+      encodeResolution( rate[i], 1, num[i], den[i], exp[i] );
+    TIFF::putN( data + 4*i, num[i], 2, true );
+    TIFF::putN( data + 4*i + 2, den[i], 2, true );
+    data[8+i] = static_cast<uint8_t>( exp[i] );
+  }
+  if( _result.logging )
+    _result.loggit( "WRITE resc and resd, horiz: " + std::to_string( num[1] ) +
+      "/" + std::to_string( den[1] ) + "E" + std::to_string( exp[1] ) +
+      ", vert: " + std::to_string( num[0] ) + "/" + std::to_string( den[0] ) +
+      "E" + std::to_string( exp[0] ) + " pixels per meter" );
+}
+
+/**
+ * Trailing zeros of the numerator move to the exponent, so the encoding is
+ * exact whenever the reduced numerator fits; otherwise it is rounded.
+ *
+ * @param n numerator, pixels per meter
+ * @param d denominator, <= 65535
+ * @param num OUT : N
+ * @param den OUT : D
+ * @param exp OUT : E
+ */
+void JP2::encodeResolution( uint64_t n, uint64_t d, uint16_t &num,
+                            uint16_t &den, int8_t &exp )
+{
+  const uint64_t g{ std::gcd( n, d ) };
+  if( g > 1 ) { n /= g; d /= g; }
+  exp = 0;
+  while( n > 0xFFFF && n % 10 == 0 ) { n /= 10; exp++; }
+  while( n > 0xFFFF ) { n = ( n + 5 ) / 10; exp++; }
+  num = static_cast<uint16_t>( n );
+  den = static_cast<uint16_t>( d );
+}
+
+/**
+ * @param buf source image
+ * @param end offset past the last byte of the enclosing box or file
+ * @param pos offset of LBox
+ * @param box OUT : the box
+ * @return failure and its offset, or Ok
+ */
+Status JP2::readBox( const uint8_t *buf, const size_t end, const size_t pos,
+                     Box &box ) noexcept
+{
+  box = Box{};
+  if( end - pos < static_cast<size_t>( NUM_BYTES_BOX_HEADER ) )
+    return Status{ MiscueCode::Truncated, pos };
+  const uint32_t lbox{ TIFF::get32( buf + pos, true ) };
+  uint64_t length{ lbox };
+  box.headerSize = NUM_BYTES_BOX_HEADER;
+  if( lbox == 1 )
+  {
+    if( end - pos < static_cast<size_t>( NUM_BYTES_XL_BOX_HEADER ) )
+      return Status{ MiscueCode::Truncated, pos };
+    length = TIFF::get64( buf + pos + NUM_BYTES_BOX_HEADER, true );
+    box.headerSize = NUM_BYTES_XL_BOX_HEADER;
+  }
+  else if( lbox == 0 )
+  {
+    length = end - pos;
+  }
+  if( length < box.headerSize )
+    return Status{ MiscueCode::InvalidHeader, pos };
+  if( length > end - pos )
+    return Status{ MiscueCode::Truncated, pos };
+
+  box.offset = pos;
+  box.length = static_cast<size_t>( length );
+  box.type   = TIFF::get32( buf + pos + 4, true );
+  return Status{};
+}
+
+/**
+ * Walk the top-level boxes to the end of the file, the children of the
+ * first `jp2h`, and the children of its first `res `.  Checked:
+ * - the signature box, then boxes within the source image
+ * - `jp2h` begins with `ihdr`, and `jp2c` is present
+ * - `resc` and `resd` are long enough for their data
+ *
+ * @param buf source image
+ * @param size number of bytes in source image
+ * @param lay OUT : boxes of interest
+ * @return failure and its offset, or Ok
+ */
+Status JP2::scanBoxes( const uint8_t *buf, const size_t size,
+                       Layout &lay ) noexcept
+{
+  static const uint8_t signature[NUM_BYTES_SIGNATURE_BOX]{
+    0x00, 0x00, 0x00, 0x0C, 0x6A, 0x50, 0x20, 0x20, 0x0D, 0x0A, 0x87, 0x0A };
+
+  lay = Layout{};
+  if( size < static_cast<size_t>( NUM_BYTES_SIGNATURE_BOX ) )
+    return Status{ MiscueCode::Truncated, 0 };
+  for( int i=0; i<NUM_BYTES_SIGNATURE_BOX; i++ ) {
+    if( buf[i] != signature[i] )
+      return Status{ MiscueCode::InvalidSignature, 0 };
+  }
+
+  Box box;
+  for( size_t pos{ NUM_BYTES_SIGNATURE_BOX }; pos < size; pos = box.end() )
+  {
+    const Status st{ readBox( buf, size, pos, box ) };
+    if( !st )
+      return st;
+    if( box.type == BOX_CODESTREAM && !lay.codestream.length )
+      lay.codestream = box;
+    if( box.type != BOX_HEADER || lay.header.length )
+      continue;
+
+    lay.header = box;
+    Box child;
+    for( size_t at{ box.data() }; at < box.end(); at = child.end() )
+    {
+      const Status childSt{ readBox( buf, box.end(), at, child ) };
+      if( !childSt )
+        return childSt;
+      if( at == box.data() )
+      {
+        if( child.type != BOX_IMAGE_HEADER ||
+            child.length - child.headerSize < static_cast<size_t>( NUM_BYTES_IHDR_DATA ) )
+          return Status{ MiscueCode::InvalidHeader, at };
+        lay.imageHeader = child;
+      }
+      if( child.type != BOX_RESOLUTION || lay.resolution.length )
+        continue;
+
+      lay.resolution = child;
+      Box res;
+      for( size_t r{ child.data() }; r < child.end(); r = res.end() )
+      {
+        const Status resSt{ readBox( buf, child.end(), r, res ) };
+        if( !resSt )
+          return resSt;
+        Box *dst{ res.type == BOX_CAPTURE ? &lay.capture :
+                  res.type == BOX_DISPLAY ? &lay.display : nullptr };
+        if( !dst || dst->length )
+          continue;
+        if( res.length - res.headerSize < static_cast<size_t>( NUM_BYTES_RES_DATA ) )
+          return Status{ MiscueCode::InvalidHeader, r };
+        *dst = res;
+      }
+    }
+    if( !lay.imageHeader.length )
+      return Status{ MiscueCode::InvalidHeader, pos };
+  }
+
+  // A streamed image is read up to `jp2h`, its codestream is not read.
+  if( !lay.header.length || ( !lay.codestream.length && !s_readPartial ) )
+    return Status{ MiscueCode::InvalidHeader, size };
+  return Status{};
+}
+
+/**
+ * Checks the same conditions as planImage(), reading the boxes in place.
+ *
+ * @return Ok, or the first failure and its offset
+ */
+Status JP2::validateImage() const noexcept
+{
+  Layout lay;
+  return scanBoxes( s_readData, s_readSize, lay );
+}
+
+/**
+ * The plan needs the boxes up to and including `jp2h`; the codestream and
+ * any other later boxes are passed through.  A box ahead of `jp2h` that
+ * extends to the end of the file needs the whole image.
+ *
+ * @param buf first bytes of the source image
+ * @param size number of bytes read
+ * @return end of `jp2h`, 0 if it is not yet read, SIZE when the boxes are
+ *   invalid, or STREAM_WHOLE_IMAGE
+ */
+size_t JP2::streamHeadLength( const uint8_t *buf, const size_t size ) const noexcept
+{
+  if( size < static_cast<size_t>( NUM_BYTES_SIGNATURE_BOX ) )
+    return 0;
+  if( TIFF::get32( buf + 4, true ) != BOX_SIGNATURE )
+    return size;
+
+  Box box;
+  for( size_t pos{ NUM_BYTES_SIGNATURE_BOX }; ; pos = box.end() )
+  {
+    if( size - pos >= 4u && TIFF::get32( buf + pos, true ) == 0 )
+      return STREAM_WHOLE_IMAGE;
+    const Status st{ readBox( buf, size, pos, box ) };
+    if( st.code == MiscueCode::Truncated )
+      return 0;
+    if( !st )
+      return size;
+    if( box.type == BOX_HEADER )
+      return box.end();
+  }
+}
+
+/**
+ * @param type TBox
+ * @return the 4 characters, `.` for any that is not printable
+ */
+std::string JP2::boxName( const uint32_t type )
+{
+  std::string s;
+  for( int shift=24; shift>=0; shift-=8 ) {
+    const char c = static_cast<char>( ( type >> shift ) & 0xFF );
+    s.push_back( c >= 0x20 && c < 0x7F ? c : '.' );
+  }
+  while( !s.empty() && s.back() == ' ' ) { s.pop_back(); }
+  return s;
+}
+
+/** @return current Metadata Parameters */
+std::string JP2::to_s()
+{
+  std::string s{"JP2: "};
+  s.append( _config->to_s() );
+  return s;
+}
+
+}   // END namespace
@@ -0,0 +1,352 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "jpeg/jpeg.h"
+#include "tiff/tiff.h"
+
+#include <algorithm>
+#include <array>
+
+
+namespace NFIMM {
+
+/**
+ * @param cfg destination sample rate
+ * @param result needed to update the runtime log and source image metadata
+ */
+Exif::Exif( const ModificationConfig &cfg, ModificationResult &result )
+     : _config(cfg), _result(result) {}
+
+/**
+ * Locate IFD0 and the first entry of each resolution tag.  A RATIONAL value
+ * must lie within the TIFF structure.
+ *
+ * @param tiff first byte of the TIFF header
+ * @param len number of bytes from TIFF header to end of APP1 segment
+ * @param layout OUT : offsets of IFD0 and the tags
+ * @return failure and its offset from the TIFF header, or Ok
+ */
+Status Exif::parse( const uint8_t *tiff, const size_t len,
+                    Layout &layout ) noexcept
+{
+  layout = Layout{};
+  if( len < static_cast<size_t>( NUM_BYTES_TIFF_HEADER ) )
+    return Status{ MiscueCode::Truncated, 0 };
+  if( tiff[0] == 'M' && tiff[1] == 'M' )
+    layout.bigEndian = true;
+  else if( !( tiff[0] == 'I' && tiff[1] == 'I' ) )
+    return Status{ MiscueCode::InvalidHeader, 0 };
+  if( TIFF::get16( tiff + 2, layout.bigEndian ) != 42 )
+    return Status{ MiscueCode::InvalidHeader, 2 };
+
+  layout.ifd0 = TIFF::get32( tiff + 4, layout.bigEndian );
+  if( layout.ifd0 < static_cast<size_t>( NUM_BYTES_TIFF_HEADER ) ||
+      layout.ifd0 > len - 2u )
+    return Status{ MiscueCode::InvalidHeader, 4 };
+  layout.countEntries = TIFF::get16( tiff + layout.ifd0, layout.bigEndian );
+  // Entries and the 4-byte offset of the next IFD
+  if( size_t{ layout.countEntries } * NUM_BYTES_IFD_ENTRY + 4u >
+      len - layout.ifd0 - 2u )
+    return Status{ MiscueCode::InvalidHeader, layout.ifd0 };
+
+  for( uint16_t i=0; i<layout.countEntries; i++ )
+  {
+    const size_t at{ layout.ifd0 + 2u + size_t{ i } * NUM_BYTES_IFD_ENTRY };
+    const uint16_t tag{ TIFF::get16( tiff + at, layout.bigEndian ) };
+    Entry *entry{nullptr};
+    if( tag == TAG_X_RESOLUTION )         entry = &layout.xRes;
+    else if( tag == TAG_Y_RESOLUTION )    entry = &layout.yRes;
+    else if( tag == TAG_RESOLUTION_UNIT ) entry = &layout.unit;
+    if( entry == nullptr || entry->found )
+      continue;
+
+    entry->found  = true;
+    entry->offset = at;
+    entry->type   = TIFF::get16( tiff + at + 2, layout.bigEndian );
+    entry->count  = TIFF::get32( tiff + at + 4, layout.bigEndian );
+    entry->value  = TIFF::get32( tiff + at + 8, layout.bigEndian );
+    if( entry->type == TYPE_RATIONAL && entry->count == 1 &&
+        ( entry->value < static_cast<size_t>( NUM_BYTES_TIFF_HEADER ) ||
+          entry->value > len - 8u ) )
+      return Status{ MiscueCode::InvalidHeader, at };
+  }
+  return Status{};
+}
+
+/**
+ * The values are patched in place when all three tags are present with the
+ * standard type and count, and the two RATIONAL values do not overlap each
+ * other or IFD0.
+ *
+ * @param layout of the parsed IFD0
+ * @return true if the segment size is unchanged
+ */
+bool Exif::patchInPlace( const Layout &layout )
+{
+  const Entry &x{ layout.xRes }, &y{ layout.yRes }, &u{ layout.unit };
+  if( !x.found || !y.found || !u.found )
+    return false;
+  if( x.type != TYPE_RATIONAL || x.count != 1 ||
+      y.type != TYPE_RATIONAL || y.count != 1 ||
+      u.type != TYPE_SHORT || u.count != 1 )
+    return false;
+
+  const size_t ifdEnd{ layout.ifd0 + 2u +
+    size_t{ layout.countEntries } * NUM_BYTES_IFD_ENTRY + 4u };
+  auto overlaps = []( size_t a, size_t aEnd, size_t b, size_t bEnd ) {
+    return a < bEnd && b < aEnd;
+  };
+  return !overlaps( x.value, x.value + 8u, y.value, y.value + 8u ) &&
+         !overlaps( x.value, x.value + 8u, layout.ifd0, ifdEnd ) &&
+         !overlaps( y.value, y.value + 8u, layout.ifd0, ifdEnd );
+}
+
+/**
+ * For "meter" the sample rate is pixels per meter, written as the exact
+ * rational N/100 pixels per centimeter.
+ *
+ * @param den OUT : denominator of the resolution rationals
+ * @return ResolutionUnit: 1 none, 2 inch, 3 centimeter
+ */
+uint16_t Exif::unitTag( uint32_t &den ) const
+{
+  den = 1;
+  if( _config.destResolution.unitsStr == "inch" )
+    return 2;
+  if( _config.destResolution.unitsStr == "meter" )
+  {
+    den = 100;
+    return 3;
+  }
+  return 1;
+}
+
+/**
+ * Only the source sample rate is set that was not found in a JFIF APP0.
+ * ResolutionUnit defaults to inch when absent.
+ *
+ * @param tiff first byte of the TIFF header
+ * @param layout of the parsed IFD0
+ */
+void Exif::readResolution( const uint8_t *tiff, const Layout &layout )
+{
+  auto rational = [tiff, &layout]( const Entry &e ) -> uint32_t {
+    if( !e.found || e.type != TYPE_RATIONAL || e.count != 1 )
+      return 0;
+    const uint32_t num{ TIFF::get32( tiff + e.value, layout.bigEndian ) };
+    const uint32_t den{ TIFF::get32( tiff + e.value + 4, layout.bigEndian ) };
+    return den == 0 ? 0 : ( num + den / 2 ) / den;
+  };
+  const uint32_t horiz{ rational( layout.xRes ) };
+  const uint32_t vert{ rational( layout.yRes ) };
+  uint16_t unit{2};
+  if( layout.unit.found && layout.unit.type == TYPE_SHORT )
+    unit = TIFF::get16( tiff + layout.unit.offset + 8, layout.bigEndian );
+
+  if( _result.logging )
+    _result.loggit( std::string{"READ EXIF byte order: "} +
+                    ( layout.bigEndian ? "MM" : "II" ) +
+                    ", XResolution: " + std::to_string( horiz ) +
+                    ", YResolution: " + std::to_string( vert ) +
+                    ", ResolutionUnit: " + std::to_string( unit ) );
+  if( !_result.srcImg.resolutionExists && horiz != 0 && vert != 0 )
+  {
+    _result.srcImg.resolutionExists = true;
+    _result.srcImg.resolution.horiz = horiz;
+    _result.srcImg.resolution.vert  = vert;
+    _result.srcImg.resolution.units = static_cast<uint8_t>( unit );
+  }
+}
+
+/**
+ * The tag values are patched in place if possible, see patchInPlace();
+ * otherwise the entire segment is rewritten, see Exif.
+ *
+ * @param pln OUT : destination image edits
+ * @param at offset of the APP1 marker
+ * @param segLength APP1 segment length, excludes the marker
+ * @throw Miscue Invalid TIFF structure, segment too large to rewrite
+ */
+void Exif::plan( ModificationPlan &pln, const size_t at,
+                 const size_t segLength )
+{
+  const size_t base{ at + JPEG::OFFSET_EXIF_TIFF };
+  const uint8_t *tiff{ NFIMM::s_readData + base };
+  const size_t tiffLength{ segLength - 8u };   // length, `Exif\0\0`
+
+  Layout layout;
+  const Status st{ parse( tiff, tiffLength, layout ) };
+  if( !st )
+    throw Miscue( st );
+  readResolution( tiff, layout );
+
+  if( !patchInPlace( layout ) )
+  {
+    planRewrite( pln, tiff, tiffLength, layout );
+    return;
+  }
+
+  uint32_t den{0};
+  const uint16_t unit{ unitTag( den ) };
+  struct Patch {
+    size_t offset;
+    std::array<uint8_t, 8> bytes;
+    size_t length;
+  };
+  std::array<Patch, 3> patches{};
+  patches[0].offset = layout.unit.offset + 8u;
+  patches[0].length = 2;
+  TIFF::putN( patches[0].bytes.data(), unit, 2, layout.bigEndian );
+  const std::pair<const Entry *, uint32_t> rationals[2]{
+    { &layout.xRes, _config.destResolution.horiz },
+    { &layout.yRes, _config.destResolution.vert } };
+  for( int i=0; i<2; i++ )
+  {
+    Patch &p{ patches[i+1] };
+    p.offset = rationals[i].first->value;
+    p.length = 8;
+    NFIMM::expressUINT32AsFourBytes( rationals[i].second, p.bytes.data(),
+                                     layout.bigEndian );
+    NFIMM::expressUINT32AsFourBytes( den, p.bytes.data() + 4,
+                                     layout.bigEndian );
+  }
+  std::sort( patches.begin(), patches.end(),
+             []( const Patch &a, const Patch &b ) { return a.offset < b.offset; } );
+
+  size_t cursor{ at };
+  for( const Patch &p : patches )
+  {
+    pln.keep( "APP1 Exif", cursor, base + p.offset - cursor );
+    pln.update( "Exif resolution", p.bytes.data(), p.length );
+    cursor = base + p.offset + p.length;
+  }
+  pln.keep( "APP1 Exif", cursor, at + JPEG::NUM_BYTES_MARKER + segLength - cursor );
+  if( _result.logging )
+    _result.loggit( "WRITE EXIF resolution in place: " +
+      std::to_string( _config.destResolution.horiz ) + "/" +
+      std::to_string( den ) + ", " +
+      std::to_string( _config.destResolution.vert ) + "/" +
+      std::to_string( den ) + ", ResolutionUnit: " + std::to_string( unit ) );
+}
+
+/**
+ * The new IFD0 holds every source IFD0 entry except the resolution tags,
+ * then the three resolution tags, sorted by tag; the two RATIONAL values
+ * follow it.  It starts on the first even offset after the TIFF structure.
+ *
+ * @param pln OUT : destination image edits
+ * @param tiff first byte of the TIFF header
+ * @param tiffLength number of bytes from TIFF header to end of APP1 segment
+ * @param layout of the parsed IFD0
+ * @throw Miscue APP1 segment would exceed 65535 bytes
+ */
+void Exif::planRewrite( ModificationPlan &pln, const uint8_t *tiff,
+                        const size_t tiffLength, const Layout &layout )
+{
+  const bool big{ layout.bigEndian };
+  using IfdEntry = std::array<uint8_t, NUM_BYTES_IFD_ENTRY>;
+  std::vector<IfdEntry> entries;
+  const uint8_t *ifd{ tiff + layout.ifd0 + 2u };
+  for( uint16_t i=0; i<layout.countEntries; i++ )
+  {
+    const uint8_t *e{ ifd + size_t{ i } * NUM_BYTES_IFD_ENTRY };
+    const uint16_t tag{ TIFF::get16( e, big ) };
+    if( tag == TAG_X_RESOLUTION || tag == TAG_Y_RESOLUTION ||
+        tag == TAG_RESOLUTION_UNIT )
+      continue;
+    IfdEntry entry;
+    std::copy( e, e + NUM_BYTES_IFD_ENTRY, entry.begin() );
+    entries.push_back( entry );
+  }
+  const uint8_t *nextIfd{ ifd + size_t{ layout.countEntries } * NUM_BYTES_IFD_ENTRY };
+
+  const size_t newIfd{ ( tiffLength + 1u ) & ~size_t{1} };
+  const size_t countEntries{ entries.size() + 3u };
+  const size_t rationalsAt{ newIfd + 2u + countEntries * NUM_BYTES_IFD_ENTRY + 4u };
+  const size_t newTiffLength{ rationalsAt + 16u };
+  const size_t segLength{ 8u + newTiffLength };
+  if( segLength > 0xFFFF )
+  {
+    std::string err{"ERROR: EXIF APP1 segment too large to add resolution tags: "};
+    err.append( std::to_string( segLength ) );
+    _result.loggit( err );
+    throw Miscue( MiscueCode::Unsupported, err );
+  }
+
+  uint32_t den{0};
+  const uint16_t unit{ unitTag( den ) };
+  auto newEntry = [big]( const uint16_t tag, const uint16_t type,
+                         const uint32_t value ) {
+    IfdEntry e{};
+    TIFF::putN( e.data(), tag, 2, big );
+    TIFF::putN( e.data() + 2, type, 2, big );
+    NFIMM::expressUINT32AsFourBytes( 1, e.data() + 4, big );
+    if( type == TYPE_SHORT )
+      TIFF::putN( e.data() + 8, static_cast<uint16_t>( value ), 2, big );
+    else
+      NFIMM::expressUINT32AsFourBytes( value, e.data() + 8, big );
+    return e;
+  };
+  entries.push_back( newEntry( TAG_X_RESOLUTION, TYPE_RATIONAL, rationalsAt ) );
+  entries.push_back( newEntry( TAG_Y_RESOLUTION, TYPE_RATIONAL, rationalsAt + 8u ) );
+  entries.push_back( newEntry( TAG_RESOLUTION_UNIT, TYPE_SHORT, unit ) );
+  std::stable_sort( entries.begin(), entries.end(),
+    [big]( const IfdEntry &a, const IfdEntry &b ) {
+      return TIFF::get16( a.data(), big ) < TIFF::get16( b.data(), big ); } );
+
+  // Marker, length, `Exif\0\0`, and source TIFF structure unchanged except
+  // for the IFD0 offset.
+  const size_t head{ static_cast<size_t>( JPEG::OFFSET_EXIF_TIFF ) };
+  std::vector<uint8_t> seg( head + newTiffLength, 0 );
+  std::copy( tiff - head, tiff + tiffLength, seg.begin() );
+  seg[2] = static_cast<uint8_t>( segLength >> 8 );
+  seg[3] = static_cast<uint8_t>( segLength );
+  uint8_t *t{ seg.data() + head };
+  NFIMM::expressUINT32AsFourBytes( newIfd, t + 4, big );
+
+  TIFF::putN( t + newIfd, static_cast<uint16_t>( countEntries ), 2, big );
+  uint8_t *p{ t + newIfd + 2u };
+  for( const IfdEntry &e : entries ) {
+    p = std::copy( e.begin(), e.end(), p );
+  }
+  p = std::copy( nextIfd, nextIfd + 4, p );
+  const uint32_t values[4]{ _config.destResolution.horiz, den,
+                            _config.destResolution.vert, den };
+  for( const uint32_t v : values ) {
+    NFIMM::expressUINT32AsFourBytes( v, p, big );
+    p += 4;
+  }
+
+  pln.update( "APP1 Exif", seg.data(), seg.size() );
+  if( _result.logging )
+    _result.loggit( "WRITE EXIF IFD0 rewritten at TIFF offset " +
+      std::to_string( newIfd ) + " with " + std::to_string( countEntries ) +
+      " entries, APP1 length " + std::to_string( segLength ) );
+}
+
+}   // END namespace
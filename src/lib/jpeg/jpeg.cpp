@@ -0,0 +1,403 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "jpeg/jpeg.h"
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+
+namespace NFIMM {
+
+/** 
+ * Initialize the read-buffer cursor and clear the write-buffer.
+*/
+JPEG::JPEG( std::shared_ptr<MetadataParameters> &mps ) : NFIMM(mps)
+{
+  s_r_cursor = 0;
+  s_writeBuffer.clear();
+}
+
+/** 
+ * Initialize the read-buffer cursor and clear the write-buffer.
+*/
+JPEG::JPEG( std::shared_ptr<const ModificationConfig> cfg )
+    : NFIMM(std::move(cfg))
+{
+  s_r_cursor = 0;
+  s_writeBuffer.clear();
+}
+
+/**
+ * Parse the marker segments up to the first SOS and patch the sample rate.
+ * The order of the destination image is:
+ *   1. all segments before the JFIF APP0 and EXIF APP1, unchanged
+ *   2. JFIF APP0 with units and densities patched, or inserted after SOI
+ *      when the source image has neither
+ *   3. EXIF APP1 with resolution tags patched, or rewritten
+ *   4. all remaining segments, the SOS and the scan data, unchanged
+ *
+ * @param pln OUT : destination image size and edits
+ * @throw Miscue Invalid marker segment or EXIF structure, EXIF segment too
+ *   large to add the resolution tags
+ */
+void JPEG::planImage( ModificationPlan &pln )
+{
+  _result.loggit( "Initialize for JPEG modification" );
+  const uint8_t *buf{ s_readData };
+
+  Markers markers;
+  const Status st{ scanMarkers( buf, s_readSize, markers ) };
+  if( !st )
+    throw Miscue( st );
+
+  // SOFn: precision, height, width
+  {
+    const size_t at{ markers.sof + NUM_BYTES_MARKER + NUM_BYTES_SEGMENT_LENGTH };
+    _result.srcImg.bitDepth = buf[at];
+    _result.srcImg.height   = ( buf[at+1] << 8 ) | buf[at+2];
+    _result.srcImg.width    = ( buf[at+3] << 8 ) | buf[at+4];
+    if( _result.logging )
+      _result.loggit( markerName( buf[markers.sof+1] ) + " image width: " +
+        std::to_string( _result.srcImg.width ) + ", height: " +
+        std::to_string( _result.srcImg.height ) + ", precision: " +
+        std::to_string( _result.srcImg.bitDepth ) );
+  }
+
+  size_t cursor{0};
+  if( !markers.jfif && !markers.exif )
+  {
+    uint32_t horiz{0}, vert{0};
+    const uint8_t units{ jfifDensity( *_config, horiz, vert ) };
+    const uint8_t app0[NUM_BYTES_JFIF_APP0]{
+      0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, units,
+      static_cast<uint8_t>( horiz >> 8 ), static_cast<uint8_t>( horiz ),
+      static_cast<uint8_t>( vert >> 8 ),  static_cast<uint8_t>( vert ),
+      0x00, 0x00 };
+    keepSegments( pln, cursor, NUM_BYTES_MARKER );
+    pln.insert( "APP0 JFIF", app0, sizeof( app0 ) );
+    _result.loggit( "No JFIF or EXIF segment, insert JFIF APP0 after SOI" );
+  }
+
+  // The JFIF and EXIF segments in source image order.
+  size_t first{ markers.jfif }, second{ markers.exif };
+  if( !first || ( second && second < first ) )
+    std::swap( first, second );
+  for( const size_t at : { first, second } )
+  {
+    if( !at )
+      continue;
+    keepSegments( pln, cursor, at );
+    if( at == markers.jfif )
+    {
+      planJfif( pln, at );
+    }
+    else
+    {
+      Exif exif( *_config, _result );
+      exif.plan( pln, at, markers.exifLength );
+    }
+    cursor = at + NUM_BYTES_MARKER
+       + ( ( buf[at+NUM_BYTES_MARKER] << 8 ) | buf[at+NUM_BYTES_MARKER+1] );
+  }
+
+  keepSegments( pln, cursor, markers.sos );
+  pln.keep( "SOS and scan data", markers.sos, s_readSize - markers.sos );
+}   // END planImage()
+
+/**
+ * The units byte and both densities are contiguous; they are the only bytes
+ * of the segment that change.
+ *
+ * @param pln OUT : destination image edits
+ * @param at offset of the APP0 marker
+ */
+void JPEG::planJfif( ModificationPlan &pln, const size_t at )
+{
+  const uint8_t *seg{ s_readData + at };
+  const size_t segEnd{ at + NUM_BYTES_MARKER + ( ( seg[2] << 8 ) | seg[3] ) };
+
+  const uint8_t srcUnits{ seg[OFFSET_JFIF_UNITS] };
+  const uint32_t srcHoriz = ( seg[OFFSET_JFIF_UNITS+1] << 8 ) | seg[OFFSET_JFIF_UNITS+2];
+  const uint32_t srcVert  = ( seg[OFFSET_JFIF_UNITS+3] << 8 ) | seg[OFFSET_JFIF_UNITS+4];
+  if( _result.logging )
+    _result.loggit( "READ JFIF units: " + std::to_string( srcUnits ) +
+                    ", Xdensity: " + std::to_string( srcHoriz ) +
+                    ", Ydensity: " + std::to_string( srcVert ) );
+  if( srcUnits != 0 )
+  {
+    _result.srcImg.resolutionExists = true;
+    _result.srcImg.resolution.horiz = srcHoriz;
+    _result.srcImg.resolution.vert  = srcVert;
+    _result.srcImg.resolution.units = srcUnits;
+  }
+
+  uint32_t horiz{0}, vert{0};
+  const uint8_t units{ jfifDensity( *_config, horiz, vert ) };
+  const uint8_t density[5]{ units,
+      static_cast<uint8_t>( horiz >> 8 ), static_cast<uint8_t>( horiz ),
+      static_cast<uint8_t>( vert >> 8 ),  static_cast<uint8_t>( vert ) };
+  if( _result.logging )
+    _result.loggit( "WRITE JFIF units: " + std::to_string( units ) +
+                    ", Xdensity: " + std::to_string( horiz ) +
+                    ", Ydensity: " + std::to_string( vert ) );
+
+  pln.keep( "APP0 JFIF", at, OFFSET_JFIF_UNITS );
+  pln.update( "JFIF density", density, sizeof( density ) );
+  pln.keep( "APP0 JFIF", at + OFFSET_JFIF_UNITS + sizeof( density ),
+            segEnd - at - OFFSET_JFIF_UNITS - sizeof( density ) );
+}
+
+/**
+ * Plan one keep per marker segment, named by its marker, from CURSOR up to
+ * END.  The segments were checked by scanMarkers().
+ *
+ * @param pln OUT : destination image edits
+ * @param cursor IN/OUT : offset of next marker, == END on return
+ * @param end offset of the next marker that is not kept unchanged
+ */
+void JPEG::keepSegments( ModificationPlan &pln, size_t &cursor,
+                         const size_t end )
+{
+  const uint8_t *buf{ s_readData };
+  while( cursor < end )
+  {
+    size_t pos{ cursor };
+    while( buf[pos] == 0xFF ) { pos++; }
+    if( pos - 1 >= end )
+    {
+      pln.keep( "Fill bytes", cursor, end - cursor );
+      break;
+    }
+    const uint8_t code{ buf[pos++] };
+    size_t next{ pos };
+    if( code != 0xD8 && code != 0x01 && !( code >= 0xD0 && code <= 0xD7 ) )
+      next += ( buf[pos] << 8 ) | buf[pos+1];
+    pln.keep( markerName( code ), cursor, next - cursor );
+    cursor = next;
+  }
+  cursor = end;
+}
+
+/**
+ * Walk the marker segments from SOI up to and including the first SOS
+ * header.  Fill bytes (`FF`) before a marker are allowed.  Only the first
+ * JFIF APP0, EXIF APP1, and SOFn segments are recorded.
+ *
+ * @param buf source image
+ * @param size number of bytes in source image
+ * @param markers OUT : offsets of the segments of interest
+ * @return failure and its offset, or Ok if the SOS was found
+ */
+Status JPEG::scanMarkers( const uint8_t *buf, const size_t size,
+                          Markers &markers ) noexcept
+{
+  markers = Markers{};
+  if( size < 2u * NUM_BYTES_MARKER )
+    return Status{ MiscueCode::Truncated, 0 };
+  if( buf[0] != 0xFF || buf[1] != 0xD8 )   // SOI
+    return Status{ MiscueCode::InvalidSignature, 0 };
+
+  size_t pos{ NUM_BYTES_MARKER };
+  while( true )
+  {
+    if( pos >= size )
+      return Status{ MiscueCode::Truncated, pos };
+    if( buf[pos] != 0xFF )
+      return Status{ MiscueCode::InvalidHeader, pos };
+    while( pos < size && buf[pos] == 0xFF ) { pos++; }
+    if( pos >= size )
+      return Status{ MiscueCode::Truncated, pos };
+
+    const size_t at{ pos - 1 };
+    const uint8_t code{ buf[pos++] };
+    if( code == 0x01 || ( code >= 0xD0 && code <= 0xD7 ) )   // TEM, RSTn
+      continue;
+    if( code == 0x00 || code == 0xD8 || code == 0xD9 )
+      return Status{ MiscueCode::InvalidHeader, at };
+
+    if( size - pos < static_cast<size_t>( NUM_BYTES_SEGMENT_LENGTH ) )
+      return Status{ MiscueCode::Truncated, at };
+    const size_t len = ( buf[pos] << 8 ) | buf[pos+1];
+    if( len < static_cast<size_t>( NUM_BYTES_SEGMENT_LENGTH ) )
+      return Status{ MiscueCode::InvalidHeader, at };
+    if( len > size - pos )
+      return Status{ MiscueCode::Truncated, at };
+    const uint8_t *data{ buf + pos + NUM_BYTES_SEGMENT_LENGTH };
+
+    if( code == 0xE0 && !markers.jfif && len >= 16u &&
+        std::memcmp( data, "JFIF\0", 5 ) == 0 )
+    {
+      markers.jfif = at;
+    }
+    else if( code == 0xE1 && !markers.exif &&
+             len >= 8u + Exif::NUM_BYTES_TIFF_HEADER &&
+             std::memcmp( data, "Exif\0\0", 6 ) == 0 )
+    {
+      markers.exif = at;
+      markers.exifLength = len;
+    }
+    else if( code >= 0xC0 && code <= 0xCF &&
+             code != 0xC4 && code != 0xC8 && code != 0xCC )
+    {
+      if( len < 8u )
+        return Status{ MiscueCode::InvalidHeader, at };
+      if( !markers.sof )
+        markers.sof = at;
+    }
+    else if( code == 0xDA )   // SOS
+    {
+      if( !markers.sof )
+        return Status{ MiscueCode::InvalidHeader, at };
+      markers.sos = at;
+      return Status{};
+    }
+    pos += len;
+  }
+}
+
+/**
+ * Checks the same conditions as planImage(), reading the segments in place:
+ * - SOI, then marker segments within the source image up to the first SOS
+ * - SOFn before SOS
+ * - TIFF header and IFD0 of the EXIF APP1 segment, if any
+ *
+ * @return Ok, or the first failure and its offset
+ */
+Status JPEG::validateImage() const noexcept
+{
+  Markers markers;
+  const Status st{ scanMarkers( s_readData, s_readSize, markers ) };
+  if( !st || !markers.exif )
+    return st;
+
+  const size_t base{ markers.exif + OFFSET_EXIF_TIFF };
+  Exif::Layout layout;
+  const Status exifSt{ Exif::parse( s_readData + base,
+                                    markers.exifLength - 8u, layout ) };
+  if( !exifSt )
+    return Status{ exifSt.code, base + exifSt.offset };
+  return Status{};
+}
+
+/**
+ * The plan needs the marker segments up to and including the SOS header;
+ * the scan data is passed through.
+ *
+ * @param buf first bytes of the source image
+ * @param size number of bytes read
+ * @return end of the SOS header, 0 if it is not yet read, or SIZE when
+ *   the segments are invalid
+ */
+size_t JPEG::streamHeadLength( const uint8_t *buf, const size_t size ) const noexcept
+{
+  Markers markers;
+  const Status st{ scanMarkers( buf, size, markers ) };
+  if( st.code == MiscueCode::Truncated )
+    return 0;
+  if( !st )
+    return size;
+  const size_t at{ markers.sos + NUM_BYTES_MARKER };
+  return at + ( ( buf[at] << 8 ) | buf[at+1] );
+}
+
+/**
+ * @param code second byte of the marker
+ * @return marker name, e.g. `DQT`, `APP1`, `SOF0`
+ */
+std::string JPEG::markerName( const uint8_t code )
+{
+  switch( code ) {
+    case 0xD8: return "SOI";
+    case 0xC4: return "DHT";
+    case 0xCC: return "DAC";
+    case 0xDA: return "SOS";
+    case 0xDB: return "DQT";
+    case 0xDD: return "DRI";
+    case 0xFE: return "COM";
+    default: break;
+  }
+  if( code >= 0xE0 && code <= 0xEF )
+    return "APP" + std::to_string( code - 0xE0 );
+  if( code >= 0xC0 && code <= 0xCF )
+    return "SOF" + std::to_string( code - 0xC0 );
+  if( code >= 0xD0 && code <= 0xD7 )
+    return "RST" + std::to_string( code - 0xD0 );
+
+  std::stringstream ss;
+  ss << "0xFF" << std::hex << std::uppercase << std::setw(2)
+     << std::setfill('0') << static_cast<int>( code );
+  return ss.str();
+}
+
+/**
+ * For "meter" the sample rate is pixels per meter and the density is
+ * rounded to dots per cm.
+ *
+ * @param cfg destination sample rate
+ * @param horiz OUT : Xdensity
+ * @param vert OUT : Ydensity
+ * @return JFIF units: 0 aspect ratio, 1 dots per inch, 2 dots per cm
+ */
+uint8_t JPEG::jfifDensity( const ModificationConfig &cfg,
+                           uint32_t &horiz, uint32_t &vert )
+{
+  horiz = cfg.destResolution.horiz;
+  vert  = cfg.destResolution.vert;
+  if( cfg.destResolution.unitsStr == "inch" )
+    return 1;
+  if( cfg.destResolution.unitsStr == "meter" )
+  {
+    horiz = ( horiz + 50 ) / 100;
+    vert  = ( vert + 50 ) / 100;
+    return 2;
+  }
+  return 0;
+}
+
+/**
+ * @param cfg destination sample rate
+ * @return true if both densities are <= 65535
+ */
+bool JPEG::isSupportedDensity( const ModificationConfig &cfg )
+{
+  uint32_t horiz{0}, vert{0};
+  jfifDensity( cfg, horiz, vert );
+  return horiz <= 0xFFFF && vert <= 0xFFFF;
+}
+
+/** @return current Metadata Parameters */
+std::string JPEG::to_s()
+{
+  std::string s{"JPEG: "};
+  s.append( _config->to_s() );
+  return s;
+}
+
+}   // END namespace
@@ -27,6 +27,8 @@ identified are necessarily the best available for the purpose.
 *******************************************************************************/
 
 #include "nfimm_lib.h"
+#include "jpeg/jpeg.h"
+#include "png/png.h"
 
 #include <algorithm>
 #include <iostream>
@@ -35,7 +37,8 @@ identified are necessarily the best available for the purpose.
 namespace NFIMM {
 
 /**
- * Check compression is either bmp or png.
+ * Check compression is an2k, bmp, jp2, jpeg, png, tiff, or wsq; "jpg" is the
+ * same as "jpeg", "tif" as "tiff", and "an2" and "eft" as "an2k".
  * @throw Miscue Non-supported compression-type
 */
 MetadataParameters::MetadataParameters( const std::string &imgFormat )
@@ -46,9 +49,17 @@ MetadataParameters::MetadataParameters( const std::string &imgFormat )
                   compression.end(),
                   compression.begin(),
                   static_cast<int(*)(int)>(std::tolower) );
+  if( compression == "jpg" )
+    compression = "jpeg";
+  else if( compression == "tif" )
+    compression = "tiff";
+  else if( compression == "an2" || compression == "eft" )
+    compression = "an2k";
 
-  if( (compression != "bmp") && (compression != "png") )
-    throw Miscue(
+  if( (compression != "an2k") && (compression != "bmp") && (compression != "jp2") &&
+      (compression != "jpeg") && (compression != "png") && (compression != "tiff") &&
+      (compression != "wsq") )
+    throw Miscue( MiscueCode::InvalidParameter,
         "Non-supported image compression: '" + compression + "'" );
   else
   {
@@ -142,4 +153,308 @@ std::string MetadataParameters::to_s() {
   return s;
 }
 
+
+/******************************************************************************/
+/* class ModificationConfig methods implementations */
+
+/**
+ * The metadata parameters were verified by the MetadataParameters
+ * constructor; for PNG, the chunk template compile verifies the custom text,
+ * for JPEG, the sample rate must fit the 2-byte JFIF density.
+ *
+ * @param mps caller's metadata parameters
+ * @throw Miscue Non-supported compression-type, invalid custom text, JPEG
+ *   density too large
+ */
+ModificationConfig::ModificationConfig( const MetadataParameters &mps )
+  : compression(mps.srcImg.compression),
+    srcResolution{ mps.srcImg.resolution.horiz, mps.srcImg.resolution.vert,
+                   mps.srcImg.resolution.units, mps.srcImg.resolution.unitsStr },
+    destResolution{ mps.destImg.resolution.horiz, mps.destImg.resolution.vert,
+                    mps.destImg.resolution.units, mps.destImg.resolution.unitsStr },
+    textChunk(mps.destImg.textChunk)
+{
+  if( (compression != "an2k") && (compression != "bmp") && (compression != "jp2") &&
+      (compression != "jpeg") && (compression != "png") && (compression != "tiff") &&
+      (compression != "wsq") )
+    throw Miscue( MiscueCode::InvalidParameter,
+        "Non-supported image compression: '" + compression + "'" );
+
+  if( compression == "jpeg" && !JPEG::isSupportedDensity( *this ) )
+    throw Miscue( MiscueCode::InvalidParameter,
+        "JPEG JFIF density exceeds 65535: " +
+        std::to_string( destResolution.horiz ) + ", " +
+        std::to_string( destResolution.vert ) );
+
+  if( compression == "png" )
+    _chunkTemplate = std::make_shared<const ChunkTemplate>( *this );
+}
+
+/**
+ * Every call compiles a new config, so a PNG Creation Time "now" is the
+ * time of the call.  Callers that modify a batch with the same parameters
+ * build the config once and share it, e.g. Batch, Server, or FormatConfigs.
+ *
+ * @param mps caller's metadata parameters
+ * @return config for the parameters
+ * @throw Miscue Non-supported compression-type, invalid custom text
+ */
+std::shared_ptr<const ModificationConfig>
+ModificationConfig::fromParameters( const MetadataParameters &mps )
+{
+  return std::make_shared<const ModificationConfig>( mps );
+}
+
+/**
+ * @param mps metadata parameters
+ * @return every parameter that is copied into the config
+ */
+std::string ModificationConfig::keyFor( const MetadataParameters &mps )
+{
+  const char sep{'\x1f'};
+  std::string key{ mps.srcImg.compression };
+  auto appendResolution = [&key, sep]( const auto &res ) {
+    key.push_back( sep );
+    key.append( std::to_string( res.horiz ) );
+    key.push_back( sep );
+    key.append( std::to_string( res.vert ) );
+    key.push_back( sep );
+    key.append( std::to_string( res.units ) );
+    key.push_back( sep );
+    key.append( res.unitsStr );
+  };
+  appendResolution( mps.srcImg.resolution );
+  appendResolution( mps.destImg.resolution );
+  for( auto &txt : mps.destImg.textChunk ) {
+    key.push_back( sep );
+    key.append( txt );
+  }
+  return key;
+}
+
+/**
+ * Used for images of several formats with the same parameters, e.g. the
+ * images embedded in a transaction or a batch of mixed formats.
+ *
+ * @param format compression of the other image
+ * @return new config, validated for FORMAT
+ * @throw Miscue Non-supported compression-type, invalid custom text, JPEG
+ *   density too large
+ */
+std::shared_ptr<const ModificationConfig>
+ModificationConfig::withCompression( const std::string &format ) const
+{
+  return std::make_shared<const ModificationConfig>( toParameters( format ) );
+}
+
+/**
+ * @return keyFor() of the parameters the config was built from
+ */
+std::string ModificationConfig::key() const
+{
+  return keyFor( toParameters( compression ) );
+}
+
+/**
+ * @param format compression of the parameters
+ * @return the config's parameters
+ * @throw Miscue Non-supported compression-type
+ */
+MetadataParameters
+ModificationConfig::toParameters( const std::string &format ) const
+{
+  MetadataParameters mp( format );
+  mp.srcImg.resolution.horiz = srcResolution.horiz;
+  mp.srcImg.resolution.vert  = srcResolution.vert;
+  mp.set_srcImgSampleRateUnits( srcResolution.unitsStr );
+  mp.destImg.resolution.horiz = destResolution.horiz;
+  mp.destImg.resolution.vert  = destResolution.vert;
+  mp.set_destImgSampleRateUnits( destResolution.unitsStr );
+  mp.destImg.textChunk = textChunk;
+  return mp;
+}
+
+/** @return compiled template, nullptr if compression is not png */
+std::shared_ptr<const ChunkTemplate> ModificationConfig::chunkTemplate() const
+{
+  return _chunkTemplate;
+}
+
+/**
+ * @param img either "src" or "dest"
+ * @return "PPI" or "PPMM" or ""
+ */
+std::string
+ModificationConfig::get_imgSampleRateUnits( const std::string &img ) const {
+  const Resolution *res{nullptr};
+  if( img == "dest" )
+    res = &destResolution;
+  else if( img == "src" )
+    res = &srcResolution;
+  else
+    return "";
+
+  if( res->unitsStr == "inch" )
+    return "PPI";
+  else if( res->unitsStr == "meter" )
+    return "PPMM";
+  return "";
+}
+
+/** @return all required and optional metadata parameters */
+std::string ModificationConfig::to_s() const {
+  std::string s{"Modification Metadata:\n"};
+  s.append( " * Source compression format: " );
+  s.append( compression + "\n" );
+  s.append( " * Source image sample-rate " );
+  s.append( "(" + srcResolution.unitsStr + ")\n" );
+  s.append( "   Horiz: " );
+  s.append( std::to_string( srcResolution.horiz ) + "\n" );
+  s.append( "   Vert:  " );
+  s.append( std::to_string( srcResolution.vert ) + "\n" );
+  s.append( " * Destination compression format: " );
+  s.append( compression + "\n" );
+  s.append( " * Destination image sample-rate " );
+  s.append( "(" + destResolution.unitsStr + ")\n" );
+  s.append( "   Horiz: " );
+  s.append( std::to_string( destResolution.horiz ) + "\n" );
+  s.append( "   Vert:  " );
+  s.append( std::to_string( destResolution.vert ) + "\n" );
+
+  if( compression == "png" )
+  {
+    s.append( " * Destination custom text:\n" );
+    for( auto &txt : textChunk )
+    {
+      s.append( "   " + txt + "\n" );
+    }
+  }
+  return s;
+}
+
+/******************************************************************************/
+/* struct ModificationResult methods implementations */
+
+/**
+ * @param s message to log
+ */
+void ModificationResult::loggit( const std::string &s ) {
+  if( logging )
+    log.push_back( s );
+}
+
+/**
+ * @param s message to log
+ */
+void ModificationResult::loggit( const char *s ) {
+  if( logging )
+    log.emplace_back( s );
+}
+
+/** Every member is reset but logging, which is set by the handler's owner. */
+void ModificationResult::restart() {
+  const bool on{ logging };
+  *this = ModificationResult{};
+  logging = on;
+}
+
+
+/**
+ * @param element header, chunk type, or image data
+ * @param offset of first byte in source image
+ * @param size number of bytes
+ */
+void ModificationPlan::keep( const std::string &element, const size_t offset,
+                             const size_t size )
+{
+  segments.addSource( offset, size );
+  addEdit( Action::Keep, element, size );
+}
+
+/**
+ * @param element header or chunk type
+ * @param bytes rewritten element
+ * @param size number of bytes
+ */
+void ModificationPlan::update( const std::string &element,
+                               const uint8_t *bytes, const size_t size )
+{
+  segments.addBytes( bytes, size );
+  addEdit( Action::Update, element, size );
+}
+
+/**
+ * @param element header or chunk type
+ * @param bytes new element
+ * @param size number of bytes
+ */
+void ModificationPlan::insert( const std::string &element,
+                               const uint8_t *bytes, const size_t size )
+{
+  segments.addBytes( bytes, size );
+  addEdit( Action::Insert, element, size );
+}
+
+/**
+ * The edits and segments of a plan of an image that is embedded in the
+ * source image, e.g. the image of an ANSI/NIST-ITL record.  The source
+ * ranges of the embedded plan are moved by the offset of the embedded image.
+ *
+ * @param embedded plan of the embedded image
+ * @param offset of the embedded image in the source image
+ * @param prefix prepended to each element name
+ */
+void ModificationPlan::append( const ModificationPlan &embedded,
+                               const size_t offset, const std::string &prefix )
+{
+  for( const Edit &e : embedded.edits ) {
+    addEdit( e.action, prefix + e.element, e.size );
+  }
+  for( const SegmentList::Segment &seg : embedded.segments.segments() )
+  {
+    if( seg.fromSource() )
+      segments.addSource( offset + seg.srcOffset, seg.length );
+    else
+      segments.addBytes( seg.bytes.data(), seg.length );
+  }
+}
+
+/**
+ * @param action what happens to the element
+ * @param element header, chunk type, or image data
+ * @param size number of bytes in destination image
+ */
+void ModificationPlan::addEdit( const Action action,
+                                const std::string &element, const size_t size )
+{
+  if( action == Action::Keep && !edits.empty() &&
+      edits.back().action == Action::Keep && edits.back().element == element )
+    edits.back().size += size;
+  else
+    edits.push_back( Edit{ action, element, size } );
+  outputSize += size;
+}
+
+/**
+ * @return output size followed by each edit on its own line, then the
+ *   segments
+ */
+std::string ModificationPlan::to_s() const
+{
+  std::string s{"Destination image size: " + std::to_string( outputSize )};
+  for( const Edit &e : edits )
+  {
+    s.append( "\n  " );
+    switch( e.action )
+    {
+      case Action::Keep:   s.append( "keep   " ); break;
+      case Action::Update: s.append( "update " ); break;
+      case Action::Insert: s.append( "insert " ); break;
+    }
+    s.append( e.element + ": " + std::to_string( e.size ) );
+  }
+  s.append( "\n" + segments.to_s() );
+  return s;
+}
+
 }   // END namespace
\ No newline at end of file
@@ -0,0 +1,363 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "nfimm_c.h"
+#include "registry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+static_assert( NFIMM_OTHER == static_cast<int>( NFIMM::MiscueCode::Other ),
+               "nfimm_code must mirror NFIMM::MiscueCode" );
+
+/** @brief Config of every format the parameters are valid for, immutable
+ * after nfimm_config_create() and so shared by all threads */
+struct nfimm_config
+{
+  uint64_t id;          ///< unique, keys the handlers of each thread
+  bool detect;          ///< format from signature, else `format`
+  std::string format;   ///< compression if not detected
+  std::map<std::string, std::shared_ptr<const NFIMM::ModificationConfig>> configs;
+};
+
+namespace {
+
+using NFIMM::MiscueCode;
+
+/** @brief Never reused, so a destroyed config's handlers are never found */
+std::atomic<uint64_t> s_nextConfigId{1};
+
+/** @brief Handlers of this thread for the config
+ *
+ * Handlers of destroyed configs are dropped when the cache is full.
+ */
+NFIMM::HandlerCache &handlersFor( const nfimm_config &cfg )
+{
+  static const size_t MAX_CONFIGS{8};
+  static thread_local std::map<uint64_t, NFIMM::HandlerCache> s_handlers{};
+  auto it = s_handlers.find( cfg.id );
+  if( it != s_handlers.end() )
+    return it->second;
+  if( s_handlers.size() >= MAX_CONFIGS )
+    s_handlers.clear();
+  return s_handlers[cfg.id];
+}
+
+/** @brief Modify one job on the calling thread; never throws */
+void process( const nfimm_job &job, nfimm_result &res ) noexcept
+{
+  res = nfimm_result{};
+  auto fail = [&res]( const MiscueCode code ) {
+    res.code = static_cast<int32_t>( code );
+  };
+  if( job.config == nullptr || job.src == nullptr )
+    return fail( MiscueCode::InvalidParameter );
+
+  const nfimm_config &cfg{ *job.config };
+  const std::string &format{ cfg.detect
+      ? NFIMM::HandlerRegistry::instance().detect( job.src, job.src_size )
+      : cfg.format };
+  if( format.empty() )
+    return fail( MiscueCode::InvalidSignature );
+  const auto config = cfg.configs.find( format );
+  if( config == cfg.configs.end() )
+    return fail( MiscueCode::InvalidParameter );
+
+  // The read-buffer borrows the caller's source until return.
+  const NFIMM::MappedSource source;
+  try
+  {
+    NFIMM::NFIMM &handler{ handlersFor( cfg ).get( format, config->second ) };
+    handler.readImageFileIntoBuffer( job.src, job.src_size );
+    const NFIMM::Status st{
+      handler.tryModify( job.dest, job.dest_capacity, res.dest_size ) };
+    res.code = static_cast<int32_t>( st.code );
+    res.offset = st.offset;
+  }
+  catch( const NFIMM::Miscue &e )
+  {
+    fail( e.code() );
+  }
+  catch( const std::exception & )
+  {
+    fail( MiscueCode::Other );
+  }
+}
+
+
+/** @brief Threads shared by all batches
+ *
+ * A batch is a range of indexes claimed one at a time by the pool and by
+ * the caller, which waits until every index is done.  Batches of several
+ * callers are queued and run in order of arrival.
+ */
+class ThreadPool
+{
+public:
+  /** @brief Started on first use, one thread per core less the caller */
+  static ThreadPool &instance()
+  {
+    static ThreadPool s_pool{ std::max( 1u, std::thread::hardware_concurrency() ) - 1 };
+    return s_pool;
+  }
+
+  /** @brief Call FN for every index below N; returns when all are done */
+  void run( const size_t n, const std::function<void( size_t )> &fn )
+  {
+    Batch batch{ &fn, n };
+    std::unique_lock<std::mutex> lk( _mtx );
+    _queue.push_back( &batch );
+    _work.notify_all();
+    while( batch.next < batch.n )
+    {
+      const size_t i{ claim( batch ) };
+      lk.unlock();
+      fn( i );
+      lk.lock();
+      batch.done++;
+    }
+    _finished.wait( lk, [&batch] { return batch.done == batch.n; } );
+  }
+
+  /** @brief Stop and join the threads */
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lk( _mtx );
+      _stopping = true;
+    }
+    _work.notify_all();
+    for( std::thread &t : _threads ) { t.join(); }
+  }
+
+private:
+  /** @brief Indexes of one run(), guarded by the pool's mutex */
+  struct Batch {
+    const std::function<void( size_t )> *fn;
+    size_t n;
+    size_t next{0};   ///< first unclaimed index
+    size_t done{0};   ///< count of finished indexes
+  };
+
+  explicit ThreadPool( const unsigned count )
+  {
+    for( unsigned i=0; i<count; i++ ) {
+      _threads.emplace_back( [this] { work(); } );
+    }
+  }
+
+  /** @brief Next index of BATCH; a batch leaves the queue once all are claimed */
+  size_t claim( Batch &batch )
+  {
+    const size_t i{ batch.next++ };
+    if( batch.next == batch.n )
+      _queue.erase( std::find( _queue.begin(), _queue.end(), &batch ) );
+    return i;
+  }
+
+  /** @brief Run indexes of the oldest batch until stopped */
+  void work()
+  {
+    std::unique_lock<std::mutex> lk( _mtx );
+    for( ;; )
+    {
+      _work.wait( lk, [this] { return _stopping || !_queue.empty(); } );
+      if( _stopping )
+        return;
+      Batch &batch{ *_queue.front() };
+      const size_t i{ claim( batch ) };
+      lk.unlock();
+      ( *batch.fn )( i );
+      lk.lock();
+      if( ++batch.done == batch.n )
+        _finished.notify_all();
+    }
+  }
+
+  std::mutex _mtx;
+  std::condition_variable _work;       ///< a batch was queued, or stopping
+  std::condition_variable _finished;   ///< a batch is done
+  std::deque<Batch *> _queue{};        ///< batches with unclaimed indexes
+  std::vector<std::thread> _threads{};
+  bool _stopping{false};
+};   // END class ThreadPool
+
+}   // END namespace
+
+
+/******************************************************************************/
+/* C interface */
+
+/**
+ * With compression "auto" a config is compiled for every format the
+ * parameters are valid for; a job whose format has none fails with
+ * NFIMM_INVALID_PARAMETER.
+ *
+ * @param params modification parameters
+ * @param out OUT : the config, NULL on failure
+ * @return NFIMM_OK, or why the parameters are invalid
+ */
+int nfimm_config_create( const nfimm_params *params, nfimm_config **out )
+{
+  if( out == nullptr )
+    return NFIMM_INVALID_PARAMETER;
+  *out = nullptr;
+  if( params == nullptr || params->compression == nullptr ||
+      ( params->text == nullptr && params->text_count > 0 ) )
+    return NFIMM_INVALID_PARAMETER;
+
+  try
+  {
+    const std::string compression{ params->compression };
+    std::unique_ptr<nfimm_config> cfg{ new nfimm_config{
+      s_nextConfigId.fetch_add( 1 ), compression == "auto",
+      compression, {} } };
+
+    NFIMM::MetadataParameters mp( cfg->detect ? "png" : compression );
+    mp.srcImg.resolution.horiz = params->src_horiz;
+    mp.srcImg.resolution.vert = params->src_vert;
+    mp.set_srcImgSampleRateUnits( params->src_units ? params->src_units : "" );
+    mp.destImg.resolution.horiz = params->dest_horiz;
+    mp.destImg.resolution.vert = params->dest_vert;
+    mp.set_destImgSampleRateUnits( params->dest_units ? params->dest_units : "" );
+    for( size_t i=0; i<params->text_count; i++ ) {
+      if( params->text[i] == nullptr )
+        return NFIMM_INVALID_PARAMETER;
+      mp.destImg.textChunk.push_back( params->text[i] );
+    }
+    const auto base = std::make_shared<const NFIMM::ModificationConfig>( mp );
+
+    if( !cfg->detect )
+      cfg->configs[compression] = base;
+    else
+    {
+      for( const std::string &format : NFIMM::HandlerRegistry::instance().formats() )
+      {
+        try
+        {
+          cfg->configs[format] = base->withCompression( format );
+        }
+        catch( const NFIMM::Miscue & ) {}
+      }
+    }
+    *out = cfg.release();
+    return NFIMM_OK;
+  }
+  catch( const NFIMM::Miscue &e )
+  {
+    return static_cast<int>( e.code() );
+  }
+  catch( const std::exception & )
+  {
+    return NFIMM_OTHER;
+  }
+}
+
+/**
+ * @param config from nfimm_config_create(), may be NULL
+ */
+void nfimm_config_destroy( nfimm_config *config )
+{
+  delete config;
+}
+
+/**
+ * @param job source, destination, and config
+ * @param result OUT : outcome
+ * @return result->code
+ */
+int nfimm_process( const nfimm_job *job, nfimm_result *result )
+{
+  if( result == nullptr )
+    return NFIMM_INVALID_PARAMETER;
+  if( job == nullptr )
+  {
+    *result = nfimm_result{};
+    return result->code = NFIMM_INVALID_PARAMETER;
+  }
+  process( *job, *result );
+  return result->code;
+}
+
+/**
+ * The calling thread runs jobs too; a single job never wakes the pool.
+ * Each job writes only its own result, so jobs share no state.
+ *
+ * @param jobs N jobs
+ * @param n number of jobs and results
+ * @param results OUT : N outcomes, in job order
+ * @return number of jobs whose code is not NFIMM_OK
+ */
+size_t nfimm_process_batch( const nfimm_job *jobs, size_t n,
+                            nfimm_result *results )
+{
+  if( n == 0 )
+    return 0;
+  if( jobs == nullptr || results == nullptr )
+    return n;
+
+  if( n == 1 )
+    process( jobs[0], results[0] );
+  else
+  {
+    try
+    {
+      ThreadPool::instance().run( n, [jobs, results]( const size_t i ) {
+        process( jobs[i], results[i] );
+      } );
+    }
+    catch( const std::exception & )
+    {
+      // No pool, e.g. no threads available: run every job here.
+      for( size_t i=0; i<n; i++ ) { process( jobs[i], results[i] ); }
+    }
+  }
+
+  size_t failed{0};
+  for( size_t i=0; i<n; i++ ) {
+    if( results[i].code != NFIMM_OK ) failed++;
+  }
+  return failed;
+}
+
+/**
+ * @param code an nfimm_code
+ * @return fixed description
+ */
+const char *nfimm_describe( int code )
+{
+  if( code < NFIMM_OK || code > NFIMM_OTHER )
+    code = NFIMM_OTHER;
+  return NFIMM::describe( static_cast<MiscueCode>( code ) );
+}
@@ -27,17 +27,544 @@ identified are necessarily the best available for the purpose.
 *******************************************************************************/
 
 #include "nfimm_lib.h"
+#include "output_sink.h"
+#include "probe.h"
+#include "registry.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
 #include <sys/stat.h>
+#ifdef _WIN32
+  #include <io.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
 
 
 namespace NFIMM {
 
 
 /** Initialize the metadata params container for receipt of user info and
- * logging. */
-NFIMM::NFIMM( std::shared_ptr<MetadataParameters> &mps ) : _params(mps) {}
+ * logging.  The parameters are validated and compiled for this handler, see
+ * ModificationConfig::fromParameters().
+ *
+ * @throw Miscue Non-supported compression-type, invalid custom text
+ */
+NFIMM::NFIMM( std::shared_ptr<MetadataParameters> &mps )
+  : _params(mps), _config(ModificationConfig::fromParameters( *mps )),
+    _srcPath(mps->srcImg.path), _srcPathSet(!mps->srcImg.path.empty()) {}
+
+/** The config is shared; it is never modified by NFIMM.
+ *
+ * @throw Miscue Config is nullptr
+ */
+NFIMM::NFIMM( std::shared_ptr<const ModificationConfig> cfg )
+  : _config(std::move(cfg))
+{
+  if( !_config )
+    throw Miscue( MiscueCode::InvalidParameter,
+                  "Modification config is null" );
+}
+
+/**
+ * Plan and execute into the write-buffer.  The result is copied to the
+ * caller's MetadataParameters, if any, whether or not the modification
+ * succeeded.
+ *
+ * @throw Miscue for any point where process failed
+ */
+void NFIMM::modify()
+{
+  const ModificationPlan &pln = plan();
+  s_writeBuffer.resize( pln.outputSize );
+  execute( pln, s_writeBuffer.data(), s_writeBuffer.size() );
+}
+
+/**
+ * Plan only; the destination image is returned as source ranges and new
+ * bytes and is never assembled.  The source image must remain valid and
+ * unchanged for as long as the segments are used.
+ *
+ * @param segs OUT : destination image
+ * @throw Miscue for any point where process failed
+ */
+void NFIMM::modify( SegmentList &segs )
+{
+  segs = plan().segments;
+}
+
+/**
+ * Plan, then write the destination image to the sink as it is laid out in
+ * segments; the destination image is never assembled.  The sink is finished
+ * after the last segment.
+ *
+ * @param sink receives the destination image
+ * @return number of bytes written
+ * @throw Miscue for any point where process failed, write failed
+ */
+size_t NFIMM::modify( OutputSink &sink )
+{
+  const size_t size{ plan().segments.writeTo( sink ) };
+  sink.finish();
+  return size;
+}
+
+/**
+ * Patch the source image file where it is: only the new bytes of the plan
+ * are written, at their own offsets, and the file is never copied.  The
+ * file is memory-mapped, so only the pages that are parsed are read; on
+ * Windows it is read into the read-buffer.
+ *
+ * Every source range of the plan must stay at its own offset, i.e. new
+ * bytes either replace the same number of source bytes or are appended, as
+ * for a TIFF, JPEG, JP2, or BMP resolution patch.  Otherwise the file is not
+ * changed.  A failed write may leave the file partially patched.
+ *
+ * @param path source image file, modified
+ * @return number of bytes written into the file
+ * @throw Miscue for any point where process failed, source bytes would
+ *   move, file cannot be mapped or written
+ */
+size_t NFIMM::modifyInPlace( const std::string &path )
+{
+#ifdef _WIN32
+  readImageFileIntoBuffer( path );
+#else
+  const int fd{ ::open( path.c_str(), O_RDONLY ) };
+  struct stat st;
+  if( fd < 0 || ::fstat( fd, &st ) != 0 || st.st_size == 0 )
+  {
+    if( fd >= 0 ) ::close( fd );
+    throw Miscue( MiscueCode::Io, "CANNOT open file: '" + path + "'" );
+  }
+  // The read-buffer borrows the mapping until return.
+  MappedSource source;
+  const bool mapped{ source.map( fd, static_cast<size_t>( st.st_size ) ) };
+  ::close( fd );
+  if( !mapped )
+    throw Miscue( MiscueCode::Io, "CANNOT map file: '" + path + "'" );
+  if( !_srcPathSet )
+    setSourcePath( path );
+  readImageFileIntoBuffer( source.data(), source.size() );
+#endif
+
+  const ModificationPlan &pln = plan();
+  size_t pos{0};
+  for( const SegmentList::Segment &seg : pln.segments.segments() )
+  {
+    if( seg.fromSource() && seg.srcOffset != pos )
+      throw Miscue( MiscueCode::Unsupported,
+        "Image cannot be modified in place, source bytes move at " +
+        std::to_string( seg.srcOffset ) );
+    pos += seg.length;
+  }
+  if( pln.outputSize < s_readSize )
+    throw Miscue( MiscueCode::Unsupported,
+      "Image cannot be modified in place, destination image is smaller" );
+
+  std::fstream strm( path, std::ios::in|std::ios::out|std::ios::binary );
+  if( !strm )
+    throw Miscue( MiscueCode::Io, "CANNOT open file for write: '" + path + "'" );
+  size_t written{0};
+  pos = 0;
+  for( const SegmentList::Segment &seg : pln.segments.segments() )
+  {
+    if( !seg.fromSource() )
+    {
+      strm.seekp( static_cast<std::streamoff>( pos ) );
+      strm.write( reinterpret_cast<const char *>( seg.bytes.data() ),
+                  static_cast<std::streamsize>( seg.length ) );
+      written += seg.length;
+    }
+    pos += seg.length;
+  }
+  strm.close();
+  if( !strm )
+    throw Miscue( MiscueCode::Io, "CANNOT write file: '" + path + "'" );
+  return written;
+}
+
+/**
+ * Read the source image from a file, pipe, or socket and write the
+ * destination image to another as it is produced; neither is closed.  Bytes
+ * already read from the input, e.g. to detect the format, are passed in
+ * HEAD.  Formats that stream keep only their headers in memory, see
+ * streamImage().
+ *
+ * @param fdIn source image, read to its end
+ * @param fdOut destination image
+ * @param head first bytes of the source image, already read from fdIn
+ * @return number of bytes written
+ * @throw Miscue for any point where process failed, read or write failed
+ */
+size_t NFIMM::modifyStream( const int fdIn, const int fdOut,
+                            std::vector<uint8_t> &&head )
+{
+  FdSink sink( fdOut );
+  const size_t size{ streamImage( fdIn, sink, head ) };
+  sink.finish();
+  return size;
+}
+
+/**
+ * Input is read until streamHeadLength() tells how much of it the plan
+ * needs.  Only those bytes become the read-buffer, marked s_readPartial;
+ * their plan is written and everything after them is passed through
+ * unchanged and unchecked.  A format that needs the whole image, or a
+ * stream that ends before its headers, is read entirely, then its plan is
+ * written.
+ *
+ * @param fdIn source image, read to its end
+ * @param sink destination image
+ * @param head IN/OUT first bytes of the source image
+ * @return number of bytes written
+ * @throw Miscue for any point where process failed, read or write failed
+ */
+size_t NFIMM::streamImage( const int fdIn, FdSink &sink,
+                           std::vector<uint8_t> &head )
+{
+  const size_t block{ 1u << 16 };
+
+  // Read until HEAD holds at least LEN bytes; false at end of input.
+  auto fill = [fdIn, &head]( const size_t len ) {
+    const size_t had{ head.size() };
+    if( had >= len )
+      return true;
+    head.resize( len );
+    const size_t got{ readDescriptor( fdIn, head.data() + had, len - had ) };
+    head.resize( had + got );
+    return had + got == len;
+  };
+
+  size_t headLength{ streamHeadLength( head.data(), head.size() ) };
+  bool more{true};
+  while( headLength == 0 && more )
+  {
+    more = fill( head.size() + block );
+    headLength = streamHeadLength( head.data(), head.size() );
+  }
+
+  if( headLength != 0 && headLength != STREAM_WHOLE_IMAGE && fill( headLength ) )
+  {
+    // Bytes already read past the headers are written after the plan.
+    const std::vector<uint8_t> data( head.begin() + headLength, head.end() );
+    head.resize( headLength );
+    readImageFileIntoBuffer( std::move( head ) );
+
+    struct Partial {
+      ~Partial() { s_readPartial = false; }
+    } partial;
+    s_readPartial = true;
+    const size_t size{ plan().segments.writeTo( sink ) };
+    sink.write( data.data(), data.size() );
+    const size_t passed{ data.size() + sink.copyFrom( fdIn ) };
+    if( _result.logging )
+      _result.loggit( "Image data passed through: " + std::to_string( passed ) +
+                      " bytes" );
+    return size + passed;
+  }
+
+  while( fill( head.size() + block ) ) {}
+  readImageFileIntoBuffer( std::move( head ) );
+  return plan().segments.writeTo( sink );
+}
+
+/**
+ * Start a new result, validate the source image, and parse and update its
+ * headers.  No destination bytes are produced; the plan holds their exact
+ * count and layout.  The source image must not change until execute()
+ * returns.
+ *
+ * @return the plan, valid until the next call of plan()
+ * @throw Miscue for any point where process failed
+ */
+const ModificationPlan &NFIMM::plan()
+{
+  const Status st{ validate() };
+  if( !st )
+  {
+    _result.restart();
+    _publishedLogCount = 0;
+    if( _result.logging )
+      _result.loggit( std::string{"Source image validation FAILED: "} +
+                      st.what() + " at byte " + std::to_string( st.offset ) );
+    publishResult();
+    throw Miscue( st );
+  }
+  return planValidated();
+}
+
+/**
+ * @return the plan, valid until the next call of plan()
+ * @throw Miscue for any point where process failed
+ */
+const ModificationPlan &NFIMM::planValidated()
+{
+  _result.restart();
+  _publishedLogCount = 0;
+  _plan = ModificationPlan{};
+  _plan.segments.reset( s_readData, s_readSize );
+  try
+  {
+    planImage( _plan );
+  }
+  catch( const Miscue & )
+  {
+    publishResult();
+    throw;
+  }
+  if( _result.logging )
+    _result.loggit( "Destination image size: " +
+                    std::to_string( _plan.outputSize ) + " in " +
+                    std::to_string( _plan.segments.segments().size() ) +
+                    " segments" );
+  publishResult();
+  return _plan;
+}
+
+/**
+ * Walk the headers of the source image without building any objects or
+ * strings.  A source image that passes may still fail modification, e.g.
+ * on an invalid Creation Time, but never by reading out of bounds.
+ *
+ * @return Ok, or the first failure found
+ */
+Status NFIMM::validate() const noexcept
+{
+  if( s_readData == nullptr )
+    return Status{ MiscueCode::InvalidParameter, 0 };
+  return validateImage();
+}
+
+/**
+ * A current source image needs no modification: its destination image
+ * would be the same bytes.  Nothing is written and no plan is kept.
+ *
+ * @return false if the source image is not current, or not valid
+ */
+bool NFIMM::isCurrent() noexcept
+{
+  if( s_readData == nullptr )
+    return false;
+  return isCurrentImage();
+}
+
+/**
+ * Exact for every format that patches its headers in place: the plan is
+ * current if it has the size of the source image and every new byte
+ * equals the source byte it replaces.  Only the headers are read.
+ *
+ * @return false if the destination image would differ, or on any failure
+ */
+bool NFIMM::isCurrentImage() noexcept
+{
+  if( !validate() )
+    return false;
+  try
+  {
+    const ModificationPlan &pln = planValidated();
+    if( pln.outputSize != s_readSize )
+      return false;
+    size_t pos{0};
+    for( const SegmentList::Segment &seg : pln.segments.segments() )
+    {
+      if( seg.fromSource() ? seg.srcOffset != pos
+            : std::memcmp( seg.bytes.data(), s_readData + pos, seg.length ) != 0 )
+        return false;
+      pos += seg.length;
+    }
+    return true;
+  }
+  catch( const std::exception & )
+  {
+    return false;
+  }
+}
+
+/**
+ * Nothing is written.  The path of the probe is left as set by the caller.
+ *
+ * @param probe OUT : format, status, and header metadata
+ * @return probe.status
+ */
+Status NFIMM::probe( ImageProbe &probe ) noexcept
+{
+  if( _config )
+    probe.format = _config->compression;
+  if( s_readData == nullptr )
+    return probe.status = Status{ MiscueCode::InvalidParameter, 0 };
+  try
+  {
+    probe.status = probeImage( probe );
+  }
+  catch( const Miscue &e )
+  {
+    probe.status = Status{ e.code(), 0 };
+  }
+  catch( const std::exception & )
+  {
+    probe.status = Status{ MiscueCode::Other, 0 };
+  }
+  return probe.status;
+}
+
+/**
+ * Planning reads only the headers of every format.
+ *
+ * @param probe OUT : metadata extracted from the source image header
+ * @return Ok, or the validation failure
+ * @throw Miscue for any point where planning failed
+ */
+Status NFIMM::probeImage( ImageProbe &probe )
+{
+  const Status st{ validate() };
+  if( !st )
+    return st;
+  planValidated();
+  probe.width = _result.srcImg.width;
+  probe.height = _result.srcImg.height;
+  probe.bitDepth = _result.srcImg.bitDepth;
+  probe.resolutionExists = _result.srcImg.resolutionExists;
+  probe.horiz = _result.srcImg.resolution.horiz;
+  probe.vert = _result.srcImg.resolution.vert;
+  probe.units = _result.srcImg.resolution.units;
+  return Status{};
+}
+
+/**
+ * A source image that fails validate() returns at once: no log, no strings,
+ * and no stack unwinding.  Any other failure is caught and returned as its
+ * code.
+ *
+ * @param action run with the plan of a valid source image
+ * @return Ok, or the failure
+ */
+template<typename Action>
+Status NFIMM::guard( Action &&action ) noexcept
+{
+  const Status st{ validate() };
+  if( !st )
+  {
+    _result.restart();
+    _publishedLogCount = 0;
+    return st;
+  }
+  try
+  {
+    action( planValidated() );
+  }
+  catch( const Miscue &e )
+  {
+    return Status{ e.code(), 0 };
+  }
+  catch( const std::exception & )
+  {
+    return Status{ MiscueCode::Other, 0 };
+  }
+  return Status{};
+}
+
+/**
+ * @return Ok, or the failure; see modify()
+ */
+Status NFIMM::tryModify() noexcept
+{
+  return guard( [this]( const ModificationPlan &pln ) {
+    s_writeBuffer.resize( pln.outputSize );
+    execute( pln, s_writeBuffer.data(), s_writeBuffer.size() );
+  } );
+}
+
+/**
+ * @param segs OUT : destination image
+ * @return Ok, or the failure; see modify( SegmentList & )
+ */
+Status NFIMM::tryModify( SegmentList &segs ) noexcept
+{
+  return guard( [&segs]( const ModificationPlan &pln ) {
+    segs = pln.segments;
+  } );
+}
+
+/**
+ * @param sink receives the destination image
+ * @return Ok, or the failure; see modify( OutputSink & )
+ */
+Status NFIMM::tryModify( OutputSink &sink ) noexcept
+{
+  return guard( [&sink]( const ModificationPlan &pln ) {
+    pln.segments.writeTo( sink );
+    sink.finish();
+  } );
+}
+
+/**
+ * A destination that is too small fails with InvalidParameter, and SIZE
+ * holds the number of bytes needed; nothing is written.
+ *
+ * @param dest OUT : destination image
+ * @param capacity number of bytes available at dest
+ * @param size OUT : bytes of the destination image, 0 if not planned
+ * @return Ok, or the failure; see execute()
+ */
+Status NFIMM::tryModify( uint8_t *dest, const size_t capacity,
+                         size_t &size ) noexcept
+{
+  size = 0;
+  bool fits{false};
+  Status st{ guard( [&]( const ModificationPlan &pln ) {
+    size = pln.outputSize;
+    fits = dest != nullptr && capacity >= size;
+    if( fits )
+      pln.segments.copyTo( dest );
+  } ) };
+  if( st && !fits )
+    st.code = MiscueCode::InvalidParameter;
+  return st;
+}
+
+/**
+ * Assemble the destination image from the plan's segments.
+ *
+ * @param pln plan returned by plan()
+ * @param dest OUT : destination image
+ * @param capacity number of bytes available at dest
+ * @return number of bytes written, always ModificationPlan::outputSize
+ * @throw Miscue dest too small
+ */
+size_t NFIMM::execute( const ModificationPlan &pln, uint8_t *dest,
+                       const size_t capacity )
+{
+  if( dest == nullptr || capacity < pln.outputSize )
+    throw Miscue( MiscueCode::InvalidParameter,
+                  "Destination buffer too small: " +
+                  std::to_string( capacity ) + " bytes, need " +
+                  std::to_string( pln.outputSize ) );
+  return pln.segments.copyTo( dest );
+}
+
+/**
+ * The log is appended, as it has always been, while counts and the source
+ * image `pHYs` resolution are those of the most recent image.
+ */
+void NFIMM::publishResult()
+{
+  if( !_params ) return;
+
+  _params->log.insert( _params->log.end(),
+                       _result.log.begin() + _publishedLogCount,
+                       _result.log.end() );
+  _publishedLogCount = _result.log.size();
+  _params->pngWriteImageInfo.countSourceChunks =
+    _result.pngWriteImageInfo.countSourceChunks;
+  _params->pngWriteImageInfo.countInsertChunks =
+    _result.pngWriteImageInfo.countInsertChunks;
+  _params->srcImg.existingPhysResolution =
+    _result.srcImg.existingPhysResolution;
+}
 
 /** 1 byte -> [0-255] or [0x00-0xFF].
  *
@@ -69,8 +596,43 @@ void NFIMM::expressUINT32AsFourBytes( const size_t val,
 }
 
 /**
- * Reads 4 consecutive bytes from the read-buffer vector; the current index
- * into this vector is maintained by variable static `s_r_cursor`.
+ * Loop until LEN bytes are read or the input ends; a pipe or socket may
+ * return fewer bytes than requested.
+ *
+ * @param fd open for read by caller
+ * @param buf OUT the bytes read
+ * @param len number of bytes to read
+ * @return number of bytes read, less than LEN only at end of input
+ * @throw Miscue Read failed
+ */
+size_t NFIMM::readDescriptor( const int fd, uint8_t *buf, const size_t len )
+{
+  size_t done{0};
+  while( done < len )
+  {
+#ifdef _WIN32
+    const int n = ::_read( fd, buf + done,
+                           static_cast<unsigned int>( len - done ) );
+#else
+    const ssize_t n = ::read( fd, buf + done, len - done );
+#endif
+    if( n == 0 )
+      break;
+    if( n < 0 )
+    {
+      if( errno == EINTR ) continue;
+      throw Miscue( MiscueCode::Io,
+                    "CANNOT read source image from descriptor " +
+                    std::to_string( fd ) + ": " + std::strerror( errno ) );
+    }
+    done += static_cast<size_t>( n );
+  }
+  return done;
+}
+
+/**
+ * Reads 4 consecutive bytes from the source image; the current index
+ * into the source image is maintained by variable static `s_r_cursor`.
  * The `s_r_cursor` is incremented by the number of bytes that were copied,
  * namely 4.
  *
@@ -80,7 +642,7 @@ void NFIMM::next4bytes( uint8_t toBytes[] )
 {
   uint32_t val{0};
   for( uint32_t i=s_r_cursor,j=0; j<4; i++,j++ ) {
-    toBytes[j] = s_readBuffer[i];
+    toBytes[j] = s_readData[i];
     val <<= 8;
     val += toBytes[j];
   }
@@ -103,7 +665,7 @@ void NFIMM::next4bytes( uint8_t toBytes[] )
 void NFIMM::nextLengthBytes( const uint32_t len, uint8_t toBytes[] )
 {
   for( uint32_t i=s_r_cursor,j=0; j<len; i++,j++ ) {
-    toBytes[j] = s_readBuffer[i];
+    toBytes[j] = s_readData[i];
   }
   s_r_cursor += len;
 }
@@ -119,7 +681,9 @@ std::string printVersion()
 }
 
 /**
- * Clear the read-buffer (vector) and read the image-bytes into it.
+ * Clear the read-buffer (vector) and read the image-bytes into it.  The PATH
+ * is used for PNG Creation Time "file" unless the caller set another one for
+ * this image.
  *
  * @param path to source image
  * @throw Miscue If file cannot be opened or is zero size
@@ -129,36 +693,107 @@ void NFIMM::readImageFileIntoBuffer( const std::string &path )
   std::fstream strm;
   strm.open( path, std::ios::in|std::ios::binary );
   if( !strm )
-    throw Miscue( "CANNOT open file: '" + path + "'" );
+    throw Miscue( MiscueCode::Io, "CANNOT open file: '" + path + "'" );
 
   std::vector<uint8_t> contents(
     (std::istreambuf_iterator<char>(strm)), std::istreambuf_iterator<char>() );
-  s_readBuffer.clear();
-  s_readBuffer = contents;
   strm.close();
+  if( !_srcPathSet )
+    setSourcePath( path );
+  readImageFileIntoBuffer( std::move( contents ) );
+}
+
+/**
+ * Clear the read-buffer (vector) and copy the image-bytes into it.  Callers
+ * that no longer need the vector should move it in instead.
+ *
+ * @param vec IN : source image
+ */
+void NFIMM::readImageFileIntoBuffer( const std::vector<uint8_t> &vec )
+{
+  readImageFileIntoBuffer( std::vector<uint8_t>( vec ) );
 }
 
 /**
- * Clear the read-buffer (vector) and transfer the image-bytes into it.
+ * Take ownership of the image-bytes; the caller's vector is left empty.  The
+ * image has no source path unless the caller set one before this read.
  *
  * @param vec IN : source image
  */
-void NFIMM::readImageFileIntoBuffer( const std::vector<uint8_t> vec )
+void NFIMM::readImageFileIntoBuffer( std::vector<uint8_t> &&vec )
+{
+  s_readBuffer = std::move( vec );
+  s_readData = s_readBuffer.data();
+  s_readSize = s_readBuffer.size();
+  if( !_srcPathSet )
+    _srcPath.clear();
+  _srcPathSet = false;
+}
+
+/**
+ * Read the image-bytes where they are, no copy is made.  The caller's memory
+ * must remain valid and unchanged until modify() returns.  The image has no
+ * source path unless the caller set one before this read.
+ *
+ * @param data IN : first byte of source image
+ * @param size IN : number of bytes of source image
+ * @throw Miscue If data is nullptr
+ */
+void NFIMM::readImageFileIntoBuffer( const uint8_t *data, const size_t size )
 {
+  if( data == nullptr )
+    throw Miscue( MiscueCode::InvalidParameter,
+                  "Source image data is null" );
   s_readBuffer.clear();
-  s_readBuffer = vec;
+  s_readData = data;
+  s_readSize = size;
+  if( !_srcPathSet )
+    _srcPath.clear();
+  _srcPathSet = false;
 }
 
 /**
- * Transfers the image write-buffer bytes into the vector and then clears
- * the write-buffer.
+ * Moves the image write-buffer bytes into the vector; the write-buffer is left
+ * empty.
  *
  * @param vec OUT : destination image
  */
 void NFIMM::retrieveWriteImageBuffer( std::vector<uint8_t> &vec )
 {
-  vec = s_writeBuffer;
+  vec = releaseWriteImageBuffer();
+}
+
+/**
+ * Copies the image write-buffer bytes into the caller's memory and then
+ * clears the write-buffer.  Use writeImageSize() to size the memory.
+ *
+ * @param dest OUT : destination image
+ * @param capacity number of bytes available at dest
+ * @return number of bytes copied
+ * @throw Miscue If dest is nullptr or smaller than the destination image
+ */
+size_t NFIMM::retrieveWriteImageBuffer( uint8_t *dest, const size_t capacity )
+{
+  const size_t size = s_writeBuffer.size();
+  if( dest == nullptr || capacity < size )
+    throw Miscue( MiscueCode::InvalidParameter,
+                  "Destination buffer too small: " +
+                  std::to_string( capacity ) + " bytes, need " +
+                  std::to_string( size ) );
+
+  std::copy( s_writeBuffer.begin(), s_writeBuffer.end(), dest );
+  s_writeBuffer.clear();
+  return size;
+}
+
+/**
+ * @return the destination image; the write-buffer is left empty
+ */
+std::vector<uint8_t> NFIMM::releaseWriteImageBuffer()
+{
+  std::vector<uint8_t> vec = std::move( s_writeBuffer );
   s_writeBuffer.clear();
+  return vec;
 }
 
 /**
@@ -169,13 +804,9 @@ void NFIMM::retrieveWriteImageBuffer( std::vector<uint8_t> &vec )
  */
 void NFIMM::writeImageBufferToFile( const std::string &path )
 {
-  std::fstream strm;
-  strm.open( path, std::ios::out|std::ios::binary );
-  if( !strm )
-    throw Miscue( "CANNOT open output image file: '" + path + "'" );
-
-  for (const auto &e : s_writeBuffer) strm << e;
-  strm.close();
+  FileSink sink( path );
+  sink.write( s_writeBuffer.data(), s_writeBuffer.size() );
+  sink.finish();
 }
 
 /** BMP format uses little-endian. 1 byte -> [0-255] or [0x00-0xFF].
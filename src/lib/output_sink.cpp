@@ -0,0 +1,201 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#include "output_sink.h"
+
+#include <cerrno>
+#include <cstring>
+#ifdef _WIN32
+  #include <io.h>
+  #define popen _popen
+  #define pclose _pclose
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+namespace NFIMM {
+
+/**
+ * Loop until all bytes are written; a pipe or socket may accept fewer bytes
+ * than requested.
+ *
+ * @param data bytes to write
+ * @param len number of bytes
+ * @throw Miscue Write failed
+ */
+void FdSink::write( const uint8_t *data, const size_t len )
+{
+  size_t done{0};
+  while( done < len )
+  {
+#ifdef _WIN32
+    const int n = ::_write( _fd, data + done,
+                            static_cast<unsigned int>( len - done ) );
+#else
+    const ssize_t n = ::write( _fd, data + done, len - done );
+#endif
+    if( n < 0 )
+    {
+      if( errno == EINTR ) continue;
+      throw Miscue( MiscueCode::Io,
+                    "CANNOT write output image to descriptor " +
+                    std::to_string( _fd ) + ": " + std::strerror( errno ) );
+    }
+    done += static_cast<size_t>( n );
+  }
+}
+
+/**
+ * The unchanged image data after the headers is passed through without
+ * being parsed.  On Linux, splice(2) moves the bytes in the kernel when
+ * either descriptor is a pipe; otherwise they are copied through a fixed
+ * buffer.  Memory use does not depend on the number of bytes.
+ *
+ * @param fdIn read to its end, not closed
+ * @return number of bytes written
+ * @throw Miscue Read or write failed
+ */
+size_t FdSink::copyFrom( const int fdIn )
+{
+  size_t total{0};
+#ifdef __linux__
+  while( true )
+  {
+    const ssize_t n = ::splice( fdIn, nullptr, _fd, nullptr, 1u << 20,
+                                SPLICE_F_MOVE | SPLICE_F_MORE );
+    if( n == 0 )
+      return total;
+    if( n > 0 )
+    {
+      total += static_cast<size_t>( n );
+      continue;
+    }
+    if( errno == EINTR ) continue;
+    if( errno == EINVAL ) break;   // no pipe, copy below
+    throw Miscue( MiscueCode::Io,
+                  "CANNOT pass image data from descriptor " +
+                  std::to_string( fdIn ) + " to " + std::to_string( _fd ) +
+                  ": " + std::strerror( errno ) );
+  }
+#endif
+  std::vector<uint8_t> buf( 1u << 16 );
+  while( true )
+  {
+    const size_t n{ NFIMM::readDescriptor( fdIn, buf.data(), buf.size() ) };
+    write( buf.data(), n );
+    total += n;
+    if( n < buf.size() )
+      return total;
+  }
+}
+
+
+/**
+ * @param data bytes to write
+ * @param len number of bytes
+ * @throw Miscue If file cannot be opened, write failed
+ */
+void FileSink::write( const uint8_t *data, const size_t len )
+{
+  if( !_strm.is_open() )
+  {
+    _strm.open( _path, std::ios::out|std::ios::binary|std::ios::trunc );
+    if( !_strm )
+      throw Miscue( MiscueCode::Io,
+                    "CANNOT open output image file: '" + _path + "'" );
+  }
+  _strm.write( reinterpret_cast<const char *>(data),
+               static_cast<std::streamsize>(len) );
+  if( !_strm )
+    throw Miscue( MiscueCode::Io,
+                  "CANNOT write output image file: '" + _path + "'" );
+}
+
+/**
+ * @throw Miscue Flush failed
+ */
+void FileSink::finish()
+{
+  if( !_strm.is_open() ) return;
+  _strm.close();
+  if( !_strm )
+    throw Miscue( MiscueCode::Io,
+                  "CANNOT close output image file: '" + _path + "'" );
+}
+
+
+/**
+ * @param command run by the shell, reads the destination image on stdin
+ * @throw Miscue If command cannot be started
+ */
+PipeSink::PipeSink( const std::string &command ) : _command(command)
+{
+#ifdef _WIN32
+  _pipe = popen( command.c_str(), "wb" );
+#else
+  _pipe = popen( command.c_str(), "w" );
+#endif
+  if( !_pipe )
+    throw Miscue( MiscueCode::Io,
+                  "CANNOT start output command: '" + command + "'" );
+}
+
+/** The exit status is ignored here; call finish() to check it. */
+PipeSink::~PipeSink()
+{
+  if( _pipe ) pclose( _pipe );
+}
+
+/**
+ * @param data bytes to write
+ * @param len number of bytes
+ * @throw Miscue Write failed, the command may have exited
+ */
+void PipeSink::write( const uint8_t *data, const size_t len )
+{
+  if( !_pipe || std::fwrite( data, 1, len, _pipe ) != len )
+    throw Miscue( MiscueCode::Io,
+                  "CANNOT write output image to command: '" +
+                  _command + "'" );
+}
+
+/**
+ * @throw Miscue Command failed
+ */
+void PipeSink::finish()
+{
+  if( !_pipe ) return;
+  const int status = pclose( _pipe );
+  _pipe = nullptr;
+  if( status != 0 )
+    throw Miscue( MiscueCode::Io,
+                  "Output command failed, status " +
+                  std::to_string( status ) + ": '" + _command + "'" );
+}
+
+}   // END namespace
@@ -0,0 +1,289 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "png/png.h"
+
+#include <sstream>
+
+namespace NFIMM {
+
+/**
+ * Tokenize each caller-specified `keyword:text` string, verify the keyword,
+ * and encode the whole chunk including its CRC.  Invalid keywords are ignored;
+ * they are logged with every image.
+ *
+ * @param cfg modification parameters the chunks are built from
+ * @throw Miscue Invalid file creation-time parameter, or UTCtime error
+ */
+ChunkTemplate::ChunkTemplate( const ModificationConfig &cfg )
+{
+  // pHYs: resolution is always saved using 'meter' units.
+  {
+    const Phys::WholeChunk chunk{ Phys::buildChunk(
+      cfg.destResolution.horiz, cfg.destResolution.unitsStr ) };
+    _physChunk.assign( chunk.begin(), chunk.end() );
+  }
+
+  // Caller-specified tEXt: the format of the chunk's string is 'keyword:text'
+  // and only the first two tokens are used.
+  for( auto &txt : cfg.textChunk ) {
+    std::istringstream tokenStream(txt);
+    std::string keyword{}, text{};
+    std::getline( tokenStream, keyword, ':' );
+    std::getline( tokenStream, text, ':' );
+
+    bool foundValidKeyword{false};
+    for( auto &keywd : Text::_textKeywords ) {
+      if( keyword == keywd ) {
+        foundValidKeyword = true;
+        break;
+      }
+    }
+    if( !foundValidKeyword ) {
+      _ignoredKeywords.push_back( keyword );
+      continue;
+    }
+
+    TextEntry entry;
+    if( keyword == "Creation Time" ) {
+      Text::UTCtime utct{};
+      if( text == "now" ) {
+        Text::getUTCtime( &utct );
+      }
+      else if( text == "file" ) {
+        entry.isFileTime = true;
+      }
+      else {
+        throw Miscue( "Invalid file creation-time parameter: " + text );
+      }
+      entry.wholeChunk = encodeTime( keyword, utct );
+      // Type, keyword, and null-separator precede the patched time bytes.
+      entry.prefixCRC = CRCforPNG::updateCRC( 0xffffffffL,
+                          &entry.wholeChunk[PNG::NUM_BYTES_CHUNK_LENGTH],
+                          PNG::NUM_BYTES_CHUNK_TYPE +
+                            static_cast<int>(keyword.size()) + 1 );
+    }
+    else {
+      entry.wholeChunk = encodeText( keyword, text );
+    }
+    _textEntries.push_back( entry );
+  }
+
+  // Comment: source resolution is patched per image when pHYs exists.
+  const std::string destRate{
+    std::to_string( cfg.destResolution.horiz ) +
+    cfg.get_imgSampleRateUnits("dest") };
+  _commentInserted = encodeText( "Comment",
+                                 "NFIMM inserted pHYs resolution as " + destRate );
+  _commentUpdatedPrefix = "NFIMM updated pHYs resolution from ";
+  _commentUpdatedSuffix = "PPMM to " + destRate;
+  {
+    std::string s{"tEXtComment"};
+    s.push_back( '\0' );
+    s.append( _commentUpdatedPrefix );
+    _commentUpdatedPrefixCRC = CRCforPNG::updateCRC( 0xffffffffL,
+      reinterpret_cast<const uint8_t *>(s.data()), static_cast<int>(s.size()) );
+  }
+
+  _softwareChunk = encodeText( "Software", "header mod by " + printVersion() );
+}
+
+/**
+ * @return true if the destination image depends on the source file's
+ *   modification time, not only on the source bytes
+ */
+bool ChunkTemplate::usesFileTime() const
+{
+  for( auto &entry : _textEntries ) {
+    if( entry.isFileTime ) return true;
+  }
+  return false;
+}
+
+/**
+ * The Creation Time "file" chunk is patched with the source image
+ * timestamp, the Comment chunk with the source image `pHYs` resolution.
+ * All other chunks are copied as-is.
+ *
+ * @param result source image `pHYs` resolution, and runtime log
+ * @param srcPath source image PATH for Creation Time "file"
+ * @param chunks OUT : new chunks in order of insertion
+ * @throw Miscue Get FILE gmtime error
+ */
+void ChunkTemplate::buildTextChunks(
+                ModificationResult &result, const std::string &srcPath,
+                std::vector<std::shared_ptr<PNG::ChunkLayout>> &chunks ) const
+{
+  for( auto &keyword : _ignoredKeywords ) {
+    if( result.logging )
+      result.loggit( "Ignore tEXt invalid keyword: '" + keyword + "'" );
+  }
+
+  for( auto &entry : _textEntries ) {
+    if( !entry.isFileTime ) {
+      chunks.push_back( toChunkLayout( entry.wholeChunk ) );
+      continue;
+    }
+    if( result.logging )
+      result.loggit( "Src file for timestamp: " + srcPath );
+    Text::UTCtime utct{};
+    Text::getFiletime( srcPath, &utct );
+
+    std::vector<uint8_t> whole{ entry.wholeChunk };
+    size_t i{ whole.size() - PNG::NUM_BYTES_CHUNK_CRC - 7 };
+    const size_t timeStart{i};
+    whole[i++] = utct.yearBytes[0];
+    whole[i++] = utct.yearBytes[1];
+    whole[i++] = utct.mon;
+    whole[i++] = utct.day;
+    whole[i++] = utct.hr;
+    whole[i++] = utct.min;
+    whole[i++] = utct.sec;
+    const uint32_t crc = CRCforPNG::updateCRC( entry.prefixCRC,
+                           &whole[timeStart], 7 ) ^ 0xffffffffL;
+    NFIMM::expressUINT32AsFourBytes( crc, &whole[i], true );
+    chunks.push_back( toChunkLayout( whole ) );
+  }
+
+  if( PNG::s_pHYsChunkExists ) {
+    const std::string perImage{
+      std::to_string( result.srcImg.existingPhysResolution ) +
+      _commentUpdatedSuffix };
+    std::vector<uint8_t> whole{
+      encodeBytes( "Comment", _commentUpdatedPrefix + perImage ) };
+    const uint32_t crc = CRCforPNG::updateCRC( _commentUpdatedPrefixCRC,
+                           reinterpret_cast<const uint8_t *>(perImage.data()),
+                           static_cast<int>(perImage.size()) ) ^ 0xffffffffL;
+    NFIMM::expressUINT32AsFourBytes( crc,
+      &whole[whole.size() - PNG::NUM_BYTES_CHUNK_CRC], true );
+    chunks.push_back( toChunkLayout( whole ) );
+  }
+  else {
+    chunks.push_back( toChunkLayout( _commentInserted ) );
+  }
+
+  chunks.push_back( toChunkLayout( _softwareChunk ) );
+}
+
+/**
+ * @param whole chunk bytes from LEN to CRC inclusive
+ * @return chunk object ready for transfer to the write-buffer
+ * @throw Miscue Cannot allocate chunk's dataBuffer
+ */
+std::shared_ptr<PNG::ChunkLayout>
+ChunkTemplate::toChunkLayout( const std::vector<uint8_t> &whole )
+{
+  std::shared_ptr<PNG::ChunkLayout> chnk( new PNG::ChunkLayout );
+  size_t i{0};
+  for( int j=0; j<PNG::NUM_BYTES_CHUNK_LENGTH; j++ )
+    chnk->lengthBytes[j] = whole[i++];
+  for( int j=0; j<PNG::NUM_BYTES_CHUNK_TYPE; j++ )
+    chnk->typeBytes[j] = whole[i++];
+
+  const uint32_t len{ chnk->length() };
+  chnk->dataBuffer = new (std::nothrow) uint8_t[len];
+  if( !chnk->dataBuffer )
+    throw Miscue( "cannot allocate chunk data buffer: '" + chnk->type() + "'" );
+  for( uint32_t j=0; j<len; j++ )
+    chnk->dataBuffer[j] = whole[i++];
+  for( int j=0; j<PNG::NUM_BYTES_CHUNK_CRC; j++ )
+    chnk->crcBytes[j] = whole[i++];
+
+  chnk->concatenate4parts();
+  return chnk;
+}
+
+/**
+ * @param keyword valid `tEXt` keyword
+ * @param text of the keyword
+ * @return whole chunk with CRC
+ */
+std::vector<uint8_t>
+ChunkTemplate::encodeText( const std::string &keyword, const std::string &text )
+{
+  std::vector<uint8_t> whole{ encodeBytes( keyword, text ) };
+  setCRC( whole );
+  return whole;
+}
+
+/**
+ * @param keyword valid `tEXt` keyword
+ * @param text of the keyword
+ * @return whole chunk where the CRC bytes are zero
+ */
+std::vector<uint8_t>
+ChunkTemplate::encodeBytes( const std::string &keyword, const std::string &text )
+{
+  const size_t dataBufSize{ keyword.size() + text.size() + 1 };
+  std::vector<uint8_t> whole( 4 );
+  whole.reserve( dataBufSize + 12 );
+  NFIMM::expressUINT32AsFourBytes( dataBufSize, &whole[0], true );
+  whole.insert( whole.end(), { 't', 'E', 'X', 't' } );
+  whole.insert( whole.end(), keyword.begin(), keyword.end() );
+  whole.push_back( 0x00 );   // null separator
+  whole.insert( whole.end(), text.begin(), text.end() );
+  whole.resize( whole.size() + PNG::NUM_BYTES_CHUNK_CRC );
+  return whole;
+}
+
+/**
+ * @param keyword `Creation Time`
+ * @param utct date/time: 2-byte year, month, day, hour, minute, second
+ * @return whole chunk with CRC
+ */
+std::vector<uint8_t>
+ChunkTemplate::encodeTime( const std::string &keyword,
+                           const Text::UTCtime &utct )
+{
+  std::string text{};
+  text.push_back( static_cast<char>(utct.yearBytes[0]) );
+  text.push_back( static_cast<char>(utct.yearBytes[1]) );
+  text.push_back( static_cast<char>(utct.mon) );
+  text.push_back( static_cast<char>(utct.day) );
+  text.push_back( static_cast<char>(utct.hr) );
+  text.push_back( static_cast<char>(utct.min) );
+  text.push_back( static_cast<char>(utct.sec) );
+  return encodeText( keyword, text );
+}
+
+/**
+ * The CRC is calculated on the type and data bytes; it excludes the LEN.
+ *
+ * @param whole chunk bytes, the last four are updated with the CRC
+ */
+void ChunkTemplate::setCRC( std::vector<uint8_t> &whole )
+{
+  const int len{ static_cast<int>(whole.size()) -
+                 PNG::NUM_BYTES_CHUNK_LENGTH - PNG::NUM_BYTES_CHUNK_CRC };
+  const uint32_t crc = CRCforPNG::calc(
+                         &whole[PNG::NUM_BYTES_CHUNK_LENGTH], len );
+  NFIMM::expressUINT32AsFourBytes( crc,
+    &whole[whole.size() - PNG::NUM_BYTES_CHUNK_CRC], true );
+}
+
+}   // END namespace
@@ -32,32 +32,9 @@ identified are necessarily the best available for the purpose.
 
 namespace CRCforPNG {
 
-/** @brief Table of Cyclic Redundancy Checksums for all 8-bit bytes */
-uint32_t crc_table[256];
-
-/** Calc table only once. */
-void buildCRCtable()
-{
-  static bool crc_table_generated{false};
-  if( crc_table_generated == true ) return;
-
-  uint32_t c;
-
-  for( int n=0; n<256; n++ )
-  {
-    c = (uint32_t)n;
-    for( int k=0; k<8; k++ ) {
-      if( c & 1 ) {
-        c = 0xedb88320L ^ ( c >> 1 );
-      } 
-      else {
-        c = c >> 1;
-      }
-    }
-    crc_table[n] = c;
-  }
-  crc_table_generated = true;
-}
+/** Table is generated at compile time, see makeCRCtable(); retained for
+ * callers that build the table before the first calculation. */
+void buildCRCtable() {}
 
 
 /**
@@ -68,7 +45,7 @@ void buildCRCtable()
  * @param len length of current array (buf)
  * @return 1's complement CRC
  */
-uint32_t calc( uint8_t *buf, int len )
+uint32_t calc( const uint8_t *buf, int len )
 {
   return updateCRC( 0xffffffffL, buf, len ) ^ 0xffffffffL;
 }
@@ -79,15 +56,13 @@ uint32_t calc( uint8_t *buf, int len )
  */
 std::string to_s_CRCtable()
 {
-  buildCRCtable();
-
   std::stringstream ss{};
   ss << "CRC_TABLE\n  N  dec(CRC(N))          hex(CRC(N))\n";
 
   for( int n=0; n<256; n++ ) {
     ss << std::dec << std::setw(3)  << n << "  ";
-    ss << std::dec << std::setw(12) << crc_table[n] << "  ";
-    ss << std::hex << std::setw(8)  << "0x" << crc_table[n] << "\n";
+    ss << std::dec << std::setw(12) << s_crcTable[n] << "  ";
+    ss << std::hex << std::setw(8)  << "0x" << s_crcTable[n] << "\n";
   }
   return ss.str();
 }
@@ -102,14 +77,12 @@ std::string to_s_CRCtable()
  * @param len length of current array (buf)
  * @return the updated CRC
  */
-uint32_t updateCRC( const uint32_t crc, uint8_t *buf, int len )
+uint32_t updateCRC( const uint32_t crc, const uint8_t *buf, int len )
 {
   uint32_t c = crc;
 
-  buildCRCtable();
-
   for( int n=0; n<len; n++ ) {
-    c = crc_table[ ( c ^ buf[n] ) & 0xff ] ^ ( c >> 8 );
+    c = s_crcTable[ ( c ^ buf[n] ) & 0xff ] ^ ( c >> 8 );
   }
   return c;
 }
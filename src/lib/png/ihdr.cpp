@@ -38,18 +38,20 @@ namespace NFIMM {
  * passed as-is to the destination header. Parsed values are output to log
  * for verification/inspection.
  *
- * @param mps needed to update the runtime log
+ * @param result needed to update the runtime log and source image metadata
  * @param chnk the IHDR chunk to parse
  */
-IhdrX::IhdrX( std::shared_ptr<MetadataParameters> &mps, std::shared_ptr<PNG::ChunkLayout> &chnk )
+IhdrX::IhdrX( ModificationResult &result, std::shared_ptr<PNG::ChunkLayout> &chnk )
 {
-  // mps->loggit( "INSIDE IhdrX::parseChunk(), chunk pointer index: " +
+  // result.loggit( "INSIDE IhdrX::parseChunk(), chunk pointer index: " +
   //     std::to_string(_idx));
-  mps->loggit( "IHDR: wholeChunkStr(): 0x" + chnk->wholeChunkStr() );
-  mps->loggit( "IHDR length: " + std::to_string( chnk->length() ) );
-  mps->loggit( "IHDR type: '"  + chnk->type() + "'" );
-  mps->loggit( "IHDR data: 0x" + chnk->data() );
-  mps->loggit( "IHDR CRC:  0x" + chnk->crc() );
+  if( result.logging ) {
+    result.loggit( "IHDR: wholeChunkStr(): 0x" + chnk->wholeChunkStr() );
+    result.loggit( "IHDR length: " + std::to_string( chnk->length() ) );
+    result.loggit( "IHDR type: '"  + chnk->type() + "'" );
+    result.loggit( "IHDR data: 0x" + chnk->data() );
+    result.loggit( "IHDR CRC:  0x" + chnk->crc() );
+  }
 
   for( int i=0; i<NUM_BYTES_CHUNK_IHDR_TOTAL; i++ ) {
     PNG::s_oneByte = chnk->wholeChunkBuffer[i];
@@ -68,8 +70,9 @@ IhdrX::IhdrX( std::shared_ptr<MetadataParameters> &mps, std::shared_ptr<PNG::Chu
     tmp32Val += PNG::s_oneByte;
   }
   _imageHDR.length = tmp32Val; tmp32Val = 0;
-  mps->loggit( "IHDR len of data, should == 13: " +
-                       std::to_string( _imageHDR.length ) );
+  if( result.logging )
+    result.loggit( "IHDR len of data, should == 13: " +
+                         std::to_string( _imageHDR.length ) );
 
   // Chunk type-name:
   for( int i=0; i<PNG::NUM_BYTES_CHUNK_TYPE; i++ ) {
@@ -80,7 +83,7 @@ IhdrX::IhdrX( std::shared_ptr<MetadataParameters> &mps, std::shared_ptr<PNG::Chu
   if( _imageHDR.tostring_type() != "IHDR" ) {
     std::string msg{"ERROR: invalid IHDR name: "};
     msg.append( _imageHDR.tostring_type() );
-    throw Miscue( msg );
+    throw Miscue( MiscueCode::InvalidHeader, msg );
   }
 
   // START Chunk data.
@@ -100,8 +103,9 @@ IhdrX::IhdrX( std::shared_ptr<MetadataParameters> &mps, std::shared_ptr<PNG::Chu
       tmp32Val += PNG::s_oneByte;
     }
     _imageHDR.imageInfo.dimension.width = tmp32Val;
-    mps->loggit( "IHDR image width: " +
-                      std::to_string( _imageHDR.imageInfo.dimension.width ) );
+    if( result.logging )
+      result.loggit( "IHDR image width: " +
+                        std::to_string( _imageHDR.imageInfo.dimension.width ) );
     tmp32Val = 0;
     // Height:
     for( int i=0; i<NUM_BYTES_IHDR_HEIGHT; i++ ) {
@@ -111,8 +115,9 @@ IhdrX::IhdrX( std::shared_ptr<MetadataParameters> &mps, std::shared_ptr<PNG::Chu
       tmp32Val += PNG::s_oneByte;
     }
     _imageHDR.imageInfo.dimension.height = tmp32Val;
-    mps->loggit( "IHDR image height: " +
-                      std::to_string( _imageHDR.imageInfo.dimension.height ) );
+    if( result.logging )
+      result.loggit( "IHDR image height: " +
+                        std::to_string( _imageHDR.imageInfo.dimension.height ) );
     // Rest of the (5) bytes:
     _imageHDR.imageInfo.bitDepth          = _imageHDR.data[8];
     _imageHDR.imageInfo.colorType         = _imageHDR.data[9];
@@ -120,6 +125,10 @@ IhdrX::IhdrX( std::shared_ptr<MetadataParameters> &mps, std::shared_ptr<PNG::Chu
     _imageHDR.imageInfo.filterMethod      = _imageHDR.data[11];
     _imageHDR.imageInfo.interlaceMethod   = _imageHDR.data[12];
 
+    result.srcImg.width    = _imageHDR.imageInfo.dimension.width;
+    result.srcImg.height   = _imageHDR.imageInfo.dimension.height;
+    result.srcImg.bitDepth = _imageHDR.imageInfo.bitDepth;
+
   }
   // END Chunk data.
 
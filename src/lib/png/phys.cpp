@@ -33,117 +33,118 @@ identified are necessarily the best available for the purpose.
 
 namespace NFIMM {
 
+namespace {
+
+/** Pixels per meter; must match NFIMM::convertPPItoPPMM(). */
+constexpr uint32_t ppiToPPMM( const uint32_t ppi )
+{
+  return static_cast<uint32_t>(ppi / 0.0254);
+}
+
+/** Whole `pHYs` chunk, units are always meter. */
+constexpr Phys::WholeChunk makeChunk( const uint32_t ppmm )
+{
+  Phys::WholeChunk c{ 0x00, 0x00, 0x00, 0x09, 'p', 'H', 'Y', 's' };
+  for( int i=0; i<4; i++ ) {
+    const uint8_t oneByte = static_cast<uint8_t>( ppmm >> (8*(3-i)) );
+    c[8+i]  = oneByte;   // horizontal
+    c[12+i] = oneByte;   // vertical
+  }
+  c[16] = 0x01;
+  const uint32_t crc{ CRCforPNG::calcConstexpr( c, 4, 4+9 ) };
+  for( int i=0; i<4; i++ ) {
+    c[17+i] = static_cast<uint8_t>( crc >> (8*(3-i)) );
+  }
+  return c;
+}
+
+/** Standard fingerprint sample rate as specified by the caller. */
+struct StandardChunk {
+  uint32_t sampleRate;     ///< Caller-specified value
+  bool inch;               ///< Caller-specified units
+  Phys::WholeChunk chunk;  ///< Ready for write
+};
+
+constexpr StandardChunk s_standardChunks[]{
+  {  500, true,  makeChunk( ppiToPPMM(  500 ) ) },
+  { 1000, true,  makeChunk( ppiToPPMM( 1000 ) ) },
+  { 2000, true,  makeChunk( ppiToPPMM( 2000 ) ) },
+  { ppiToPPMM(  500 ), false, makeChunk( ppiToPPMM(  500 ) ) },
+  { ppiToPPMM( 1000 ), false, makeChunk( ppiToPPMM( 1000 ) ) },
+  { ppiToPPMM( 2000 ), false, makeChunk( ppiToPPMM( 2000 ) ) }
+};
+
+// 1000PPI in meters, see Phys::updateChunk().
+static_assert( s_standardChunks[1].chunk[17] == 0xE3 &&
+               s_standardChunks[1].chunk[18] == 0x91 &&
+               s_standardChunks[1].chunk[19] == 0xA4 &&
+               s_standardChunks[1].chunk[20] == 0x22,
+               "pHYs CRC for 1000PPI must be E391A422" );
+
+}   // END anonymous namespace
+
+/**
+ * Standard fingerprint sample rates are copied from the chunks that were
+ * generated at compile time; no unit conversion or CRC is calculated.
+ *
+ * @param sampleRate destination sample rate specified by the caller
+ * @param units [ "inch" | "meter" | "other" ]
+ * @return whole chunk where resolution is always in 'meter' units
+ */
+Phys::WholeChunk Phys::buildChunk( const uint32_t sampleRate,
+                                   const std::string &units )
+{
+  const bool inch{ units == "inch" };
+  for( auto &entry : s_standardChunks ) {
+    if( entry.sampleRate == sampleRate && entry.inch == inch )
+      return entry.chunk;
+  }
+
+  uint32_t sampratemm{sampleRate};
+  if( inch )
+    NFIMM::convertPPItoPPMM( sampleRate, sampratemm );
+  return makeChunk( sampratemm );
+}
+
 /**
- * @param mps needed to update the runtime log
+ * @param cfg destination sample rate and units
+ * @param result needed to update the runtime log and source image metadata
  * @param chnk the pHYs chunk to parse
  */
-Phys::Phys( std::shared_ptr<MetadataParameters> &mps,
+Phys::Phys( const ModificationConfig &cfg, ModificationResult &result,
             std::shared_ptr<PNG::ChunkLayout> &chnk )
-     : _params(mps), _chnk(chnk) {}
+     : _config(cfg), _result(result), _chnk(chnk) {}
 
 /**
  * The chunk object is newly created and the reference to the object is saved
  * to the container of insertion pointers.  This reference occurs before
  * all inserted `tEXt` chunk pointers.
  *
- * @throw Miscue Cannot allocate chunk shared pointer, or chunk's dataBuffer
+ * The whole chunk, including its CRC, is copied from the chunk template that
+ * was compiled for the current metadata parameters.
+ *
+ * @throw Miscue Cannot allocate chunk's dataBuffer
  */
 void Phys::insertChunk()
 {
-  std::shared_ptr<PNG::ChunkLayout> pchunk;
-  try
-  {
-    pchunk.reset( new PNG::ChunkLayout );
-  }
-  catch( const std::bad_weak_ptr bwPtr )
-  {
-      throw Miscue( "pHYs chunk-layout bad_weak_ptr" );
-  }
+  std::shared_ptr<const ChunkTemplate> tmpl{ _config.chunkTemplate() };
+  std::shared_ptr<PNG::ChunkLayout> pchunk{
+    ChunkTemplate::toChunkLayout( tmpl->_physChunk ) };
 
   // Chunk is valid, append the object to container that is iterated
   // upon write to output buffer and update index.
   PNG::s_insertChunkPointers.push_back( pchunk );
   PNG::_insertChunkIndex++;
 
-  // Load the type chars.
-  pchunk->typeBytes[0] = 'p';
-  pchunk->typeBytes[1] = 'H';
-  pchunk->typeBytes[2] = 'Y';
-  pchunk->typeBytes[3] = 's';
-
-  _params->loggit( "PNG::Phys insertChunk: " + pchunk->type() );
-  _params->loggit( "PNG::Phys _insertChunkIndex: " +
-                    std::to_string( PNG::_insertChunkIndex) );
-
-  // Update the chunk's data length.
-  NFIMM::expressUINT32AsFourBytes( NUM_BYTES_PHYS_DATA, pchunk->lengthBytes,
-                                   true );
-
-  // Build the chunk data part.
-  // Retrieve the destination sample-rate/resolution from user-specified
-  // metadata parameters object.
-  const uint32_t destSampleRate{_params->destImg.resolution.horiz};
-  uint32_t sampratemm{destSampleRate};
-
-  // Retrieve the sample-rate/resolution units from user-specified
-  // metadata parameters object.
-  std::string units = _params->destImg.resolution.unitsStr;
-  if( units == "inch" ) {
-    _params->loggit( "Resolution update units: 'inch'" );
-    NFIMM::convertPPItoPPMM( destSampleRate, sampratemm );
-    _params->loggit( "Convert resolution: " + std::to_string( destSampleRate ) +
-                     "PPI = " + std::to_string(sampratemm) + "PPMM" );
-  }
-  pchunk->dataBuffer = new uint8_t[NUM_BYTES_PHYS_DATA];
-  if( !pchunk->dataBuffer )
-  {
-    throw Miscue( "cannot allocate text chunk data buffer: 'pHYs'" );
-  }
-
-  // Push the resolution and units to the data-part.
-  uint8_t resolutionBytes[4];
-  NFIMM::expressUINT32AsFourBytes( sampratemm, resolutionBytes, true );
-  for( int i=0; i<9; i++ ) {
-    // horizontal:
-    for( int j=0; j<4; j++ ) {
-      pchunk->dataBuffer[i] = resolutionBytes[j];  i++;
-    }
-    // vertical:
-    for( int j=0; j<4; j++ ) {
-      pchunk->dataBuffer[i] = resolutionBytes[j];  i++;
-    }
-    // units: ALWAYS updated to units = meter
-    pchunk->dataBuffer[i] = BYTE_PHYS_UNITS;
-  }
-
-  // Concat the type- and data-parts of the chunk to calculate the CRC.
-  uint8_t cat[PNG::NUM_BYTES_CHUNK_TYPE+NUM_BYTES_PHYS_DATA];
-  int ix{0};
-  for( ix=0; ix<PNG::NUM_BYTES_CHUNK_TYPE; ix++ ) {
-    cat[ix] = pchunk->typeBytes[ix];
+  if( _result.logging ) {
+    _result.loggit( "PNG::Phys insertChunk: " + pchunk->type() );
+    _result.loggit( "PNG::Phys _insertChunkIndex: " +
+                      std::to_string( PNG::_insertChunkIndex) );
+    _result.loggit( "pHYs whole chunk: " + pchunk->wholeChunkStr() );
+    _result.loggit( "pHYs CRC calculated = 0x" + pchunk->crc() );
   }
-  for( ix=PNG::NUM_BYTES_CHUNK_TYPE;
-       ix<PNG::NUM_BYTES_CHUNK_TYPE+NUM_BYTES_PHYS_DATA;
-       ix++ ) {
-    cat[ix] = pchunk->dataBuffer[ix-PNG::NUM_BYTES_CHUNK_TYPE];
-  }
-
-  uint32_t crc_calculated{0};
-  crc_calculated = CRCforPNG::calc( cat,
-    PNG::NUM_BYTES_CHUNK_TYPE+NUM_BYTES_PHYS_DATA );
-
-  // Update the CRC-bytes.
-  NFIMM::expressUINT32AsFourBytes( crc_calculated,
-                                   pchunk->crcBytes,
-                                   true );
-
-  // Concatenate the 4-parts into a single buffer
-  pchunk->concatenate4parts();
-
-  _params->loggit( "pHYs whole chunk: " + pchunk->wholeChunkStr() );
-  _params->loggit( "pHYs CRC calculated = 0x" + pchunk->crc() );
   // Increment the count
-  _params->pngWriteImageInfo.countInsertChunks++;
+  _result.pngWriteImageInfo.countInsertChunks++;
 
 }   // END insertChunk()
 
@@ -163,14 +164,16 @@ void Phys::insertChunk()
  */
 void Phys::parseChunk()
 {
-  _params->loggit( "INSIDE Phys::parseChunk()" );
-  _params->loggit( "PHYS: wholeChunkStr(): 0x" +
-                       _chnk->wholeChunkStr() );
-  _params->loggit( "Phys length: " +
-                    std::to_string( _chnk->length() ) );
-  _params->loggit( "Phys type: '" + _chnk->type() + "'" );
-  _params->loggit( "Phys data: 0x" + _chnk->data() );
-  _params->loggit( "Phys CRC:  0x" + _chnk->crc() );
+  if( _result.logging ) {
+    _result.loggit( "INSIDE Phys::parseChunk()" );
+    _result.loggit( "PHYS: wholeChunkStr(): 0x" +
+                         _chnk->wholeChunkStr() );
+    _result.loggit( "Phys length: " +
+                      std::to_string( _chnk->length() ) );
+    _result.loggit( "Phys type: '" + _chnk->type() + "'" );
+    _result.loggit( "Phys data: 0x" + _chnk->data() );
+    _result.loggit( "Phys CRC:  0x" + _chnk->crc() );
+  }
 
   for( uint32_t i=0; i<_chnk->length()+12; i++ ) {
     PNG::s_oneByte = _chnk->wholeChunkBuffer[i];
@@ -190,8 +193,9 @@ void Phys::parseChunk()
   }
   _imagepHYs.length = tmp32Val;
   tmp32Val = 0;
-  _params->loggit( "pHYs len of data, should == 9: " +
-                    std::to_string( _imagepHYs.length ) );
+  if( _result.logging )
+    _result.loggit( "pHYs len of data, should == 9: " +
+                      std::to_string( _imagepHYs.length ) );
 
   // Chunk type-name:
   for( int i=0; i<PNG::NUM_BYTES_CHUNK_TYPE; i++ ) {
@@ -202,7 +206,7 @@ void Phys::parseChunk()
   if( _imagepHYs.tostring_type() != "pHYs" ) {
     std::string msg{"ERROR: invalid pHYs name: "};
     msg.append( _imagepHYs.tostring_type() );
-    throw Miscue( msg );
+    throw Miscue( MiscueCode::InvalidChunk, msg );
   }
 
   // START Chunk data.
@@ -216,7 +220,8 @@ void Phys::parseChunk()
     }
     _imagepHYs.imageResolution.horizontal = tmp32Val;
     tmp32Val = 0;
-    _params->loggit( "pHYs " + _imagepHYs.imageResolution.horizBytesHex() );
+    if( _result.logging )
+      _result.loggit( "pHYs " + _imagepHYs.imageResolution.horizBytesHex() );
 
     // Vertical resolution:
     for( int i=0; i<NUM_BYTES_PHYS_RESOLUTION; i++ ) {
@@ -226,14 +231,21 @@ void Phys::parseChunk()
       tmp32Val += PNG::s_oneByte;
     }
     _imagepHYs.imageResolution.vertical = tmp32Val;
-    _params->loggit( "pHYs " + _imagepHYs.imageResolution.vertBytesHex() );
-    _params->srcImg.existingPhysResolution = tmp32Val;
+    if( _result.logging )
+      _result.loggit( "pHYs " + _imagepHYs.imageResolution.vertBytesHex() );
+    _result.srcImg.existingPhysResolution = tmp32Val;
 
     // Units:
     _imagepHYs.imageResolution.units =
       _chnk
         ->dataBuffer[NUM_BYTES_PHYS_RESOLUTION+NUM_BYTES_PHYS_RESOLUTION];
-    _params->loggit( "pHYs sample-rate info:\n" + _imagepHYs.imageResolution.to_s() );
+    if( _result.logging )
+      _result.loggit( "pHYs sample-rate info:\n" + _imagepHYs.imageResolution.to_s() );
+
+    _result.srcImg.resolutionExists = true;
+    _result.srcImg.resolution.horiz = _imagepHYs.imageResolution.horizontal;
+    _result.srcImg.resolution.vert  = _imagepHYs.imageResolution.vertical;
+    _result.srcImg.resolution.units = _imagepHYs.imageResolution.units;
   }
   // END Chunk data.
 
@@ -246,14 +258,14 @@ void Phys::parseChunk()
 
 /**
  * Update the chunk data's horizontal and vertical bytes and the units-byte per
- * the Metadata Parameters object that is passed from the user of NFIMM.  This
+ * the modification config that is passed from the user of NFIMM.  This
  * "new" chunk is the one written to the destination image (hence replacing the
  * source image chunk).
  * 
  * The `pHYs` chunk is ALWAYS set to use 'meter' as units.  Therefore, if the
  * destination sample rate is specified as PPI, then it is converted to meters.
  * 
- * The CRC is calculated.
+ * The whole chunk and its CRC are copied from the chunk template.
  * 
  * The write buffer is built by "transferring bytes" from each of the 4 parts
  * of a chunk (and not the chunk "as a whole").  (This is the implementation
@@ -278,74 +290,50 @@ void Phys::parseChunk()
  */
 void Phys::updateChunk()
 {
-  _params->loggit( "INSIDE PNG::Phys updateChunk()" );
-
-  // Retrieve the destination sample-rate/resolution from user-specified
-  // metadata parameters object.
-  const uint32_t destSampleRate{_params->destImg.resolution.horiz};
-  uint32_t sampratemm{destSampleRate};
+  _result.loggit( "INSIDE PNG::Phys updateChunk()" );
 
   // Retrieve the sample-rate/resolution units from user-specified
   // metadata parameters object.
-  std::string units = _params->destImg.resolution.unitsStr;
-  if( units == "inch" ) {
-    _params->loggit( "Resolution update units: 'inch'" );
-    NFIMM::convertPPItoPPMM( destSampleRate, sampratemm );
-    _params->loggit( "Convert destination resolution: " + std::to_string( destSampleRate ) +
-                     "PPI = " + std::to_string(sampratemm) + "PPMM" );
-  }
+  std::string units = _config.destResolution.unitsStr;
+  if( units == "inch" )
+    _result.loggit( "Resolution update units: 'inch'" );
   else if( units == "meter" )
-    _params->loggit( "Resolution update units: 'meter'" );
+    _result.loggit( "Resolution update units: 'meter'" );
   else if( units == "other" )
-    _params->loggit( "Resolution update units: 'other'" );
+    _result.loggit( "Resolution update units: 'other'" );
   else {
     std::string msg{"ERROR: invalid pHYs resolution units: "};
     msg.append( units );
-    throw Miscue( msg );
+    throw Miscue( MiscueCode::InvalidParameter, msg );
   }
 
-  // Update the data[] buffer with resolution and units.
-  uint8_t resolutionBytes[4];
-  NFIMM::expressUINT32AsFourBytes( sampratemm, resolutionBytes, true );
-  NFIMM::expressUINT32AsFourBytes( sampratemm, _chnk->crcBytes, true );
-
-  for( int i=0; i<8; i++ ) {
-    // horizontal:
-    for( int j=0; j<4; j++ ) {
-      _chnk->dataBuffer[i] = resolutionBytes[j];  i++;
-    }
-    // vertical:
-    for( int j=0; j<4; j++ ) {
-      _chnk->dataBuffer[i] = resolutionBytes[j];  i++;
-    }
-    // units: ALWAYS updated to units = meter
-    _chnk->dataBuffer[i] = BYTE_PHYS_UNITS;
+  if( _chnk->length() != NUM_BYTES_PHYS_DATA ) {
+    std::string msg{"ERROR: invalid pHYs data length: "};
+    msg.append( std::to_string( _chnk->length() ) );
+    throw Miscue( MiscueCode::InvalidChunk, msg );
   }
 
-  // Concat the type- and data-parts of the chunk to calculate the CRC.
-  uint8_t cat[PNG::NUM_BYTES_CHUNK_TYPE+NUM_BYTES_PHYS_DATA];
-  int ix{0};
-  for( ix=0; ix<PNG::NUM_BYTES_CHUNK_TYPE; ix++ ) {
-    cat[ix] = _chnk->typeBytes[ix];
+  // Overwrite the data[] buffer, CRC, and whole chunk with the chunk that
+  // was built, CRC included, for the current metadata parameters.
+  std::shared_ptr<const ChunkTemplate> tmpl{ _config.chunkTemplate() };
+  const std::vector<uint8_t> &whole{ tmpl->_physChunk };
+  const int dataStart{ PNG::NUM_BYTES_CHUNK_LENGTH + PNG::NUM_BYTES_CHUNK_TYPE };
+
+  for( int i=0; i<NUM_BYTES_PHYS_DATA; i++ ) {
+    _chnk->dataBuffer[i] = whole[dataStart+i];
   }
-  for( ix=PNG::NUM_BYTES_CHUNK_TYPE;
-       ix<PNG::NUM_BYTES_CHUNK_TYPE+NUM_BYTES_PHYS_DATA;
-       ix++ ) {
-    cat[ix] = _chnk->dataBuffer[ix-PNG::NUM_BYTES_CHUNK_TYPE];
+  for( int i=0; i<PNG::NUM_BYTES_CHUNK_CRC; i++ ) {
+    _chnk->crcBytes[i] = whole[dataStart+NUM_BYTES_PHYS_DATA+i];
   }
+  for( int i=0; i<NUM_BYTES_CHUNK_PHYS_TOTAL; i++ ) {
+    _chnk->wholeChunkBuffer[i] = whole[i];
+  }
+  if( _result.logging ) {
+    _result.loggit( "pHYs CRC calculated = 0x" + _chnk->crc() );
 
-  uint32_t crc_calculated{0};
-  crc_calculated = CRCforPNG::calc( cat,
-    PNG::NUM_BYTES_CHUNK_TYPE+NUM_BYTES_PHYS_DATA );
-
-  // Update the CRC-bytes.
-  NFIMM::expressUINT32AsFourBytes( crc_calculated, _chnk->crcBytes, true );
-  _params->loggit( "pHYs CRC calculated = 0x" + _chnk->crc() );
-
-  _chnk->concatenate4parts();
-
-  _params->loggit( "PHYS: updated wholeChunkStr(): 0x" +
-                   _chnk->wholeChunkStr() );
+    _result.loggit( "PHYS: updated wholeChunkStr(): 0x" +
+                     _chnk->wholeChunkStr() );
+  }
 }   // END updateChunk()
 
 
@@ -27,7 +27,10 @@ identified are necessarily the best available for the purpose.
 *******************************************************************************/
 
 #include "png/png.h"
+#include "output_sink.h"
+#include "probe.h"
 
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <sstream>
@@ -35,13 +38,22 @@ identified are necessarily the best available for the purpose.
 
 namespace NFIMM {
 
-size_t PNG::_insertChunkIndex;
-std::vector<std::shared_ptr<PNG::ChunkLayout>> PNG::s_insertChunkPointers;
+thread_local size_t PNG::_insertChunkIndex;
+thread_local std::vector<std::shared_ptr<PNG::ChunkLayout>> PNG::s_insertChunkPointers;
 
 /** Clear the chunk containers, clear write-buffer. */
 PNG::PNG( std::shared_ptr<MetadataParameters> &mps ) : NFIMM{mps}
 {
-  _params->loggit( "Initialize for PNG modification" );
+  s_pHYsChunkExists = false;
+  s_writeBuffer.clear();
+  s_insertChunkPointers.clear();
+  _srcChunkPointers.clear();
+}
+
+/** Clear the chunk containers, clear write-buffer. */
+PNG::PNG( std::shared_ptr<const ModificationConfig> cfg )
+    : NFIMM{std::move(cfg)}
+{
   s_pHYsChunkExists = false;
   s_writeBuffer.clear();
   s_insertChunkPointers.clear();
@@ -49,33 +61,311 @@ PNG::PNG( std::shared_ptr<MetadataParameters> &mps ) : NFIMM{mps}
 }
 
 /**
- * Run the entire process to parse, update, and insert chunks. To reassemble
- * the destination image, transfer bytes to write-buffer.
+ * Run the entire process to parse, update, and insert chunks, and determine
+ * the order and size of the destination image.
  *
+ * @param pln OUT : destination image size and edits
  * @throw Miscue for any point where process failed
  */
-void PNG::modify()
+void PNG::planImage( ModificationPlan &pln )
+{
+  _result.loggit( "Initialize for PNG modification" );
+  PNG::_insertChunkIndex = 0;  // required for linux
+  s_pHYsChunkExists = false;
+  s_insertChunkPointers.clear();
+  _srcChunkPointers.clear();
+  _countChunk = 0;
+  Signature sig( _result, s_readData, s_readSize );
+  // s_r_cursor = 8;
+  _result.loggit( ">> Parse all chunks in source");
+  parseAllChunks();
+  _result.loggit( ">> Process source chunks");
+  processExistingChunks();
+  insertChunkPhys();
+  _result.loggit( ">> Insert custom text");
+  insertCustomText();
+  if( _result.logging )
+    _result.loggit( "Chunk INSERT total COUNT: " + std::to_string( _insertChunkIndex ) );
+  _result.loggit( ">> Layout chunks for write");
+  orderChunks( pln );
+}
+
+/**
+ * Checks, in order of the source image:
+ * - signature
+ * - IHDR is first, with 13 data bytes
+ * - each chunk lies within the image and its type is known
+ * - pHYs has 9 data bytes
+ * - IEND is present
+ *
+ * @return Ok, or the first failure found and its source image offset
+ */
+Status PNG::validateImage() const noexcept
 {
-  try
+  const uint8_t *buf{ s_readData };
+  const size_t size{ s_readSize };
+  const size_t sigLength{ Signature::s_definedHex.size() };
+
+  if( size < sigLength )
+    return Status{ MiscueCode::Truncated, 0 };
+  if( !std::equal( Signature::s_definedHex.begin(),
+                   Signature::s_definedHex.end(), buf ) )
+    return Status{ MiscueCode::InvalidSignature, 0 };
+
+  auto isType = []( const uint8_t *p, const char *name ) {
+    return std::equal( p, p + NUM_BYTES_CHUNK_TYPE, name );
+  };
+
+  size_t pos{ sigLength };
+  bool first{true};
+  while( true )
   {
-    PNG::_insertChunkIndex = 0;  // required for linux
-    Signature sig( _params, s_readBuffer );
-    // s_r_cursor = 8;
-    _params->loggit( ">> Parse all chunks in source");
-    parseAllChunks();
-    _params->loggit( ">> Process source chunks");
-    processExistingChunks();
-    insertChunkPhys();
-    _params->loggit( ">> Insert custom text");
-    insertCustomText();
-    _params->loggit( "Chunk INSERT total COUNT: " + std::to_string( _insertChunkIndex ) );
-    _params->loggit( ">> Xfer chunks to write buffer");
-    xferChunks();
+    if( size - pos < 12u )   // LEN + TYPE + CRC
+      return Status{ MiscueCode::Truncated, pos };
+
+    uint32_t len{0};
+    for( int i=0; i<NUM_BYTES_CHUNK_LENGTH; i++ ) {
+      len <<= 8;
+      len += buf[pos+i];
+    }
+    const uint8_t *type{ buf + pos + NUM_BYTES_CHUNK_LENGTH };
+    if( len > size - pos - 12u )
+      return Status{ MiscueCode::Truncated, pos };
+
+    if( first && ( !isType( type, "IHDR" ) || len != 13u ) )
+      return Status{ MiscueCode::InvalidHeader, pos };
+    first = false;
+
+    bool known{false};
+    for( const std::string &t : _allChunkTypes ) {
+      if( isType( type, t.c_str() ) ) { known = true; break; }
+    }
+    if( !known )
+      return Status{ MiscueCode::InvalidChunk, pos };
+    if( isType( type, "pHYs" ) && len != 9u )
+      return Status{ MiscueCode::InvalidChunk, pos };
+    if( isType( type, "IEND" ) )
+      return Status{};
+
+    pos += len + 12u;
   }
-  catch( const Miscue &e ) {
-    throw Miscue( e );
+}
+
+/**
+ * A PNG is never copied unchanged, so the plan cannot be compared with the
+ * source.  It is current when its pHYs chunk is, byte for byte, the one
+ * NFIMM would write and a Software tEXt chunk of NFIMM is present.  Only the
+ * chunks ahead of the first IDAT are read.
+ *
+ * @return false if not current, or on a malformed chunk
+ */
+bool PNG::isCurrentImage() noexcept
+{
+  const std::shared_ptr<const ChunkTemplate> tmpl{
+    _config ? _config->chunkTemplate() : nullptr };
+  const uint8_t *buf{ s_readData };
+  const size_t size{ s_readSize };
+  const size_t sigLength{ Signature::s_definedHex.size() };
+  if( !tmpl || size < sigLength ||
+      !std::equal( Signature::s_definedHex.begin(),
+                   Signature::s_definedHex.end(), buf ) )
+    return false;
+
+  static const char software[]{ "Software\0header mod by " };
+  const std::vector<uint8_t> &phys{ tmpl->_physChunk };
+  bool physCurrent{false};
+  bool softwareFound{false};
+  size_t pos{ sigLength };
+  while( size - pos >= 12u )
+  {
+    uint32_t len{0};
+    for( int i=0; i<NUM_BYTES_CHUNK_LENGTH; i++ ) {
+      len <<= 8;
+      len += buf[pos+i];
+    }
+    if( len > size - pos - 12u )
+      return false;
+    const uint8_t *type{ buf + pos + NUM_BYTES_CHUNK_LENGTH };
+    const uint8_t *data{ type + NUM_BYTES_CHUNK_TYPE };
+    if( std::equal( type, type + NUM_BYTES_CHUNK_TYPE, "IDAT" ) ||
+        std::equal( type, type + NUM_BYTES_CHUNK_TYPE, "IEND" ) )
+      break;
+    if( std::equal( type, type + NUM_BYTES_CHUNK_TYPE, "pHYs" ) )
+      physCurrent = len + 12u == phys.size() &&
+                    std::equal( phys.begin(), phys.end(), buf + pos );
+    else if( std::equal( type, type + NUM_BYTES_CHUNK_TYPE, "tEXt" ) &&
+             len >= sizeof( software ) - 1 &&
+             std::equal( software, software + sizeof( software ) - 1, data ) )
+      softwareFound = true;
+    pos += len + 12u;
   }
+  return physCurrent && softwareFound;
+}
 
+/**
+ * Nothing is parsed into chunk containers and no CRC is checked; the walk
+ * stops at the first IDAT, which is all that is read of the source image.
+ * The pHYs unit is as found: 1 == meter.
+ *
+ * @param probe OUT : IHDR, pHYs, and tEXt fields
+ * @return Ok, or the failure and its source image offset
+ */
+Status PNG::probeImage( ImageProbe &probe )
+{
+  const uint8_t *buf{ s_readData };
+  const size_t size{ s_readSize };
+  const size_t sigLength{ Signature::s_definedHex.size() };
+  if( size < sigLength )
+    return Status{ MiscueCode::Truncated, 0 };
+  if( !std::equal( Signature::s_definedHex.begin(),
+                   Signature::s_definedHex.end(), buf ) )
+    return Status{ MiscueCode::InvalidSignature, 0 };
+
+  auto be32 = [buf]( const size_t offset ) {
+    uint32_t val{0};
+    for( int i=0; i<4; i++ ) {
+      val <<= 8;
+      val += buf[offset+i];
+    }
+    return val;
+  };
+  static const char software[]{ "header mod by " };
+  bool ihdrFound{false};
+  size_t pos{ sigLength };
+  while( true )
+  {
+    if( size - pos < 12u )
+      return Status{ MiscueCode::Truncated, pos };
+    const uint32_t len{ be32( pos ) };
+    if( len > size - pos - 12u )
+      return Status{ MiscueCode::Truncated, pos };
+    const uint8_t *type{ buf + pos + NUM_BYTES_CHUNK_LENGTH };
+    const uint8_t *data{ type + NUM_BYTES_CHUNK_TYPE };
+    const size_t dataPos{ pos + NUM_BYTES_CHUNK_LENGTH + NUM_BYTES_CHUNK_TYPE };
+    if( !ihdrFound )
+    {
+      if( !std::equal( type, type + NUM_BYTES_CHUNK_TYPE, "IHDR" ) || len < 13u )
+        return Status{ MiscueCode::InvalidHeader, pos };
+      ihdrFound = true;
+      probe.width = be32( dataPos );
+      probe.height = be32( dataPos + 4 );
+      probe.bitDepth = data[8];
+      probe.colorType = data[9];
+    }
+    else if( std::equal( type, type + NUM_BYTES_CHUNK_TYPE, "IDAT" ) ||
+             std::equal( type, type + NUM_BYTES_CHUNK_TYPE, "IEND" ) )
+    {
+      probe.headerEnd = pos;
+      return Status{};
+    }
+    else if( std::equal( type, type + NUM_BYTES_CHUNK_TYPE, "pHYs" ) && len == 9u )
+    {
+      probe.resolutionExists = true;
+      probe.horiz = be32( dataPos );
+      probe.vert = be32( dataPos + 4 );
+      probe.units = data[8];
+      probe.resolutionOffset = pos;
+    }
+    else if( std::equal( type, type + NUM_BYTES_CHUNK_TYPE, "tEXt" ) )
+    {
+      const uint8_t *end{ data + len };
+      const uint8_t *nul{ std::find( data, end, 0 ) };
+      std::string keyword( data, nul );
+      std::string text( nul == end ? end : nul + 1, end );
+      if( keyword == "Software" && text.compare( 0, sizeof( software ) - 1,
+                                                 software ) == 0 )
+        probe.nfimmSoftware = true;
+      probe.text.emplace_back( std::move( keyword ), std::move( text ) );
+    }
+    pos += len + 12u;
+  }
+}
+
+/**
+ * Only the chunks ahead of the first IDAT are read into memory.  They are
+ * planned as an image of their own, ended by an IEND, and the destination
+ * chunks are written without that IEND; the new chunks therefore go where
+ * they would in the whole image, see orderChunks().  The first IDAT and
+ * everything after it are passed through unchanged and are not checked.
+ * An image without IDAT is read entirely.
+ *
+ * @param fdIn source image, read to its end
+ * @param sink destination image
+ * @param head IN/OUT first bytes of the source image
+ * @return number of bytes written
+ * @throw Miscue Invalid signature or chunk, truncated, read or write failed
+ */
+size_t PNG::streamImage( const int fdIn, FdSink &sink, std::vector<uint8_t> &head )
+{
+  static const uint8_t iend[NUM_BYTES_CHUNK_LENGTH + NUM_BYTES_CHUNK_TYPE +
+                            NUM_BYTES_CHUNK_CRC]{
+    0x00, 0x00, 0x00, 0x00, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82 };
+
+  // Read until HEAD holds at least LEN bytes; false at end of input.
+  auto fill = [fdIn, &head]( const size_t len ) {
+    const size_t had{ head.size() };
+    if( had >= len )
+      return true;
+    head.resize( len );
+    const size_t got{ readDescriptor( fdIn, head.data() + had, len - had ) };
+    head.resize( had + got );
+    return had + got == len;
+  };
+
+  const size_t sigLength{ Signature::s_definedHex.size() };
+  if( !fill( sigLength ) ||
+      !std::equal( Signature::s_definedHex.begin(),
+                   Signature::s_definedHex.end(), head.begin() ) )
+    throw Miscue( MiscueCode::InvalidSignature,
+                  "ERROR: Signature validation FAILED: not a PNG stream" );
+
+  size_t pos{ sigLength };
+  while( true )
+  {
+    if( !fill( pos + NUM_BYTES_CHUNK_LENGTH + NUM_BYTES_CHUNK_TYPE ) )
+      throw Miscue( MiscueCode::Truncated,
+                    "PNG stream ends inside chunk at " + std::to_string( pos ) );
+    uint32_t len{0};
+    for( int i=0; i<NUM_BYTES_CHUNK_LENGTH; i++ ) {
+      len <<= 8;
+      len += head[pos+i];
+    }
+    const uint8_t *type{ head.data() + pos + NUM_BYTES_CHUNK_LENGTH };
+    if( len > 0x7FFFFFFFu )
+      throw Miscue( MiscueCode::InvalidChunk,
+                    "PNG chunk length exceeds 2^31-1 at " + std::to_string( pos ) );
+    if( std::equal( type, type + NUM_BYTES_CHUNK_TYPE, "IDAT" ) )
+      break;
+    if( std::equal( type, type + NUM_BYTES_CHUNK_TYPE, "IEND" ) )
+      return NFIMM::streamImage( fdIn, sink, head );
+
+    pos += len + NUM_BYTES_CHUNK_LENGTH + NUM_BYTES_CHUNK_TYPE +
+           NUM_BYTES_CHUNK_CRC;
+    if( !fill( pos ) )
+      throw Miscue( MiscueCode::Truncated,
+                    "PNG stream ends inside chunk before " + std::to_string( pos ) );
+  }
+
+  // Bytes already read from the first IDAT on are written after the plan.
+  const std::vector<uint8_t> data( head.begin() + pos, head.end() );
+  head.resize( pos );
+  head.insert( head.end(), std::begin( iend ), std::end( iend ) );
+  readImageFileIntoBuffer( std::move( head ) );
+
+  const SegmentList &segs{ plan().segments };
+  size_t left{ segs.size() - sizeof( iend ) };
+  for( const SegmentList::Segment &seg : segs.segments() )
+  {
+    const size_t n{ std::min( seg.length, left ) };
+    sink.write( segs.data( seg ), n );
+    left -= n;
+  }
+  sink.write( data.data(), data.size() );
+  const size_t passed{ data.size() + sink.copyFrom( fdIn ) };
+  if( _result.logging )
+    _result.loggit( "Image data passed through: " + std::to_string( passed ) +
+                    " bytes" );
+  return segs.size() - sizeof( iend ) + passed;
 }
 
 /**
@@ -123,7 +413,7 @@ void PNG::modify()
  * 
  * After all chunks read, they are ready to be processed.
  * 
- * Updates the COUNT of chunks in the MetadataParameters object used to support
+ * Updates the COUNT of chunks in the ModificationResult object used to support
  * WRITE operations.
  * 
  * @param offset starting point for first chunk after Signature in image buffer
@@ -138,6 +428,7 @@ void PNG::parseAllChunks( int offset )
   while( true )
   {
     std::shared_ptr<ChunkLayout> currentChunk( new ChunkLayout );
+    currentChunk->srcOffset = s_r_cursor;
 
     // Parse the LEN
     next4bytes( currentChunk->lengthBytes );
@@ -146,29 +437,37 @@ void PNG::parseAllChunks( int offset )
     next4bytes( currentChunk->typeBytes );
     {
       // log all except IDAT
-      if( currentChunk->type() != "IDAT" )
-      _params->loggit( "*** currentChunk: " +
+      if( _result.logging && currentChunk->type() != "IDAT" )
+      _result.loggit( "*** currentChunk: " +
                         currentChunk->type() + "  len: " +
                         std::to_string( currentChunk->length() ) );
     }
 
-    // Parse the Chunk's DATA
-    currentChunk->dataBuffer = new uint8_t[currentChunk->length()];
-    nextLengthBytes( currentChunk->length(), currentChunk->dataBuffer );
+    // Parse the Chunk's DATA; the image data is never modified and is
+    // written from the source image, see orderChunks().
+    const bool isImageData{ currentChunk->type() == "IDAT" };
+    if( isImageData ) {
+      s_r_cursor += currentChunk->length();
+    }
+    else {
+      currentChunk->dataBuffer = new uint8_t[currentChunk->length()];
+      nextLengthBytes( currentChunk->length(), currentChunk->dataBuffer );
+    }
     // {
     //   // Dump all bytes of the image data to the log; useful for extreme debug.
-    //   _params->loggit( "*** currentChunk->dataBuffer(): 0x" + currentChunk->data() );
+    //   _result.loggit( "*** currentChunk->dataBuffer(): 0x" + currentChunk->data() );
     // }
 
     // Parse the Chunk CRC
     next4bytes( currentChunk->crcBytes );
     {
       // Dump all bytes to log; useful for extreme debug.
-      // _params->loggit( "*** currentChunk->crc(): 0x" + currentChunk->crc() );
+      // _result.loggit( "*** currentChunk->crc(): 0x" + currentChunk->crc() );
     }
 
     // Concatenate the 4-parts into a single buffer
-    currentChunk->concatenate4parts();
+    if( !isImageData )
+      currentChunk->concatenate4parts();
 
     // Save the chunk pointer
     _srcChunkPointers.push_back( currentChunk );
@@ -177,7 +476,7 @@ void PNG::parseAllChunks( int offset )
     //   std::string loggerStr{};
     //   auto strAddr = "Chunk address: currentChunk: 0x%p";
     //   logAddress( strAddr, currentChunk, loggerStr );
-    //   _params->logggit( loggerStr );
+    //   _result.loggit( loggerStr );
     // }
     _countChunk++;
 
@@ -186,12 +485,15 @@ void PNG::parseAllChunks( int offset )
     // If key does exist, increment the count.  This accounts for those chunks
     //   where multiple are allowed:
     //     IDAT, sPLT, iTXt, tEXt, zTXt
-    itr = chunkDictionary.find( currentChunk->type() );
-    if( itr != chunkDictionary.end() )
-      itr->second += 1;
-    else
-      chunkDictionary.insert( std::pair<std::string,
-                              uint32_t>( currentChunk->type(), 1 ) );
+    // The map is only logged.
+    if( _result.logging ) {
+      itr = chunkDictionary.find( currentChunk->type() );
+      if( itr != chunkDictionary.end() )
+        itr->second += 1;
+      else
+        chunkDictionary.insert( std::pair<std::string,
+                                uint32_t>( currentChunk->type(), 1 ) );
+    }
 
     if( currentChunk->type() == "IEND" ) {
       break;   // exit while(true) because reached End of File chunk
@@ -201,15 +503,17 @@ void PNG::parseAllChunks( int offset )
     }
   }  // END while(true)
 
-  _params->loggit( "Source image chunk summary, total COUNT = " +
-                    std::to_string( _countChunk ) );
-  for( itr = chunkDictionary.begin(); itr != chunkDictionary.end(); ++itr) {
-    _params->loggit( "Source image chunk type => " + itr->first +
-                     "  COUNT =>" + std::to_string( itr-> second ) );
+  if( _result.logging ) {
+    _result.loggit( "Source image chunk summary, total COUNT = " +
+                      std::to_string( _countChunk ) );
+    for( itr = chunkDictionary.begin(); itr != chunkDictionary.end(); ++itr) {
+      _result.loggit( "Source image chunk type => " + itr->first +
+                       "  COUNT =>" + std::to_string( itr-> second ) );
+    }
   }
 
   // Update output for write of dest image.
-  _params->pngWriteImageInfo.countSourceChunks = _countChunk;
+  _result.pngWriteImageInfo.countSourceChunks = _countChunk;
 }
 
 // -----------------------------------------------------------------------------
@@ -231,13 +535,12 @@ void PNG::insertChunkPhys()
 {
   // Insert chunk `pHYs` if it does not exist.
   if( !s_pHYsChunkExists ) {
-    _params->loggit( "pHYs does not exist, insert it" );
-    // Phys ph( _params, 0 );
-    Phys ph( _params, _srcChunkPointers[0] );
+    _result.loggit( "pHYs does not exist, insert it" );
+    Phys ph( *_config, _result, _srcChunkPointers[0] );
     ph.insertChunk();
   }
   else {
-    _params->loggit( "pHYs does exist, already been updated" );
+    _result.loggit( "pHYs does exist, already been updated" );
   }
 }
 
@@ -266,21 +569,21 @@ void PNG::processExistingChunks()
     if( !foundValidChunk ) {
       std::string msg{"IDENTIFIED INvalid chunk: '" +
                        _srcChunkPointers[i]->type() + "'"};
-      _params->loggit( msg );
-      throw Miscue( msg );
+      _result.loggit( msg );
+      throw Miscue( MiscueCode::InvalidChunk, msg );
     }
 
     if( _srcChunkPointers[i]->type() == "IHDR" ) {
-      _params->loggit( "Chunk xfer without modification: IHDR" );
+      _result.loggit( "Chunk xfer without modification: IHDR" );
 
       // Constructor parses the chunk data and updates the write-data-buffer.
-      IhdrX ih( _params, _srcChunkPointers[i] );
+      IhdrX ih( _result, _srcChunkPointers[i] );
     }
     else if( _srcChunkPointers[i]->type() == "pHYs" ) {
-      _params->loggit( "Chunk eligible for modification: pHYs" );
+      _result.loggit( "Chunk eligible for modification: pHYs" );
 
       // Constructor parses the chunk data and updates the write-data-buffer.
-      Phys ph( _params, _srcChunkPointers[i] );
+      Phys ph( *_config, _result, _srcChunkPointers[i] );
       ph.parseChunk();
       ph.updateChunk();
     }
@@ -298,7 +601,7 @@ void PNG::insertCustomText()
 {
   // Constructor parses the chunk metadata and builds the chunks for
   // insertion into write-data-buffer.
-  Text tx( _params );
+  Text tx( *_config, _result, _srcPath );
   tx.insertChunks();
 }
 
@@ -306,167 +609,83 @@ void PNG::insertCustomText()
 std::string PNG::to_s()
 {
   std::string s{"PNG: "};
-  s.append( _params->to_s() );
+  s.append( _config->to_s() );
   return s;
 }
 
 
 /**
- * Calculate the write-buffer size.  This is the same size as the source image
- * if there is no insertion of one or more `tEXt` chunks.  Write-buffer size
- * is calculated by iterating through the array of pointers to the chunks and
- * adding the chunk (data length + LEN + TYPE + CRC) where:
+ * Determine the layout of the destination image and calculate its size.
+ * This is the same size as the source image if there is no insertion of
+ * one or more `tEXt` chunks.  Size is calculated by adding each chunk's
+ * (data length + LEN + TYPE + CRC) where:
  * - LEN + TYPE + CRC = 12
  * 
- * Lengths of chunks for insertion are added to write-buffer size by iterating
- * through the insertion pointers array.
- * 
- * Save the write-buffer size to the metadata parameters in order to save the
- * buffer to disk later.
+ * The source chunks keep their order and are referenced in place, except the
+ * `pHYs` chunk which is updated in place.  All inserted chunks are written as
+ * one block right after the source `pHYs`, so they merge with its update
+ * into one block of new bytes.  Without a source `pHYs`, the inserted
+ * chunks, the new `pHYs` and the `tEXt` chunks, go ahead of the first
+ * `IDAT`.  The destination image is therefore at most three segments: two
+ * source ranges around one block of new bytes.
  * 
- * Write the signature to the write-buffer.
- * 
- * Then, iterate through the source chunks (array of pointers) and check for
- * chunk type `IDAT`.  `tEXt` chunks are inserted prior to the first
- * occurrence of `IDAT`.  A flag us used to insert ONLY prior to the first
- * `IDAT` and not all of them (since it is permissible for multiple `IDAT`s).
- * 
- * Transfer each chunk one at a tiime to the write buffer from either:
- * - _srcChunkPointers
- * - _insertChunkPointers
+ * @param pln OUT : destination image size, edits, and segments
  */
-void PNG::xferChunks()
+void PNG::orderChunks( ModificationPlan &pln )
 {
-  uint32_t totalChunks = _params->pngWriteImageInfo.sumChunks();
-  _params->
-    loggit( "WRITE all chunks, COUNT: " + std::to_string( totalChunks ) );
-  _params->
-    loggit( "WRITE sourced chunks, COUNT: " +
-             std::to_string( _params->pngWriteImageInfo.countSourceChunks ) );
-  _params->
-    loggit( "WRITE inserted chunks, COUNT: " +
-             std::to_string( _params->pngWriteImageInfo.countInsertChunks ) );
-
-  // Update the writeBufferSize based on the lengths of the source image chunks
-  //   AND the insertion-chunks .
-  uint32_t writeBufferSize{8};   // signature = 8 bytes
-  for( uint32_t p=0; p<_countChunk; p++ ) {
-    writeBufferSize += _srcChunkPointers[p]->length();
-    writeBufferSize += 12;  // LEN + TYPE + CRC
-  }
-  // _params->loggit( "writeBufferSize source: " +
-  //                   std::to_string( writeBufferSize ) );
-  for( size_t p=0; p<_insertChunkIndex; p++ ) {
-    writeBufferSize += s_insertChunkPointers[p]->length();
-    writeBufferSize += 12;  // LEN + TYPE + CRC
+  uint32_t totalChunks = _result.pngWriteImageInfo.sumChunks();
+  if( _result.logging ) {
+    _result.
+      loggit( "WRITE all chunks, COUNT: " + std::to_string( totalChunks ) );
+    _result.
+      loggit( "WRITE sourced chunks, COUNT: " +
+               std::to_string( _result.pngWriteImageInfo.countSourceChunks ) );
+    _result.
+      loggit( "WRITE inserted chunks, COUNT: " +
+               std::to_string( _result.pngWriteImageInfo.countInsertChunks ) );
   }
 
   // SIGNATURE
-  _params->loggit( "Length of Signature should == 8: " +
-                    std::to_string( Signature::s_definedHex.size() ) );
-  xferBytesBetweenBuffers( s_writeBuffer, Signature::s_definedHex );
-
-  // Append IHDR - note that IHDR is always the first chunk after the signature
-  // per the PNG spec and is passed to the destination image header unchanged.
-  // Therefore IDHR is first in the container of src image chunks.
-  _params->loggit( "IHDR whole chunk (sourced): " +
-                    _srcChunkPointers[0]->wholeChunkStr() );
-  xferBytesBetweenBuffers( s_writeBuffer, _srcChunkPointers[0]->wholeChunk() );
-  delete [] _srcChunkPointers[0]->wholeChunkBuffer;
-  delete [] _srcChunkPointers[0]->dataBuffer;
-
-  // Append pHYs - since this chunk contains the image resolution, this chunk
-  // has either been modified from the source or inserted if it did not exist
-  // in the source.  Therefore, by design, if the pHYs chunk exists in source,
-  // it is updated and the appended to the _writeBuffer.
-  // If it does not exist in source, then by design this chunk is first in the
-  // container that contains all chunks to insert.
-  // Iterate the source chunk container and write to buffer
-  for( std::shared_ptr<PNG::ChunkLayout> chnk : _srcChunkPointers )
-  {
-    if( chnk->type() == "pHYs" )
+  pln.keep( "Signature", 0, Signature::s_definedHex.size() );
+
+  auto insertAll = [this, &pln]() {
+    for( const std::shared_ptr<ChunkLayout> &ins : s_insertChunkPointers )
     {
-      s_pHYsChunkExists = true;
-      _params->loggit( "pHYs whole chunk (updated): " + chnk->wholeChunkStr() );
-      xferBytesBetweenBuffers( s_writeBuffer, chnk->wholeChunk() );
-      delete [] chnk->wholeChunkBuffer;
-      delete [] chnk->dataBuffer;
-      break;
+      if( _result.logging )
+        _result.loggit( ins->type() + " whole chunk (inserted): " +
+                        ins->wholeChunkStr() );
+      pln.insert( ins->type(), ins->wholeChunkBuffer, ins->length() + 12u );
     }
-  }
-  if( !s_pHYsChunkExists )
-  {
-    for( std::shared_ptr<PNG::ChunkLayout> chnk : s_insertChunkPointers )
-    {
-      if( chnk->type() == "pHYs" )
-      {
-        _params->loggit( "pHYs whole chunk (inserted): " + chnk->wholeChunkStr() );
-        xferBytesBetweenBuffers( s_writeBuffer, chnk->wholeChunk() );
-        delete [] chnk->wholeChunkBuffer;
-        delete [] chnk->dataBuffer;
-      }
-    }
-  }
+  };
 
-  // Chunk ordering per the PNG spec calls-out no order-constraint per tEXt.
-  // Therefore, all tEXt chunks in the insert-chunk container shall be written
-  // to the _writeBuffer just ahead of the IDAT chunks.  (Any tEXt chunks in
-  // the source image header container will be written in the order they
-  // originally appeared).
-
-  // In the use-case where zero custom tEXt were specified, thie insert
-  // container shall contain three chunks: 1-pHYs chunk and 2-tEXt chunks.
-
-  // Write all chunks from the source chunks container to the _writeBuffer
-  // except:
-  //  * IHDR - already been written to the _writeBuffer
-  //  * pHYs - if it exists, the insert-container contains the chunk and has
-  //           already been written to the _writeBuffer
-  //  * IDAT - these go last but before IEND
-  //  * IEND - must go last
-
-  // Iterate the source chunk container and write to buffer
-  for( std::shared_ptr<PNG::ChunkLayout> chnk : _srcChunkPointers )
+  bool insertDone{false};
+  for( const std::shared_ptr<ChunkLayout> &chnk : _srcChunkPointers )
   {
-    if( chnk->type() == "IHDR" ) continue;
-    if( chnk->type() == "pHYs" ) continue;
-    if( chnk->type() == "IDAT" ) continue;
-    if( chnk->type() == "IEND" ) continue;
-
-    _params->loggit( "_writeBuffer sourced header chunk: " + chnk->type() );
-    _params->loggit( "whole chunk (inserted): " + chnk->wholeChunkStr() );
-    xferBytesBetweenBuffers( s_writeBuffer, chnk->wholeChunk() );
-    delete [] chnk->wholeChunkBuffer;
-    delete [] chnk->dataBuffer;
-  }
+    const std::string type{ chnk->type() };
+    const size_t wholeLength{ chnk->length() + 12u };  // LEN + TYPE + CRC
 
-  // Iterate the insert chunk container and write to buffer
-  for( std::shared_ptr<PNG::ChunkLayout> chnk : s_insertChunkPointers )
-  {
-    // pHYs has already been xferred above
-    if( chnk->type() == "pHYs" ) continue;
-
-    _params->loggit( "_writeBuffer header chunk: " + chnk->type() );
-    _params->loggit( "whole chunk (inserted): " + chnk->wholeChunkStr() );
-    xferBytesBetweenBuffers( s_writeBuffer, chnk->wholeChunk() );
-    delete [] chnk->wholeChunkBuffer;
-    delete [] chnk->dataBuffer;
-  }
+    // Chunk ordering per the PNG spec calls-out no order-constraint per tEXt,
+    // and pHYs must only precede the first IDAT.
+    if( !insertDone && ( type == "IDAT" || type == "IEND" ) )
+    {
+      insertAll();
+      insertDone = true;
+    }
 
-  // Iterate the source chunk container and write to buffer
-  for( std::shared_ptr<PNG::ChunkLayout> chnk : _srcChunkPointers )
-  {
-    if( chnk->type() == "IDAT" )
+    if( type == "pHYs" )
     {
-      xferBytesBetweenBuffers( s_writeBuffer, chnk->wholeChunk() );
-      delete [] chnk->wholeChunkBuffer;
-      delete [] chnk->dataBuffer;
+      if( _result.logging )
+        _result.loggit( "pHYs whole chunk (updated): " + chnk->wholeChunkStr() );
+      pln.update( type, chnk->wholeChunkBuffer, wholeLength );
+      if( !insertDone )
+      {
+        insertAll();
+        insertDone = true;
+      }
     }
-    if( chnk->type() == "IEND" )
+    else
     {
-      xferBytesBetweenBuffers( s_writeBuffer, chnk->wholeChunk() );
-      delete [] chnk->wholeChunkBuffer;
-      delete [] chnk->dataBuffer;
+      pln.keep( type, chnk->srcOffset, wholeLength );
     }
   }
 }
@@ -537,6 +756,7 @@ PNG::ChunkLayout::data() {
   std::string s{};
   char hex[3];
 
+  if( !dataBuffer ) return s;
   for( uint32_t j=0; j<length(); j++ ) {
     sprintf( hex, "%02X", dataBuffer[j] );
     s.append( hex );
@@ -572,6 +792,7 @@ PNG::ChunkLayout::wholeChunkStr() {
   char hex[3];
   uint32_t total{length()+12};
 
+  if( !wholeChunkBuffer ) return s;
   for( uint32_t j=0; j<total; j++ ) {
     sprintf( hex, "%02X", wholeChunkBuffer[j] );
     s.append( hex );
@@ -585,6 +806,7 @@ PNG::ChunkLayout::wholeChunk() {
   std::vector<uint8_t>v;
   uint32_t total{length()+12};
 
+  if( !wholeChunkBuffer ) return v;
   for( uint32_t j=0; j<total; j++ ) {
     v.push_back( wholeChunkBuffer[j] );
   }
@@ -33,12 +33,18 @@ namespace NFIMM {
 /**
  * Validates the PNG signature required for all valid PNG images. Update the
  * source image buffer read cursor to = 8.
- * @param mps metatdata container for logging
- * @param buf container for source image bytes
+ * @param result container for logging
+ * @param buf source image bytes
+ * @param size number of source image bytes
  * @throw Miscue If signature is invalid
  */
-Signature::Signature( std::shared_ptr<MetadataParameters> &mps, std::vector<uint8_t> &buf )
+Signature::Signature( ModificationResult &result, const uint8_t *buf,
+                      const size_t size )
 {
+  if( size < static_cast<size_t>( NUM_BYTES_SIGNATURE ) )
+    throw Miscue( MiscueCode::Truncated,
+                  "ERROR: Signature validation FAILED: image too short" );
+
   for( int i=0; i<NUM_BYTES_SIGNATURE; i++ ) {
     dataBytes.push_back( buf[i] );
   }
@@ -47,9 +53,10 @@ Signature::Signature( std::shared_ptr<MetadataParameters> &mps, std::vector<uint
   if( dataBytes != defined )
   {
     std::string msg{"ERROR: Signature validation FAILED: " + to_s()};
-    throw Miscue( msg );
+    throw Miscue( MiscueCode::InvalidSignature, msg );
   }
-  mps->loggit( "Signature validation OK! : " + to_s() );
+  if( result.logging )
+    result.loggit( "Signature validation OK! : " + to_s() );
   PNG::s_r_cursor = 8;
 }
 
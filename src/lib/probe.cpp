@@ -0,0 +1,144 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "probe.h"
+
+namespace NFIMM {
+
+namespace {
+
+/** @brief Quoted CSV field if it holds a separator, quote, or line end */
+std::string csvField( const std::string &s )
+{
+  if( s.find_first_of( ",\"\r\n" ) == std::string::npos )
+    return s;
+  std::string out{"\""};
+  for( const char c : s ) {
+    if( c == '"' ) out.push_back( '"' );
+    out.push_back( c );
+  }
+  out.push_back( '"' );
+  return out;
+}
+
+/** @brief JSON string; bytes above 0x7F are kept as UTF-8, or if LATIN1
+ * are Latin-1 characters and encoded as such */
+std::string jsonString( const std::string &s, const bool latin1 = false )
+{
+  static const char hex[]{ "0123456789abcdef" };
+  std::string out{"\""};
+  for( const char ch : s )
+  {
+    const uint8_t c{ static_cast<uint8_t>( ch ) };
+    if( c == '"' || c == '\\' ) {
+      out.push_back( '\\' );
+      out.push_back( ch );
+    }
+    else if( c < 0x20 || ( latin1 && c > 0x7E ) ) {
+      out.append( "\\u00" );
+      out.push_back( hex[c >> 4] );
+      out.push_back( hex[c & 0xF] );
+    }
+    else
+      out.push_back( ch );
+  }
+  out.push_back( '"' );
+  return out;
+}
+
+}   // END namespace
+
+/**
+ * @return comma-separated names, in the order of to_csv()
+ */
+std::string ImageProbe::csvHeader()
+{
+  return "path,format,status,offset,width,height,bit_depth,color_type,"
+         "resolution_exists,horiz,vert,units,header_end,resolution_offset,"
+         "dib_header_size,compression,nfimm_software,text";
+}
+
+/**
+ * @return the fields of csvHeader(), status as its description
+ */
+std::string ImageProbe::to_csv() const
+{
+  std::string txt;
+  for( const auto &kv : text ) {
+    if( !txt.empty() ) txt.push_back( ';' );
+    txt.append( kv.first + "=" + kv.second );
+  }
+  return csvField( path ) + "," + format + "," + csvField( status.what() ) +
+    "," + std::to_string( status.offset ) +
+    "," + std::to_string( width ) + "," + std::to_string( height ) +
+    "," + std::to_string( bitDepth ) + "," + std::to_string( colorType ) +
+    "," + ( resolutionExists ? "1" : "0" ) +
+    "," + std::to_string( horiz ) + "," + std::to_string( vert ) +
+    "," + std::to_string( units ) +
+    "," + std::to_string( headerEnd ) + "," + std::to_string( resolutionOffset ) +
+    "," + std::to_string( dibHeaderSize ) + "," + std::to_string( compression ) +
+    "," + ( nfimmSoftware ? "1" : "0" ) + "," + csvField( txt );
+}
+
+/**
+ * The status is its code and description; text is an array of
+ * {"keyword", "text"} objects.
+ *
+ * @return JSON object
+ */
+std::string ImageProbe::to_json() const
+{
+  std::string s{ "{\"path\":" + jsonString( path ) +
+    ",\"format\":" + jsonString( format ) +
+    ",\"code\":" + std::to_string( static_cast<int>( status.code ) ) +
+    ",\"status\":" + jsonString( status.what() ) +
+    ",\"offset\":" + std::to_string( status.offset ) +
+    ",\"width\":" + std::to_string( width ) +
+    ",\"height\":" + std::to_string( height ) +
+    ",\"bit_depth\":" + std::to_string( bitDepth ) +
+    ",\"color_type\":" + std::to_string( colorType ) +
+    ",\"resolution_exists\":" + ( resolutionExists ? "true" : "false" ) +
+    ",\"horiz\":" + std::to_string( horiz ) +
+    ",\"vert\":" + std::to_string( vert ) +
+    ",\"units\":" + std::to_string( units ) +
+    ",\"header_end\":" + std::to_string( headerEnd ) +
+    ",\"resolution_offset\":" + std::to_string( resolutionOffset ) +
+    ",\"dib_header_size\":" + std::to_string( dibHeaderSize ) +
+    ",\"compression\":" + std::to_string( compression ) +
+    ",\"nfimm_software\":" + ( nfimmSoftware ? "true" : "false" ) +
+    ",\"text\":[" };
+  for( size_t i=0; i<text.size(); i++ ) {
+    if( i ) s.push_back( ',' );
+    s.append( "{\"keyword\":" + jsonString( text[i].first, true ) +
+              ",\"text\":" + jsonString( text[i].second, true ) + "}" );
+  }
+  s.append( "]}" );
+  return s;
+}
+
+}   // END namespace
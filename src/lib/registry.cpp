@@ -0,0 +1,335 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "registry.h"
+#include "an2k/an2k.h"
+#include "bmp/bmp.h"
+#include "jp2/jp2.h"
+#include "jpeg/jpeg.h"
+#include "png/png.h"
+#include "tiff/tiff.h"
+#include "wsq/wsq.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#ifndef _WIN32
+  #include <sys/mman.h>
+#endif
+
+namespace NFIMM {
+
+namespace {
+
+/** @return factory of the handler class */
+template<typename Handler>
+HandlerRegistry::Factory factoryOf()
+{
+  return []( std::shared_ptr<const ModificationConfig> cfg ) {
+    return std::unique_ptr<NFIMM>( new Handler( std::move( cfg ) ) );
+  };
+}
+
+}   // END anonymous namespace
+
+/******************************************************************************/
+/* class FormatConfigs methods implementations */
+
+/**
+ * @param base config of the caller
+ * @throw Miscue Config is nullptr
+ */
+FormatConfigs::FormatConfigs( std::shared_ptr<const ModificationConfig> base )
+  : _base(std::move(base))
+{
+  if( !_base )
+    throw Miscue( MiscueCode::InvalidParameter,
+                  "Modification config is null" );
+}
+
+/**
+ * @param format compression of the image
+ * @return config with the parameters of the base config
+ * @throw Miscue Non-supported compression-type, JPEG density too large
+ */
+std::shared_ptr<const ModificationConfig>
+FormatConfigs::get( const std::string &format )
+{
+  if( format == _base->compression )
+    return _base;
+  std::shared_ptr<const ModificationConfig> &cfg{ _configs[format] };
+  if( !cfg )
+    cfg = _base->withCompression( format );
+  return cfg;
+}
+
+
+/******************************************************************************/
+/* class HandlerCache methods implementations */
+
+/**
+ * @param format compression of the image
+ * @param configs configs of the worker, used only to create the handler
+ * @return handler of the format
+ * @throw Miscue Non-supported compression-type, invalid config; nothing is
+ *   cached
+ */
+NFIMM &HandlerCache::get( const std::string &format, FormatConfigs &configs )
+{
+  const auto it = _handlers.find( format );
+  if( it != _handlers.end() )
+    return *it->second;
+  return get( format, configs.get( format ) );
+}
+
+/**
+ * @param format compression of the image
+ * @param config of the format, used only to create the handler
+ * @return handler of the format
+ * @throw Miscue Non-supported compression-type, invalid config; nothing is
+ *   cached
+ */
+NFIMM &HandlerCache::get( const std::string &format,
+                          std::shared_ptr<const ModificationConfig> config )
+{
+  std::unique_ptr<NFIMM> &handler{ _handlers[format] };
+  if( !handler )
+  {
+    try
+    {
+      handler = HandlerRegistry::instance().create( std::move( config ) );
+    }
+    catch( ... )
+    {
+      _handlers.erase( format );
+      throw;
+    }
+    handler->setLogging( false );
+  }
+  return *handler;
+}
+
+
+/******************************************************************************/
+/* class MappedSource methods implementations */
+
+MappedSource::~MappedSource()
+{
+#ifndef _WIN32
+  if( _data != nullptr )
+    ::munmap( const_cast<uint8_t *>( _data ), _size );
+#endif
+  NFIMM::s_readData = nullptr;
+  NFIMM::s_readSize = 0;
+}
+
+/**
+ * The descriptor may be closed once mapped.
+ *
+ * @param fd open for reading
+ * @param size bytes of the file, more than zero
+ * @return false if the file cannot be mapped, or is already
+ */
+bool MappedSource::map( const int fd, const size_t size ) noexcept
+{
+#ifdef _WIN32
+  (void)fd;
+  (void)size;
+  return false;
+#else
+  if( _data != nullptr || size == 0 )
+    return false;
+  void *m{ ::mmap( nullptr, size, PROT_READ, MAP_SHARED, fd, 0 ) };
+  if( m == MAP_FAILED )
+    return false;
+  _data = static_cast<const uint8_t *>( m );
+  _size = size;
+  return true;
+#endif
+}
+
+
+/******************************************************************************/
+/* class HandlerRegistry methods implementations */
+
+/**
+ * Register every format supported by NFIMM.
+ */
+HandlerRegistry::HandlerRegistry()
+{
+  add( "an2k", { '1', '.', '0', '0', '1', ':' }, factoryOf<AN2K>() );
+  add( "an2k", { '1', '.', '0', '1', ':' }, factoryOf<AN2K>() );
+  add( "bmp",  { 'B', 'M' }, factoryOf<BMP>() );
+  add( "jp2",  { 0x00, 0x00, 0x00, 0x0C, 0x6A, 0x50, 0x20, 0x20,
+                 0x0D, 0x0A, 0x87, 0x0A }, factoryOf<JP2>() );
+  add( "jpeg", { 0xFF, 0xD8, 0xFF }, factoryOf<JPEG>() );
+  add( "png",  { 0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A },
+               factoryOf<PNG>() );
+  add( "tiff", { 'I', 'I', 0x2A, 0x00 }, factoryOf<TIFF>() );
+  add( "tiff", { 'M', 'M', 0x00, 0x2A }, factoryOf<TIFF>() );
+  add( "tiff", { 'I', 'I', 0x2B, 0x00 }, factoryOf<TIFF>() );
+  add( "tiff", { 'M', 'M', 0x00, 0x2B }, factoryOf<TIFF>() );
+  add( "wsq",  { 0xFF, 0xA0, 0xFF }, factoryOf<WSQ>() );
+}
+
+/**
+ * The registry is built on first use; adding formats is not thread-safe.
+ *
+ * @return the registry of the built-in handlers
+ */
+HandlerRegistry &HandlerRegistry::instance()
+{
+  static HandlerRegistry s_registry{};
+  return s_registry;
+}
+
+/**
+ * A format may have several signatures; the factory of the most recent
+ * add() of the format is used.  A signature must be no longer than
+ * PREFIX_SIZE; an empty signature registers the handler only.
+ *
+ * @param format compression name, see MetadataParameters
+ * @param signature leading bytes of every image of the format
+ * @param create builds the handler
+ * @throw Miscue Empty format or factory, signature too long
+ */
+void HandlerRegistry::add( const std::string &format,
+                           const std::vector<uint8_t> &signature, Factory create )
+{
+  if( format.empty() || !create )
+    throw Miscue( MiscueCode::InvalidParameter,
+                  "Handler registry: format and factory are required" );
+  if( signature.size() > PREFIX_SIZE )
+    throw Miscue( MiscueCode::InvalidParameter,
+                  "Handler registry: signature of '" + format + "' longer than " +
+                  std::to_string( PREFIX_SIZE ) + " bytes" );
+
+  _factories[format] = std::move( create );
+  if( signature.empty() )
+    return;
+
+  // Keep longest first so that a longer signature wins over its prefix.
+  auto at = std::find_if( _signatures.begin(), _signatures.end(),
+      [&signature]( const Signature &s ) { return s.bytes.size() < signature.size(); } );
+  _signatures.insert( at, Signature{ format, signature } );
+}
+
+/**
+ * @param buf first bytes of the image, PREFIX_SIZE is enough
+ * @param size number of bytes
+ * @return compression name, empty if no signature matches
+ */
+const std::string &
+HandlerRegistry::detect( const uint8_t *buf, const size_t size ) const noexcept
+{
+  static const std::string s_unknown{};
+  for( const Signature &s : _signatures )
+  {
+    if( s.bytes.size() <= size &&
+        std::memcmp( buf, s.bytes.data(), s.bytes.size() ) == 0 )
+      return s.format;
+  }
+  return s_unknown;
+}
+
+/**
+ * Only the first PREFIX_SIZE bytes are read.
+ *
+ * @param path of the image file
+ * @return compression name, empty if no signature matches
+ * @throw Miscue File cannot be opened
+ */
+std::string HandlerRegistry::detect( const std::string &path ) const
+{
+  std::ifstream strm( path, std::ios::in|std::ios::binary );
+  if( !strm )
+    throw Miscue( MiscueCode::Io, "Cannot open image file: " + path );
+
+  uint8_t prefix[PREFIX_SIZE];
+  strm.read( reinterpret_cast<char *>( prefix ), PREFIX_SIZE );
+  return detect( prefix, static_cast<size_t>( strm.gcount() ) );
+}
+
+/**
+ * @param format compression name
+ * @return true if a handler is registered
+ */
+bool HandlerRegistry::supports( const std::string &format ) const
+{
+  return _factories.count( format ) != 0;
+}
+
+/**
+ * @return compression names, sorted
+ */
+std::vector<std::string> HandlerRegistry::formats() const
+{
+  std::vector<std::string> names;
+  for( const auto &f : _factories ) { names.push_back( f.first ); }
+  return names;
+}
+
+/**
+ * @param cfg validated parameters, its compression selects the handler
+ * @return new handler
+ * @throw Miscue Config is nullptr, no handler for the compression
+ */
+std::unique_ptr<NFIMM>
+HandlerRegistry::create( std::shared_ptr<const ModificationConfig> cfg ) const
+{
+  if( !cfg )
+    throw Miscue( MiscueCode::InvalidParameter,
+                  "Modification config is null" );
+  auto it = _factories.find( cfg->compression );
+  if( it == _factories.end() )
+    throw Miscue( MiscueCode::Unsupported,
+                  "No handler for image compression: '" + cfg->compression + "'" );
+  return it->second( std::move( cfg ) );
+}
+
+/**
+ * The handler does not read the image; see NFIMM::readImageFileIntoBuffer().
+ *
+ * @param buf first bytes of the image, PREFIX_SIZE is enough
+ * @param size number of bytes
+ * @param configs config of every format for the caller's parameters
+ * @return new handler for the detected format
+ * @throw Miscue Unknown signature, or invalid parameters for the format
+ */
+std::unique_ptr<NFIMM>
+HandlerRegistry::create( const uint8_t *buf, const size_t size,
+                         FormatConfigs &configs ) const
+{
+  const std::string &format{ detect( buf, size ) };
+  if( format.empty() )
+    throw Miscue( MiscueCode::InvalidSignature,
+                  "Image format not recognized from its signature" );
+  return create( configs.get( format ) );
+}
+
+}   // END namespace
@@ -0,0 +1,152 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+#include "output_sink.h"
+
+#include <algorithm>
+
+namespace NFIMM {
+
+/**
+ * @param source first byte of source image
+ * @param size number of bytes of source image
+ */
+void SegmentList::reset( const uint8_t *source, const size_t size )
+{
+  _source = source;
+  _sourceSize = size;
+  _segments.clear();
+  _size = 0;
+}
+
+/**
+ * Extends the last segment if it is the source range that ends at OFFSET.
+ *
+ * @param offset of first byte in source image
+ * @param length number of bytes
+ * @throw Miscue Range extends past end of source image
+ */
+void SegmentList::addSource( const size_t offset, const size_t length )
+{
+  if( length == 0 ) return;
+  if( offset > _sourceSize || length > _sourceSize - offset )
+    throw Miscue( MiscueCode::Truncated,
+                  "Segment past end of source image: offset " +
+                  std::to_string( offset ) + ", length " +
+                  std::to_string( length ) );
+
+  if( !_segments.empty() && _segments.back().fromSource() &&
+      _segments.back().srcOffset + _segments.back().length == offset )
+  {
+    _segments.back().length += length;
+  }
+  else
+  {
+    Segment seg{};
+    seg.srcOffset = offset;
+    seg.length = length;
+    _segments.push_back( std::move( seg ) );
+  }
+  _size += length;
+}
+
+/**
+ * Extends the last segment if it is also new bytes.
+ *
+ * @param bytes to copy into the list
+ * @param length number of bytes
+ */
+void SegmentList::addBytes( const uint8_t *bytes, const size_t length )
+{
+  if( length == 0 ) return;
+
+  if( _segments.empty() || _segments.back().fromSource() )
+    _segments.push_back( Segment{} );
+
+  Segment &seg = _segments.back();
+  seg.bytes.insert( seg.bytes.end(), bytes, bytes + length );
+  seg.length += length;
+  _size += length;
+}
+
+/**
+ * @param seg segment of this list
+ * @return pointer to SEG.length bytes
+ */
+const uint8_t *SegmentList::data( const Segment &seg ) const
+{
+  return seg.fromSource() ? _source + seg.srcOffset : seg.bytes.data();
+}
+
+/**
+ * @param dest OUT : destination image, size() bytes
+ * @return number of bytes copied
+ */
+size_t SegmentList::copyTo( uint8_t *dest ) const
+{
+  for( const Segment &seg : _segments )
+  {
+    const uint8_t *from = data( seg );
+    dest = std::copy( from, from + seg.length, dest );
+  }
+  return _size;
+}
+
+/**
+ * Source ranges are passed to the sink in place; nothing is buffered.
+ *
+ * @param sink receives the destination image
+ * @return number of bytes written
+ * @throw Miscue Write failed
+ */
+size_t SegmentList::writeTo( OutputSink &sink ) const
+{
+  for( const Segment &seg : _segments )
+  {
+    sink.write( data( seg ), seg.length );
+  }
+  return _size;
+}
+
+/**
+ * @return count of segments followed by each on its own line
+ */
+std::string SegmentList::to_s() const
+{
+  std::string s{"Segments: " + std::to_string( _segments.size() )};
+  for( const Segment &seg : _segments )
+  {
+    if( seg.fromSource() )
+      s.append( "\n  source offset " + std::to_string( seg.srcOffset ) +
+                ": " + std::to_string( seg.length ) );
+    else
+      s.append( "\n  new bytes: " + std::to_string( seg.length ) );
+  }
+  return s;
+}
+
+}   // END namespace
@@ -0,0 +1,515 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "server.h"
+#include "output_sink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace NFIMM {
+
+namespace {
+
+/** @brief Write a file from offset zero and truncate it, or a pipe in order
+ *
+ * A regular destination, e.g. a memfd that is reused for every request, is
+ * written with pwrite() so its file offset is never used.
+ */
+class DescriptorSink : public OutputSink
+{
+public:
+  /** @brief Default constructor not used */
+  DescriptorSink() = delete;
+  /** @brief POSITIONAL for a regular file */
+  DescriptorSink( const int fd, const bool positional )
+    : _fd(fd), _positional(positional), _stream(fd) {}
+
+  /** @brief Write the next bytes of the destination image */
+  void write( const uint8_t *data, const size_t len ) override
+  {
+    if( !_positional )
+    {
+      _stream.write( data, len );
+      _written += len;
+      return;
+    }
+    size_t done{0};
+    while( done < len )
+    {
+      const ssize_t n = ::pwrite( _fd, data + done, len - done,
+                                  static_cast<off_t>( _written + done ) );
+      if( n < 0 )
+      {
+        if( errno == EINTR ) continue;
+        throw Miscue( MiscueCode::Io,
+                      "CANNOT write destination image: " +
+                      std::string{ std::strerror( errno ) } );
+      }
+      done += static_cast<size_t>( n );
+    }
+    _written += len;
+  }
+
+  /** @brief Cut a regular file to the destination image size */
+  void finish() override
+  {
+    if( _positional && ::ftruncate( _fd, static_cast<off_t>( _written ) ) != 0 )
+      throw Miscue( MiscueCode::Io,
+                    "CANNOT truncate destination image: " +
+                    std::string{ std::strerror( errno ) } );
+  }
+
+  /** @return number of bytes written */
+  size_t written() const { return _written; }
+
+private:
+  int _fd;              ///< open for write by client
+  bool _positional;     ///< regular file
+  FdSink _stream;       ///< otherwise
+  size_t _written{0};   ///< bytes so far
+};   // END class DescriptorSink
+
+/**
+ * @param path of the socket
+ * @param addr OUT socket address
+ * @throw Miscue Path too long for a UNIX socket
+ */
+void socketAddress( const std::string &path, sockaddr_un &addr )
+{
+  if( path.empty() || path.size() >= sizeof( addr.sun_path ) )
+    throw Miscue( MiscueCode::InvalidParameter,
+                  "Invalid socket path: '" + path + "'" );
+  addr = sockaddr_un{};
+  addr.sun_family = AF_UNIX;
+  std::memcpy( addr.sun_path, path.c_str(), path.size() + 1 );
+}
+
+/**
+ * Receive a fixed-size message and the descriptors sent with it; they are
+ * attached to its first byte.  More than MAXFDS descriptors are closed and
+ * counted.
+ *
+ * @param sock connected socket
+ * @param buf OUT the message
+ * @param len size of the message
+ * @param fds OUT the first two descriptors
+ * @param nfds OUT number of descriptors sent
+ * @return true if the whole message was received, false at end of connection
+ */
+bool receive( const int sock, void *buf, const size_t len, int fds[2], size_t &nfds )
+{
+  alignas( cmsghdr ) char ctrl[CMSG_SPACE( 2 * sizeof( int ) )];
+  iovec iov{ buf, len };
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof( ctrl );
+
+  ssize_t n;
+  do {
+    n = ::recvmsg( sock, &msg, MSG_CMSG_CLOEXEC );
+  } while( n < 0 && errno == EINTR );
+
+  nfds = 0;
+  if( n > 0 )
+  {
+    for( cmsghdr *c = CMSG_FIRSTHDR( &msg ); c != nullptr; c = CMSG_NXTHDR( &msg, c ) )
+    {
+      if( c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS )
+        continue;
+      const size_t count{ ( c->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int ) };
+      for( size_t i=0; i<count; i++ )
+      {
+        int fd;
+        std::memcpy( &fd, CMSG_DATA( c ) + i * sizeof( int ), sizeof( fd ) );
+        if( nfds < 2 )
+          fds[nfds] = fd;
+        else
+          ::close( fd );
+        nfds++;
+      }
+    }
+    if( msg.msg_flags & MSG_CTRUNC )
+      nfds = 3;   // more than were sent back
+  }
+
+  size_t got{ n > 0 ? static_cast<size_t>( n ) : 0u };
+  while( n > 0 && got < len )
+  {
+    n = ::recv( sock, static_cast<char *>( buf ) + got, len - got, 0 );
+    if( n < 0 && errno == EINTR ) { n = 1; continue; }
+    if( n > 0 ) got += static_cast<size_t>( n );
+  }
+  if( got == len )
+    return true;
+  for( size_t i=0; i<std::min( nfds, size_t{2} ); i++ ) { ::close( fds[i] ); }
+  return false;
+}
+
+/**
+ * @param sock connected socket
+ * @param buf bytes to send
+ * @param len number of bytes
+ * @return true if all bytes were sent
+ */
+bool sendAll( const int sock, const void *buf, const size_t len )
+{
+  size_t done{0};
+  while( done < len )
+  {
+    const ssize_t n = ::send( sock, static_cast<const char *>( buf ) + done,
+                              len - done, MSG_NOSIGNAL );
+    if( n < 0 && errno == EINTR ) continue;
+    if( n <= 0 ) return false;
+    done += static_cast<size_t>( n );
+  }
+  return true;
+}
+
+}   // END anonymous namespace
+
+
+/******************************************************************************/
+/* class Server methods implementations */
+
+/** @brief Configs and handlers of one worker, reused for every request */
+struct Server::Worker
+{
+  /** @brief Configs derived from the server's config, by format */
+  FormatConfigs configs;
+  /** @brief One handler per format, created on first use */
+  HandlerCache handlers{};
+  /** @brief Source image read from a pipe */
+  std::vector<uint8_t> buffer{};
+
+  /** @brief Derive every config from the server's config */
+  explicit Worker( std::shared_ptr<const ModificationConfig> cfg )
+    : configs(std::move(cfg)) {}
+};
+
+/**
+ * A stale socket file left by a previous server is removed first.
+ *
+ * @param cfg sample rate and custom text of every image
+ * @param path of the socket file
+ * @param workers number of threads, zero for one per CPU
+ * @param detect true to detect the format of each image from its
+ *   signature, false to take every image as the config's format
+ * @throw Miscue Config is nullptr, socket cannot be created or bound
+ */
+Server::Server( std::shared_ptr<const ModificationConfig> cfg,
+                const std::string &path, const unsigned workers,
+                const bool detect )
+  : _config(std::move(cfg)), _path(path), _detect(detect),
+    _workers( workers ? workers
+                      : std::max( 1u, std::thread::hardware_concurrency() ) )
+{
+  if( !_config )
+    throw Miscue( MiscueCode::InvalidParameter,
+                  "Modification config is null" );
+  sockaddr_un addr;
+  socketAddress( _path, addr );
+
+  struct stat st;
+  if( ::lstat( _path.c_str(), &st ) == 0 && S_ISSOCK( st.st_mode ) )
+    ::unlink( _path.c_str() );
+
+  _listenFd = ::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+  if( _listenFd < 0 ||
+      ::bind( _listenFd, reinterpret_cast<const sockaddr *>( &addr ),
+              sizeof( addr ) ) != 0 ||
+      ::listen( _listenFd, SOMAXCONN ) != 0 )
+  {
+    const std::string err{ std::strerror( errno ) };
+    if( _listenFd >= 0 ) ::close( _listenFd );
+    throw Miscue( MiscueCode::Io,
+                  "CANNOT listen on socket '" + _path + "': " + err );
+  }
+
+  _connections.reset( new std::atomic<int>[_workers] );
+  for( unsigned i=0; i<_workers; i++ ) { _connections[i].store( -1 ); }
+}
+
+/** The socket file is removed. */
+Server::~Server()
+{
+  stop();
+  for( std::thread &t : _threads ) { t.join(); }
+  ::close( _listenFd );
+  ::unlink( _path.c_str() );
+}
+
+/**
+ * Start the workers and wait for them; returns after stop().
+ */
+void Server::run()
+{
+  for( unsigned i=0; i<_workers; i++ ) {
+    _threads.emplace_back( &Server::work, this, i );
+  }
+  for( std::thread &t : _threads ) { t.join(); }
+  _threads.clear();
+}
+
+/**
+ * Shut down the listening socket and every open connection; the workers
+ * finish the request in progress.  Only atomics and shutdown(2) are used,
+ * so this may be called from a signal handler.
+ */
+void Server::stop() noexcept
+{
+  _stopping.store( true );
+  ::shutdown( _listenFd, SHUT_RDWR );
+  for( unsigned i=0; i<_workers; i++ )
+  {
+    const int fd{ _connections[i].load() };
+    if( fd >= 0 )
+      ::shutdown( fd, SHUT_RDWR );
+  }
+}
+
+/**
+ * @param index of the worker
+ */
+void Server::work( const unsigned index )
+{
+  Worker worker( _config );
+  while( !_stopping.load() )
+  {
+    const int conn{ ::accept4( _listenFd, nullptr, nullptr, SOCK_CLOEXEC ) };
+    if( conn < 0 )
+    {
+      if( errno == EINTR || errno == ECONNABORTED ) continue;
+      break;   // shut down by stop()
+    }
+    _connections[index].store( conn );
+    if( !_stopping.load() )
+      serve( worker, conn );
+    _connections[index].store( -1 );
+    ::close( conn );
+  }
+}
+
+/**
+ * A malformed request is answered with InvalidParameter; the connection is
+ * closed only when the client closes it or a reply cannot be sent.
+ *
+ * @param worker configs and handlers of this thread
+ * @param conn connected client
+ */
+void Server::serve( Worker &worker, const int conn )
+{
+  while( !_stopping.load() )
+  {
+    Request req;
+    int fds[2]{ -1, -1 };
+    size_t nfds{0};
+    if( !receive( conn, &req, sizeof( req ), fds, nfds ) )
+      return;
+
+    Reply rep;
+    if( req.magic != MAGIC || req.version != VERSION || nfds != 2 )
+      rep.code = static_cast<int32_t>( MiscueCode::InvalidParameter );
+    else
+      rep = modify( worker, fds[0], fds[1] );
+    for( size_t i=0; i<std::min( nfds, size_t{2} ); i++ ) { ::close( fds[i] ); }
+
+    if( !sendAll( conn, &rep, sizeof( rep ) ) )
+      return;
+  }
+}
+
+/**
+ * The source is read in place when it is a regular file; the handler of
+ * its format is created on first use and reused.  Failures are returned
+ * in the reply, never thrown.
+ *
+ * @param worker configs and handlers of this thread
+ * @param src source image descriptor
+ * @param dst destination image descriptor
+ * @return code, destination size, and failure offset
+ */
+Server::Reply Server::modify( Worker &worker, const int src, const int dst )
+{
+  Reply rep;
+  auto fail = [&rep]( const MiscueCode code ) {
+    rep.code = static_cast<int32_t>( code );
+    return rep;
+  };
+
+  struct stat srcStat, dstStat;
+  if( ::fstat( src, &srcStat ) != 0 || ::fstat( dst, &dstStat ) != 0 )
+    return fail( MiscueCode::Io );
+
+  // The mapping is released, and the read-buffer cleared, on return.
+  MappedSource source;
+  const uint8_t *data{nullptr};
+  size_t size{0};
+  if( S_ISREG( srcStat.st_mode ) )
+  {
+    size = static_cast<size_t>( srcStat.st_size );
+    if( size == 0 )
+      return fail( MiscueCode::Truncated );
+    if( !source.map( src, size ) )
+      return fail( MiscueCode::Io );
+    data = source.data();
+  }
+  else
+  {
+    const size_t block{ 1u << 16 };
+    size_t got{0};
+    worker.buffer.clear();
+    try
+    {
+      do
+      {
+        const size_t had{ worker.buffer.size() };
+        worker.buffer.resize( had + block );
+        got = NFIMM::readDescriptor( src, worker.buffer.data() + had, block );
+        worker.buffer.resize( had + got );
+      } while( got == block );
+    }
+    catch( const Miscue &e )
+    {
+      return fail( e.code() );
+    }
+    data = worker.buffer.data();
+    size = worker.buffer.size();
+  }
+
+  const std::string &format{ _detect ? HandlerRegistry::instance().detect( data, size )
+                                     : _config->compression };
+  if( format.empty() )
+    return fail( MiscueCode::InvalidSignature );
+
+  NFIMM *handler{nullptr};
+  try
+  {
+    handler = &worker.handlers.get( format, worker.configs );
+  }
+  catch( const Miscue &e )
+  {
+    return fail( e.code() );
+  }
+
+  handler->readImageFileIntoBuffer( data, size );
+  DescriptorSink sink( dst, S_ISREG( dstStat.st_mode ) );
+  const Status st{ handler->tryModify( sink ) };
+  rep.code = static_cast<int32_t>( st.code );
+  rep.offset = st.offset;
+  rep.size = sink.written();
+  return rep;
+}
+
+
+/******************************************************************************/
+/* class ServeClient methods implementations */
+
+/**
+ * @param path of the server's socket
+ * @throw Miscue Cannot connect
+ */
+ServeClient::ServeClient( const std::string &path )
+{
+  sockaddr_un addr;
+  socketAddress( path, addr );
+  _fd = ::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+  if( _fd < 0 ||
+      ::connect( _fd, reinterpret_cast<const sockaddr *>( &addr ),
+                 sizeof( addr ) ) != 0 )
+  {
+    const std::string err{ std::strerror( errno ) };
+    if( _fd >= 0 ) ::close( _fd );
+    throw Miscue( MiscueCode::Io,
+                  "CANNOT connect to socket '" + path + "': " + err );
+  }
+}
+
+/** The server closes its side when it reads end of connection. */
+ServeClient::~ServeClient()
+{
+  if( _fd >= 0 ) ::close( _fd );
+}
+
+/**
+ * The descriptors stay open in the client; the server closes its copies.
+ * A regular destination is truncated to the destination size.
+ *
+ * @param src source image: file, memfd, or pipe
+ * @param dst destination image: file, memfd, or pipe
+ * @return reply of the server
+ * @throw Miscue Request cannot be sent, connection closed
+ */
+Server::Reply ServeClient::modify( const int src, const int dst )
+{
+  Server::Request req;
+  iovec iov{ &req, sizeof( req ) };
+  alignas( cmsghdr ) char ctrl[CMSG_SPACE( 2 * sizeof( int ) )]{};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof( ctrl );
+  cmsghdr *c{ CMSG_FIRSTHDR( &msg ) };
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN( 2 * sizeof( int ) );
+  const int fds[2]{ src, dst };
+  std::memcpy( CMSG_DATA( c ), fds, sizeof( fds ) );
+
+  ssize_t n;
+  do {
+    n = ::sendmsg( _fd, &msg, MSG_NOSIGNAL );
+  } while( n < 0 && errno == EINTR );
+  if( n != static_cast<ssize_t>( sizeof( req ) ) )
+    throw Miscue( MiscueCode::Io, "CANNOT send request to server: " +
+                  std::string{ n < 0 ? std::strerror( errno ) : "short write" } );
+
+  Server::Reply rep;
+  size_t got{0};
+  while( got < sizeof( rep ) )
+  {
+    n = ::recv( _fd, reinterpret_cast<char *>( &rep ) + got, sizeof( rep ) - got, 0 );
+    if( n < 0 && errno == EINTR ) continue;
+    if( n <= 0 )
+      throw Miscue( MiscueCode::Io, "Server closed the connection" );
+    got += static_cast<size_t>( n );
+  }
+  return rep;
+}
+
+}   // END namespace
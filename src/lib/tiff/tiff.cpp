@@ -0,0 +1,625 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "tiff/tiff.h"
+
+#include <algorithm>
+#include <map>
+
+
+namespace NFIMM {
+
+/** 
+ * Initialize the read-buffer cursor and clear the write-buffer.
+*/
+TIFF::TIFF( std::shared_ptr<MetadataParameters> &mps ) : NFIMM(mps)
+{
+  s_r_cursor = 0;
+  s_writeBuffer.clear();
+}
+
+/** 
+ * Initialize the read-buffer cursor and clear the write-buffer.
+*/
+TIFF::TIFF( std::shared_ptr<const ModificationConfig> cfg )
+    : NFIMM(std::move(cfg))
+{
+  s_r_cursor = 0;
+  s_writeBuffer.clear();
+}
+
+/**
+ * Read every IFD of the chain, then for each page either patch the tag
+ * values in place or move its IFD to the end of the destination image.
+ * The destination image is:
+ *   1. the source image with the patched values and IFD offsets
+ *   2. the moved IFDs, if any, in page order
+ *
+ * @param pln OUT : destination image size and edits
+ * @throw Miscue Invalid header or IFD, classic TIFF would exceed 4 GB
+ */
+void TIFF::planImage( ModificationPlan &pln )
+{
+  _result.loggit( "Initialize for TIFF modification" );
+  const uint8_t *buf{ s_readData };
+  const size_t size{ s_readSize };
+
+  Format fmt;
+  uint64_t first{0};
+  Status st{ readHeader( buf, size, fmt, first ) };
+  if( !st )
+    throw Miscue( st );
+  if( _result.logging )
+    _result.loggit( std::string{"TIFF byte order: "} +
+                    ( fmt.bigEndian ? "MM" : "II" ) +
+                    ( fmt.bigTiff ? ", BigTIFF" : ", classic" ) );
+
+  std::vector<Ifd> ifds;
+  for( uint64_t at{ first }; at != 0; at = ifds.back().next )
+  {
+    if( ifds.size() > size / ( fmt.countSize() + fmt.offsetSize() ) )
+      throw Miscue( MiscueCode::InvalidHeader, "ERROR: TIFF IFD chain loops" );
+    Ifd ifd;
+    st = readIfd( buf, size, fmt, at, ifd );
+    if( !st )
+      throw Miscue( st );
+    ifds.push_back( ifd );
+  }
+  if( _result.logging )
+    _result.loggit( "TIFF pages: " + std::to_string( ifds.size() ) );
+
+  // Source image metadata from the first page.
+  {
+    const Ifd &ifd{ ifds.front() };
+    _result.srcImg.width    = ifd.width;
+    _result.srcImg.height   = ifd.height;
+    _result.srcImg.bitDepth = ifd.bitDepth;
+    auto rational = [&]( const Entry &e ) -> uint32_t {
+      if( !e.found || e.type != TYPE_RATIONAL || e.count != 1 )
+        return 0;
+      const size_t at{ fmt.bigTiff ? e.valueAt : static_cast<size_t>( e.value ) };
+      const uint32_t num{ get32( buf + at, fmt.bigEndian ) };
+      const uint32_t den{ get32( buf + at + 4, fmt.bigEndian ) };
+      return den == 0 ? 0 : ( num + den / 2 ) / den;
+    };
+    const uint32_t horiz{ rational( ifd.xRes ) }, vert{ rational( ifd.yRes ) };
+    if( horiz != 0 && vert != 0 )
+    {
+      _result.srcImg.resolutionExists = true;
+      _result.srcImg.resolution.horiz = horiz;
+      _result.srcImg.resolution.vert  = vert;
+      _result.srcImg.resolution.units = 2;
+      if( ifd.unit.found && ifd.unit.type == TYPE_SHORT )
+        _result.srcImg.resolution.units =
+          static_cast<uint8_t>( get16( buf + ifd.unit.valueAt, fmt.bigEndian ) );
+    }
+    if( _result.logging )
+      _result.loggit( "READ page 0 width: " + std::to_string( ifd.width ) +
+        ", height: " + std::to_string( ifd.height ) +
+        ", bits per sample: " + std::to_string( ifd.bitDepth ) +
+        ", XResolution: " + std::to_string( horiz ) +
+        ", YResolution: " + std::to_string( vert ) );
+  }
+
+  // IFD byte ranges, sorted, for the overlap check of the patches.
+  std::vector<std::pair<size_t, size_t>> regions;
+  for( const Ifd &ifd : ifds ) {
+    regions.emplace_back( ifd.offset, ifd.end( fmt ) );
+  }
+  std::sort( regions.begin(), regions.end() );
+  auto inIfd = [&regions]( const size_t from, const size_t to ) {
+    auto it = std::upper_bound( regions.begin(), regions.end(),
+                                std::make_pair( from, ~size_t{0} ) );
+    if( it != regions.begin() && std::prev( it )->second > from )
+      return true;
+    return it != regions.end() && it->first < to;
+  };
+
+  // Accepted patches by offset; identical patches shared by pages are one.
+  std::map<size_t, Patch> patches;
+  auto conflicts = [&patches]( const Patch &p ) {
+    const size_t to{ p.offset + p.bytes.size() };
+    auto it = patches.lower_bound( p.offset );
+    if( it != patches.end() && it->first == p.offset )
+      return it->second.bytes != p.bytes;
+    if( it != patches.end() && it->first < to )
+      return true;
+    if( it != patches.begin() ) {
+      const Patch &q{ std::prev( it )->second };
+      return q.offset + q.bytes.size() > p.offset;
+    }
+    return false;
+  };
+
+  std::vector<size_t> newOffset( ifds.size() );
+  std::vector<bool> moved( ifds.size(), false );
+  size_t appendAt{ size + ( size & 1u ) };   // IFDs begin on a word boundary
+  for( size_t i=0; i<ifds.size(); i++ )
+  {
+    const Ifd &ifd{ ifds[i] };
+    std::vector<Patch> candidates{ inPlacePatches( fmt, ifd ) };
+    bool inPlace{ !candidates.empty() };
+    for( const Patch &p : candidates )
+    {
+      const size_t to{ p.offset + p.bytes.size() };
+      const bool withinIfd{ p.offset >= ifd.offset && to <= ifd.end( fmt ) };
+      if( ( !withinIfd && inIfd( p.offset, to ) ) || conflicts( p ) )
+        inPlace = false;
+    }
+
+    if( inPlace )
+    {
+      for( Patch &p : candidates ) {
+        const size_t at{ p.offset };
+        patches.emplace( at, std::move( p ) );
+      }
+      newOffset[i] = ifd.offset;
+      if( _result.logging )
+        _result.loggit( "Page " + std::to_string( i ) +
+                        ": resolution patched in place" );
+    }
+    else
+    {
+      moved[i] = true;
+      newOffset[i] = appendAt;
+      const size_t countEntries{ static_cast<size_t>(
+        ifd.countEntries - ifd.countResolutionEntries ) + 3u };
+      appendAt += fmt.countSize() + countEntries * fmt.entrySize()
+                + fmt.offsetSize() + ( fmt.bigTiff ? 0u : 16u );
+      if( _result.logging )
+        _result.loggit( "Page " + std::to_string( i ) + ": IFD moved to " +
+                        std::to_string( newOffset[i] ) );
+    }
+  }
+  if( !fmt.bigTiff && appendAt > 0xFFFFFFFFu )
+  {
+    std::string err{"ERROR: TIFF IFDs moved past 4 GB, BigTIFF is required: "};
+    err.append( std::to_string( appendAt ) );
+    _result.loggit( err );
+    throw Miscue( MiscueCode::Unsupported, err );
+  }
+
+  // Offsets that point to a moved IFD, in the header or the previous IFD,
+  // unless that IFD is itself moved.
+  for( size_t i=0; i<ifds.size(); i++ )
+  {
+    if( !moved[i] || ( i > 0 && moved[i-1] ) )
+      continue;
+    Patch p;
+    p.offset = i == 0 ? fmt.headerSize() - fmt.offsetSize() : ifds[i-1].nextAt;
+    p.bytes.resize( fmt.offsetSize() );
+    putN( p.bytes.data(), newOffset[i], fmt.offsetSize(), fmt.bigEndian );
+    p.element = "IFD offset";
+    patches.emplace( p.offset, std::move( p ) );
+  }
+
+  size_t cursor{0};
+  for( const auto &entry : patches )
+  {
+    const Patch &p{ entry.second };
+    pln.keep( "TIFF data", cursor, p.offset - cursor );
+    pln.update( p.element, p.bytes.data(), p.bytes.size() );
+    cursor = p.offset + p.bytes.size();
+  }
+  pln.keep( "TIFF data", cursor, size - cursor );
+
+  if( std::find( moved.begin(), moved.end(), true ) != moved.end() )
+  {
+    if( size & 1u )
+    {
+      const uint8_t pad{0};
+      pln.insert( "Padding", &pad, 1 );
+    }
+    for( size_t i=0; i<ifds.size(); i++ )
+    {
+      if( !moved[i] )
+        continue;
+      const uint64_t next{ i + 1 < ifds.size() ? newOffset[i+1] : 0u };
+      const std::vector<uint8_t> ifd{ rewriteIfd( fmt, ifds[i], newOffset[i], next ) };
+      pln.insert( "IFD " + std::to_string( i ), ifd.data(), ifd.size() );
+    }
+  }
+}   // END planImage()
+
+/**
+ * The values are patched in place when all three tags are present with the
+ * standard type and count, and the two RATIONAL values do not overlap.
+ *
+ * @param fmt byte order and field sizes
+ * @param ifd page
+ * @return one patch per tag, empty if the IFD must be moved
+ */
+std::vector<TIFF::Patch>
+TIFF::inPlacePatches( const Format &fmt, const Ifd &ifd ) const
+{
+  const Entry &x{ ifd.xRes }, &y{ ifd.yRes }, &u{ ifd.unit };
+  if( !x.found || !y.found || !u.found ||
+      x.type != TYPE_RATIONAL || x.count != 1 ||
+      y.type != TYPE_RATIONAL || y.count != 1 ||
+      u.type != TYPE_SHORT || u.count != 1 )
+    return {};
+
+  const size_t xAt{ fmt.bigTiff ? x.valueAt : static_cast<size_t>( x.value ) };
+  const size_t yAt{ fmt.bigTiff ? y.valueAt : static_cast<size_t>( y.value ) };
+  if( xAt < yAt + 8u && yAt < xAt + 8u )
+    return {};
+
+  uint32_t den{0};
+  const uint16_t unit{ unitTag( den ) };
+  std::vector<Patch> patches( 3 );
+  const std::pair<size_t, uint32_t> rationals[2]{
+    { xAt, _config->destResolution.horiz },
+    { yAt, _config->destResolution.vert } };
+  for( int i=0; i<2; i++ )
+  {
+    Patch &p{ patches[i] };
+    p.offset = rationals[i].first;
+    p.bytes.resize( 8 );
+    putN( p.bytes.data(), rationals[i].second, 4, fmt.bigEndian );
+    putN( p.bytes.data() + 4, den, 4, fmt.bigEndian );
+    p.element = i == 0 ? "XResolution" : "YResolution";
+  }
+  Patch &p{ patches[2] };
+  p.offset = u.valueAt;
+  p.bytes.resize( 2 );
+  putN( p.bytes.data(), unit, 2, fmt.bigEndian );
+  p.element = "ResolutionUnit";
+  return patches;
+}
+
+/**
+ * The new IFD holds every source entry except the resolution tags, then the
+ * three resolution tags, sorted by tag.  For classic TIFF, the two RATIONAL
+ * values follow the IFD; for BigTIFF they are in the value fields.
+ *
+ * @param fmt byte order and field sizes
+ * @param ifd page
+ * @param at offset of the new IFD in the destination image
+ * @param next offset of the next IFD in the destination image, or 0
+ * @return the new IFD
+ */
+std::vector<uint8_t> TIFF::rewriteIfd( const Format &fmt, const Ifd &ifd,
+                                       const size_t at,
+                                       const uint64_t next ) const
+{
+  const bool big{ fmt.bigEndian };
+  const size_t entrySize{ fmt.entrySize() };
+  const size_t valueOffset{ 4u + fmt.offsetSize() };   // tag, type, count
+
+  std::vector<std::vector<uint8_t>> entries;
+  const uint8_t *src{ s_readData + ifd.offset + fmt.countSize() };
+  for( uint64_t i=0; i<ifd.countEntries; i++ )
+  {
+    const uint8_t *e{ src + i * entrySize };
+    const uint16_t tag{ get16( e, big ) };
+    if( tag == TAG_X_RESOLUTION || tag == TAG_Y_RESOLUTION ||
+        tag == TAG_RESOLUTION_UNIT )
+      continue;
+    entries.emplace_back( e, e + entrySize );
+  }
+
+  const size_t countEntries{ entries.size() + 3u };
+  const size_t rationalsAt{ at + fmt.countSize() + countEntries * entrySize
+                            + fmt.offsetSize() };
+  uint32_t den{0};
+  const uint16_t unit{ unitTag( den ) };
+  auto newEntry = [&]( const uint16_t tag, const uint16_t type ) {
+    std::vector<uint8_t> e( entrySize, 0 );
+    putN( e.data(), tag, 2, big );
+    putN( e.data() + 2, type, 2, big );
+    putN( e.data() + 4, 1, fmt.offsetSize(), big );
+    return e;
+  };
+  const uint32_t rates[2]{ _config->destResolution.horiz,
+                           _config->destResolution.vert };
+  const uint16_t tags[2]{ TAG_X_RESOLUTION, TAG_Y_RESOLUTION };
+  for( int i=0; i<2; i++ )
+  {
+    std::vector<uint8_t> e{ newEntry( tags[i], TYPE_RATIONAL ) };
+    if( fmt.bigTiff )
+    {
+      putN( e.data() + valueOffset, rates[i], 4, big );
+      putN( e.data() + valueOffset + 4, den, 4, big );
+    }
+    else
+    {
+      putN( e.data() + valueOffset, rationalsAt + 8u * i, 4, big );
+    }
+    entries.push_back( e );
+  }
+  {
+    std::vector<uint8_t> e{ newEntry( TAG_RESOLUTION_UNIT, TYPE_SHORT ) };
+    putN( e.data() + valueOffset, unit, 2, big );
+    entries.push_back( e );
+  }
+  std::stable_sort( entries.begin(), entries.end(),
+    [big]( const std::vector<uint8_t> &a, const std::vector<uint8_t> &b ) {
+      return get16( a.data(), big ) < get16( b.data(), big ); } );
+
+  std::vector<uint8_t> out( fmt.countSize() );
+  putN( out.data(), countEntries, fmt.countSize(), big );
+  for( const auto &e : entries ) {
+    out.insert( out.end(), e.begin(), e.end() );
+  }
+  out.resize( out.size() + fmt.offsetSize() );
+  putN( out.data() + out.size() - fmt.offsetSize(), next, fmt.offsetSize(), big );
+  if( !fmt.bigTiff )
+  {
+    for( int i=0; i<2; i++ )
+    {
+      out.resize( out.size() + 8u );
+      putN( out.data() + out.size() - 8u, rates[i], 4, big );
+      putN( out.data() + out.size() - 4u, den, 4, big );
+    }
+  }
+  return out;
+}
+
+/**
+ * @param buf source image
+ * @param size number of bytes in source image
+ * @param fmt OUT : byte order and field sizes
+ * @param first OUT : offset of the first IFD
+ * @return failure and its offset, or Ok
+ */
+Status TIFF::readHeader( const uint8_t *buf, const size_t size, Format &fmt,
+                         uint64_t &first ) noexcept
+{
+  fmt = Format{};
+  first = 0;
+  if( size < 8u )
+    return Status{ MiscueCode::Truncated, 0 };
+  if( buf[0] == 'M' && buf[1] == 'M' )
+    fmt.bigEndian = true;
+  else if( !( buf[0] == 'I' && buf[1] == 'I' ) )
+    return Status{ MiscueCode::InvalidSignature, 0 };
+
+  const uint16_t version{ get16( buf + 2, fmt.bigEndian ) };
+  if( version == 42 )
+  {
+    first = get32( buf + 4, fmt.bigEndian );
+  }
+  else if( version == 43 )
+  {
+    fmt.bigTiff = true;
+    if( size < 16u )
+      return Status{ MiscueCode::Truncated, 0 };
+    if( get16( buf + 4, fmt.bigEndian ) != 8 || get16( buf + 6, fmt.bigEndian ) != 0 )
+      return Status{ MiscueCode::InvalidHeader, 4 };
+    first = get64( buf + 8, fmt.bigEndian );
+  }
+  else
+  {
+    return Status{ MiscueCode::InvalidSignature, 2 };
+  }
+  if( first == 0 )
+    return Status{ MiscueCode::InvalidHeader, fmt.headerSize() - fmt.offsetSize() };
+  return Status{};
+}
+
+/**
+ * Only the first entry of each resolution tag is recorded.  A classic TIFF
+ * RATIONAL value must lie within the source image.
+ *
+ * @param buf source image
+ * @param size number of bytes in source image
+ * @param fmt byte order and field sizes
+ * @param offset of the IFD
+ * @param ifd OUT : page
+ * @return failure and its offset, or Ok
+ */
+Status TIFF::readIfd( const uint8_t *buf, const size_t size, const Format &fmt,
+                      const uint64_t offset, Ifd &ifd ) noexcept
+{
+  ifd = Ifd{};
+  if( offset < fmt.headerSize() )
+    return Status{ MiscueCode::InvalidHeader, 0 };
+  if( offset > size || size - offset < fmt.countSize() + fmt.offsetSize() )
+    return Status{ MiscueCode::Truncated, size };
+
+  const bool big{ fmt.bigEndian };
+  ifd.offset = static_cast<size_t>( offset );
+  ifd.countEntries = fmt.bigTiff ? get64( buf + ifd.offset, big )
+                                 : get16( buf + ifd.offset, big );
+  if( ifd.countEntries >
+      ( size - ifd.offset - fmt.countSize() - fmt.offsetSize() ) / fmt.entrySize() )
+    return Status{ MiscueCode::Truncated, ifd.offset };
+  ifd.nextAt = ifd.offset + fmt.countSize() +
+               static_cast<size_t>( ifd.countEntries ) * fmt.entrySize();
+  ifd.next = fmt.bigTiff ? get64( buf + ifd.nextAt, big )
+                         : get32( buf + ifd.nextAt, big );
+
+  for( uint64_t i=0; i<ifd.countEntries; i++ )
+  {
+    const size_t at{ ifd.offset + fmt.countSize() +
+                     static_cast<size_t>( i ) * fmt.entrySize() };
+    const uint16_t tag{ get16( buf + at, big ) };
+    const uint16_t type{ get16( buf + at + 2, big ) };
+    const uint64_t count{ fmt.bigTiff ? get64( buf + at + 4, big )
+                                      : get32( buf + at + 4, big ) };
+    const size_t valueAt{ at + 4u + fmt.offsetSize() };
+    const uint64_t value{ fmt.bigTiff ? get64( buf + valueAt, big )
+                                      : get32( buf + valueAt, big ) };
+
+    if( ( tag == TAG_IMAGE_WIDTH || tag == TAG_IMAGE_LENGTH ) && count == 1 )
+    {
+      uint32_t dim{0};
+      if( type == TYPE_SHORT )      dim = get16( buf + valueAt, big );
+      else if( type == TYPE_LONG )  dim = get32( buf + valueAt, big );
+      else if( type == TYPE_LONG8 ) dim = static_cast<uint32_t>( value );
+      ( tag == TAG_IMAGE_WIDTH ? ifd.width : ifd.height ) = dim;
+    }
+    else if( tag == TAG_BITS_PER_SAMPLE && type == TYPE_SHORT && count >= 1 )
+    {
+      if( count * 2u <= fmt.offsetSize() )
+        ifd.bitDepth = get16( buf + valueAt, big );
+      else if( value <= size - 2u )
+        ifd.bitDepth = get16( buf + value, big );
+    }
+
+    Entry *entry{nullptr};
+    if( tag == TAG_X_RESOLUTION )         entry = &ifd.xRes;
+    else if( tag == TAG_Y_RESOLUTION )    entry = &ifd.yRes;
+    else if( tag == TAG_RESOLUTION_UNIT ) entry = &ifd.unit;
+    if( entry == nullptr )
+      continue;
+    ifd.countResolutionEntries++;
+    if( entry->found )
+      continue;
+
+    entry->found   = true;
+    entry->type    = type;
+    entry->count   = count;
+    entry->valueAt = valueAt;
+    entry->value   = value;
+    if( !fmt.bigTiff && type == TYPE_RATIONAL && count == 1 &&
+        ( value < fmt.headerSize() || value > size - 8u ) )
+      return Status{ MiscueCode::InvalidHeader, at };
+  }
+  return Status{};
+}
+
+/**
+ * Checks the same conditions as planImage(), reading the IFDs in place:
+ * - byte order, version, first IFD offset
+ * - each IFD of the chain, and the RATIONAL resolution values, within the
+ *   source image
+ * - the chain does not loop (tortoise and hare, no allocation)
+ *
+ * @return Ok, or the first failure and its offset
+ */
+Status TIFF::validateImage() const noexcept
+{
+  Format fmt;
+  uint64_t first{0};
+  Status st{ readHeader( s_readData, s_readSize, fmt, first ) };
+  if( !st )
+    return st;
+
+  Ifd ifd;
+  uint64_t slow{ first }, fast{ first };
+  while( true )
+  {
+    for( int i=0; i<2; i++ )
+    {
+      st = readIfd( s_readData, s_readSize, fmt, fast, ifd );
+      if( !st )
+        return st;
+      fast = ifd.next;
+      if( fast == 0 )
+        return Status{};
+    }
+    readIfd( s_readData, s_readSize, fmt, slow, ifd );
+    slow = ifd.next;
+    if( slow == fast )
+      return Status{ MiscueCode::InvalidHeader, static_cast<size_t>( fast ) };
+  }
+}
+
+/**
+ * For "meter" the sample rate is pixels per meter, written as the exact
+ * rational N/100 pixels per centimeter.
+ *
+ * @param den OUT : denominator of the resolution rationals
+ * @return ResolutionUnit: 1 none, 2 inch, 3 centimeter
+ */
+uint16_t TIFF::unitTag( uint32_t &den ) const
+{
+  den = 1;
+  if( _config->destResolution.unitsStr == "inch" )
+    return 2;
+  if( _config->destResolution.unitsStr == "meter" )
+  {
+    den = 100;
+    return 3;
+  }
+  return 1;
+}
+
+/**
+ * @param p first byte
+ * @param bigEndian true if `MM`
+ * @return value
+ */
+uint16_t TIFF::get16( const uint8_t *p, const bool bigEndian )
+{
+  return static_cast<uint16_t>( bigEndian ? ( p[0] << 8 ) | p[1]
+                                          : ( p[1] << 8 ) | p[0] );
+}
+
+/**
+ * @param p first byte
+ * @param bigEndian true if `MM`
+ * @return value
+ */
+uint32_t TIFF::get32( const uint8_t *p, const bool bigEndian )
+{
+  uint32_t val{0};
+  for( int i=0; i<4; i++ ) {
+    val = ( val << 8 ) | p[ bigEndian ? i : 3 - i ];
+  }
+  return val;
+}
+
+/**
+ * @param p first byte
+ * @param bigEndian true if `MM`
+ * @return value
+ */
+uint64_t TIFF::get64( const uint8_t *p, const bool bigEndian )
+{
+  uint64_t val{0};
+  for( int i=0; i<8; i++ ) {
+    val = ( val << 8 ) | p[ bigEndian ? i : 7 - i ];
+  }
+  return val;
+}
+
+/**
+ * @param p OUT : first byte
+ * @param val value, the low LEN bytes are written
+ * @param len number of bytes
+ * @param bigEndian true if `MM`
+ */
+void TIFF::putN( uint8_t *p, const uint64_t val, const size_t len,
+                 const bool bigEndian )
+{
+  for( size_t i=0; i<len; i++ ) {
+    p[ bigEndian ? len - 1 - i : i ] = static_cast<uint8_t>( val >> ( 8 * i ) );
+  }
+}
+
+/** @return current Metadata Parameters */
+std::string TIFF::to_s()
+{
+  std::string s{"TIFF: "};
+  s.append( _config->to_s() );
+  return s;
+}
+
+}   // END namespace
@@ -0,0 +1,360 @@
+/*******************************************************************************
+License:
+This software was developed at the National Institute of Standards and
+Technology (NIST) by employees of the Federal Government in the course
+of their official duties. Pursuant to title 17 Section 105 of the
+United States Code, this software is not subject to copyright protection
+and is in the public domain. NIST assumes no responsibility  whatsoever for
+its use by other parties, and makes no guarantees, expressed or implied,
+about its quality, reliability, or any other characteristic.
+
+This software has been determined to be outside the scope of the EAR
+(see Part 734.3 of the EAR for exact details) as it has been created solely
+by employees of the U.S. Government; it is freely distributed with no
+licensing requirements; and it is considered public domain. Therefore,
+it is permissible to distribute this software as a free download from the
+internet.
+
+Disclaimer:
+This software was developed to promote biometric standards and biometric
+technology testing for the Federal Government in accordance with the USA
+PATRIOT Act and the Enhanced Border Security and Visa Entry Reform Act.
+Specific hardware and software products identified in this software were used
+in order to perform the software development.  In no case does such
+identification imply recommendation or endorsement by the National Institute
+of Standards and Technology, nor does it imply that the products and equipment
+identified are necessarily the best available for the purpose.
+*******************************************************************************/
+
+#include "wsq/wsq.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+
+namespace NFIMM {
+
+/** 
+ * Initialize the read-buffer cursor and clear the write-buffer.
+*/
+WSQ::WSQ( std::shared_ptr<MetadataParameters> &mps ) : NFIMM(mps)
+{
+  s_r_cursor = 0;
+  s_writeBuffer.clear();
+}
+
+/** 
+ * Initialize the read-buffer cursor and clear the write-buffer.
+*/
+WSQ::WSQ( std::shared_ptr<const ModificationConfig> cfg )
+    : NFIMM(std::move(cfg))
+{
+  s_r_cursor = 0;
+  s_writeBuffer.clear();
+}
+
+/**
+ * Parse the marker segments up to the SOF and patch the NISTCOM PPI.  The
+ * order of the destination image is:
+ *   1. SOI, then the NISTCOM comment when the source image has none
+ *   2. all segments before the SOF, the NISTCOM comment rewritten
+ *   3. the SOF and the blocks, unchanged
+ *
+ * @param pln OUT : destination image size and edits
+ * @throw Miscue Invalid marker segment, NISTCOM comment too large
+ */
+void WSQ::planImage( ModificationPlan &pln )
+{
+  _result.loggit( "Initialize for WSQ modification" );
+  const uint8_t *buf{ s_readData };
+
+  Markers markers;
+  const Status st{ scanMarkers( buf, s_readSize, markers ) };
+  if( !st )
+    throw Miscue( st );
+
+  // SOF: black, white, height, width
+  {
+    const size_t at{ markers.sof + NUM_BYTES_MARKER + NUM_BYTES_SEGMENT_LENGTH };
+    _result.srcImg.bitDepth = 8;
+    _result.srcImg.height   = ( buf[at+2] << 8 ) | buf[at+3];
+    _result.srcImg.width    = ( buf[at+4] << 8 ) | buf[at+5];
+    if( _result.logging )
+      _result.loggit( "SOF image width: " + std::to_string( _result.srcImg.width ) +
+        ", height: " + std::to_string( _result.srcImg.height ) );
+  }
+
+  size_t cursor{0};
+  if( markers.nistcom )
+  {
+    keepSegments( pln, cursor, markers.nistcom );
+    planNistcom( pln, markers.nistcom );
+    cursor = markers.nistcom + NUM_BYTES_MARKER
+           + ( ( buf[markers.nistcom+2] << 8 ) | buf[markers.nistcom+3] );
+  }
+  else
+  {
+    const std::string text{ "NIST_COM 8\nPIX_WIDTH " +
+      std::to_string( _result.srcImg.width ) + "\nPIX_HEIGHT " +
+      std::to_string( _result.srcImg.height ) + "\nPIX_DEPTH 8\nPPI " +
+      std::to_string( ppi( *_config ) ) +
+      "\nLOSSY 1\nCOLORSPACE GRAY\nCOMPRESSION WSQ" };
+    const size_t len{ NUM_BYTES_SEGMENT_LENGTH + text.size() };
+    std::vector<uint8_t> com{ 0xFF, MARKER_COM,
+      static_cast<uint8_t>( len >> 8 ), static_cast<uint8_t>( len ) };
+    com.insert( com.end(), text.begin(), text.end() );
+
+    keepSegments( pln, cursor, NUM_BYTES_MARKER );
+    pln.insert( "COM NISTCOM", com.data(), com.size() );
+    if( _result.logging )
+      _result.loggit( "No NISTCOM comment, insert after SOI, PPI: " +
+                      std::to_string( ppi( *_config ) ) );
+  }
+
+  keepSegments( pln, cursor, markers.sof );
+  pln.keep( "SOF and blocks", markers.sof, s_readSize - markers.sof );
+}   // END planImage()
+
+/**
+ * Rewrite the value of the `PPI` attribute.  When there is none, append it
+ * after the last attribute and increment the `NIST_COM` count.  Line ends
+ * and any trailing NUL bytes of the source comment are kept.
+ *
+ * @param pln OUT : destination image edits
+ * @param at offset of the COM marker
+ * @throw Miscue Comment exceeds the 2-byte segment length
+ */
+void WSQ::planNistcom( ModificationPlan &pln, const size_t at )
+{
+  const uint8_t *seg{ s_readData + at };
+  const size_t len = ( seg[2] << 8 ) | seg[3];
+  std::string text( reinterpret_cast<const char *>( seg ) + NUM_BYTES_MARKER +
+                    NUM_BYTES_SEGMENT_LENGTH, len - NUM_BYTES_SEGMENT_LENGTH );
+  const std::string value{ std::to_string( ppi( *_config ) ) };
+
+  // Start of each line; the text before the trailing NUL bytes.
+  size_t textEnd{ text.size() };
+  while( textEnd > 0 && text[textEnd-1] == '\0' ) { textEnd--; }
+  size_t ppiLine{ std::string::npos };
+  for( size_t pos{0}; pos < textEnd; )
+  {
+    if( text.compare( pos, 4, "PPI " ) == 0 || text.compare( pos, 4, "PPI\t" ) == 0 )
+    {
+      ppiLine = pos;
+      break;
+    }
+    const size_t nl{ text.find( '\n', pos ) };
+    pos = ( nl == std::string::npos ) ? textEnd : nl + 1;
+  }
+
+  if( ppiLine != std::string::npos )
+  {
+    const size_t first{ ppiLine + 4 };
+    size_t last{ first };
+    while( last < textEnd && text[last] != '\n' && text[last] != '\r' ) { last++; }
+    const std::string srcValue{ text.substr( first, last - first ) };
+    if( _result.logging )
+      _result.loggit( "READ NISTCOM PPI: " + srcValue );
+    const long srcPpi{ std::strtol( srcValue.c_str(), nullptr, 10 ) };
+    if( srcPpi > 0 )
+    {
+      _result.srcImg.resolutionExists = true;
+      _result.srcImg.resolution.horiz = static_cast<uint32_t>( srcPpi );
+      _result.srcImg.resolution.vert  = static_cast<uint32_t>( srcPpi );
+      _result.srcImg.resolution.units = 1;
+    }
+    text.replace( first, last - first, value );
+  }
+  else
+  {
+    _result.loggit( "READ NISTCOM has no PPI attribute" );
+    const bool lineEnd{ textEnd > 0 && text[textEnd-1] == '\n' };
+    text.insert( textEnd, lineEnd ? "PPI " + value + "\n" : "\nPPI " + value );
+
+    // NIST_COM count on the first line.
+    const size_t first{ 8 };
+    size_t last{ first };
+    while( last < text.size() && ( text[last] == ' ' || text[last] == '\t' ) ) { last++; }
+    const size_t digits{ last };
+    while( last < text.size() && text[last] >= '0' && text[last] <= '9' ) { last++; }
+    if( last > digits )
+    {
+      const long count{ std::strtol( text.c_str() + digits, nullptr, 10 ) };
+      text.replace( digits, last - digits, std::to_string( count + 1 ) );
+    }
+  }
+  if( _result.logging )
+    _result.loggit( "WRITE NISTCOM PPI: " + value );
+
+  const size_t newLen{ NUM_BYTES_SEGMENT_LENGTH + text.size() };
+  if( newLen > 0xFFFF )
+    throw Miscue( MiscueCode::Unsupported,
+                  "WSQ NISTCOM comment exceeds 65535 bytes" );
+  std::vector<uint8_t> com{ 0xFF, MARKER_COM,
+    static_cast<uint8_t>( newLen >> 8 ), static_cast<uint8_t>( newLen ) };
+  com.insert( com.end(), text.begin(), text.end() );
+  pln.update( "COM NISTCOM", com.data(), com.size() );
+}
+
+/**
+ * Plan one keep per marker segment, named by its marker, from CURSOR up to
+ * END.  The segments were checked by scanMarkers().
+ *
+ * @param pln OUT : destination image edits
+ * @param cursor IN/OUT : offset of next marker, == END on return
+ * @param end offset of the next marker that is not kept unchanged
+ */
+void WSQ::keepSegments( ModificationPlan &pln, size_t &cursor,
+                        const size_t end )
+{
+  const uint8_t *buf{ s_readData };
+  while( cursor < end )
+  {
+    const uint8_t code{ buf[cursor+1] };
+    size_t next{ cursor + NUM_BYTES_MARKER };
+    if( code != MARKER_SOI )
+      next += ( buf[next] << 8 ) | buf[next+1];
+    pln.keep( markerName( code ), cursor, next - cursor );
+    cursor = next;
+  }
+  cursor = end;
+}
+
+/**
+ * Walk the marker segments from SOI up to and including the SOF header.
+ * Only table, comment, and restart definition segments may precede the
+ * SOF.  Only the first NISTCOM comment is recorded.
+ *
+ * @param buf source image
+ * @param size number of bytes in source image
+ * @param markers OUT : offsets of the segments of interest
+ * @return failure and its offset, or Ok if the SOF was found
+ */
+Status WSQ::scanMarkers( const uint8_t *buf, const size_t size,
+                         Markers &markers ) noexcept
+{
+  markers = Markers{};
+  if( size < 2u * NUM_BYTES_MARKER )
+    return Status{ MiscueCode::Truncated, 0 };
+  if( buf[0] != 0xFF || buf[1] != MARKER_SOI )
+    return Status{ MiscueCode::InvalidSignature, 0 };
+
+  size_t pos{ NUM_BYTES_MARKER };
+  while( true )
+  {
+    if( size - pos < static_cast<size_t>( NUM_BYTES_MARKER ) )
+      return Status{ MiscueCode::Truncated, pos };
+    const uint8_t code{ buf[pos+1] };
+    if( buf[pos] != 0xFF || code < MARKER_SOF || code > MARKER_COM ||
+        code == MARKER_SOB )
+      return Status{ MiscueCode::InvalidHeader, pos };
+
+    const size_t at{ pos + NUM_BYTES_MARKER };
+    if( size - at < static_cast<size_t>( NUM_BYTES_SEGMENT_LENGTH ) )
+      return Status{ MiscueCode::Truncated, pos };
+    const size_t len = ( buf[at] << 8 ) | buf[at+1];
+    if( len < static_cast<size_t>( NUM_BYTES_SEGMENT_LENGTH ) )
+      return Status{ MiscueCode::InvalidHeader, pos };
+    if( len > size - at )
+      return Status{ MiscueCode::Truncated, pos };
+    const uint8_t *data{ buf + at + NUM_BYTES_SEGMENT_LENGTH };
+
+    if( code == MARKER_COM && !markers.nistcom && len >= 10u &&
+        std::memcmp( data, "NIST_COM", 8 ) == 0 )
+    {
+      markers.nistcom = pos;
+    }
+    else if( code == MARKER_SOF )
+    {
+      if( len < NUM_BYTES_SEGMENT_LENGTH + NUM_BYTES_SOF_READ )
+        return Status{ MiscueCode::InvalidHeader, pos };
+      markers.sof = pos;
+      return Status{};
+    }
+    pos = at + len;
+  }
+}
+
+/**
+ * Checks the same conditions as planImage(), reading the segments in place:
+ * SOI, then marker segments within the source image up to the SOF.
+ *
+ * @return Ok, or the first failure and its offset
+ */
+Status WSQ::validateImage() const noexcept
+{
+  Markers markers;
+  return scanMarkers( s_readData, s_readSize, markers );
+}
+
+/**
+ * The plan needs the marker segments up to and including the SOF; the
+ * blocks are passed through.
+ *
+ * @param buf first bytes of the source image
+ * @param size number of bytes read
+ * @return end of the SOF segment, 0 if it is not yet read, or SIZE when
+ *   the segments are invalid
+ */
+size_t WSQ::streamHeadLength( const uint8_t *buf, const size_t size ) const noexcept
+{
+  Markers markers;
+  const Status st{ scanMarkers( buf, size, markers ) };
+  if( st.code == MiscueCode::Truncated )
+    return 0;
+  if( !st )
+    return size;
+  const size_t at{ markers.sof + NUM_BYTES_MARKER };
+  return at + ( ( buf[at] << 8 ) | buf[at+1] );
+}
+
+/**
+ * @param code second byte of the marker
+ * @return marker name, e.g. `DTT`, `COM`
+ */
+std::string WSQ::markerName( const uint8_t code )
+{
+  switch( code ) {
+    case MARKER_SOI: return "SOI";
+    case MARKER_EOI: return "EOI";
+    case MARKER_SOF: return "SOF";
+    case MARKER_SOB: return "SOB";
+    case MARKER_DTT: return "DTT";
+    case MARKER_DQT: return "DQT";
+    case MARKER_DHT: return "DHT";
+    case MARKER_DRT: return "DRT";
+    case MARKER_COM: return "COM";
+    default: break;
+  }
+  std::stringstream ss;
+  ss << "0xFF" << std::hex << std::uppercase << std::setw(2)
+     << std::setfill('0') << static_cast<int>( code );
+  return ss.str();
+}
+
+/**
+ * For "meter" the sample rate is pixels per meter and is rounded to pixels
+ * per inch.
+ *
+ * @param cfg destination sample rate
+ * @return horizontal pixels per inch
+ */
+uint32_t WSQ::ppi( const ModificationConfig &cfg )
+{
+  const uint32_t horiz{ cfg.destResolution.horiz };
+  if( cfg.destResolution.unitsStr == "meter" )
+    return static_cast<uint32_t>( ( uint64_t{ horiz } * 254 + 5000 ) / 10000 );
+  return horiz;
+}
+
+/** @return current Metadata Parameters */
+std::string WSQ::to_s()
+{
+  std::string s{"WSQ: "};
+  s.append( _config->to_s() );
+  return s;
+}
+
+}   // END namespace